@@ -0,0 +1,227 @@
+#include "LegacyAllocator.h"
+
+#include <assert.h>
+#include <stdexcept>
+
+std::vector<LegacyMemoryBlock> LegacyAllocator::sBlocks;
+const uint64_t LegacyAllocator::sDefaultBlockSize = 16777216; // 16 MB Blocks
+
+uint64_t LegacyAllocator::sNumAllocations = 0;
+uint64_t LegacyAllocator::sNumAllocatedBytes = 0;
+
+static int64_t sNumChunksAllocated = 0;
+
+LegacyMemoryChunk* LegacyMemoryBlock::AllocateChunk(uint64_t size)
+{
+	LegacyMemoryChunk* chunk = nullptr;
+
+	for (int32_t j = 0; j < mChunks.size(); ++j)
+	{
+		if (mChunks[j].mFree &&
+			mChunks[j].mSize >= size)
+		{
+			// We found a chunk that is big enough, now let's split the chunk into two.
+			uint64_t extraSize = mChunks[j].mSize - size;
+
+			if (extraSize > 0)
+			{
+				mChunks[j].mSize = size;
+
+				LegacyMemoryChunk extraChunk;
+				extraChunk.mFree = true;
+				extraChunk.mOffset = mChunks[j].mOffset + mChunks[j].mSize;
+				extraChunk.mSize = extraSize;
+				extraChunk.mID = -1;
+
+				mChunks.insert(mChunks.begin() + j + 1, extraChunk);
+			}
+
+			mChunks[j].mFree = false;
+			mChunks[j].mID = sNumChunksAllocated++;
+
+			assert(mChunks[j].mID >= 0); // Did we overflow int64_t?
+
+			// make sure we grab the pointer after inserting the new chunk (as it may reallocate the data).
+			chunk = &mChunks[j];
+			break;
+		}
+	}
+
+	return chunk;
+}
+
+bool LegacyMemoryBlock::FreeChunk(int64_t id)
+{
+	bool bFreed = false;
+
+	for (int32_t j = 0; j < mChunks.size(); ++j)
+	{
+		if (mChunks[j].mID == id)
+		{
+			bFreed = true;
+
+			// Mark this chunk as freed
+			mChunks[j].mFree = true;
+
+			// See if we can merge this chunk
+			// First try merging it with the next chunk in the list
+			if (j < mChunks.size() - 1 &&
+				mChunks[j + 1].mFree)
+			{
+				mChunks[j].mSize += mChunks[j + 1].mSize;
+				mChunks.erase(mChunks.begin() + j + 1);
+			}
+
+			// Now try merging with the previous chunk
+			if (j > 0 &&
+				mChunks[j - 1].mFree)
+			{
+				mChunks[j - 1].mSize += mChunks[j].mSize;
+				mChunks.erase(mChunks.begin() + j);
+			}
+		}
+	}
+
+	return bFreed;
+}
+
+void LegacyAllocator::Alloc(uint64_t size, uint64_t alignment, uint32_t memoryType, LegacyAllocation& outAllocation)
+{
+	LegacyMemoryBlock* block = nullptr;
+	LegacyMemoryChunk* chunk = nullptr;
+
+	uint64_t maxAlignSize = size + alignment;
+	for (int32_t i = 0; i < sBlocks.size(); ++i)
+	{
+		if (sBlocks[i].mMemoryType == memoryType)
+		{
+			chunk = sBlocks[i].AllocateChunk(maxAlignSize);
+
+			if (chunk != nullptr)
+			{
+				block = &sBlocks[i];
+				break;
+			}
+		}
+	}
+
+	if (chunk == nullptr)
+	{
+		uint64_t newBlockSize = maxAlignSize > sDefaultBlockSize ? maxAlignSize : sDefaultBlockSize;
+		block = AllocateBlock(newBlockSize, memoryType);
+		assert(block);
+
+		chunk = block->AllocateChunk(maxAlignSize);
+	}
+
+	assert(chunk);
+
+	outAllocation.mDeviceMemory = block->mDeviceMemory;
+	outAllocation.mID = chunk->mID;
+	outAllocation.mOffset = ((chunk->mOffset + alignment - 1) / alignment) * alignment;
+	outAllocation.mSize = size;
+	outAllocation.mType = block->mMemoryType;
+
+	sNumAllocations++;
+	sNumAllocatedBytes += maxAlignSize;
+}
+
+void LegacyAllocator::Free(LegacyAllocation& allocation)
+{
+	sNumAllocations--;
+	sNumAllocatedBytes -= allocation.mSize;
+
+	bool bFreed = false;
+	for (int32_t i = 0; i < sBlocks.size(); ++i)
+	{
+		if (sBlocks[i].mMemoryType == allocation.mType)
+		{
+			bFreed = sBlocks[i].FreeChunk(allocation.mID);
+
+			if (bFreed)
+			{
+				// If the block is entirely free, deallocate the memory.
+				if (sBlocks[i].mChunks.size() == 1)
+				{
+					assert(sBlocks[i].mChunks[0].mFree);
+					FreeBlock(sBlocks[i]);
+				}
+				break;
+			}
+		}
+	}
+
+	assert(bFreed);
+
+	allocation.mDeviceMemory = VK_NULL_HANDLE;
+	allocation.mID = -1;
+	allocation.mOffset = 0;
+	allocation.mSize = 0;
+	allocation.mType = 0;
+}
+
+uint64_t LegacyAllocator::GetNumBlocksAllocated()
+{
+	return static_cast<uint64_t>(sBlocks.size());
+}
+
+uint64_t LegacyAllocator::GetNumAllocations()
+{
+	return sNumAllocations;
+}
+
+uint64_t LegacyAllocator::GetNumAllocatedBytes()
+{
+	return sNumAllocatedBytes;
+}
+
+LegacyMemoryBlock* LegacyAllocator::AllocateBlock(uint64_t newBlockSize, uint32_t memoryType)
+{
+	sBlocks.push_back(LegacyMemoryBlock());
+	LegacyMemoryBlock& newBlock = sBlocks.back();
+
+	newBlock.mSize = newBlockSize;
+	newBlock.mAvailableMemory = newBlockSize;
+	newBlock.mLargestChunk = newBlockSize;
+	newBlock.mMemoryType = memoryType;
+
+	// Allocate video memory.
+	VkMemoryAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.allocationSize = newBlockSize;
+	allocInfo.memoryTypeIndex = memoryType;
+
+	// Goes to the same stub as the current allocator's blocks.
+	if (vkAllocateMemory(VK_NULL_HANDLE, &allocInfo, nullptr, &newBlock.mDeviceMemory) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to allocate image memory");
+	}
+
+	// Initialize the starting chunk.
+	LegacyMemoryChunk firstChunk;
+	firstChunk.mFree = true;
+	firstChunk.mID = -1;
+	firstChunk.mOffset = 0;
+	firstChunk.mSize = newBlockSize;
+	newBlock.mChunks.push_back(firstChunk);
+
+	return &newBlock;
+}
+
+void LegacyAllocator::FreeBlock(LegacyMemoryBlock& block)
+{
+	int32_t index = 0;
+
+	for (index = 0; index < sBlocks.size(); ++index)
+	{
+		if (block.mDeviceMemory == sBlocks[index].mDeviceMemory)
+		{
+			break;
+		}
+	}
+
+	assert(index < sBlocks.size());
+
+	vkFreeMemory(VK_NULL_HANDLE, sBlocks[index].mDeviceMemory, nullptr);
+	sBlocks.erase(sBlocks.begin() + index);
+}
\ No newline at end of file
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+
+// The allocator as it was before MemoryBlock moved to TLSF free lists: every block keeps its
+// chunks in a vector that is scanned front to back on both allocate and free. Kept here unchanged
+// apart from the names, so the replay compares against exactly what was replaced.
+
+struct LegacyAllocation
+{
+	VkDeviceMemory mDeviceMemory;
+	uint32_t mType;
+	int64_t mID;
+	VkDeviceSize mSize;
+	VkDeviceSize mOffset;
+
+	LegacyAllocation() :
+		mDeviceMemory(VK_NULL_HANDLE),
+		mType(0),
+		mID(-1),
+		mSize(0),
+		mOffset(0)
+	{
+
+	}
+};
+
+struct LegacyMemoryChunk
+{
+	int64_t mID;
+	uint64_t mOffset;
+	uint64_t mSize;
+	bool mFree;
+
+	LegacyMemoryChunk() :
+		mID(-1),
+		mOffset(0),
+		mSize(0),
+		mFree(true)
+	{
+
+	}
+};
+
+struct LegacyMemoryBlock
+{
+	LegacyMemoryChunk* AllocateChunk(uint64_t size);
+	bool FreeChunk(int64_t id);
+
+	LegacyMemoryBlock() :
+		mDeviceMemory(0),
+		mSize(0),
+		mAvailableMemory(0),
+		mLargestChunk(0),
+		mMemoryType(0)
+	{
+
+	}
+
+	std::vector<LegacyMemoryChunk> mChunks;
+	VkDeviceMemory mDeviceMemory;
+	uint64_t mSize;
+	uint64_t mAvailableMemory;
+	uint64_t mLargestChunk;
+	uint32_t mMemoryType;
+};
+
+class LegacyAllocator
+{
+public:
+
+	static void Alloc(uint64_t size, uint64_t alignment, uint32_t memoryType, LegacyAllocation& outAllocation);
+	static void Free(LegacyAllocation& allocation);
+
+	static uint64_t GetNumBlocksAllocated();
+	static uint64_t GetNumAllocations();
+	static uint64_t GetNumAllocatedBytes();
+
+	static const uint64_t sDefaultBlockSize;
+
+private:
+
+	static LegacyMemoryBlock* AllocateBlock(uint64_t newBlockSize, uint32_t memoryType);
+	static void FreeBlock(LegacyMemoryBlock& block);
+
+	static std::vector<LegacyMemoryBlock> sBlocks;
+	static uint64_t sNumAllocations;
+	static uint64_t sNumAllocatedBytes;
+};
\ No newline at end of file
@@ -0,0 +1,251 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Allocator.h"
+#include "LegacyAllocator.h"
+#include "Trace.h"
+#include "VulkanStubs.h"
+
+// Replays allocation traces against the current allocator and the one it replaced, on the CPU
+// with stubbed Vulkan calls. Build and run the Release configuration, debug builds log every
+// allocation.
+
+typedef std::chrono::high_resolution_clock Clock;
+
+static void PrintUsage()
+{
+	printf("Usage:\n");
+	printf("  AllocatorBench replay <trace> [runs]\n");
+	printf("      Replays the trace on the legacy and the TLSF allocator, best time of runs (default 5).\n");
+	printf("  AllocatorBench generate <trace> [seed]\n");
+	printf("      Writes the synthetic trace for seed (default 1). Traces/synthetic.trace is seed 1.\n");
+	printf("  AllocatorBench threads <trace> [maxThreads]\n");
+	printf("      Replays the trace on the TLSF allocator from 1 to maxThreads (default 8) threads at once.\n");
+}
+
+static double GetElapsedMs(Clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+static double ReplayLegacy(const std::vector<TraceOp>& ops, uint32_t numAllocations)
+{
+	std::vector<LegacyAllocation> allocations(numAllocations);
+
+	Clock::time_point start = Clock::now();
+
+	for (const TraceOp& op : ops)
+	{
+		if (op.mFree)
+		{
+			LegacyAllocator::Free(allocations[op.mID]);
+		}
+		else
+		{
+			LegacyAllocator::Alloc(op.mSize, op.mAlignment, op.mMemoryType, allocations[op.mID]);
+		}
+	}
+
+	return GetElapsedMs(start);
+}
+
+static double ReplayTlsf(const std::vector<TraceOp>& ops, uint32_t numAllocations)
+{
+	std::vector<Allocation> allocations(numAllocations);
+
+	Clock::time_point start = Clock::now();
+
+	for (const TraceOp& op : ops)
+	{
+		if (op.mFree)
+		{
+			Allocator::Free(allocations[op.mID]);
+		}
+		else
+		{
+			Allocator::Alloc(op.mSize, op.mAlignment, op.mMemoryType, allocations[op.mID]);
+		}
+	}
+
+	return GetElapsedMs(start);
+}
+
+// Every allocation has to be made before it is freed, and freed at most once.
+static bool ValidateTrace(const std::vector<TraceOp>& ops, uint32_t numAllocations)
+{
+	std::vector<uint8_t> state(numAllocations, 0);
+
+	for (const TraceOp& op : ops)
+	{
+		uint8_t expected = op.mFree ? 1 : 0;
+
+		if (op.mID >= numAllocations ||
+			op.mMemoryType >= STUB_NUM_MEMORY_TYPES ||
+			(!op.mFree && op.mAlignment == 0) ||
+			state[op.mID] != expected)
+		{
+			printf("Trace is inconsistent at allocation %u\n", op.mID);
+			return false;
+		}
+
+		state[op.mID]++;
+	}
+
+	return true;
+}
+
+static int32_t Replay(const std::string& path, uint32_t runs)
+{
+	std::vector<TraceOp> ops;
+
+	if (!LoadTrace(path, ops))
+	{
+		printf("Failed to load trace %s\n", path.c_str());
+		return 1;
+	}
+
+	uint32_t numAllocations = GetNumTraceAllocations(ops);
+
+	if (!ValidateTrace(ops, numAllocations))
+	{
+		return 1;
+	}
+
+	Allocator::Initialize(false, false);
+
+	printf("Replaying %u operations from %s, best of %u runs\n", static_cast<uint32_t>(ops.size()), path.c_str(), runs);
+
+	double legacyMs = 0.0;
+	double tlsfMs = 0.0;
+	uint64_t legacyBlockAllocations = 0;
+	uint64_t tlsfBlockAllocations = 0;
+
+	for (uint32_t i = 0; i < runs; ++i)
+	{
+		ResetStubCounters();
+		double ms = ReplayLegacy(ops, numAllocations);
+		legacyMs = (i == 0 || ms < legacyMs) ? ms : legacyMs;
+		legacyBlockAllocations = GetNumStubMemoryAllocations();
+
+		ResetStubCounters();
+		ms = ReplayTlsf(ops, numAllocations);
+		tlsfMs = (i == 0 || ms < tlsfMs) ? ms : tlsfMs;
+		tlsfBlockAllocations = GetNumStubMemoryAllocations();
+
+		if (GetNumLiveStubMemory() != 0)
+		{
+			printf("Device memory is still allocated after the trace freed everything\n");
+			return 1;
+		}
+	}
+
+	printf("  legacy linear scan: %9.2f ms, %llu vkAllocateMemory calls\n", legacyMs, static_cast<unsigned long long>(legacyBlockAllocations));
+	printf("  TLSF:               %9.2f ms, %llu vkAllocateMemory calls\n", tlsfMs, static_cast<unsigned long long>(tlsfBlockAllocations));
+
+	return 0;
+}
+
+// Every thread replays the whole trace into its own allocations, so the allocator's locks are
+// contended on every operation. Build with -fsanitize=thread or address on Linux to check the
+// allocator for races and leaks.
+static int32_t ReplayThreaded(const std::string& path, uint32_t maxThreads)
+{
+	std::vector<TraceOp> ops;
+
+	if (!LoadTrace(path, ops))
+	{
+		printf("Failed to load trace %s\n", path.c_str());
+		return 1;
+	}
+
+	uint32_t numAllocations = GetNumTraceAllocations(ops);
+
+	if (!ValidateTrace(ops, numAllocations))
+	{
+		return 1;
+	}
+
+	Allocator::Initialize(false, false);
+
+	printf("Replaying %u operations from %s on each thread\n", static_cast<uint32_t>(ops.size()), path.c_str());
+
+	for (uint32_t numThreads = 1; numThreads <= maxThreads; numThreads *= 2)
+	{
+		std::vector<std::thread> threads;
+		threads.reserve(numThreads);
+
+		Clock::time_point start = Clock::now();
+
+		for (uint32_t i = 0; i < numThreads; ++i)
+		{
+			threads.emplace_back([&ops, numAllocations]() { ReplayTlsf(ops, numAllocations); });
+		}
+
+		for (std::thread& thread : threads)
+		{
+			thread.join();
+		}
+
+		double ms = GetElapsedMs(start);
+		double opsPerSecond = static_cast<double>(ops.size()) * numThreads * 1000.0 / ms;
+
+		if (GetNumLiveStubMemory() != 0)
+		{
+			printf("Device memory is still allocated after the trace freed everything\n");
+			return 1;
+		}
+
+		printf("  %2u threads: %9.2f ms, %.2fM operations/s\n", numThreads, ms, opsPerSecond / 1000000.0);
+	}
+
+	return 0;
+}
+
+static int32_t Generate(const std::string& path, uint32_t seed)
+{
+	std::vector<TraceOp> ops;
+	GenerateTrace(seed, ops);
+
+	if (!SaveTrace(path, ops, seed))
+	{
+		printf("Failed to write trace %s\n", path.c_str());
+		return 1;
+	}
+
+	printf("Wrote %u operations to %s\n", static_cast<uint32_t>(ops.size()), path.c_str());
+
+	return 0;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc >= 3 &&
+		strcmp(argv[1], "replay") == 0)
+	{
+		uint32_t runs = (argc >= 4) ? static_cast<uint32_t>(atoi(argv[3])) : 5;
+		return Replay(argv[2], (runs > 0) ? runs : 1);
+	}
+
+	if (argc >= 3 &&
+		strcmp(argv[1], "generate") == 0)
+	{
+		uint32_t seed = (argc >= 4) ? static_cast<uint32_t>(strtoul(argv[3], nullptr, 10)) : 1;
+		return Generate(argv[2], seed);
+	}
+
+	if (argc >= 3 &&
+		strcmp(argv[1], "threads") == 0)
+	{
+		uint32_t maxThreads = (argc >= 4) ? static_cast<uint32_t>(atoi(argv[3])) : 8;
+		return ReplayThreaded(argv[2], (maxThreads > 0) ? maxThreads : 1);
+	}
+
+	PrintUsage();
+	return 1;
+}
\ No newline at end of file
@@ -0,0 +1,190 @@
+#include "Trace.h"
+
+#include <stdio.h>
+
+#define TRACE_INITIAL_ALLOCATIONS 4000
+#define TRACE_CHURN_OPERATIONS 20000
+#define TRACE_MEMORY_TYPES 3
+
+// xorshift32, so that traces don't depend on the standard library's distributions.
+static uint32_t NextRandom(uint32_t& state)
+{
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+static TraceOp MakeAllocation(uint32_t id, uint32_t& state)
+{
+	TraceOp op;
+	op.mFree = false;
+	op.mID = id;
+	op.mMemoryType = NextRandom(state) % TRACE_MEMORY_TYPES;
+
+	if (NextRandom(state) % 5 < 3)
+	{
+		// Uniform sized, 256 bytes to 64 KB.
+		op.mSize = 256ULL * (1 + NextRandom(state) % 256);
+		op.mAlignment = 256;
+	}
+	else
+	{
+		// Mesh sized, 64 KB to 4 MB.
+		op.mSize = 4096ULL * (16 + NextRandom(state) % 1009);
+		op.mAlignment = 16;
+	}
+
+	return op;
+}
+
+static TraceOp MakeFree(uint32_t id)
+{
+	TraceOp op;
+	op.mFree = true;
+	op.mID = id;
+	return op;
+}
+
+bool LoadTrace(const std::string& path, std::vector<TraceOp>& outOps)
+{
+	FILE* file = fopen(path.c_str(), "r");
+
+	if (file == nullptr)
+	{
+		return false;
+	}
+
+	outOps.clear();
+
+	char line[256];
+	bool valid = true;
+
+	while (valid &&
+		fgets(line, sizeof(line), file) != nullptr)
+	{
+		if (line[0] == '#' ||
+			line[0] == '\n' ||
+			line[0] == '\r')
+		{
+			continue;
+		}
+
+		TraceOp op;
+		unsigned int id = 0;
+		unsigned long long size = 0;
+		unsigned long long alignment = 0;
+		unsigned int memoryType = 0;
+
+		if (line[0] == 'a' &&
+			sscanf(line + 1, "%u %llu %llu %u", &id, &size, &alignment, &memoryType) == 4)
+		{
+			op.mFree = false;
+			op.mSize = size;
+			op.mAlignment = alignment;
+			op.mMemoryType = memoryType;
+		}
+		else if (line[0] == 'f' &&
+			sscanf(line + 1, "%u", &id) == 1)
+		{
+			op.mFree = true;
+		}
+		else
+		{
+			printf("Malformed trace line: %s", line);
+			valid = false;
+		}
+
+		op.mID = id;
+		outOps.push_back(op);
+	}
+
+	fclose(file);
+
+	return valid;
+}
+
+bool SaveTrace(const std::string& path, const std::vector<TraceOp>& ops, uint32_t seed)
+{
+	FILE* file = fopen(path.c_str(), "w");
+
+	if (file == nullptr)
+	{
+		return false;
+	}
+
+	fprintf(file, "# AllocatorBench trace, generated with seed %u\n", seed);
+	fprintf(file, "# a <id> <size> <alignment> <memory type>\n");
+	fprintf(file, "# f <id>\n");
+
+	for (const TraceOp& op : ops)
+	{
+		if (op.mFree)
+		{
+			fprintf(file, "f %u\n", op.mID);
+		}
+		else
+		{
+			fprintf(file, "a %u %llu %llu %u\n",
+				op.mID,
+				static_cast<unsigned long long>(op.mSize),
+				static_cast<unsigned long long>(op.mAlignment),
+				op.mMemoryType);
+		}
+	}
+
+	bool written = ferror(file) == 0;
+	fclose(file);
+
+	return written;
+}
+
+void GenerateTrace(uint32_t seed, std::vector<TraceOp>& outOps)
+{
+	uint32_t state = (seed != 0) ? seed : 1;
+	uint32_t nextID = 0;
+	std::vector<uint32_t> live;
+
+	outOps.clear();
+
+	for (uint32_t i = 0; i < TRACE_INITIAL_ALLOCATIONS; ++i)
+	{
+		outOps.push_back(MakeAllocation(nextID, state));
+		live.push_back(nextID++);
+	}
+
+	// Free a random allocation and replace it, the way streaming and per-level data come and go.
+	for (uint32_t i = 0; i < TRACE_CHURN_OPERATIONS; ++i)
+	{
+		uint32_t index = NextRandom(state) % static_cast<uint32_t>(live.size());
+		outOps.push_back(MakeFree(live[index]));
+
+		outOps.push_back(MakeAllocation(nextID, state));
+		live[index] = nextID++;
+	}
+
+	while (!live.empty())
+	{
+		uint32_t index = NextRandom(state) % static_cast<uint32_t>(live.size());
+		outOps.push_back(MakeFree(live[index]));
+
+		live[index] = live.back();
+		live.pop_back();
+	}
+}
+
+uint32_t GetNumTraceAllocations(const std::vector<TraceOp>& ops)
+{
+	uint32_t numAllocations = 0;
+
+	for (const TraceOp& op : ops)
+	{
+		if (!op.mFree &&
+			op.mID + 1 > numAllocations)
+		{
+			numAllocations = op.mID + 1;
+		}
+	}
+
+	return numAllocations;
+}
\ No newline at end of file
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// One line of an allocation trace. Allocations are identified by the order they were made in,
+// frees refer back to that id.
+struct TraceOp
+{
+	bool mFree;
+	uint32_t mID;
+	uint64_t mSize;
+	uint64_t mAlignment;
+	uint32_t mMemoryType;
+
+	TraceOp() :
+		mFree(false),
+		mID(0),
+		mSize(0),
+		mAlignment(1),
+		mMemoryType(0)
+	{
+
+	}
+};
+
+// Traces are text, one operation per line:
+//   a <id> <size> <alignment> <memory type>
+//   f <id>
+// Lines starting with # are comments.
+bool LoadTrace(const std::string& path, std::vector<TraceOp>& outOps);
+bool SaveTrace(const std::string& path, const std::vector<TraceOp>& ops, uint32_t seed);
+
+// Mixed uniform and mesh sized allocations across three memory types, followed by frees and
+// reallocations at random and finally freeing everything that is left, in random order.
+// The same seed always produces the same trace.
+void GenerateTrace(uint32_t seed, std::vector<TraceOp>& outOps);
+
+// Number of ids the trace allocates.
+uint32_t GetNumTraceAllocations(const std::vector<TraceOp>& ops);
\ No newline at end of file
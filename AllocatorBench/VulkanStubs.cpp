@@ -0,0 +1,255 @@
+#include "VulkanStubs.h"
+#include "Renderer.h"
+
+#include <atomic>
+#include <stdexcept>
+#include <stdlib.h>
+#include <string.h>
+
+#define STUB_HEAP_SIZE (4ULL * 1024 * 1024 * 1024)
+
+struct StubMemory
+{
+	VkDeviceSize mSize;
+	void* mMappedPtr;
+};
+
+static std::atomic<uint64_t> sNumMemoryAllocations(0);
+static std::atomic<uint64_t> sNumLiveMemory(0);
+static std::atomic<uint64_t> sNextHandle(1);
+
+static StubMemory* GetStubMemory(VkDeviceMemory memory)
+{
+	return (StubMemory*)(uintptr_t)memory;
+}
+
+uint64_t GetNumStubMemoryAllocations()
+{
+	return sNumMemoryAllocations;
+}
+
+uint64_t GetNumLiveStubMemory()
+{
+	return sNumLiveMemory;
+}
+
+void ResetStubCounters()
+{
+	sNumMemoryAllocations = 0;
+}
+
+// Renderer
+
+// No renderer is created. The members below never read any state, the allocator only needs
+// something to call them on.
+Renderer* Renderer::Get()
+{
+	return nullptr;
+}
+
+VkDevice Renderer::GetDevice()
+{
+	return VK_NULL_HANDLE;
+}
+
+VkPhysicalDevice Renderer::GetPhysicalDevice()
+{
+	return VK_NULL_HANDLE;
+}
+
+VkInstance Renderer::GetInstance()
+{
+	return VK_NULL_HANDLE;
+}
+
+uint32_t Renderer::FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties)
+{
+	VkPhysicalDeviceMemoryProperties memoryProperties;
+	vkGetPhysicalDeviceMemoryProperties(VK_NULL_HANDLE, &memoryProperties);
+
+	for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i)
+	{
+		if ((typeFilter & (1 << i)) &&
+			(memoryProperties.memoryTypes[i].propertyFlags & properties) == properties)
+		{
+			return i;
+		}
+	}
+
+	throw std::runtime_error("Failed to find suitable memory type");
+}
+
+VkCommandBuffer Renderer::BeginSingleSubmissionCommands()
+{
+	return VK_NULL_HANDLE;
+}
+
+void Renderer::EndSingleSubmissionCommands(VkCommandBuffer commandBuffer, bool waitForIdle, VkFence fence)
+{
+
+}
+
+DestructionQueue& Renderer::GetDestructionQueue()
+{
+	static DestructionQueue sDestructionQueue;
+	return sDestructionQueue;
+}
+
+// DestructionQueue, nothing is in flight so frees happen straight away.
+
+DestructionQueue::DestructionQueue()
+{
+	for (uint32_t i = 0; i < VK_MAX_MEMORY_HEAPS; ++i)
+	{
+		mPendingFreeBytes[i] = 0;
+	}
+}
+
+void DestructionQueue::FreeAllocation(Allocation& allocation)
+{
+	if (allocation.IsValid())
+	{
+		Allocator::Free(allocation);
+	}
+}
+
+uint64_t DestructionQueue::GetPendingFreeBytes(uint32_t heapIndex)
+{
+	return 0;
+}
+
+// Vulkan
+
+VKAPI_ATTR void VKAPI_CALL vkGetPhysicalDeviceMemoryProperties(VkPhysicalDevice physicalDevice, VkPhysicalDeviceMemoryProperties* pMemoryProperties)
+{
+	memset(pMemoryProperties, 0, sizeof(*pMemoryProperties));
+
+	pMemoryProperties->memoryHeapCount = 2;
+	pMemoryProperties->memoryHeaps[0].size = STUB_HEAP_SIZE;
+	pMemoryProperties->memoryHeaps[0].flags = VK_MEMORY_HEAP_DEVICE_LOCAL_BIT;
+	pMemoryProperties->memoryHeaps[1].size = STUB_HEAP_SIZE;
+	pMemoryProperties->memoryHeaps[1].flags = 0;
+
+	pMemoryProperties->memoryTypeCount = STUB_NUM_MEMORY_TYPES;
+	pMemoryProperties->memoryTypes[0].heapIndex = 0;
+	pMemoryProperties->memoryTypes[0].propertyFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+	pMemoryProperties->memoryTypes[1].heapIndex = 1;
+	pMemoryProperties->memoryTypes[1].propertyFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+	pMemoryProperties->memoryTypes[2].heapIndex = 1;
+	pMemoryProperties->memoryTypes[2].propertyFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkGetPhysicalDeviceProperties(VkPhysicalDevice physicalDevice, VkPhysicalDeviceProperties* pProperties)
+{
+	memset(pProperties, 0, sizeof(*pProperties));
+
+	pProperties->limits.bufferImageGranularity = 1024;
+	pProperties->limits.nonCoherentAtomSize = 64;
+	pProperties->limits.minUniformBufferOffsetAlignment = 256;
+	pProperties->limits.minStorageBufferOffsetAlignment = 16;
+	pProperties->limits.optimalBufferCopyOffsetAlignment = 16;
+}
+
+VKAPI_ATTR PFN_vkVoidFunction VKAPI_CALL vkGetInstanceProcAddr(VkInstance instance, const char* pName)
+{
+	return nullptr;
+}
+
+VKAPI_ATTR PFN_vkVoidFunction VKAPI_CALL vkGetDeviceProcAddr(VkDevice device, const char* pName)
+{
+	return nullptr;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkCreateBuffer(VkDevice device, const VkBufferCreateInfo* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkBuffer* pBuffer)
+{
+	*pBuffer = (VkBuffer)(uintptr_t)sNextHandle++;
+	return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkDestroyBuffer(VkDevice device, VkBuffer buffer, const VkAllocationCallbacks* pAllocator)
+{
+
+}
+
+VKAPI_ATTR void VKAPI_CALL vkGetBufferMemoryRequirements(VkDevice device, VkBuffer buffer, VkMemoryRequirements* pMemoryRequirements)
+{
+	// Sizes and alignment come from the allocator, only the memory types matter.
+	pMemoryRequirements->size = 0;
+	pMemoryRequirements->alignment = 1;
+	pMemoryRequirements->memoryTypeBits = (1 << STUB_NUM_MEMORY_TYPES) - 1;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkGetImageMemoryRequirements(VkDevice device, VkImage image, VkMemoryRequirements* pMemoryRequirements)
+{
+	pMemoryRequirements->size = 0;
+	pMemoryRequirements->alignment = 1;
+	pMemoryRequirements->memoryTypeBits = 1;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkBindBufferMemory(VkDevice device, VkBuffer buffer, VkDeviceMemory memory, VkDeviceSize memoryOffset)
+{
+	return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkAllocateMemory(VkDevice device, const VkMemoryAllocateInfo* pAllocateInfo, const VkAllocationCallbacks* pAllocator, VkDeviceMemory* pMemory)
+{
+	StubMemory* memory = new StubMemory();
+	memory->mSize = pAllocateInfo->allocationSize;
+	memory->mMappedPtr = nullptr;
+
+	sNumMemoryAllocations++;
+	sNumLiveMemory++;
+
+	*pMemory = (VkDeviceMemory)(uintptr_t)memory;
+	return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkFreeMemory(VkDevice device, VkDeviceMemory memory, const VkAllocationCallbacks* pAllocator)
+{
+	StubMemory* stubMemory = GetStubMemory(memory);
+
+	if (stubMemory != nullptr)
+	{
+		free(stubMemory->mMappedPtr);
+		delete stubMemory;
+		sNumLiveMemory--;
+	}
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkMapMemory(VkDevice device, VkDeviceMemory memory, VkDeviceSize offset, VkDeviceSize size, VkMemoryMapFlags flags, void** ppData)
+{
+	StubMemory* stubMemory = GetStubMemory(memory);
+
+	// Never touched, so the pages are never committed.
+	if (stubMemory->mMappedPtr == nullptr)
+	{
+		stubMemory->mMappedPtr = malloc(static_cast<size_t>(stubMemory->mSize));
+	}
+
+	*ppData = static_cast<char*>(stubMemory->mMappedPtr) + offset;
+	return (stubMemory->mMappedPtr != nullptr) ? VK_SUCCESS : VK_ERROR_MEMORY_MAP_FAILED;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkUnmapMemory(VkDevice device, VkDeviceMemory memory)
+{
+
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkFlushMappedMemoryRanges(VkDevice device, uint32_t memoryRangeCount, const VkMappedMemoryRange* pMemoryRanges)
+{
+	return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdPipelineBarrier(VkCommandBuffer commandBuffer,
+	VkPipelineStageFlags srcStageMask,
+	VkPipelineStageFlags dstStageMask,
+	VkDependencyFlags dependencyFlags,
+	uint32_t memoryBarrierCount,
+	const VkMemoryBarrier* pMemoryBarriers,
+	uint32_t bufferMemoryBarrierCount,
+	const VkBufferMemoryBarrier* pBufferMemoryBarriers,
+	uint32_t imageMemoryBarrierCount,
+	const VkImageMemoryBarrier* pImageMemoryBarriers)
+{
+
+}
\ No newline at end of file
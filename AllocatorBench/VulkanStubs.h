@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdint.h>
+
+// Engine/Allocator.cpp is compiled into the benchmark as is. VulkanStubs.cpp defines the Vulkan
+// and Renderer functions it calls, so that no device is needed and only the allocator's own
+// bookkeeping is measured. The stubs report a discrete GPU with one 4 GB device local heap
+// and one 4 GB host heap:
+//   memory type 0: device local
+//   memory type 1: host visible, host coherent
+//   memory type 2: host visible, host cached
+// vkAllocateMemory only hands out handles. Host visible blocks get address space for their
+// mapping, which is never written. The stubs may be called from any thread.
+
+#define STUB_NUM_MEMORY_TYPES 3
+
+// Number of vkAllocateMemory calls since the last reset.
+uint64_t GetNumStubMemoryAllocations();
+
+// Number of device memory handles that haven't been freed.
+uint64_t GetNumLiveStubMemory();
+
+void ResetStubCounters();
\ No newline at end of file
@@ -1,5 +1,9 @@
 #include <stdint.h>
+#include <string.h>
+
+#if defined(_WIN32)
 #include <Windows.h>
+#endif
 
 #undef min
 #undef max
@@ -9,17 +13,23 @@
 #include "Quad.h"
 #include "Button.h"
 #include "Selector.h"
-#include "CheckBox.h"
+#include "Checkbox.h"
 #include "Renderer.h"
 #include "Text.h"
 #include "TextField.h"
 #include "Canvas.h"
 #include "Log.h"
 #include "DefaultFonts.h"
+#include "AllocatorOverlay.h"
+#include "GpuProfilerOverlay.h"
+#include "CameraPath.h"
+#include "ApplicationState.h"
 
 static Text* fontDemoText = nullptr;
 static Text* fontNameText = nullptr;
 static Canvas* fontTestCanvas = nullptr;
+static AllocatorOverlay* allocatorOverlay = nullptr;
+static GpuProfilerOverlay* gpuProfilerOverlay = nullptr;
 
 static const char* sDefaultTestString = "Beep Boop!\nThis is a font test.\nThe quick brown fox jumps over the lazy dog?";
 
@@ -35,7 +45,7 @@ static Font* demoFonts[] =
 	&DefaultFonts::sUbuntuMono24
 };
 
-static int32_t numFonts = ARRAYSIZE(demoFonts);
+static int32_t numFonts = sizeof(demoFonts) / sizeof(demoFonts[0]);
 static int32_t currentFont = 0;
 
 void PlusSize(Button* button)
@@ -67,6 +77,18 @@ void ShowFontTest(Button* button)
 	fontTestCanvas->SetVisible(check->IsChecked());
 }
 
+void ShowAllocatorOverlay(Button* button)
+{
+	CheckBox* check = static_cast<CheckBox*>(button);
+	allocatorOverlay->SetVisible(check->IsChecked());
+}
+
+void ShowGpuProfilerOverlay(Button* button)
+{
+	CheckBox* check = static_cast<CheckBox*>(button);
+	gpuProfilerOverlay->SetVisible(check->IsChecked());
+}
+
 void OnTextFieldEdit(TextField* textField)
 {
 	fontDemoText->SetText(textField->GetTextString());
@@ -97,17 +119,33 @@ void OnFontTextFieldConfirm(TextField* textField)
 	}
 }
 
-#ifndef _DEBUG
+#if defined(_WIN32) && !defined(_DEBUG)
 int32_t WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR pCmdLine, int32_t nCmdShow)
 #else
 int32_t main(int32_t argc, char** argv)
 #endif
 {
+#if defined(_WIN32) && !defined(_DEBUG)
+	ParseCommandLine(__argc, __argv);
+#else
+	ParseCommandLine(argc, argv);
+#endif
+
 	Initialize(1280, 720);
 
+	const AppState* appState = GetAppState();
+	bool monkeyScene = strcmp(appState->mSceneName, "MonkeyScene") == 0;
+
 	Scene* scene = new Scene();
-	scene->Load("Scenes/Sponza/", "Sponza.dae");
-	//scene->Load("Scenes/MonkeyScene/Collada/", "MonkeyScene3.dae");
+
+	if (monkeyScene)
+	{
+		scene->Load("Scenes/MonkeyScene/Collada/", "MonkeyScene3.dae");
+	}
+	else
+	{
+		scene->Load("Scenes/Sponza/", "Sponza.dae");
+	}
 
 	Canvas* rootCanvas = new Canvas();
 	rootCanvas->SetRect(0, 0, 1280, 720);
@@ -181,6 +219,34 @@ int32_t main(int32_t argc, char** argv)
 	enableLabel->SetText("Enable Font Test");
 	enableLabel->SetPosition(1130, 685);
 
+	allocatorOverlay = new AllocatorOverlay();
+	allocatorOverlay->SetPosition(780, 420);
+	allocatorOverlay->SetDimensions(500, 240);
+	allocatorOverlay->SetVisible(false);
+
+	CheckBox* memoryCheckbox = new CheckBox();
+	memoryCheckbox->SetPressedHandler(ShowAllocatorOverlay);
+	memoryCheckbox->SetChecked(false);
+	memoryCheckbox->SetPosition(1100, 650);
+
+	Text* memoryLabel = new Text();
+	memoryLabel->SetText("Memory Stats");
+	memoryLabel->SetPosition(1130, 652);
+
+	gpuProfilerOverlay = new GpuProfilerOverlay();
+	gpuProfilerOverlay->SetPosition(780, 220);
+	gpuProfilerOverlay->SetDimensions(500, 190);
+	gpuProfilerOverlay->SetVisible(false);
+
+	CheckBox* gpuCheckbox = new CheckBox();
+	gpuCheckbox->SetPressedHandler(ShowGpuProfilerOverlay);
+	gpuCheckbox->SetChecked(false);
+	gpuCheckbox->SetPosition(1100, 617);
+
+	Text* gpuLabel = new Text();
+	gpuLabel->SetText("GPU Timings");
+	gpuLabel->SetPosition(1130, 619);
+
 	TextField* textFieldDemo = new TextField();
 	textFieldDemo->SetPosition(100, 120);
 	textFieldDemo->SetDimensions(400, 32);
@@ -220,6 +286,12 @@ int32_t main(int32_t argc, char** argv)
 	rootCanvas->AddChild(text1);
 	rootCanvas->AddChild(canvas2);
 	rootCanvas->AddChild(fontTestCanvas);
+	rootCanvas->AddChild(memoryCheckbox);
+	rootCanvas->AddChild(memoryLabel);
+	rootCanvas->AddChild(allocatorOverlay);
+	rootCanvas->AddChild(gpuCheckbox);
+	rootCanvas->AddChild(gpuLabel);
+	rootCanvas->AddChild(gpuProfilerOverlay);
 
 	Renderer::Get()->SetRootWidget(rootCanvas);
 
@@ -228,6 +300,48 @@ int32_t main(int32_t argc, char** argv)
 	scene->GetActiveCamera()->SetRotation(glm::vec3(0.0f, -90.0f, 0.0f));
 	SetScene(scene);
 
+	// Headless runs and benchmarks follow a fixed path, so every run renders the same frames.
+	CameraPath flythrough;
+
+	if (appState->mCameraPathFile != nullptr)
+	{
+		if (!flythrough.Load(appState->mCameraPathFile))
+		{
+			LogError("Failed to load camera path %s", appState->mCameraPathFile);
+		}
+	}
+	else if (monkeyScene)
+	{
+		flythrough.AddKeyframe(0.0f, glm::vec3(0.0f, 5.0f, 20.0f), glm::vec3(0.0f, -90.0f, 0.0f));
+		flythrough.AddKeyframe(5.0f, glm::vec3(20.0f, 5.0f, 0.0f), glm::vec3(0.0f, 0.0f, 0.0f));
+		flythrough.AddKeyframe(10.0f, glm::vec3(0.0f, 5.0f, -20.0f), glm::vec3(0.0f, 90.0f, 0.0f));
+		flythrough.AddKeyframe(15.0f, glm::vec3(-20.0f, 5.0f, 0.0f), glm::vec3(0.0f, 180.0f, 0.0f));
+		flythrough.AddKeyframe(20.0f, glm::vec3(0.0f, 5.0f, 20.0f), glm::vec3(0.0f, 270.0f, 0.0f));
+	}
+	else
+	{
+		// Down one side of the atrium, around the end and back up the other side.
+		flythrough.AddKeyframe(0.0f, glm::vec3(-50.0f, 10.0f, 5.0f), glm::vec3(0.0f, -90.0f, 0.0f));
+		flythrough.AddKeyframe(8.0f, glm::vec3(50.0f, 10.0f, 5.0f), glm::vec3(0.0f, -90.0f, 0.0f));
+		flythrough.AddKeyframe(10.0f, glm::vec3(60.0f, 10.0f, 0.0f), glm::vec3(0.0f, 0.0f, 0.0f));
+		flythrough.AddKeyframe(12.0f, glm::vec3(50.0f, 10.0f, -5.0f), glm::vec3(0.0f, 90.0f, 0.0f));
+		flythrough.AddKeyframe(20.0f, glm::vec3(-50.0f, 10.0f, -5.0f), glm::vec3(0.0f, 90.0f, 0.0f));
+		flythrough.AddKeyframe(22.0f, glm::vec3(-60.0f, 10.0f, 0.0f), glm::vec3(0.0f, 180.0f, 0.0f));
+		flythrough.AddKeyframe(24.0f, glm::vec3(-50.0f, 10.0f, 5.0f), glm::vec3(0.0f, 270.0f, 0.0f));
+	}
+
+	if (appState->mBenchmarkFrames > 0)
+	{
+		// The same set of lights in every run.
+		scene->SpawnTestLights();
+	}
+
+	if ((appState->mHeadless || appState->mBenchmarkFrames > 0) &&
+		!flythrough.IsEmpty())
+	{
+		SetCameraPath(&flythrough);
+	}
+
 	bool ret = true;
 
 	while (ret)
@@ -4,9 +4,10 @@
 #include "Scene.h"
 #include "Camera.h"
 #include "EnvironmentCapture.h"
+#include "CpuProfiler.h"
 
 #include <glm/glm.hpp>
-#include <exception>
+#include <stdexcept>
 
 using namespace std;
 
@@ -15,7 +16,7 @@ Actor::Actor() :
 	mMesh(nullptr),
 	mEnvironmentCapture(nullptr),
 	mDescriptorSet(VK_NULL_HANDLE),
-	mUniformBuffer(VK_NULL_HANDLE)
+	mUniformOffset(0)
 {
 
 }
@@ -41,33 +42,13 @@ void Actor::Create(const aiNode& node, vector<Mesh>& meshes)
 
 		mMesh = &meshes[node.mMeshes[0]];
 
-		CreateUniformBuffer();
 		CreateDescriptorSet();
 	}
 }
 
 void Actor::Destroy()
 {
-	VkDevice device = Renderer::Get()->GetDevice();
 
-	if (mUniformBuffer != VK_NULL_HANDLE)
-	{
-		vkDestroyBuffer(device, mUniformBuffer, nullptr);
-		mUniformBuffer = VK_NULL_HANDLE;
-	}
-	
-	if (mUniformBufferMemory.IsValid())
-	{
-		Allocator::Free(mUniformBufferMemory);
-	}
-}
-
-void Actor::CreateUniformBuffer()
-{
-	Renderer* renderer = Renderer::Get();
-
-	VkDeviceSize bufferSize = sizeof(GeometryUniformBuffer);
-	renderer->CreateBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, mUniformBuffer, mUniformBufferMemory);
 }
 
 void Actor::CreateDescriptorSet()
@@ -84,11 +65,11 @@ void Actor::CreateDescriptorSet()
 
 	if (vkAllocateDescriptorSets(device, &allocInfo, &mDescriptorSet) != VK_SUCCESS)
 	{
-		throw exception("Failed to create descriptor set");
+		throw runtime_error("Failed to create descriptor set");
 	}
 
 	VkDescriptorBufferInfo bufferInfo = {};
-	bufferInfo.buffer = mUniformBuffer;
+	bufferInfo.buffer = renderer->GetUniformRingBuffer().GetBuffer();
 	bufferInfo.offset = 0;
 	bufferInfo.range = sizeof(GeometryUniformBuffer);
 
@@ -100,7 +81,7 @@ void Actor::CreateDescriptorSet()
 	descriptorWrites[0].dstSet = mDescriptorSet;
 	descriptorWrites[0].dstBinding = AD_UNIFORM_BUFFER;
 	descriptorWrites[0].dstArrayElement = 0;
-	descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	descriptorWrites[0].descriptorCount = 1;
 	descriptorWrites[0].pBufferInfo = &bufferInfo;
 	descriptorWrites[0].pImageInfo = nullptr;
@@ -128,8 +109,8 @@ void Actor::Draw(VkCommandBuffer commandBuffer)
 			1,
 			1,
 			&mDescriptorSet,
-			0,
-			nullptr);
+			1,
+			&mUniformOffset);
 
 		vkCmdDrawIndexed(commandBuffer,
 			mMesh->GetNumIndices(),
@@ -143,7 +124,17 @@ void Actor::Draw(VkCommandBuffer commandBuffer)
 void Actor::Update(Scene* scene,
 	float deltaTime)
 {
+	PROFILE_FUNCTION();
+
     UpdateUniformBuffer(scene, deltaTime);
+
+	// Every actor is drawn each frame. Marking here rather than in Draw() keeps
+	// Draw() free of writes, so that it can be recorded on several threads.
+	if (mMesh != nullptr &&
+		mMesh->GetMaterial() != nullptr)
+	{
+		mMesh->GetMaterial()->MarkSampled(Renderer::Get()->GetFrameNumber());
+	}
 }
 
 glm::vec3 Actor::GetPosition()
@@ -158,7 +149,6 @@ glm::vec3 Actor::GetPosition()
 
 void Actor::UpdateUniformBuffer(Scene* scene, float deltaTime)
 {
-	VkDevice device = Renderer::Get()->GetDevice();
 	Camera* camera = scene->GetActiveCamera();
 
 	GeometryUniformBuffer ubo = {};
@@ -170,10 +160,7 @@ void Actor::UpdateUniformBuffer(Scene* scene, float deltaTime)
     ubo.mMetallic = mMesh->GetMaterial()->GetMetallic();
     ubo.mRoughness = mMesh->GetMaterial()->GetRoughness();
 
-	void* data;
-	vkMapMemory(device, mUniformBufferMemory.mDeviceMemory, mUniformBufferMemory.mOffset, sizeof(ubo), 0, &data);
-	memcpy(data, &ubo, sizeof(ubo));
-	vkUnmapMemory(device, mUniformBufferMemory.mDeviceMemory);
+	mUniformOffset = Renderer::Get()->GetUniformRingBuffer().Write(&ubo, sizeof(ubo));
 }
 
 void Actor::UpdateEnvironmentSampler()
@@ -206,6 +193,26 @@ void Actor::UpdateEnvironmentSampler()
 	}
 }
 
+void Actor::ReplaceDescriptorSet()
+{
+	if (mDescriptorSet == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	Renderer* renderer = Renderer::Get();
+	renderer->GetDestructionQueue().FreeDescriptorSet(mDescriptorSet, renderer->GetDescriptorPool());
+
+	CreateDescriptorSet();
+}
+
+bool Actor::UsesTexture(const Texture2D* texture) const
+{
+	return mMesh != nullptr &&
+		mMesh->GetMaterial() != nullptr &&
+		mMesh->GetMaterial()->UsesTexture(texture);
+}
+
 void Actor::SetEnvironmentCapture(EnvironmentCapture* environmentCapture)
 {
 	mEnvironmentCapture = environmentCapture;
@@ -38,6 +38,12 @@ public:
 
     void UpdateEnvironmentSampler();
 
+	// Moves to a new descriptor set, for when one of the material's textures has a new image view
+	// while submitted frames may still use the current set.
+	void ReplaceDescriptorSet();
+
+	bool UsesTexture(const Texture2D* texture) const;
+
 	glm::vec3 GetPosition();
 
 protected:
@@ -45,8 +51,6 @@ protected:
 	void UpdateUniformBuffer(class Scene* camera,
 		float DeltaTime);
 
-	void CreateUniformBuffer();
-
 	void CreateDescriptorSet();
 
 	EnvironmentCapture* mEnvironmentCapture;
@@ -58,6 +62,7 @@ protected:
 	glm::mat4 mWorldMatrix;
 
 	VkDescriptorSet mDescriptorSet;
-	VkBuffer mUniformBuffer;
-	Allocation mUniformBufferMemory;
+
+	// Dynamic offset of this frame's GeometryUniformBuffer in the renderer's uniform ring.
+	uint32_t mUniformOffset;
 };
\ No newline at end of file
@@ -1,195 +1,1407 @@
 #include "Allocator.h"
 #include "Renderer.h"
 #include "Log.h"
+#include "Utilities.h"
 
 #include <assert.h>
-#include <exception>
+#include <stdexcept>
+#include <string.h>
+#include <stdio.h>
 
-std::vector<MemoryBlock> Allocator::sBlocks;
-const uint64_t Allocator::sDefaultBlockSize = 16777216; // 16 MB Blocks
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
-uint64_t Allocator::sNumAllocations = 0;
-uint64_t Allocator::sNumAllocatedBytes = 0;
+std::vector<MemoryBlock*> Allocator::sBlocks[VK_MAX_MEMORY_TYPES];
+std::mutex Allocator::sMutexes[VK_MAX_MEMORY_TYPES];
+VkPhysicalDeviceMemoryProperties Allocator::sMemoryProperties = {};
+uint64_t Allocator::sBlockSizes[VK_MAX_MEMORY_TYPES] = {};
+VkDeviceSize Allocator::sBufferImageGranularity = 1;
+bool Allocator::sDedicatedAllocationEnabled = false;
+PFN_vkGetImageMemoryRequirements2KHR Allocator::sGetImageMemoryRequirements2 = nullptr;
+PFN_vkGetPhysicalDeviceMemoryProperties2KHR Allocator::sGetPhysicalDeviceMemoryProperties2 = nullptr;
+uint32_t Allocator::sDeviceLocalHeap = 0;
+std::atomic<uint64_t> Allocator::sBudgetLimit(0);
 
-static int64_t sNumChunksAllocated = 0;
+VkDeviceSize Allocator::sNonCoherentAtomSize = 1;
+uint32_t Allocator::sArenaMemoryTypeBits[static_cast<uint32_t>(BufferArena::Num)] = {};
+VkDeviceSize Allocator::sArenaAlignments[static_cast<uint32_t>(BufferArena::Num)] = {};
 
-MemoryChunk* MemoryBlock::AllocateChunk(uint64_t size)
+std::atomic<uint64_t> Allocator::sNumBlocks(0);
+std::atomic<uint64_t> Allocator::sNumAllocations(0);
+std::atomic<uint64_t> Allocator::sNumAllocatedBytes(0);
+std::atomic<uint64_t> Allocator::sCategoryBytes[static_cast<uint32_t>(AllocationCategory::Num)] = {};
+std::atomic<uint32_t> Allocator::sCategoryAllocations[static_cast<uint32_t>(AllocationCategory::Num)] = {};
+std::atomic<uint64_t> Allocator::sHeapBlockBytes[VK_MAX_MEMORY_HEAPS] = {};
+std::atomic<uint64_t> Allocator::sHeapAllocatedBytes[VK_MAX_MEMORY_HEAPS] = {};
+
+static std::atomic<int64_t> sNumChunksAllocated(0);
+
+static void AppendMemoryStatsJson(std::string& json, const MemoryStats& stats)
+{
+	AppendFormat(json, "\"blocks\": %u, \"allocations\": %u, \"freeChunks\": %u, ",
+		stats.mNumBlocks,
+		stats.mNumAllocations,
+		stats.mNumFreeChunks);
+	AppendFormat(json, "\"reservedBytes\": %llu, \"usedBytes\": %llu, \"freeBytes\": %llu, \"largestFreeChunk\": %llu, \"fragmentation\": %.4f",
+		static_cast<unsigned long long>(stats.mReservedBytes),
+		static_cast<unsigned long long>(stats.mUsedBytes),
+		static_cast<unsigned long long>(stats.mFreeBytes),
+		static_cast<unsigned long long>(stats.mLargestFreeChunk),
+		stats.GetFragmentation());
+}
+
+// Index of the least significant set bit. Value must be non-zero.
+static uint32_t FindLowestBit(uint64_t value)
+{
+	assert(value != 0);
+#ifdef _MSC_VER
+	unsigned long index = 0;
+	_BitScanForward64(&index, value);
+	return static_cast<uint32_t>(index);
+#else
+	return static_cast<uint32_t>(__builtin_ctzll(value));
+#endif
+}
+
+// Index of the most significant set bit. Value must be non-zero.
+static uint32_t FindHighestBit(uint64_t value)
+{
+	assert(value != 0);
+#ifdef _MSC_VER
+	unsigned long index = 0;
+	_BitScanReverse64(&index, value);
+	return static_cast<uint32_t>(index);
+#else
+	return static_cast<uint32_t>(63 - __builtin_clzll(value));
+#endif
+}
+
+void MemoryBlock::Initialize(uint64_t size, uint32_t memoryType)
+{
+	mSize = size;
+	mAvailableMemory = size;
+	mMemoryType = memoryType;
+
+	mFlBitmap = 0;
+	memset(mSlBitmap, 0, sizeof(mSlBitmap));
+	memset(mFreeLists, 0, sizeof(mFreeLists));
+
+	// The whole block starts out as a single free chunk.
+	mFirstChunk = CreateChunkNode();
+	mFirstChunk->mOffset = 0;
+	mFirstChunk->mSize = size;
+	InsertFreeChunk(mFirstChunk);
+}
+
+void MemoryBlock::Destroy()
+{
+	MemoryChunk* chunk = mFirstChunk;
+	while (chunk != nullptr)
+	{
+		MemoryChunk* next = chunk->mNextPhysical;
+		delete chunk;
+		chunk = next;
+	}
+
+	chunk = mUnusedChunks;
+	while (chunk != nullptr)
+	{
+		MemoryChunk* next = chunk->mNextFree;
+		delete chunk;
+		chunk = next;
+	}
+
+	mFirstChunk = nullptr;
+	mUnusedChunks = nullptr;
+}
+
+MemoryChunk* MemoryBlock::AllocateChunk(uint64_t size, uint64_t alignment)
+{
+	assert(alignment > 0);
+
+	if (size == 0 ||
+		size > mAvailableMemory)
+	{
+		return nullptr;
+	}
+
+	MemoryChunk* chunk = nullptr;
+
+	if (size == mSize)
+	{
+		// Exactly sized blocks (e.g. dedicated allocations) would be missed by the
+		// rounded up search below, so take the whole block directly.
+		chunk = mFirstChunk;
+		RemoveFreeChunk(chunk);
+	}
+	else
+	{
+		chunk = FindAlignedChunk(size, alignment);
+
+		if (chunk == nullptr)
+		{
+			return nullptr;
+		}
+	}
+
+	assert(chunk->mFree);
+
+	// Return the padding in front of the aligned offset to the free lists.
+	// The previous chunk is never free (free neighbours are always merged),
+	// so the padding doesn't need to be coalesced.
+	uint64_t alignedOffset = ((chunk->mOffset + alignment - 1) / alignment) * alignment;
+	uint64_t padding = alignedOffset - chunk->mOffset;
+
+	if (padding > 0)
+	{
+		MemoryChunk* paddingChunk = CreateChunkNode();
+		paddingChunk->mOffset = chunk->mOffset;
+		paddingChunk->mSize = padding;
+		paddingChunk->mPrevPhysical = chunk->mPrevPhysical;
+		paddingChunk->mNextPhysical = chunk;
+
+		if (chunk->mPrevPhysical != nullptr)
+		{
+			chunk->mPrevPhysical->mNextPhysical = paddingChunk;
+		}
+		else
+		{
+			mFirstChunk = paddingChunk;
+		}
+
+		chunk->mPrevPhysical = paddingChunk;
+		chunk->mOffset = alignedOffset;
+		chunk->mSize -= padding;
+
+		InsertFreeChunk(paddingChunk);
+	}
+
+	assert(chunk->mSize >= size);
+
+	// Split off the remainder and return it to the free lists.
+	uint64_t extraSize = chunk->mSize - size;
+
+	if (extraSize > 0)
+	{
+		MemoryChunk* extraChunk = CreateChunkNode();
+		extraChunk->mOffset = chunk->mOffset + size;
+		extraChunk->mSize = extraSize;
+		extraChunk->mPrevPhysical = chunk;
+		extraChunk->mNextPhysical = chunk->mNextPhysical;
+
+		if (chunk->mNextPhysical != nullptr)
+		{
+			chunk->mNextPhysical->mPrevPhysical = extraChunk;
+		}
+
+		chunk->mNextPhysical = extraChunk;
+		chunk->mSize = size;
+
+		InsertFreeChunk(extraChunk);
+	}
+
+	chunk->mFree = false;
+	chunk->mID = sNumChunksAllocated++;
+
+	assert(chunk->mID >= 0); // Did we overflow int64_t?
+
+	mAvailableMemory -= chunk->mSize;
+
+	return chunk;
+}
+
+void MemoryBlock::FreeChunk(MemoryChunk* chunk)
+{
+	assert(chunk != nullptr);
+	assert(!chunk->mFree);
+	mAvailableMemory += chunk->mSize;
+
+	chunk->mFree = true;
+	chunk->mID = -1;
+	chunk->mOwner = nullptr;
+	chunk->mResource = nullptr;
+
+	// Merge with the next chunk if it is free.
+	MemoryChunk* next = chunk->mNextPhysical;
+	if (next != nullptr &&
+		next->mFree)
+	{
+		RemoveFreeChunk(next);
+
+		chunk->mSize += next->mSize;
+		chunk->mNextPhysical = next->mNextPhysical;
+
+		if (next->mNextPhysical != nullptr)
+		{
+			next->mNextPhysical->mPrevPhysical = chunk;
+		}
+
+		ReleaseChunkNode(next);
+	}
+
+	// Merge with the previous chunk if it is free.
+	MemoryChunk* prev = chunk->mPrevPhysical;
+	if (prev != nullptr &&
+		prev->mFree)
+	{
+		RemoveFreeChunk(prev);
+
+		prev->mSize += chunk->mSize;
+		prev->mNextPhysical = chunk->mNextPhysical;
+
+		if (chunk->mNextPhysical != nullptr)
+		{
+			chunk->mNextPhysical->mPrevPhysical = prev;
+		}
+
+		ReleaseChunkNode(chunk);
+		chunk = prev;
+	}
+
+	InsertFreeChunk(chunk);
+}
+
+bool MemoryBlock::IsEmpty() const
+{
+	return mAvailableMemory == mSize;
+}
+
+MemoryChunk* MemoryBlock::GetFirstChunk() const
+{
+	return mFirstChunk;
+}
+
+void MemoryBlock::CalculateStats(MemoryStats& outStats) const
+{
+	outStats = MemoryStats();
+	outStats.mNumBlocks = 1;
+	outStats.mReservedBytes = mSize;
+	outStats.mUsedBytes = mSize - mAvailableMemory;
+	outStats.mFreeBytes = mAvailableMemory;
+
+	for (MemoryChunk* chunk = mFirstChunk; chunk != nullptr; chunk = chunk->mNextPhysical)
+	{
+		if (chunk->mFree)
+		{
+			outStats.mNumFreeChunks++;
+
+			if (chunk->mSize > outStats.mLargestFreeChunk)
+			{
+				outStats.mLargestFreeChunk = chunk->mSize;
+			}
+		}
+		else
+		{
+			outStats.mNumAllocations++;
+		}
+	}
+}
+
+void MemoryStats::Add(const MemoryStats& other)
+{
+	mNumBlocks += other.mNumBlocks;
+	mNumAllocations += other.mNumAllocations;
+	mNumFreeChunks += other.mNumFreeChunks;
+	mReservedBytes += other.mReservedBytes;
+	mUsedBytes += other.mUsedBytes;
+	mFreeBytes += other.mFreeBytes;
+
+	if (other.mLargestFreeChunk > mLargestFreeChunk)
+	{
+		mLargestFreeChunk = other.mLargestFreeChunk;
+	}
+}
+
+float MemoryStats::GetFragmentation() const
+{
+	if (mFreeBytes == 0)
+	{
+		return 0.0f;
+	}
+
+	return 1.0f - static_cast<float>(static_cast<double>(mLargestFreeChunk) / static_cast<double>(mFreeBytes));
+}
+
+void MemoryBlock::MapInsert(uint64_t size, uint32_t& fl, uint32_t& sl)
+{
+	if (size < TLSF_SMALL_CHUNK_SIZE)
+	{
+		// Small sizes are stored linearly in the first list.
+		fl = 0;
+		sl = static_cast<uint32_t>(size / (TLSF_SMALL_CHUNK_SIZE / TLSF_SL_INDEX_COUNT));
+	}
+	else
+	{
+		uint32_t highBit = FindHighestBit(size);
+		sl = static_cast<uint32_t>(size >> (highBit - TLSF_SL_INDEX_COUNT_LOG2)) ^ TLSF_SL_INDEX_COUNT;
+		fl = highBit - (TLSF_FL_INDEX_SHIFT - 1);
+	}
+}
+
+bool MemoryBlock::MapSearch(uint64_t size, uint32_t& fl, uint32_t& sl)
+{
+	// Round up to the next list boundary so that any chunk found in
+	// the resulting list is guaranteed to be large enough.
+	if (size < TLSF_SMALL_CHUNK_SIZE)
+	{
+		uint64_t granularity = TLSF_SMALL_CHUNK_SIZE / TLSF_SL_INDEX_COUNT;
+		size = (size + granularity - 1) & ~(granularity - 1);
+	}
+	else
+	{
+		uint64_t round = (1ULL << (FindHighestBit(size) - TLSF_SL_INDEX_COUNT_LOG2)) - 1;
+
+		if (size > UINT64_MAX - round)
+		{
+			return false;
+		}
+
+		size += round;
+	}
+
+	MapInsert(size, fl, sl);
+
+	return fl < TLSF_FL_INDEX_COUNT;
+}
+
+MemoryChunk* MemoryBlock::FindFreeChunk(uint32_t& fl, uint32_t& sl)
+{
+	// First look for a list in the same first level range.
+	uint32_t slMap = mSlBitmap[fl] & (~0U << sl);
+
+	if (slMap == 0)
+	{
+		// Nothing available, move on to the next non-empty first level range.
+		uint64_t flMap = (fl + 1 < 64) ? (mFlBitmap & (~0ULL << (fl + 1))) : 0;
+
+		if (flMap == 0)
+		{
+			return nullptr;
+		}
+
+		fl = FindLowestBit(flMap);
+		slMap = mSlBitmap[fl];
+		assert(slMap != 0);
+	}
+
+	sl = FindLowestBit(slMap);
+
+	return mFreeLists[fl][sl];
+}
+
+MemoryChunk* MemoryBlock::FindAlignedChunk(uint64_t size, uint64_t alignment)
+{
+	uint32_t fl = 0;
+	uint32_t sl = 0;
+
+	// The head of the list that fits size is usually good enough, either because it is
+	// already aligned or because it is big enough to absorb the padding.
+	if (MapSearch(size, fl, sl))
+	{
+		MemoryChunk* chunk = FindFreeChunk(fl, sl);
+
+		if (chunk != nullptr)
+		{
+			uint64_t alignedOffset = ((chunk->mOffset + alignment - 1) / alignment) * alignment;
+
+			if (alignedOffset + size <= chunk->mOffset + chunk->mSize)
+			{
+				RemoveFreeChunk(chunk, fl, sl);
+				return chunk;
+			}
+		}
+	}
+
+	// Otherwise search for a chunk that fits even with the worst case padding.
+	if (alignment > 1 &&
+		size <= UINT64_MAX - (alignment - 1) &&
+		MapSearch(size + alignment - 1, fl, sl))
+	{
+		MemoryChunk* chunk = FindFreeChunk(fl, sl);
+
+		if (chunk != nullptr)
+		{
+			RemoveFreeChunk(chunk, fl, sl);
+			return chunk;
+		}
+	}
+
+	return nullptr;
+}
+
+void MemoryBlock::InsertFreeChunk(MemoryChunk* chunk)
+{
+	uint32_t fl = 0;
+	uint32_t sl = 0;
+	MapInsert(chunk->mSize, fl, sl);
+
+	MemoryChunk* head = mFreeLists[fl][sl];
+
+	chunk->mFree = true;
+	chunk->mPrevFree = nullptr;
+	chunk->mNextFree = head;
+
+	if (head != nullptr)
+	{
+		head->mPrevFree = chunk;
+	}
+
+	mFreeLists[fl][sl] = chunk;
+	mFlBitmap |= (1ULL << fl);
+	mSlBitmap[fl] |= (1U << sl);
+}
+
+void MemoryBlock::RemoveFreeChunk(MemoryChunk* chunk)
+{
+	uint32_t fl = 0;
+	uint32_t sl = 0;
+	MapInsert(chunk->mSize, fl, sl);
+
+	RemoveFreeChunk(chunk, fl, sl);
+}
+
+void MemoryBlock::RemoveFreeChunk(MemoryChunk* chunk, uint32_t fl, uint32_t sl)
+{
+	MemoryChunk* prev = chunk->mPrevFree;
+	MemoryChunk* next = chunk->mNextFree;
+
+	if (prev != nullptr)
+	{
+		prev->mNextFree = next;
+	}
+
+	if (next != nullptr)
+	{
+		next->mPrevFree = prev;
+	}
+
+	if (mFreeLists[fl][sl] == chunk)
+	{
+		mFreeLists[fl][sl] = next;
+
+		if (next == nullptr)
+		{
+			mSlBitmap[fl] &= ~(1U << sl);
+
+			if (mSlBitmap[fl] == 0)
+			{
+				mFlBitmap &= ~(1ULL << fl);
+			}
+		}
+	}
+
+	chunk->mPrevFree = nullptr;
+	chunk->mNextFree = nullptr;
+}
+
+MemoryChunk* MemoryBlock::CreateChunkNode()
+{
+	MemoryChunk* chunk = mUnusedChunks;
+
+	if (chunk != nullptr)
+	{
+		mUnusedChunks = chunk->mNextFree;
+		*chunk = MemoryChunk();
+	}
+	else
+	{
+		chunk = new MemoryChunk();
+	}
+
+	return chunk;
+}
+
+void MemoryBlock::ReleaseChunkNode(MemoryChunk* chunk)
+{
+	// Keep retired nodes around so that splitting doesn't hit the heap.
+	*chunk = MemoryChunk();
+	chunk->mNextFree = mUnusedChunks;
+	mUnusedChunks = chunk;
+}
+
+void Allocator::Initialize(bool dedicatedAllocationEnabled, bool memoryBudgetEnabled)
+{
+	Renderer* renderer = Renderer::Get();
+
+	vkGetPhysicalDeviceMemoryProperties(renderer->GetPhysicalDevice(), &sMemoryProperties);
+
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(renderer->GetPhysicalDevice(), &deviceProperties);
+	sBufferImageGranularity = deviceProperties.limits.bufferImageGranularity;
+	sNonCoherentAtomSize = deviceProperties.limits.nonCoherentAtomSize;
+
+	// Offsets into the arena buffers must satisfy the rules for how the ranges are bound.
+	// Geometry covers both index types and keeps vertex fetches aligned.
+	const VkPhysicalDeviceLimits& limits = deviceProperties.limits;
+	sArenaAlignments[static_cast<uint32_t>(BufferArena::Geometry)] = 16;
+	sArenaAlignments[static_cast<uint32_t>(BufferArena::Uniform)] = limits.minUniformBufferOffsetAlignment;
+	sArenaAlignments[static_cast<uint32_t>(BufferArena::Storage)] = limits.minStorageBufferOffsetAlignment;
+	sArenaAlignments[static_cast<uint32_t>(BufferArena::Staging)] = (limits.optimalBufferCopyOffsetAlignment > 16) ? limits.optimalBufferCopyOffsetAlignment : 16;
+
+	// The memory types a buffer can live in only depend on its usage and flags, not its size,
+	// so a small probe buffer per arena tells which memory types its blocks can use.
+	for (uint32_t i = 0; i < static_cast<uint32_t>(BufferArena::Num); ++i)
+	{
+		sArenaAlignments[i] = (sArenaAlignments[i] > 0) ? sArenaAlignments[i] : 1;
+
+		VkBufferCreateInfo ciBuffer = {};
+		ciBuffer.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		ciBuffer.size = 1024;
+		ciBuffer.usage = GetArenaUsage(static_cast<BufferArena>(i));
+		ciBuffer.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+		VkBuffer probeBuffer = VK_NULL_HANDLE;
+
+		if (vkCreateBuffer(renderer->GetDevice(), &ciBuffer, nullptr, &probeBuffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create buffer arena probe");
+		}
+
+		VkMemoryRequirements memRequirements;
+		vkGetBufferMemoryRequirements(renderer->GetDevice(), probeBuffer, &memRequirements);
+		sArenaMemoryTypeBits[i] = memRequirements.memoryTypeBits;
+
+		vkDestroyBuffer(renderer->GetDevice(), probeBuffer, nullptr);
+	}
+
+	for (uint32_t i = 0; i < sMemoryProperties.memoryTypeCount; ++i)
+	{
+		// Big heaps get bigger blocks so they need fewer vkAllocateMemory calls,
+		// but a block should never take a large share of a small heap.
+		uint64_t heapSize = sMemoryProperties.memoryHeaps[sMemoryProperties.memoryTypes[i].heapIndex].size;
+		uint64_t blockSize = heapSize / ALLOCATOR_HEAP_BLOCK_DIVISOR;
+		blockSize = (blockSize != 0) ? (1ULL << FindHighestBit(blockSize)) : ALLOCATOR_MIN_BLOCK_SIZE;
+		blockSize = (blockSize < ALLOCATOR_MIN_BLOCK_SIZE) ? ALLOCATOR_MIN_BLOCK_SIZE : blockSize;
+		blockSize = (blockSize > ALLOCATOR_MAX_BLOCK_SIZE) ? ALLOCATOR_MAX_BLOCK_SIZE : blockSize;
+
+		uint64_t heapLimit = heapSize / 8;
+		heapLimit = (heapLimit < ALLOCATOR_SMALL_BLOCK_SIZE) ? ALLOCATOR_SMALL_BLOCK_SIZE : heapLimit;
+		blockSize = (blockSize > heapLimit) ? heapLimit : blockSize;
+
+		sBlockSizes[i] = blockSize;
+	}
+
+	sDeviceLocalHeap = 0;
+
+	for (uint32_t i = 0; i < sMemoryProperties.memoryHeapCount; ++i)
+	{
+		const VkMemoryHeap& heap = sMemoryProperties.memoryHeaps[i];
+		const VkMemoryHeap& current = sMemoryProperties.memoryHeaps[sDeviceLocalHeap];
+
+		if ((heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) &&
+			(!(current.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) || heap.size > current.size))
+		{
+			sDeviceLocalHeap = i;
+		}
+	}
+
+	// The budget is queried through an instance level function, which the renderer only
+	// enables alongside the device extension.
+	sGetPhysicalDeviceMemoryProperties2 = nullptr;
+
+	if (memoryBudgetEnabled)
+	{
+		sGetPhysicalDeviceMemoryProperties2 = (PFN_vkGetPhysicalDeviceMemoryProperties2KHR)vkGetInstanceProcAddr(renderer->GetInstance(), "vkGetPhysicalDeviceMemoryProperties2KHR");
+	}
+
+	LogDebug("Allocator: memory budget %s", (sGetPhysicalDeviceMemoryProperties2 != nullptr) ? "enabled" : "estimated from heap sizes");
+
+	sDedicatedAllocationEnabled = false;
+
+	if (dedicatedAllocationEnabled)
+	{
+		VkDevice device = renderer->GetDevice();
+		sGetImageMemoryRequirements2 = (PFN_vkGetImageMemoryRequirements2KHR)vkGetDeviceProcAddr(device, "vkGetImageMemoryRequirements2KHR");
+		sDedicatedAllocationEnabled = (sGetImageMemoryRequirements2 != nullptr);
+	}
+
+	LogDebug("Allocator: dedicated allocations %s", sDedicatedAllocationEnabled ? "enabled" : "disabled");
+}
+
+void Allocator::Alloc(uint64_t size, uint64_t alignment, uint32_t memoryType, Allocation& outAllocation, AllocationCategory category, bool linear)
+{
+	AllocFromBlocks(size, alignment, memoryType, category, linear, BufferArena::Num, outAllocation);
+}
+
+void Allocator::AllocBufferRange(VkDeviceSize size, BufferArena arena, VkMemoryPropertyFlags properties, Allocation& outAllocation)
+{
+	assert(arena != BufferArena::Num);
+
+	uint32_t arenaIndex = static_cast<uint32_t>(arena);
+	uint32_t memoryType = Renderer::Get()->FindMemoryType(sArenaMemoryTypeBits[arenaIndex], properties);
+
+	AllocationCategory category = AllocationCategory::Other;
+
+	switch (arena)
+	{
+	case BufferArena::Geometry: category = AllocationCategory::Mesh; break;
+	case BufferArena::Uniform: category = AllocationCategory::Uniform; break;
+	case BufferArena::Staging: category = AllocationCategory::Staging; break;
+	default: break;
+	}
+
+	AllocFromBlocks(size, sArenaAlignments[arenaIndex], memoryType, category, true, arena, outAllocation);
+}
+
+void Allocator::AllocFromBlocks(uint64_t size, uint64_t alignment, uint32_t memoryType, AllocationCategory category, bool linear, BufferArena arena, Allocation& outAllocation)
+{
+	alignment = (alignment > 0) ? alignment : 1;
+
+	// Don't let big resources claim most of a block that could never be shared.
+	if (size + alignment >= GetBlockSize(memoryType) / 2)
+	{
+		AllocDedicated(size, alignment, memoryType, VK_NULL_HANDLE, VK_NULL_HANDLE, outAllocation, category, arena);
+		return;
+	}
+
+	MemoryBlockType blockType = (size <= ALLOCATOR_SMALL_ALLOCATION_SIZE) ? MemoryBlockType::Small : MemoryBlockType::Large;
+	MemoryBlock* block = nullptr;
+
+	std::unique_lock<std::mutex> lock(sMutexes[memoryType]);
+	MemoryChunk* chunk = AllocateChunk(size, alignment, memoryType, blockType, linear, arena, nullptr, block);
+
+	if (chunk == nullptr)
+	{
+		// vkAllocateMemory is by far the slowest part, don't stall other threads on it.
+		// Two threads may both create a block here, the spare one is simply used later.
+		lock.unlock();
+
+		uint64_t newBlockSize = (blockType == MemoryBlockType::Small) ? ALLOCATOR_SMALL_BLOCK_SIZE : GetBlockSize(memoryType);
+		block = AllocateBlock(newBlockSize, memoryType, blockType, arena);
+
+		// Close to the limit of the heap a smaller block may still fit.
+		while (block == nullptr &&
+			newBlockSize / 2 >= size + alignment)
+		{
+			newBlockSize /= 2;
+			block = AllocateBlock(newBlockSize, memoryType, blockType, arena);
+		}
+
+		if (block == nullptr)
+		{
+			throw std::runtime_error("Out of device memory");
+		}
+
+		block->mLinear = linear;
+
+		lock.lock();
+		AddBlock(block);
+
+		chunk = block->AllocateChunk(size, alignment);
+	}
+
+	assert(chunk);
+
+	InitializeAllocation(block, chunk, size, alignment, category, outAllocation);
+	lock.unlock();
+
+	TrackAllocation(outAllocation);
+
+	LogDebug("ALLOC: NumAllocations = %llu, NumAllocatedBytes = %llu", static_cast<unsigned long long>(GetNumAllocations()), static_cast<unsigned long long>(GetNumAllocatedBytes()));
+}
+
+void Allocator::AllocImage(VkImage image, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, Allocation& outAllocation)
+{
+	Renderer* renderer = Renderer::Get();
+	VkMemoryRequirements memRequirements;
+	bool dedicated = false;
+
+	if (sDedicatedAllocationEnabled)
+	{
+		VkImageMemoryRequirementsInfo2KHR requirementsInfo = {};
+		requirementsInfo.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2_KHR;
+		requirementsInfo.image = image;
+
+		VkMemoryDedicatedRequirementsKHR dedicatedRequirements = {};
+		dedicatedRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS_KHR;
+
+		VkMemoryRequirements2KHR requirements = {};
+		requirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2_KHR;
+		requirements.pNext = &dedicatedRequirements;
+
+		sGetImageMemoryRequirements2(renderer->GetDevice(), &requirementsInfo, &requirements);
+
+		memRequirements = requirements.memoryRequirements;
+		dedicated = dedicatedRequirements.requiresDedicatedAllocation || dedicatedRequirements.prefersDedicatedAllocation;
+	}
+	else
+	{
+		vkGetImageMemoryRequirements(renderer->GetDevice(), image, &memRequirements);
+	}
+
+	uint32_t memoryType = renderer->FindMemoryType(memRequirements.memoryTypeBits, properties);
+
+	// Render targets are recreated on resize as a whole, so keep them out of the shared blocks.
+	bool renderTarget = (usage & (VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT)) != 0;
+	dedicated = dedicated || (renderTarget && memRequirements.size >= ALLOCATOR_DEDICATED_RENDER_TARGET_SIZE);
+	dedicated = dedicated || (memRequirements.size + memRequirements.alignment >= GetBlockSize(memoryType) / 2);
+
+	AllocationCategory category = renderTarget ? AllocationCategory::RenderTarget : AllocationCategory::Texture;
+
+	if (dedicated)
+	{
+		AllocDedicated(memRequirements.size, memRequirements.alignment, memoryType, image, VK_NULL_HANDLE, outAllocation, category);
+	}
+	else
+	{
+		Alloc(memRequirements.size, memRequirements.alignment, memoryType, outAllocation, category, false);
+	}
+}
+
+void Allocator::AllocDedicated(uint64_t size, uint64_t alignment, uint32_t memoryType, VkImage image, VkBuffer buffer, Allocation& outAllocation, AllocationCategory category, BufferArena arena)
+{
+	// A dedicated block holds exactly one allocation at offset 0, which satisfies any alignment.
+	MemoryBlock* block = AllocateBlock(size, memoryType, MemoryBlockType::Dedicated, arena, image, buffer);
+
+	if (block == nullptr)
+	{
+		throw std::runtime_error("Out of device memory");
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(sMutexes[memoryType]);
+		AddBlock(block);
+
+		MemoryChunk* chunk = block->AllocateChunk(size);
+		assert(chunk);
+
+		InitializeAllocation(block, chunk, size, alignment, category, outAllocation);
+	}
+
+	TrackAllocation(outAllocation);
+
+	LogDebug("ALLOC DEDICATED: Size = %llu, NumAllocations = %llu, NumAllocatedBytes = %llu", static_cast<unsigned long long>(size), static_cast<unsigned long long>(GetNumAllocations()), static_cast<unsigned long long>(GetNumAllocatedBytes()));
+}
+
+void Allocator::Free(Allocation& allocation)
+{
+	UntrackAllocation(allocation);
+
+	LogDebug("FREE: NumAllocations = %llu, NumAllocatedBytes = %llu", static_cast<unsigned long long>(GetNumAllocations()), static_cast<unsigned long long>(GetNumAllocatedBytes()));
+
+	MemoryBlock* block = allocation.mBlock;
+	assert(block != nullptr);
+	assert(block->mDeviceMemory == allocation.mDeviceMemory);
+
+	bool empty = false;
+
+	{
+		std::lock_guard<std::mutex> lock(sMutexes[block->mMemoryType]);
+		assert(allocation.mChunk->mID == allocation.mID);
+
+		block->FreeChunk(allocation.mChunk);
+
+		// If the block is entirely free, deallocate the memory. Once it is out of
+		// the list no other thread can allocate from it.
+		empty = block->IsEmpty();
+
+		if (empty)
+		{
+			RemoveBlock(block);
+		}
+	}
+
+	if (empty)
+	{
+		FreeBlock(block);
+	}
+
+	allocation.mDeviceMemory = VK_NULL_HANDLE;
+	allocation.mID = -1;
+	allocation.mOffset = 0;
+	allocation.mAlignment = 1;
+	allocation.mCategory = AllocationCategory::Other;
+	allocation.mSize = 0;
+	allocation.mType = 0;
+	allocation.mMappedPtr = nullptr;
+	allocation.mBuffer = VK_NULL_HANDLE;
+	allocation.mBlock = nullptr;
+	allocation.mChunk = nullptr;
+}
+
+void Allocator::FlushMappedRange(const Allocation& allocation, VkDeviceSize offset, VkDeviceSize size)
 {
-	MemoryChunk* chunk = nullptr;
+	MemoryBlock* block = allocation.mBlock;
+	assert(block != nullptr);
+	assert(block->mMappedPtr != nullptr);
 
-	for (int32_t j = 0; j < mChunks.size(); ++j)
+	if (block->mCoherent)
 	{
-		if (mChunks[j].mFree &&
-			mChunks[j].mSize >= size)
-		{
-			// We found a chunk that is big enough, now let's split the chunk into two.
-			uint64_t extraSize = mChunks[j].mSize - size;
+		return;
+	}
 
-			if (extraSize > 0)
-			{
-				mChunks[j].mSize = size;
-				
-				MemoryChunk extraChunk;
-				extraChunk.mFree = true;
-				extraChunk.mOffset = mChunks[j].mOffset + mChunks[j].mSize;
-				extraChunk.mSize = extraSize;
-				extraChunk.mID = -1;
-
-				mChunks.insert(mChunks.begin() + j + 1, extraChunk);
-			}
+	if (size == VK_WHOLE_SIZE)
+	{
+		size = allocation.mSize - offset;
+	}
 
-			mChunks[j].mFree = false;
-			mChunks[j].mID = sNumChunksAllocated++;
+	if (size == 0)
+	{
+		return;
+	}
 
-			assert(mChunks[j].mID >= 0); // Did we overflow int64_t?
+	// Flushed ranges must be aligned to nonCoherentAtomSize.
+	VkDeviceSize start = allocation.mOffset + offset;
+	VkDeviceSize end = start + size;
+	start = (start / sNonCoherentAtomSize) * sNonCoherentAtomSize;
+	end = ((end + sNonCoherentAtomSize - 1) / sNonCoherentAtomSize) * sNonCoherentAtomSize;
 
-			// make sure we grab the pointer after inserting the new chunk (as it may reallocate the data).
-			chunk = &mChunks[j];
-			break;
-		}
+	if (end > block->mSize)
+	{
+		end = block->mSize;
 	}
 
-	return chunk;
+	VkMappedMemoryRange range = {};
+	range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+	range.memory = block->mDeviceMemory;
+	range.offset = start;
+	range.size = end - start;
+
+	vkFlushMappedMemoryRanges(Renderer::Get()->GetDevice(), 1, &range);
 }
 
-bool MemoryBlock::FreeChunk(int64_t id)
+void Allocator::SetRelocatable(Allocation& allocation, RelocatableResource* resource)
 {
-	bool bFreed = false;
+	assert(allocation.mChunk != nullptr);
+	assert(allocation.mChunk->mID == allocation.mID);
 
-	for (int32_t j = 0; j < mChunks.size(); ++j)
+	// Dedicated memory belongs to one resource and is never shared, so there is nothing to compact.
+	// Mapped blocks are never compacted either. On UMA devices and software drivers the device
+	// local type is often host visible too, so textures and meshes can land in them.
+	if (allocation.mBlock->mBlockType == MemoryBlockType::Dedicated ||
+		allocation.mBlock->mMappedPtr != nullptr)
 	{
-		if (mChunks[j].mID == id)
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(sMutexes[allocation.mType]);
+	allocation.mChunk->mOwner = (resource != nullptr) ? &allocation : nullptr;
+	allocation.mChunk->mResource = resource;
+}
+
+uint32_t Allocator::Defragment(uint64_t maxBytes, std::vector<RelocatableResource*>& outMoved)
+{
+	struct Relocation
+	{
+		Allocation* mOwner;
+		RelocatableResource* mResource;
+		Allocation mNewAllocation;
+	};
+
+	std::vector<Relocation> relocations;
+	uint64_t bytesMoved = 0;
+
+	// Reserve the destinations under the shard lock. The copies are recorded after it is released
+	// so that no thread ever waits on the submission lock while holding an allocator lock.
+	for (uint32_t memoryType = 0; memoryType < sMemoryProperties.memoryTypeCount && relocations.empty(); ++memoryType)
+	{
+		std::lock_guard<std::mutex> lock(sMutexes[memoryType]);
+
+		MemoryBlock* srcBlock = FindDefragmentationSource(memoryType);
+
+		if (srcBlock == nullptr)
+		{
+			continue;
+		}
+
+		for (MemoryChunk* chunk = srcBlock->GetFirstChunk(); chunk != nullptr; chunk = chunk->mNextPhysical)
 		{
-			bFreed = true;
+			if (chunk->mFree)
+			{
+				continue;
+			}
 
-			// Mark this chunk as freed
-			mChunks[j].mFree = true;
-			
-			// See if we can merge this chunk
-			// First try merging it with the next chunk in the list
-			if (j < mChunks.size() - 1 &&
-				mChunks[j + 1].mFree)
+			const Allocation& oldAllocation = *chunk->mOwner;
+
+			// Always move at least one allocation so large resources still make progress.
+			if (bytesMoved > 0 &&
+				bytesMoved + oldAllocation.mSize > maxBytes)
 			{
-				mChunks[j].mSize += mChunks[j + 1].mSize;
-				mChunks.erase(mChunks.begin() + j + 1);
+				break;
 			}
 
-			// Now try merging with the previous chunk
-			if (j > 0 &&
-				mChunks[j - 1].mFree)
+			// Only move into existing blocks, allocating a new block would defeat the purpose.
+			MemoryBlock* dstBlock = nullptr;
+			MemoryChunk* dstChunk = AllocateChunk(oldAllocation.mSize, oldAllocation.mAlignment, srcBlock->mMemoryType, srcBlock->mBlockType, srcBlock->mLinear, srcBlock->mArena, srcBlock, dstBlock);
+
+			if (dstChunk == nullptr)
 			{
-				mChunks[j - 1].mSize += mChunks[j].mSize;
-				mChunks.erase(mChunks.begin() + j);
+				break;
 			}
+
+			Relocation relocation;
+			relocation.mOwner = chunk->mOwner;
+			relocation.mResource = chunk->mResource;
+			InitializeAllocation(dstBlock, dstChunk, oldAllocation.mSize, oldAllocation.mAlignment, oldAllocation.mCategory, relocation.mNewAllocation);
+			relocations.push_back(relocation);
+
+			bytesMoved += oldAllocation.mSize;
 		}
 	}
 
-	return bFreed;
+	if (relocations.empty())
+	{
+		return 0;
+	}
+
+	// Frames in flight may still be reading the sources. The copies go to the same queue after
+	// them, and the barriers they are recorded with wait for earlier work, so the CPU doesn't.
+	Renderer* renderer = Renderer::Get();
+	VkCommandBuffer commandBuffer = renderer->BeginSingleSubmissionCommands();
+
+	for (Relocation& relocation : relocations)
+	{
+		TrackAllocation(relocation.mNewAllocation);
+		relocation.mResource->RecordRelocation(commandBuffer, *relocation.mOwner, relocation.mNewAllocation);
+	}
+
+	// Make the copies visible to the frames that read from the new locations.
+	VkMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+
+	vkCmdPipelineBarrier(commandBuffer,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+		0,
+		1,
+		&barrier,
+		0,
+		nullptr,
+		0,
+		nullptr);
+
+	renderer->EndSingleSubmissionCommands(commandBuffer, false);
+
+	for (Relocation& relocation : relocations)
+	{
+		Allocation oldAllocation = *relocation.mOwner;
+		*relocation.mOwner = relocation.mNewAllocation;
+		SetRelocatable(*relocation.mOwner, relocation.mResource);
+
+		relocation.mResource->FinishRelocation(*relocation.mOwner);
+		outMoved.push_back(relocation.mResource);
+
+		// The copy and frames in flight still read the old memory, so it is freed once the
+		// frame being prepared has completed. The source block is released with its last allocation.
+		renderer->GetDestructionQueue().FreeAllocation(oldAllocation);
+	}
+
+	LogDebug("DEFRAG: Moved %u allocations (%llu bytes), NumBlocks = %llu", static_cast<uint32_t>(relocations.size()), static_cast<unsigned long long>(bytesMoved), static_cast<unsigned long long>(GetNumBlocksAllocated()));
+
+	return static_cast<uint32_t>(relocations.size());
 }
 
-void Allocator::Alloc(uint64_t size, uint64_t alignment, uint32_t memoryType, Allocation& outAllocation)
+uint64_t Allocator::GetNumBlocksAllocated()
 {
-	MemoryBlock* block = nullptr;
-	MemoryChunk* chunk = nullptr;
+	return sNumBlocks;
+}
+
+uint64_t Allocator::GetNumAllocations()
+{
+	return sNumAllocations;
+}
+
+uint64_t Allocator::GetNumAllocatedBytes()
+{
+	return sNumAllocatedBytes;
+}
+
+uint64_t Allocator::GetBlockSize(uint32_t memoryType)
+{
+	assert(memoryType < VK_MAX_MEMORY_TYPES);
+	assert(sBlockSizes[memoryType] != 0); // Was Initialize() called?
+	return sBlockSizes[memoryType];
+}
+
+void Allocator::GetHeapBudget(uint32_t heapIndex, HeapBudget& outBudget)
+{
+	assert(heapIndex < sMemoryProperties.memoryHeapCount);
+
+	const VkMemoryHeap& heap = sMemoryProperties.memoryHeaps[heapIndex];
+
+	outBudget.mBlockBytes = sHeapBlockBytes[heapIndex];
+	outBudget.mAllocatedBytes = sHeapAllocatedBytes[heapIndex];
+	outBudget.mPendingFreeBytes = Renderer::Get()->GetDestructionQueue().GetPendingFreeBytes(heapIndex);
+
+	if (sGetPhysicalDeviceMemoryProperties2 != nullptr)
+	{
+		VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties = {};
+		budgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+		VkPhysicalDeviceMemoryProperties2KHR memoryProperties = {};
+		memoryProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2_KHR;
+		memoryProperties.pNext = &budgetProperties;
+
+		sGetPhysicalDeviceMemoryProperties2(Renderer::Get()->GetPhysicalDevice(), &memoryProperties);
+
+		outBudget.mBudget = static_cast<uint64_t>(budgetProperties.heapBudget[heapIndex] * ALLOCATOR_BUDGET_SCALE);
+		outBudget.mUsage = budgetProperties.heapUsage[heapIndex];
+	}
+	else
+	{
+		// Without the extension only our own blocks are known.
+		outBudget.mBudget = static_cast<uint64_t>(heap.size * ALLOCATOR_BUDGET_SCALE);
+		outBudget.mUsage = outBudget.mBlockBytes;
+	}
+
+	uint64_t limit = sBudgetLimit;
+
+	if (limit > 0 &&
+		(heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) &&
+		outBudget.mBudget > limit)
+	{
+		outBudget.mBudget = limit;
+	}
+}
+
+uint32_t Allocator::GetDeviceLocalHeap()
+{
+	return sDeviceLocalHeap;
+}
+
+uint32_t Allocator::GetHeapIndex(uint32_t memoryType)
+{
+	assert(memoryType < sMemoryProperties.memoryTypeCount);
+	return sMemoryProperties.memoryTypes[memoryType].heapIndex;
+}
+
+void Allocator::SetBudgetLimit(uint64_t limit)
+{
+	sBudgetLimit = limit;
+}
+
+void Allocator::GetStats(AllocatorStats& outStats)
+{
+	outStats = AllocatorStats();
 
-	uint64_t maxAlignSize = size + alignment;
-	for (int32_t i = 0; i < sBlocks.size(); ++i)
+	for (uint32_t memoryType = 0; memoryType < sMemoryProperties.memoryTypeCount; ++memoryType)
 	{
-		if (sBlocks[i].mMemoryType == memoryType)
+		std::lock_guard<std::mutex> lock(sMutexes[memoryType]);
+
+		for (MemoryBlock* block : sBlocks[memoryType])
 		{
-			chunk = sBlocks[i].AllocateChunk(maxAlignSize);
+			MemoryStats blockStats;
+			block->CalculateStats(blockStats);
 
-			if (chunk != nullptr)
+			outStats.mTotal.Add(blockStats);
+			outStats.mMemoryTypes[block->mMemoryType].Add(blockStats);
+			outStats.mMemoryHeaps[sMemoryProperties.memoryTypes[block->mMemoryType].heapIndex].Add(blockStats);
+			outStats.mBlockTypes[static_cast<uint32_t>(block->mBlockType)].Add(blockStats);
+		}
+	}
+
+	for (uint32_t i = 0; i < static_cast<uint32_t>(AllocationCategory::Num); ++i)
+	{
+		outStats.mCategoryBytes[i] = sCategoryBytes[i];
+		outStats.mCategoryAllocations[i] = sCategoryAllocations[i];
+	}
+}
+
+std::string Allocator::GetStatsJson(bool blocks)
+{
+	AllocatorStats stats;
+	GetStats(stats);
+
+	std::string json;
+	json.reserve(4096);
+
+	json += "{\n\t\"total\": { ";
+	AppendMemoryStatsJson(json, stats.mTotal);
+	AppendFormat(json, ", \"requestedBytes\": %llu },\n", static_cast<unsigned long long>(GetNumAllocatedBytes()));
+
+	json += "\t\"heaps\": [\n";
+	for (uint32_t i = 0; i < sMemoryProperties.memoryHeapCount; ++i)
+	{
+		HeapBudget budget;
+		GetHeapBudget(i, budget);
+
+		AppendFormat(json, "\t\t{ \"index\": %u, \"size\": %llu, \"flags\": %u, \"budget\": %llu, \"usage\": %llu, ",
+			i,
+			static_cast<unsigned long long>(sMemoryProperties.memoryHeaps[i].size),
+			sMemoryProperties.memoryHeaps[i].flags,
+			static_cast<unsigned long long>(budget.mBudget),
+			static_cast<unsigned long long>(budget.mUsage));
+		AppendMemoryStatsJson(json, stats.mMemoryHeaps[i]);
+		json += (i + 1 < sMemoryProperties.memoryHeapCount) ? " },\n" : " }\n";
+	}
+	json += "\t],\n";
+
+	json += "\t\"memoryTypes\": [\n";
+	for (uint32_t i = 0; i < sMemoryProperties.memoryTypeCount; ++i)
+	{
+		AppendFormat(json, "\t\t{ \"index\": %u, \"heap\": %u, \"flags\": %u, \"blockSize\": %llu, ",
+			i,
+			sMemoryProperties.memoryTypes[i].heapIndex,
+			sMemoryProperties.memoryTypes[i].propertyFlags,
+			static_cast<unsigned long long>(sBlockSizes[i]));
+		AppendMemoryStatsJson(json, stats.mMemoryTypes[i]);
+		json += (i + 1 < sMemoryProperties.memoryTypeCount) ? " },\n" : " }\n";
+	}
+	json += "\t],\n";
+
+	json += "\t\"blockTypes\": {\n";
+	for (uint32_t i = 0; i < static_cast<uint32_t>(MemoryBlockType::Num); ++i)
+	{
+		AppendFormat(json, "\t\t\"%s\": { ", GetBlockTypeName(static_cast<MemoryBlockType>(i)));
+		AppendMemoryStatsJson(json, stats.mBlockTypes[i]);
+		json += (i + 1 < static_cast<uint32_t>(MemoryBlockType::Num)) ? " },\n" : " }\n";
+	}
+	json += "\t},\n";
+
+	json += "\t\"categories\": {\n";
+	for (uint32_t i = 0; i < static_cast<uint32_t>(AllocationCategory::Num); ++i)
+	{
+		AppendFormat(json, "\t\t\"%s\": { \"allocations\": %u, \"bytes\": %llu }%s\n",
+			GetCategoryName(static_cast<AllocationCategory>(i)),
+			stats.mCategoryAllocations[i],
+			static_cast<unsigned long long>(stats.mCategoryBytes[i]),
+			(i + 1 < static_cast<uint32_t>(AllocationCategory::Num)) ? "," : "");
+	}
+	json += blocks ? "\t},\n" : "\t}\n";
+
+	if (blocks)
+	{
+		json += "\t\"blocks\": [";
+		bool first = true;
+		for (uint32_t memoryType = 0; memoryType < sMemoryProperties.memoryTypeCount; ++memoryType)
+		{
+			std::lock_guard<std::mutex> lock(sMutexes[memoryType]);
+
+			for (MemoryBlock* block : sBlocks[memoryType])
 			{
-				block = &sBlocks[i];
-				break;
+				MemoryStats blockStats;
+				block->CalculateStats(blockStats);
+
+				json += first ? "\n" : ",\n";
+				first = false;
+
+				AppendFormat(json, "\t\t{ \"memoryType\": %u, \"type\": \"%s\", \"arena\": \"%s\", \"linear\": %s, ",
+					block->mMemoryType,
+					GetBlockTypeName(block->mBlockType),
+					GetArenaName(block->mArena),
+					block->mLinear ? "true" : "false");
+				AppendMemoryStatsJson(json, blockStats);
+				json += " }";
 			}
 		}
+		json += "\n\t]\n";
 	}
 
-	if (chunk == nullptr)
+	json += "}\n";
+
+	return json;
+}
+
+bool Allocator::WriteStatsJson(const std::string& path, bool blocks)
+{
+	FILE* file = fopen(path.c_str(), "w");
+
+	if (file == nullptr)
+	{
+		LogError("Failed to open %s for writing allocator stats", path.c_str());
+		return false;
+	}
+
+	std::string json = GetStatsJson(blocks);
+	fwrite(json.c_str(), 1, json.size(), file);
+	fclose(file);
+
+	return true;
+}
+
+const char* Allocator::GetCategoryName(AllocationCategory category)
+{
+	switch (category)
 	{
-		uint64_t newBlockSize = maxAlignSize > sDefaultBlockSize ? maxAlignSize : sDefaultBlockSize;
-		block = AllocateBlock(newBlockSize, memoryType);
-		assert(block);
+	case AllocationCategory::Texture: return "Texture";
+	case AllocationCategory::RenderTarget: return "RenderTarget";
+	case AllocationCategory::Mesh: return "Mesh";
+	case AllocationCategory::Uniform: return "Uniform";
+	case AllocationCategory::Staging: return "Staging";
+	case AllocationCategory::Other: return "Other";
+	default: return "Unknown";
+	}
+}
 
-		chunk = block->AllocateChunk(maxAlignSize);
+const char* Allocator::GetBlockTypeName(MemoryBlockType blockType)
+{
+	switch (blockType)
+	{
+	case MemoryBlockType::Small: return "Small";
+	case MemoryBlockType::Large: return "Large";
+	case MemoryBlockType::Dedicated: return "Dedicated";
+	default: return "Unknown";
 	}
+}
 
-	assert(chunk);
+const char* Allocator::GetArenaName(BufferArena arena)
+{
+	switch (arena)
+	{
+	case BufferArena::Geometry: return "Geometry";
+	case BufferArena::Uniform: return "Uniform";
+	case BufferArena::Storage: return "Storage";
+	case BufferArena::Staging: return "Staging";
+	default: return "None";
+	}
+}
 
-	outAllocation.mDeviceMemory = block->mDeviceMemory;
-	outAllocation.mID = chunk->mID;
-	outAllocation.mOffset = ((chunk->mOffset + alignment - 1) / alignment) * alignment;
-	outAllocation.mSize = size;
-	outAllocation.mType = block->mMemoryType;
+VkBufferUsageFlags Allocator::GetArenaUsage(BufferArena arena)
+{
+	// Transfer usage lets the contents be uploaded and moved by Defragment().
+	VkBufferUsageFlags transfer = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
 
-	sNumAllocations++;
-	sNumAllocatedBytes += maxAlignSize;
+	switch (arena)
+	{
+	case BufferArena::Geometry: return transfer | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+	case BufferArena::Uniform: return transfer | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+	case BufferArena::Storage: return transfer | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+	case BufferArena::Staging: return transfer;
+	default: return 0;
+	}
+}
+
+void Allocator::TrackAllocation(const Allocation& allocation)
+{
+	uint32_t category = static_cast<uint32_t>(allocation.mCategory);
 
-	LogDebug("ALLOC: NumAllocations = %lld, NumAllocatedBytes = %lld", sNumAllocations, sNumAllocatedBytes);
+	sNumAllocations++;
+	sNumAllocatedBytes += allocation.mSize;
+	sCategoryAllocations[category]++;
+	sCategoryBytes[category] += allocation.mSize;
+	sHeapAllocatedBytes[sMemoryProperties.memoryTypes[allocation.mType].heapIndex] += allocation.mSize;
 }
 
-void Allocator::Free(Allocation& allocation)
+void Allocator::UntrackAllocation(const Allocation& allocation)
 {
+	uint32_t category = static_cast<uint32_t>(allocation.mCategory);
+
+	assert(sNumAllocations > 0);
+	assert(sNumAllocatedBytes >= allocation.mSize);
+	assert(sCategoryAllocations[category] > 0);
+
 	sNumAllocations--;
 	sNumAllocatedBytes -= allocation.mSize;
+	sCategoryAllocations[category]--;
+	sCategoryBytes[category] -= allocation.mSize;
+	sHeapAllocatedBytes[sMemoryProperties.memoryTypes[allocation.mType].heapIndex] -= allocation.mSize;
+}
+
+bool Allocator::IsCompatibleBlock(const MemoryBlock* block, uint32_t memoryType, MemoryBlockType blockType, bool linear, BufferArena arena)
+{
+	// With a granularity above 1, a buffer and an optimal image sharing a "page" of that size
+	// may alias. Keeping them in separate blocks is simpler than padding every neighbour.
+	return block->mMemoryType == memoryType &&
+		block->mBlockType == blockType &&
+		block->mArena == arena &&
+		(sBufferImageGranularity <= 1 || block->mLinear == linear);
+}
+
+MemoryChunk* Allocator::AllocateChunk(uint64_t size, uint64_t alignment, uint32_t memoryType, MemoryBlockType blockType, bool linear, BufferArena arena, MemoryBlock* excludeBlock, MemoryBlock*& outBlock)
+{
+	assert(blockType != MemoryBlockType::Dedicated);
 
-	LogDebug("FREE: NumAllocations = %lld, NumAllocatedBytes = %lld", sNumAllocations, sNumAllocatedBytes);
+	std::vector<MemoryBlock*>& blocks = sBlocks[memoryType];
 
-	bool bFreed = false;
-	for (int32_t i = 0; i < sBlocks.size(); ++i)
+	for (size_t i = 0; i < blocks.size(); ++i)
 	{
-		if (sBlocks[i].mMemoryType == allocation.mType)
+		if (blocks[i] != excludeBlock &&
+			IsCompatibleBlock(blocks[i], memoryType, blockType, linear, arena))
 		{
-			bFreed = sBlocks[i].FreeChunk(allocation.mID);
+			MemoryChunk* chunk = blocks[i]->AllocateChunk(size, alignment);
 
-			if (bFreed)
+			if (chunk != nullptr)
 			{
-				// If the block is entirely free, deallocate the memory.
-				if (sBlocks[i].mChunks.size() == 1)
-				{
-					assert(sBlocks[i].mChunks[0].mFree);
-					FreeBlock(sBlocks[i]);
-				}
-				break;
+				outBlock = blocks[i];
+				return chunk;
 			}
 		}
 	}
 
-	assert(bFreed);
-
-	allocation.mDeviceMemory = VK_NULL_HANDLE;
-	allocation.mID = -1;
-	allocation.mOffset = 0;
-	allocation.mSize = 0;
-	allocation.mType = 0;
+	return nullptr;
 }
 
-uint64_t Allocator::GetNumBlocksAllocated()
+void Allocator::InitializeAllocation(MemoryBlock* block, MemoryChunk* chunk, uint64_t size, uint64_t alignment, AllocationCategory category, Allocation& outAllocation)
 {
-	return static_cast<uint64_t>(sBlocks.size());
+	outAllocation.mDeviceMemory = block->mDeviceMemory;
+	outAllocation.mID = chunk->mID;
+	assert(chunk->mOffset % alignment == 0);
+	outAllocation.mOffset = chunk->mOffset;
+	outAllocation.mAlignment = alignment;
+	outAllocation.mCategory = category;
+	outAllocation.mSize = size;
+	outAllocation.mType = block->mMemoryType;
+	outAllocation.mMappedPtr = (block->mMappedPtr != nullptr) ? reinterpret_cast<uint8_t*>(block->mMappedPtr) + outAllocation.mOffset : nullptr;
+	outAllocation.mBuffer = block->mBuffer;
+	outAllocation.mBlock = block;
+	outAllocation.mChunk = chunk;
 }
 
-uint64_t Allocator::GetNumAllocations()
+MemoryBlock* Allocator::FindDefragmentationSource(uint32_t memoryType)
 {
-	return sNumAllocations;
-}
+	// Pick the least used device local block whose contents can all be moved
+	// and fit in the free space of the other blocks of the same memory type.
+	MemoryBlock* source = nullptr;
+	uint64_t sourceUsed = UINT64_MAX;
 
-uint64_t Allocator::GetNumAllocatedBytes()
-{
-	return sNumAllocatedBytes;
+	for (MemoryBlock* block : sBlocks[memoryType])
+	{
+		uint64_t used = block->mSize - block->mAvailableMemory;
+
+		if (block->mMappedPtr != nullptr ||
+			block->mBlockType == MemoryBlockType::Dedicated ||
+			used == 0 ||
+			used >= sourceUsed)
+		{
+			continue;
+		}
+
+		uint64_t otherAvailable = 0;
+		for (MemoryBlock* other : sBlocks[memoryType])
+		{
+			if (other != block &&
+				IsCompatibleBlock(other, block->mMemoryType, block->mBlockType, block->mLinear, block->mArena))
+			{
+				otherAvailable += other->mAvailableMemory;
+			}
+		}
+
+		if (otherAvailable < used)
+		{
+			continue;
+		}
+
+		bool movable = true;
+		for (MemoryChunk* chunk = block->GetFirstChunk(); chunk != nullptr; chunk = chunk->mNextPhysical)
+		{
+			if (!chunk->mFree &&
+				chunk->mResource == nullptr)
+			{
+				movable = false;
+				break;
+			}
+		}
+
+		if (movable)
+		{
+			source = block;
+			sourceUsed = used;
+		}
+	}
+
+	return source;
 }
 
-MemoryBlock* Allocator::AllocateBlock(uint64_t newBlockSize, uint32_t memoryType)
+MemoryBlock* Allocator::AllocateBlock(uint64_t newBlockSize, uint32_t memoryType, MemoryBlockType blockType, BufferArena arena, VkImage dedicatedImage, VkBuffer dedicatedBuffer)
 {
-	sBlocks.push_back(MemoryBlock());
-	MemoryBlock& newBlock = sBlocks.back();
+	VkDevice device = Renderer::Get()->GetDevice();
 
-	newBlock.mSize = newBlockSize;
-	newBlock.mAvailableMemory = newBlockSize;
-	newBlock.mLargestChunk = newBlockSize;
-	newBlock.mMemoryType = memoryType;
+	MemoryBlock* newBlock = new MemoryBlock();
+	newBlock->mBlockType = blockType;
+	newBlock->mArena = arena;
 
 	// Allocate video memory.
 	VkMemoryAllocateInfo allocInfo = {};
@@ -197,36 +1409,127 @@ MemoryBlock* Allocator::AllocateBlock(uint64_t newBlockSize, uint32_t memoryType
 	allocInfo.allocationSize = newBlockSize;
 	allocInfo.memoryTypeIndex = memoryType;
 
-	if (vkAllocateMemory(Renderer::Get()->GetDevice(), &allocInfo, nullptr, &newBlock.mDeviceMemory) != VK_SUCCESS)
+	// Arena blocks are covered by a single buffer, which also owns dedicated arena memory.
+	if (arena != BufferArena::Num)
+	{
+		VkBufferCreateInfo ciBuffer = {};
+		ciBuffer.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		ciBuffer.size = newBlockSize;
+		ciBuffer.usage = GetArenaUsage(arena);
+		ciBuffer.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+		if (vkCreateBuffer(device, &ciBuffer, nullptr, &newBlock->mBuffer) != VK_SUCCESS)
+		{
+			delete newBlock;
+			throw std::runtime_error("Failed to create arena buffer");
+		}
+
+		VkMemoryRequirements memRequirements;
+		vkGetBufferMemoryRequirements(device, newBlock->mBuffer, &memRequirements);
+		assert(memRequirements.memoryTypeBits & (1 << memoryType));
+
+		allocInfo.allocationSize = (memRequirements.size > newBlockSize) ? memRequirements.size : newBlockSize;
+		dedicatedBuffer = (blockType == MemoryBlockType::Dedicated) ? newBlock->mBuffer : VK_NULL_HANDLE;
+	}
+
+	// Let the driver know which resource owns dedicated memory.
+	VkMemoryDedicatedAllocateInfoKHR dedicatedInfo = {};
+	dedicatedInfo.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO_KHR;
+	dedicatedInfo.image = dedicatedImage;
+	dedicatedInfo.buffer = dedicatedBuffer;
+
+	if (sDedicatedAllocationEnabled &&
+		(dedicatedImage != VK_NULL_HANDLE || dedicatedBuffer != VK_NULL_HANDLE))
+	{
+		allocInfo.pNext = &dedicatedInfo;
+	}
+
+	VkResult result = vkAllocateMemory(device, &allocInfo, nullptr, &newBlock->mDeviceMemory);
+
+	if (result != VK_SUCCESS)
+	{
+		vkDestroyBuffer(device, newBlock->mBuffer, nullptr);
+		delete newBlock;
+
+		if (result == VK_ERROR_OUT_OF_DEVICE_MEMORY ||
+			result == VK_ERROR_OUT_OF_HOST_MEMORY)
+		{
+			LogError("Allocator: out of memory allocating %llu bytes from memory type %u", static_cast<unsigned long long>(newBlockSize), memoryType);
+			return nullptr;
+		}
+
+		throw std::runtime_error("Failed to allocate device memory");
+	}
+
+	if (newBlock->mBuffer != VK_NULL_HANDLE)
 	{
-		throw std::exception("Failed to allocate image memory");
+		vkBindBufferMemory(device, newBlock->mBuffer, newBlock->mDeviceMemory, 0);
 	}
 
 	// Initialize the starting chunk.
-	MemoryChunk firstChunk;
-	firstChunk.mFree = true;
-	firstChunk.mID = -1;
-	firstChunk.mOffset = 0;
-	firstChunk.mSize = newBlockSize;
-	newBlock.mChunks.push_back(firstChunk);
+	newBlock->Initialize(newBlockSize, memoryType);
 
-	return &newBlock;
-}
+	// Map host visible memory once and keep it mapped until the block is freed.
+	VkMemoryPropertyFlags propertyFlags = sMemoryProperties.memoryTypes[memoryType].propertyFlags;
 
-void Allocator::FreeBlock(MemoryBlock& block)
-{
-	int32_t index = 0;
+	newBlock->mCoherent = (propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
 
-	for (index = 0; index < sBlocks.size(); ++index)
+	if (propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
 	{
-		if (block.mDeviceMemory == sBlocks[index].mDeviceMemory)
+		if (vkMapMemory(device, newBlock->mDeviceMemory, 0, VK_WHOLE_SIZE, 0, &newBlock->mMappedPtr) != VK_SUCCESS)
 		{
-			break;
+			vkDestroyBuffer(device, newBlock->mBuffer, nullptr);
+			vkFreeMemory(device, newBlock->mDeviceMemory, nullptr);
+			newBlock->Destroy();
+			delete newBlock;
+			throw std::runtime_error("Failed to map memory block");
 		}
 	}
 
-	assert(index < sBlocks.size());
+	return newBlock;
+}
+
+void Allocator::FreeBlock(MemoryBlock* block)
+{
+	if (block->mBuffer != VK_NULL_HANDLE)
+	{
+		vkDestroyBuffer(Renderer::Get()->GetDevice(), block->mBuffer, nullptr);
+		block->mBuffer = VK_NULL_HANDLE;
+	}
+
+	if (block->mMappedPtr != nullptr)
+	{
+		vkUnmapMemory(Renderer::Get()->GetDevice(), block->mDeviceMemory);
+		block->mMappedPtr = nullptr;
+	}
+
+	vkFreeMemory(Renderer::Get()->GetDevice(), block->mDeviceMemory, nullptr);
+	block->Destroy();
+	delete block;
+}
+
+void Allocator::AddBlock(MemoryBlock* block)
+{
+	std::vector<MemoryBlock*>& blocks = sBlocks[block->mMemoryType];
+
+	block->mBlockIndex = static_cast<uint32_t>(blocks.size());
+	blocks.push_back(block);
+	sNumBlocks++;
+	sHeapBlockBytes[sMemoryProperties.memoryTypes[block->mMemoryType].heapIndex] += block->mSize;
+}
+
+void Allocator::RemoveBlock(MemoryBlock* block)
+{
+	std::vector<MemoryBlock*>& blocks = sBlocks[block->mMemoryType];
+
+	uint32_t index = block->mBlockIndex;
+	assert(index < blocks.size());
+	assert(blocks[index] == block);
 
-	vkFreeMemory(Renderer::Get()->GetDevice(), sBlocks[index].mDeviceMemory, nullptr);
-	sBlocks.erase(sBlocks.begin() + index);
+	// Swap the last block into the vacated slot.
+	blocks[index] = blocks.back();
+	blocks[index]->mBlockIndex = index;
+	blocks.pop_back();
+	sNumBlocks--;
+	sHeapBlockBytes[sMemoryProperties.memoryTypes[block->mMemoryType].heapIndex] -= block->mSize;
 }
\ No newline at end of file
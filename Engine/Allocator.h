@@ -2,6 +2,176 @@
 
 #include <vulkan/vulkan.h>
 #include <vector>
+#include <string>
+#include <mutex>
+#include <atomic>
+
+// Two-level segregated fit parameters.
+// The first level splits sizes by power of two, the second level linearly
+// subdivides each power of two range into (1 << TLSF_SL_INDEX_COUNT_LOG2) lists.
+#define TLSF_SL_INDEX_COUNT_LOG2 5
+#define TLSF_SL_INDEX_COUNT (1 << TLSF_SL_INDEX_COUNT_LOG2)
+#define TLSF_FL_INDEX_SHIFT (TLSF_SL_INDEX_COUNT_LOG2 + 3)
+#define TLSF_FL_INDEX_COUNT (64 - TLSF_FL_INDEX_SHIFT + 1)
+#define TLSF_SMALL_CHUNK_SIZE (1ULL << TLSF_FL_INDEX_SHIFT)
+
+// Block sizing. Large blocks scale with the size of their heap.
+#define ALLOCATOR_MIN_BLOCK_SIZE (16ULL * 1024 * 1024)
+#define ALLOCATOR_MAX_BLOCK_SIZE (128ULL * 1024 * 1024)
+#define ALLOCATOR_HEAP_BLOCK_DIVISOR 64
+
+// Requests up to this size are kept in their own small blocks so that they
+// don't fragment the blocks used for textures and meshes.
+#define ALLOCATOR_SMALL_ALLOCATION_SIZE (64ULL * 1024)
+#define ALLOCATOR_SMALL_BLOCK_SIZE (4ULL * 1024 * 1024)
+
+// Render targets at least this big always get their own VkDeviceMemory.
+#define ALLOCATOR_DEDICATED_RENDER_TARGET_SIZE (1ULL * 1024 * 1024)
+
+// Share of a heap's budget the application aims to use. The rest is left for
+// the driver, other applications and space inside partially used blocks.
+#define ALLOCATOR_BUDGET_SCALE 0.9
+
+enum class MemoryBlockType
+{
+	Small,
+	Large,
+	Dedicated,
+	Num
+};
+
+// Blocks of a buffer arena own one VkBuffer spanning the whole block. Sub-allocations
+// are bound through Allocation::mBuffer at Allocation::mOffset instead of owning a VkBuffer.
+enum class BufferArena
+{
+	Geometry,
+	Uniform,
+	Storage,
+	Staging,
+	Num
+};
+
+// What an allocation is used for, tracked for statistics only.
+enum class AllocationCategory
+{
+	Texture,
+	RenderTarget,
+	Mesh,
+	Uniform,
+	Staging,
+	Other,
+	Num
+};
+
+struct MemoryStats
+{
+	uint32_t mNumBlocks;
+	uint32_t mNumAllocations;
+	uint32_t mNumFreeChunks;
+
+	// Device memory allocated from Vulkan.
+	uint64_t mReservedBytes;
+
+	// Bytes held by live allocations, including alignment padding.
+	uint64_t mUsedBytes;
+
+	uint64_t mFreeBytes;
+	uint64_t mLargestFreeChunk;
+
+	MemoryStats() :
+		mNumBlocks(0),
+		mNumAllocations(0),
+		mNumFreeChunks(0),
+		mReservedBytes(0),
+		mUsedBytes(0),
+		mFreeBytes(0),
+		mLargestFreeChunk(0)
+	{
+
+	}
+
+	void Add(const MemoryStats& other);
+
+	// 0 when all free memory is one contiguous range, approaching 1 as it gets split up.
+	float GetFragmentation() const;
+};
+
+struct AllocatorStats
+{
+	MemoryStats mTotal;
+	MemoryStats mMemoryTypes[VK_MAX_MEMORY_TYPES];
+	MemoryStats mMemoryHeaps[VK_MAX_MEMORY_HEAPS];
+	MemoryStats mBlockTypes[static_cast<uint32_t>(MemoryBlockType::Num)];
+
+	// Requested bytes and live allocations per category.
+	uint64_t mCategoryBytes[static_cast<uint32_t>(AllocationCategory::Num)];
+	uint32_t mCategoryAllocations[static_cast<uint32_t>(AllocationCategory::Num)];
+};
+
+struct HeapBudget
+{
+	// Bytes this process should stay under, from VK_EXT_memory_budget when it is available
+	// and estimated from the heap size otherwise. Capped by Allocator::SetBudgetLimit().
+	uint64_t mBudget;
+
+	// Device memory this process has allocated from the heap, including memory the
+	// allocator doesn't own (e.g. the swapchain) when the driver reports it.
+	uint64_t mUsage;
+
+	// Memory held in allocator blocks and by live allocations within them.
+	uint64_t mBlockBytes;
+	uint64_t mAllocatedBytes;
+
+	// Bytes of allocations queued on the renderer's DestructionQueue. They stay in
+	// mAllocatedBytes until the frames that may use them have completed.
+	uint64_t mPendingFreeBytes;
+
+	HeapBudget() :
+		mBudget(0),
+		mUsage(0),
+		mBlockBytes(0),
+		mAllocatedBytes(0),
+		mPendingFreeBytes(0)
+	{
+
+	}
+
+	// Usage once the allocations that have already been freed are released, a few frames from
+	// now. Free space inside blocks is only returned once Defragment() empties them, so it
+	// isn't counted.
+	uint64_t GetEffectiveUsage() const
+	{
+		uint64_t external = (mUsage > mBlockBytes) ? mUsage - mBlockBytes : 0;
+		uint64_t allocated = (mAllocatedBytes > mPendingFreeBytes) ? mAllocatedBytes - mPendingFreeBytes : 0;
+		return allocated + external;
+	}
+
+	bool IsOverBudget() const
+	{
+		return GetEffectiveUsage() > mBudget;
+	}
+};
+
+struct MemoryBlock;
+struct MemoryChunk;
+struct Allocation;
+
+// Implemented by owners of device local resources that Allocator::Defragment() may move.
+class RelocatableResource
+{
+public:
+
+	virtual ~RelocatableResource() {}
+
+	// Create a replacement resource bound to newAllocation and record a copy
+	// of the contents of the resource bound to oldAllocation.
+	virtual void RecordRelocation(VkCommandBuffer commandBuffer, const Allocation& oldAllocation, const Allocation& newAllocation) = 0;
+
+	// Called once the copy has been submitted and allocation refers to the new memory. Frames in
+	// flight may still use the old resource, so switch over to the replacement and destroy the old
+	// one through the renderer's destruction queue.
+	virtual void FinishRelocation(const Allocation& allocation) = 0;
+};
 
 struct Allocation
 {
@@ -10,13 +180,31 @@ struct Allocation
 	int64_t mID;
 	VkDeviceSize mSize;
 	VkDeviceSize mOffset;
+	VkDeviceSize mAlignment;
+	AllocationCategory mCategory;
+
+	// Persistently mapped pointer to mOffset (nullptr if not host visible).
+	void* mMappedPtr;
+
+	// Arena buffer that contains the allocation at mOffset (VK_NULL_HANDLE if not from an arena).
+	VkBuffer mBuffer;
+
+	// Owning block and chunk, used to free the allocation directly.
+	MemoryBlock* mBlock;
+	MemoryChunk* mChunk;
 
 	Allocation() :
 		mDeviceMemory(VK_NULL_HANDLE),
 		mType(0),
 		mID(-1),
 		mSize(0),
-		mOffset(0)
+		mOffset(0),
+		mAlignment(1),
+		mCategory(AllocationCategory::Other),
+		mMappedPtr(nullptr),
+		mBuffer(VK_NULL_HANDLE),
+		mBlock(nullptr),
+		mChunk(nullptr)
 	{
 
 	}
@@ -34,11 +222,29 @@ struct MemoryChunk
 	uint64_t mSize;
 	bool mFree;
 
+	// Physically adjacent chunks within the block.
+	MemoryChunk* mPrevPhysical;
+	MemoryChunk* mNextPhysical;
+
+	// Links in the segregated free list (only valid while mFree is true).
+	MemoryChunk* mPrevFree;
+	MemoryChunk* mNextFree;
+
+	// Set for allocations that can be moved during defragmentation.
+	Allocation* mOwner;
+	RelocatableResource* mResource;
+
 	MemoryChunk() :
 		mID(-1),
 		mOffset(0),
 		mSize(0),
-		mFree(true)
+		mFree(true),
+		mPrevPhysical(nullptr),
+		mNextPhysical(nullptr),
+		mPrevFree(nullptr),
+		mNextFree(nullptr),
+		mOwner(nullptr),
+		mResource(nullptr)
 	{
 
 	}
@@ -46,47 +252,189 @@ struct MemoryChunk
 
 struct MemoryBlock
 {
-	MemoryChunk* AllocateChunk(uint64_t size);
-	bool FreeChunk(int64_t id);
+	void Initialize(uint64_t size, uint32_t memoryType);
+	void Destroy();
+
+	// Places size bytes at an offset that is a multiple of alignment. Padding in front
+	// of the aligned offset is split off and stays in the free lists.
+	MemoryChunk* AllocateChunk(uint64_t size, uint64_t alignment = 1);
+	void FreeChunk(MemoryChunk* chunk);
+
+	bool IsEmpty() const;
+
+	MemoryChunk* GetFirstChunk() const;
+
+	void CalculateStats(MemoryStats& outStats) const;
 
 	MemoryBlock() :
 		mDeviceMemory(0),
 		mSize(0),
 		mAvailableMemory(0),
-		mLargestChunk(0),
-		mMemoryType(0)
+		mMemoryType(0),
+		mBlockType(MemoryBlockType::Large),
+		mLinear(true),
+		mArena(BufferArena::Num),
+		mBuffer(VK_NULL_HANDLE),
+		mMappedPtr(nullptr),
+		mCoherent(true),
+		mBlockIndex(0),
+		mFirstChunk(nullptr),
+		mUnusedChunks(nullptr),
+		mFlBitmap(0)
 	{
 		
 	}
 
-	std::vector<MemoryChunk> mChunks;
 	VkDeviceMemory mDeviceMemory;
 	uint64_t mSize;
 	uint64_t mAvailableMemory;
-	uint64_t mLargestChunk;
 	uint32_t mMemoryType;
+	MemoryBlockType mBlockType;
+
+	// Whether the block holds linear resources (buffers) or optimally tiled images.
+	// The two are only mixed when bufferImageGranularity doesn't require separating them.
+	bool mLinear;
+
+	// Arena the block belongs to (Num for plain memory) and its buffer covering the whole block.
+	BufferArena mArena;
+	VkBuffer mBuffer;
+
+	// Host visible blocks are mapped once for their whole lifetime.
+	void* mMappedPtr;
+	bool mCoherent;
+
+	// Position in Allocator::sBlocks[mMemoryType]
+	uint32_t mBlockIndex;
+
+private:
+
+	static void MapInsert(uint64_t size, uint32_t& fl, uint32_t& sl);
+	static bool MapSearch(uint64_t size, uint32_t& fl, uint32_t& sl);
+
+	MemoryChunk* FindFreeChunk(uint32_t& fl, uint32_t& sl);
+	MemoryChunk* FindAlignedChunk(uint64_t size, uint64_t alignment);
+	void InsertFreeChunk(MemoryChunk* chunk);
+	void RemoveFreeChunk(MemoryChunk* chunk);
+	void RemoveFreeChunk(MemoryChunk* chunk, uint32_t fl, uint32_t sl);
+
+	MemoryChunk* CreateChunkNode();
+	void ReleaseChunkNode(MemoryChunk* chunk);
+
+	MemoryChunk* mFirstChunk;
+	MemoryChunk* mUnusedChunks;
+
+	uint64_t mFlBitmap;
+	uint32_t mSlBitmap[TLSF_FL_INDEX_COUNT];
+	MemoryChunk* mFreeLists[TLSF_FL_INDEX_COUNT][TLSF_SL_INDEX_COUNT];
 };
 
+// All functions may be called from any thread. Blocks are sharded by memory type, each shard
+// with its own lock, and Vulkan memory is allocated and freed outside of the locks.
 class Allocator
 {
 public:
 
-	static void Alloc(uint64_t size, uint64_t alignment, uint32_t memoryType, Allocation& outAllocation);
+	// Must be called once the logical device exists, before any allocation is made.
+	static void Initialize(bool dedicatedAllocationEnabled, bool memoryBudgetEnabled);
+
+	// Linear is false for optimally tiled images, which may need to be kept apart from buffers.
+	static void Alloc(uint64_t size, uint64_t alignment, uint32_t memoryType, Allocation& outAllocation, AllocationCategory category = AllocationCategory::Other, bool linear = true);
 	static void Free(Allocation& allocation);
 
+	// Query the memory requirements of the image and allocate memory for it, using
+	// a dedicated allocation when the driver asks for one or the image is large.
+	// The caller binds the image to the allocation. Buffers use AllocBufferRange().
+	static void AllocImage(VkImage image, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, Allocation& outAllocation);
+
+	// Sub-allocate a range of one of the arena buffers. There is no VkBuffer to create or destroy,
+	// bind outAllocation.mBuffer at outAllocation.mOffset and release the range with Free().
+	static void AllocBufferRange(VkDeviceSize size, BufferArena arena, VkMemoryPropertyFlags properties, Allocation& outAllocation);
+
+	// Makes host writes visible to the device. Only does work for non-coherent memory.
+	static void FlushMappedRange(const Allocation& allocation, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
+
+	// Allows Defragment() to move the allocation. The allocation must stay at the same address
+	// until it is freed, since the allocator writes the new location back into it.
+	// Does nothing for dedicated and mapped allocations, which are never moved.
+	static void SetRelocatable(Allocation& allocation, RelocatableResource* resource);
+
+	// Moves live allocations out of the sparsest device local block into other blocks of the
+	// same memory type, copying at most maxBytes. Blocks emptied this way are released.
+	// The copies are submitted to the graphics queue ahead of the frame being prepared without
+	// waiting, and the old memory is freed once that frame has completed. Must be called from
+	// the render thread between frames. The moved resources are appended to outMoved, descriptor
+	// sets and command buffers that refer to them need replacing.
+	static uint32_t Defragment(uint64_t maxBytes, std::vector<RelocatableResource*>& outMoved);
+
 	static uint64_t GetNumBlocksAllocated();
 	static uint64_t GetNumAllocations();
 	static uint64_t GetNumAllocatedBytes();
 
-	static const uint64_t sDefaultBlockSize;
+	static uint64_t GetBlockSize(uint32_t memoryType);
+
+	// Queries the driver when VK_EXT_memory_budget is enabled, which is cheap enough to do every frame.
+	static void GetHeapBudget(uint32_t heapIndex, HeapBudget& outBudget);
+
+	// The largest device local heap, which textures and meshes are allocated from.
+	static uint32_t GetDeviceLocalHeap();
+
+	static uint32_t GetHeapIndex(uint32_t memoryType);
+
+	// Caps the budget of device local heaps, e.g. to test behaviour on cards with less memory. 0 removes the cap.
+	static void SetBudgetLimit(uint64_t limit);
+
+	// Walks every block, so don't call this every frame in shipping builds.
+	static void GetStats(AllocatorStats& outStats);
+
+	// Snapshot of GetStats() as JSON. Blocks lists every block, useful for diffing between builds.
+	static std::string GetStatsJson(bool blocks = false);
+	static bool WriteStatsJson(const std::string& path, bool blocks = true);
+
+	static const char* GetCategoryName(AllocationCategory category);
+	static const char* GetBlockTypeName(MemoryBlockType blockType);
+	static const char* GetArenaName(BufferArena arena);
 
 private:
 
-	static MemoryBlock* AllocateBlock(uint64_t newBlockSize, uint32_t memoryType);
-	static void FreeBlock(MemoryBlock& block);
+	static void AllocFromBlocks(uint64_t size, uint64_t alignment, uint32_t memoryType, AllocationCategory category, bool linear, BufferArena arena, Allocation& outAllocation);
+	static void AllocDedicated(uint64_t size, uint64_t alignment, uint32_t memoryType, VkImage image, VkBuffer buffer, Allocation& outAllocation, AllocationCategory category, BufferArena arena = BufferArena::Num);
+
+	static VkBufferUsageFlags GetArenaUsage(BufferArena arena);
+
+	static void TrackAllocation(const Allocation& allocation);
+	static void UntrackAllocation(const Allocation& allocation);
+
+	static MemoryChunk* AllocateChunk(uint64_t size, uint64_t alignment, uint32_t memoryType, MemoryBlockType blockType, bool linear, BufferArena arena, MemoryBlock* excludeBlock, MemoryBlock*& outBlock);
+	static bool IsCompatibleBlock(const MemoryBlock* block, uint32_t memoryType, MemoryBlockType blockType, bool linear, BufferArena arena);
+	static void InitializeAllocation(MemoryBlock* block, MemoryChunk* chunk, uint64_t size, uint64_t alignment, AllocationCategory category, Allocation& outAllocation);
+	static MemoryBlock* FindDefragmentationSource(uint32_t memoryType);
 
+	// Creating and destroying blocks doesn't touch shared state, so these run without the shard lock.
+	// Add and remove are called with sMutexes[block->mMemoryType] held.
+	// AllocateBlock returns nullptr when the heap is out of memory.
+	static MemoryBlock* AllocateBlock(uint64_t newBlockSize, uint32_t memoryType, MemoryBlockType blockType, BufferArena arena = BufferArena::Num, VkImage dedicatedImage = VK_NULL_HANDLE, VkBuffer dedicatedBuffer = VK_NULL_HANDLE);
+	static void FreeBlock(MemoryBlock* block);
+	static void AddBlock(MemoryBlock* block);
+	static void RemoveBlock(MemoryBlock* block);
 
-	static std::vector<MemoryBlock> sBlocks;
-	static uint64_t sNumAllocations;
-	static uint64_t sNumAllocatedBytes;
+	static std::vector<MemoryBlock*> sBlocks[VK_MAX_MEMORY_TYPES];
+	static std::mutex sMutexes[VK_MAX_MEMORY_TYPES];
+	static VkPhysicalDeviceMemoryProperties sMemoryProperties;
+	static uint64_t sBlockSizes[VK_MAX_MEMORY_TYPES];
+	static VkDeviceSize sBufferImageGranularity;
+	static bool sDedicatedAllocationEnabled;
+	static PFN_vkGetImageMemoryRequirements2KHR sGetImageMemoryRequirements2;
+	static PFN_vkGetPhysicalDeviceMemoryProperties2KHR sGetPhysicalDeviceMemoryProperties2;
+	static uint32_t sDeviceLocalHeap;
+	static std::atomic<uint64_t> sBudgetLimit;
+	static VkDeviceSize sNonCoherentAtomSize;
+	static uint32_t sArenaMemoryTypeBits[static_cast<uint32_t>(BufferArena::Num)];
+	static VkDeviceSize sArenaAlignments[static_cast<uint32_t>(BufferArena::Num)];
+	static std::atomic<uint64_t> sNumBlocks;
+	static std::atomic<uint64_t> sNumAllocations;
+	static std::atomic<uint64_t> sNumAllocatedBytes;
+	static std::atomic<uint64_t> sCategoryBytes[static_cast<uint32_t>(AllocationCategory::Num)];
+	static std::atomic<uint32_t> sCategoryAllocations[static_cast<uint32_t>(AllocationCategory::Num)];
+	static std::atomic<uint64_t> sHeapBlockBytes[VK_MAX_MEMORY_HEAPS];
+	static std::atomic<uint64_t> sHeapAllocatedBytes[VK_MAX_MEMORY_HEAPS];
 };
\ No newline at end of file
@@ -0,0 +1,90 @@
+#include "AllocatorOverlay.h"
+#include "Allocator.h"
+#include "DefaultFonts.h"
+
+#include <stdio.h>
+
+static const double sMegabyte = 1024.0 * 1024.0;
+
+AllocatorOverlay::AllocatorOverlay() :
+	mRefreshInterval(30),
+	mFramesUntilRefresh(0)
+{
+	SetFont(&DefaultFonts::sRobotoMono24);
+	SetSize(16.0f);
+}
+
+AllocatorOverlay::~AllocatorOverlay()
+{
+
+}
+
+void AllocatorOverlay::Update()
+{
+	// Gathering stats walks every block, so don't do it every frame.
+	if (mFramesUntilRefresh == 0)
+	{
+		RefreshText();
+		mFramesUntilRefresh = mRefreshInterval;
+	}
+
+	mFramesUntilRefresh--;
+
+	Text::Update();
+}
+
+void AllocatorOverlay::SetRefreshInterval(uint32_t frames)
+{
+	mRefreshInterval = (frames > 0) ? frames : 1;
+	mFramesUntilRefresh = 0;
+}
+
+void AllocatorOverlay::RefreshText()
+{
+	AllocatorStats stats;
+	Allocator::GetStats(stats);
+
+	char line[256];
+	std::string text;
+
+	snprintf(line, sizeof(line), "GPU Memory: %.1f / %.1f MB in %u blocks\n",
+		stats.mTotal.mUsedBytes / sMegabyte,
+		stats.mTotal.mReservedBytes / sMegabyte,
+		stats.mTotal.mNumBlocks);
+	text += line;
+
+	snprintf(line, sizeof(line), "Allocations: %u  Free chunks: %u  Fragmentation: %.1f%%\n",
+		stats.mTotal.mNumAllocations,
+		stats.mTotal.mNumFreeChunks,
+		stats.mTotal.GetFragmentation() * 100.0f);
+	text += line;
+
+	for (uint32_t i = 0; i < static_cast<uint32_t>(MemoryBlockType::Num); ++i)
+	{
+		const MemoryStats& blockStats = stats.mBlockTypes[i];
+
+		if (blockStats.mNumBlocks > 0)
+		{
+			snprintf(line, sizeof(line), "  %-10s %8.1f / %8.1f MB  %u blocks\n",
+				Allocator::GetBlockTypeName(static_cast<MemoryBlockType>(i)),
+				blockStats.mUsedBytes / sMegabyte,
+				blockStats.mReservedBytes / sMegabyte,
+				blockStats.mNumBlocks);
+			text += line;
+		}
+	}
+
+	for (uint32_t i = 0; i < static_cast<uint32_t>(AllocationCategory::Num); ++i)
+	{
+		if (stats.mCategoryAllocations[i] > 0)
+		{
+			snprintf(line, sizeof(line), "  %-12s %8.1f MB  %u\n",
+				Allocator::GetCategoryName(static_cast<AllocationCategory>(i)),
+				stats.mCategoryBytes[i] / sMegabyte,
+				stats.mCategoryAllocations[i]);
+			text += line;
+		}
+	}
+
+	SetText(text);
+}
\ No newline at end of file
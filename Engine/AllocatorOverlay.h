@@ -0,0 +1,23 @@
+#pragma once
+
+#include "Text.h"
+
+// Text widget that periodically displays Allocator statistics.
+class AllocatorOverlay : public Text
+{
+public:
+
+	AllocatorOverlay();
+	virtual ~AllocatorOverlay();
+
+	virtual void Update() override;
+
+	void SetRefreshInterval(uint32_t frames);
+
+protected:
+
+	void RefreshText();
+
+	uint32_t mRefreshInterval;
+	uint32_t mFramesUntilRefresh;
+};
\ No newline at end of file
@@ -3,5 +3,12 @@
 #define APP_NAME "Vulkan Renderer 2 Deluxe 3D"
 #define APP_WINDOW_WIDTH 800
 #define APP_WINDOW_HEIGHT 600
+#define APP_FRAMES_IN_FLIGHT 2
+#define APP_HEADLESS_FRAMES 100
+#define APP_FIXED_DELTA_TIME (1.0f / 60.0f)
+#define APP_BENCHMARK_WARMUP_FRAMES 60
+#define APP_BENCHMARK_FILE_NAME "Benchmark.json"
+#define APP_RANDOM_SEED 1
+#define APP_DEFAULT_SCENE "Sponza"
 #define MAX_ENABLED_EXTENSIONS 8
 #define MAX_ENABLED_LAYERS 8
\ No newline at end of file
@@ -4,9 +4,11 @@
 
 struct AppState
 {
+#if defined(_WIN32)
 	HINSTANCE mConnection;
 	HWND mWindow;
 	POINT mMinSize;
+#endif
 	uint32_t mWindowWidth;
 	uint32_t mWindowHeight;
 	int mValidationError;
@@ -17,10 +19,61 @@ struct AppState
 	const char* mEnabledLayers[MAX_ENABLED_LAYERS];
 	bool mValidate;
 
+	// Caps device local memory use in bytes, 0 uses the budget reported by the driver.
+	uint64_t mMemoryBudget;
+
+	// Number of frames the CPU may record ahead of the GPU, up to MAX_FRAMES_IN_FLIGHT.
+	uint32_t mFramesInFlight;
+
+	// Splits recording of large scenes over worker threads with secondary command buffers.
+	bool mParallelRecording;
+
+	// Reuses recorded command buffers until the scene, widgets, debug mode or swapchain change.
+	// Frames then only cost the uniform updates and the submit.
+	bool mCacheCommandBuffers;
+
+	// Writes timestamp queries around each pass, see Renderer::GetGpuProfiler().
+	bool mGpuProfiling;
+
+	// Captures CPU zones from startup for this many frames and writes them to CPU_TRACE_FILE_NAME.
+	// 0 leaves capturing to the Ctrl+U hotkey.
+	uint32_t mCpuTraceFrames;
+
+	// Renders into offscreen images without a window or surface, e.g. with a software driver on
+	// a build machine. The frame uses the window size and time advances by APP_FIXED_DELTA_TIME.
+	bool mHeadless;
+
+	// Frames rendered when headless before Update() returns false.
+	uint32_t mHeadlessFrames;
+
+	// PNG file the last headless frame is written to, nullptr skips the readback.
+	const char* mScreenshotPath;
+
+	// Measures frame times over this many frames after mBenchmarkWarmupFrames, writes them to
+	// mBenchmarkPath and quits. Time advances by APP_FIXED_DELTA_TIME. 0 disables the benchmark.
+	uint32_t mBenchmarkFrames;
+	uint32_t mBenchmarkWarmupFrames;
+	const char* mBenchmarkPath;
+
+	// Seeds rand() at startup, so randomly spawned lights are the same in every run.
+	uint32_t mRandomSeed;
+
+	// Scene the application loads. The demo knows Sponza and MonkeyScene.
+	const char* mSceneName;
+
+	// Camera keyframes to fly along instead of the application's default path, see CameraPath::Load().
+	const char* mCameraPathFile;
+
+	// Starts from the pipelines compiled by earlier runs, saved in PIPELINE_CACHE_FILE_NAME.
+	// False starts cold, e.g. to time it, but the cache is still saved at shutdown.
+	bool mLoadPipelineCache;
+
 	AppState()
 	{
+#if defined(_WIN32)
 		mConnection = nullptr;
 		mWindow = nullptr;
+#endif
 		mWindowWidth = APP_WINDOW_WIDTH;
 		mWindowHeight = APP_WINDOW_HEIGHT;
 		mValidationError = 0;
@@ -30,5 +83,21 @@ struct AppState
 		mEnabledLayersCount = 0;
 		memset(mEnabledLayers, 0, sizeof(mEnabledLayers));
 		mValidate = true;
+		mMemoryBudget = 0;
+		mFramesInFlight = APP_FRAMES_IN_FLIGHT;
+		mParallelRecording = true;
+		mCacheCommandBuffers = false;
+		mGpuProfiling = true;
+		mCpuTraceFrames = 0;
+		mHeadless = false;
+		mHeadlessFrames = APP_HEADLESS_FRAMES;
+		mScreenshotPath = nullptr;
+		mBenchmarkFrames = 0;
+		mBenchmarkWarmupFrames = APP_BENCHMARK_WARMUP_FRAMES;
+		mBenchmarkPath = APP_BENCHMARK_FILE_NAME;
+		mRandomSeed = APP_RANDOM_SEED;
+		mSceneName = APP_DEFAULT_SCENE;
+		mCameraPathFile = nullptr;
+		mLoadPipelineCache = true;
 	}
 };
\ No newline at end of file
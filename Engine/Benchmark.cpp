@@ -0,0 +1,189 @@
+#include "Benchmark.h"
+#include "Renderer.h"
+#include "ApplicationState.h"
+#include "Log.h"
+
+#include <algorithm>
+#include <stdio.h>
+
+using namespace std;
+
+static void AppendStatsJson(std::string& json, const SampleStats& stats)
+{
+	AppendFormat(json, "{ \"mean\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f, \"min\": %.4f, \"frames\": %u }",
+		stats.mMean,
+		stats.mP50,
+		stats.mP95,
+		stats.mP99,
+		stats.mMax,
+		stats.mMin,
+		stats.mNumSamples);
+}
+
+Benchmark::Benchmark() :
+	mNumWarmupFrames(0),
+	mNumFrames(0),
+	mFrame(0),
+	mNumLaggedGpuSamples(0)
+{
+
+}
+
+void Benchmark::Start(uint32_t numWarmupFrames, uint32_t numFrames)
+{
+	mNumWarmupFrames = numWarmupFrames;
+	mNumFrames = numFrames;
+	mFrame = 0;
+
+	mNumLaggedGpuSamples = 0;
+
+	mCpuFrameTimes.clear();
+	mCpuFrameTimes.reserve(numFrames);
+	mGpuFrameTimes.clear();
+
+	if (mNumWarmupFrames == 0)
+	{
+		BeginMeasuring();
+	}
+}
+
+bool Benchmark::IsRunning() const
+{
+	return mNumFrames > 0 && !IsFinished();
+}
+
+bool Benchmark::IsMeasuring() const
+{
+	return IsRunning() && mFrame >= mNumWarmupFrames;
+}
+
+bool Benchmark::IsFinished() const
+{
+	return mNumFrames > 0 && mFrame >= mNumWarmupFrames + mNumFrames;
+}
+
+void Benchmark::EndFrame(float cpuMilliseconds)
+{
+	if (!IsRunning())
+	{
+		return;
+	}
+
+	if (IsMeasuring())
+	{
+		mCpuFrameTimes.push_back(cpuMilliseconds);
+	}
+
+	mFrame++;
+
+	if (mFrame == mNumWarmupFrames)
+	{
+		BeginMeasuring();
+	}
+
+	if (IsFinished())
+	{
+		EndMeasuring();
+	}
+}
+
+SampleStats Benchmark::GetCpuStats() const
+{
+	return ComputeSampleStats(mCpuFrameTimes);
+}
+
+bool Benchmark::GetGpuStats(SampleStats& outStats) const
+{
+	if (!Renderer::Get()->GetGpuProfiler().IsEnabled())
+	{
+		return false;
+	}
+
+	outStats = ComputeSampleStats(mGpuFrameTimes);
+
+	return true;
+}
+
+std::string Benchmark::GetResultsJson(const AppState& appState) const
+{
+	std::string json;
+
+	AppendFormat(json, "{\n\t\"scene\": \"%s\",\n", appState.mSceneName);
+	AppendFormat(json, "\t\"width\": %u,\n\t\"height\": %u,\n", appState.mWindowWidth, appState.mWindowHeight);
+	AppendFormat(json, "\t\"headless\": %s,\n", appState.mHeadless ? "true" : "false");
+	AppendFormat(json, "\t\"seed\": %u,\n", appState.mRandomSeed);
+	AppendFormat(json, "\t\"warmupFrames\": %u,\n\t\"frames\": %u,\n", mNumWarmupFrames, mNumFrames);
+
+	Renderer* renderer = Renderer::Get();
+	AppendFormat(json, "\t\"pipelineCache\": \"%s\",\n", renderer->GetPipelineCache().IsWarm() ? "warm" : "cold");
+	AppendFormat(json, "\t\"pipelineCreationMs\": %.4f,\n", renderer->GetPipelineCreationTime());
+
+	json += "\t\"cpu\": ";
+	AppendStatsJson(json, GetCpuStats());
+	json += ",\n\t\"gpu\": ";
+
+	SampleStats gpuStats;
+
+	if (GetGpuStats(gpuStats))
+	{
+		AppendStatsJson(json, gpuStats);
+	}
+	else
+	{
+		json += "null";
+	}
+
+	json += "\n}\n";
+
+	return json;
+}
+
+void Benchmark::BeginMeasuring()
+{
+	Renderer* renderer = Renderer::Get();
+
+	// Drops the GPU samples of the warmup. The warmup frames still in flight are resolved during
+	// the first measured frames, so there's room for theirs too.
+	mNumLaggedGpuSamples = static_cast<uint32_t>(min<uint64_t>(renderer->GetNumFramesInFlight() - 1, renderer->GetFrameNumber()));
+	renderer->GetGpuProfiler().SetHistorySize(mNumFrames + mNumLaggedGpuSamples);
+}
+
+void Benchmark::EndMeasuring()
+{
+	Renderer* renderer = Renderer::Get();
+	GpuProfiler& gpuProfiler = renderer->GetGpuProfiler();
+
+	if (!gpuProfiler.IsEnabled())
+	{
+		return;
+	}
+
+	// The last measured frames are still in flight.
+	renderer->ResolveFramesInFlight();
+	gpuProfiler.GetSamples(GpuScope::Frame, mGpuFrameTimes);
+
+	uint32_t numLagged = min(mNumLaggedGpuSamples, static_cast<uint32_t>(mGpuFrameTimes.size()));
+	mGpuFrameTimes.erase(mGpuFrameTimes.begin(), mGpuFrameTimes.begin() + numLagged);
+
+	if (mGpuFrameTimes.size() != mNumFrames)
+	{
+		LogWarning("Benchmark has %u GPU samples for %u frames", static_cast<uint32_t>(mGpuFrameTimes.size()), mNumFrames);
+	}
+}
+
+bool Benchmark::WriteResults(const std::string& path, const AppState& appState) const
+{
+	FILE* file = fopen(path.c_str(), "w");
+
+	if (file == nullptr)
+	{
+		LogError("Failed to open %s for writing benchmark results", path.c_str());
+		return false;
+	}
+
+	std::string json = GetResultsJson(appState);
+	fwrite(json.c_str(), 1, json.size(), file);
+	fclose(file);
+
+	return true;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "Utilities.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+struct AppState;
+
+// Measures CPU and GPU frame times in milliseconds over a fixed number of frames after a warmup,
+// for comparing builds. CPU time is the wall clock time of a whole frame. GPU time is the Frame
+// scope of the renderer's GpuProfiler. Its samples lag behind by the frames in flight, so the
+// warmup frames still in flight are skipped and the last measured frames are waited for.
+class Benchmark
+{
+public:
+
+	Benchmark();
+
+	void Start(uint32_t numWarmupFrames, uint32_t numFrames);
+
+	// Between Start() and the last measured frame.
+	bool IsRunning() const;
+
+	bool IsMeasuring() const;
+
+	bool IsFinished() const;
+
+	// Call once per frame with the time the frame took on the CPU.
+	void EndFrame(float cpuMilliseconds);
+
+	SampleStats GetCpuStats() const;
+
+	// Returns false if GPU profiling is disabled.
+	bool GetGpuStats(SampleStats& outStats) const;
+
+	std::string GetResultsJson(const AppState& appState) const;
+
+	bool WriteResults(const std::string& path, const AppState& appState) const;
+
+private:
+
+	void BeginMeasuring();
+
+	void EndMeasuring();
+
+	uint32_t mNumWarmupFrames;
+	uint32_t mNumFrames;
+	uint32_t mFrame;
+
+	// GPU samples of warmup frames that were still in flight when measuring began.
+	uint32_t mNumLaggedGpuSamples;
+
+	std::vector<float> mCpuFrameTimes;
+	std::vector<float> mGpuFrameTimes;
+};
\ No newline at end of file
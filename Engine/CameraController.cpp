@@ -1,7 +1,7 @@
 #pragma once
 
 #include "CameraController.h"
-#include <Windows.h>
+#include "Input.h"
 
 
 CameraController::CameraController() :
@@ -19,7 +19,7 @@ CameraController::~CameraController()
 
 void CameraController::Update(float deltaTime)
 {
-	if (GetAsyncKeyState(VK_CONTROL) || mCamera == nullptr)
+	if (IsKeyDown(VKEY_CONTROL) || mCamera == nullptr)
 		return;
 
 	glm::vec3 cameraPosition = mCamera->GetPosition();
@@ -29,56 +29,56 @@ void CameraController::Update(float deltaTime)
 	float c = cos(angle);
 	float s = sin(angle);
 
-	if (GetAsyncKeyState('A'))
+	if (IsKeyDown(VKEY_A))
 	{
 		cameraPosition.x -= c * (mMoveSpeed * deltaTime);
 		cameraPosition.z += s * (mMoveSpeed * deltaTime);
 	}
 
-	if (GetAsyncKeyState('D') )
+	if (IsKeyDown(VKEY_D) )
 	{
 		cameraPosition.x += c * (mMoveSpeed * deltaTime);
 		cameraPosition.z -= s * (mMoveSpeed * deltaTime);
 	}
 
-	if (GetAsyncKeyState('W'))
+	if (IsKeyDown(VKEY_W))
 	{
 		cameraPosition.z -= c * (mMoveSpeed * deltaTime);
 		cameraPosition.x -= s * (mMoveSpeed * deltaTime);
 	}
 
-	if (GetAsyncKeyState('S'))
+	if (IsKeyDown(VKEY_S))
 	{
 		cameraPosition.z += c * (mMoveSpeed * deltaTime);
 		cameraPosition.x += s * (mMoveSpeed * deltaTime);
 	}
 
-	if (GetAsyncKeyState('E'))
+	if (IsKeyDown(VKEY_E))
 	{
 		cameraPosition.y += (mMoveSpeed * deltaTime);
 	}
 
-	if (GetAsyncKeyState('Q'))
+	if (IsKeyDown(VKEY_Q))
 	{
 		cameraPosition.y -= (mMoveSpeed * deltaTime);
 	}
 
-	if (GetAsyncKeyState(VK_LEFT))
+	if (IsKeyDown(VKEY_LEFT))
 	{
 		cameraRotation.y += mRotationSpeed * deltaTime;
 	}
 
-	if (GetAsyncKeyState(VK_RIGHT))
+	if (IsKeyDown(VKEY_RIGHT))
 	{
 		cameraRotation.y -= mRotationSpeed * deltaTime;
 	}
 
-	if (GetAsyncKeyState(VK_UP))
+	if (IsKeyDown(VKEY_UP))
 	{
 		cameraRotation.x += mRotationSpeed * deltaTime;
 	}
 
-	if (GetAsyncKeyState(VK_DOWN))
+	if (IsKeyDown(VKEY_DOWN))
 	{
 		cameraRotation.x -= mRotationSpeed * deltaTime;
 	}
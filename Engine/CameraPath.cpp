@@ -0,0 +1,150 @@
+#include "CameraPath.h"
+#include "Camera.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+
+// Uniform Catmull-Rom through p1 and p2, p0 and p3 shape the tangents.
+static glm::vec3 CatmullRom(const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2, const glm::vec3& p3, float t)
+{
+	float t2 = t * t;
+	float t3 = t2 * t;
+
+	return 0.5f * ((2.0f * p1) +
+		(p2 - p0) * t +
+		(2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * t2 +
+		(3.0f * p1 - p0 - 3.0f * p2 + p3) * t3);
+}
+
+void CameraPath::AddKeyframe(float time, glm::vec3 position, glm::vec3 rotation)
+{
+	assert(mKeyframes.empty() || time > mKeyframes.back().mTime);
+
+	CameraKeyframe keyframe;
+	keyframe.mTime = time;
+	keyframe.mPosition = position;
+	keyframe.mRotation = rotation;
+
+	mKeyframes.push_back(keyframe);
+}
+
+void CameraPath::Record(Camera* camera, float interval)
+{
+	float time = mKeyframes.empty() ? 0.0f : mKeyframes.back().mTime + interval;
+	AddKeyframe(time, camera->GetPosition(), camera->GetRotation());
+}
+
+void CameraPath::Clear()
+{
+	mKeyframes.clear();
+}
+
+bool CameraPath::IsEmpty() const
+{
+	return mKeyframes.empty();
+}
+
+float CameraPath::GetDuration() const
+{
+	return mKeyframes.empty() ? 0.0f : mKeyframes.back().mTime;
+}
+
+void CameraPath::Apply(float time, Camera* camera) const
+{
+	if (mKeyframes.empty() ||
+		camera == nullptr)
+	{
+		return;
+	}
+
+	float duration = GetDuration();
+
+	if (duration > 0.0f)
+	{
+		time = fmodf(time, duration);
+	}
+
+	uint32_t next = 0;
+
+	while (next < mKeyframes.size() &&
+		mKeyframes[next].mTime <= time)
+	{
+		++next;
+	}
+
+	if (next == 0 ||
+		next == mKeyframes.size())
+	{
+		const CameraKeyframe& keyframe = (next == 0) ? mKeyframes.front() : mKeyframes.back();
+		camera->SetPosition(keyframe.mPosition);
+		camera->SetRotation(keyframe.mRotation);
+		return;
+	}
+
+	// The end keyframes stand in for their missing neighbours.
+	const CameraKeyframe& k0 = mKeyframes[(next >= 2) ? next - 2 : 0];
+	const CameraKeyframe& k1 = mKeyframes[next - 1];
+	const CameraKeyframe& k2 = mKeyframes[next];
+	const CameraKeyframe& k3 = mKeyframes[(next + 1 < mKeyframes.size()) ? next + 1 : next];
+	float alpha = (time - k1.mTime) / (k2.mTime - k1.mTime);
+
+	camera->SetPosition(CatmullRom(k0.mPosition, k1.mPosition, k2.mPosition, k3.mPosition, alpha));
+	camera->SetRotation(CatmullRom(k0.mRotation, k1.mRotation, k2.mRotation, k3.mRotation, alpha));
+}
+
+bool CameraPath::Load(const std::string& path)
+{
+	FILE* file = fopen(path.c_str(), "r");
+
+	if (file == nullptr)
+	{
+		return false;
+	}
+
+	mKeyframes.clear();
+
+	char line[256];
+
+	while (fgets(line, sizeof(line), file) != nullptr)
+	{
+		CameraKeyframe keyframe;
+
+		if (line[0] != '#' &&
+			sscanf(line, "%f %f %f %f %f %f %f",
+				&keyframe.mTime,
+				&keyframe.mPosition.x, &keyframe.mPosition.y, &keyframe.mPosition.z,
+				&keyframe.mRotation.x, &keyframe.mRotation.y, &keyframe.mRotation.z) == 7)
+		{
+			AddKeyframe(keyframe.mTime, keyframe.mPosition, keyframe.mRotation);
+		}
+	}
+
+	fclose(file);
+
+	return !mKeyframes.empty();
+}
+
+bool CameraPath::Save(const std::string& path) const
+{
+	FILE* file = fopen(path.c_str(), "w");
+
+	if (file == nullptr)
+	{
+		return false;
+	}
+
+	fprintf(file, "# time position.x position.y position.z rotation.x rotation.y rotation.z\n");
+
+	for (const CameraKeyframe& keyframe : mKeyframes)
+	{
+		fprintf(file, "%.3f %.3f %.3f %.3f %.3f %.3f %.3f\n",
+			keyframe.mTime,
+			keyframe.mPosition.x, keyframe.mPosition.y, keyframe.mPosition.z,
+			keyframe.mRotation.x, keyframe.mRotation.y, keyframe.mRotation.z);
+	}
+
+	fclose(file);
+
+	return true;
+}
\ No newline at end of file
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <glm/glm.hpp>
+
+class Camera;
+
+struct CameraKeyframe
+{
+	float mTime;
+	glm::vec3 mPosition;
+
+	// Euler angles in degrees, as passed to Camera::SetRotation().
+	glm::vec3 mRotation;
+};
+
+// Keyframed camera motion, so that unattended runs such as headless renders and benchmarks see
+// the same frames every time. The camera follows a Catmull-Rom spline through the keyframes.
+class CameraPath
+{
+public:
+
+	// Keyframes have to be added in order of increasing time.
+	void AddKeyframe(float time, glm::vec3 position, glm::vec3 rotation);
+
+	// Adds a keyframe at camera's current pose, interval seconds after the last one.
+	void Record(Camera* camera, float interval);
+
+	void Clear();
+
+	bool IsEmpty() const;
+
+	float GetDuration() const;
+
+	// Moves camera to where the path is at time, looping once the last keyframe has passed.
+	void Apply(float time, Camera* camera) const;
+
+	// Text file with one keyframe per line: time, position xyz, rotation xyz. Lines starting with # are skipped.
+	bool Load(const std::string& path);
+
+	bool Save(const std::string& path) const;
+
+private:
+
+	std::vector<CameraKeyframe> mKeyframes;
+};
\ No newline at end of file
@@ -1,4 +1,4 @@
-#include "CheckBox.h"
+#include "Checkbox.h"
 
 CheckBox::CheckBox()
 {
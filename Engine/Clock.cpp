@@ -5,7 +5,9 @@
 using namespace std;
 using namespace std::chrono;
 
-Clock::Clock()
+Clock::Clock() :
+	mDeltaTime(0.0f),
+	mFixedDeltaTime(0.0f)
 {
 
 }
@@ -26,9 +28,19 @@ void Clock::Update()
 	mCurrentTime = high_resolution_clock::now();
 	mDeltaTime = duration_cast<microseconds>(mCurrentTime - mPreviousTime).count() / 1000000.0f;
 	mPreviousTime = mCurrentTime;
+
+	if (mFixedDeltaTime > 0.0f)
+	{
+		mDeltaTime = mFixedDeltaTime;
+	}
 }
 
 float Clock::DeltaTime() const
 {
 	return mDeltaTime;
+}
+
+void Clock::SetFixedDeltaTime(float deltaTime)
+{
+	mFixedDeltaTime = deltaTime;
 }
\ No newline at end of file
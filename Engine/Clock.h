@@ -16,10 +16,15 @@ public:
 
 	float DeltaTime() const;
 
+	// Advances by a fixed step on every Update() instead of the elapsed time, for repeatable runs.
+	// 0 goes back to measuring time.
+	void SetFixedDeltaTime(float deltaTime);
+
 private:
 	
 	std::chrono::high_resolution_clock::time_point mPreviousTime;
 	std::chrono::high_resolution_clock::time_point mCurrentTime;
 
 	float mDeltaTime;
+	float mFixedDeltaTime;
 };
\ No newline at end of file
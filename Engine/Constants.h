@@ -2,9 +2,27 @@
 
 #define RENDERER_MAX_DESCRIPTOR_SETS 4096
 #define RENDERER_MAX_UNIFORM_BUFFER_DESCRIPTORS 4096
+#define RENDERER_MAX_DYNAMIC_UNIFORM_BUFFER_DESCRIPTORS 4096
 #define RENDERER_MAX_STORAGE_BUFFER_DESCRIPTORS 32
 #define RENDERER_MAX_STORAGE_IMAGE_DESCRIPTORS 32
 #define RENDERER_MAX_SAMPLER_DESCRIPTORS 4096
+#define UNIFORM_RING_FRAME_SIZE (8 * 1024 * 1024)
+#define MAX_FRAMES_IN_FLIGHT 3
+#define DEFRAG_MAX_BYTES_PER_FRAME (4 * 1024 * 1024)
+#define UPLOAD_STAGING_SIZE (64 * 1024 * 1024)
+#define UPLOAD_MAX_BATCHES 4
+#define GPU_PROFILER_HISTORY 256
+#define CPU_PROFILER_MAX_ZONES_PER_THREAD (64 * 1024)
+#define CPU_TRACE_FILE_NAME "CpuTrace.json"
+#define CAMERA_PATH_FILE_NAME "CameraPath.txt"
+#define CAMERA_PATH_RECORD_INTERVAL 2.0f
+#define PIPELINE_CACHE_FILE_NAME "PipelineCache.bin"
+#define SCENE_LOAD_MAX_THREADS 8
+#define RENDERER_MAX_RECORDING_THREADS 8
+#define RENDERER_MAX_PIPELINE_THREADS 8
+#define RENDERER_MIN_DRAWS_PER_SLICE 128
+#define TEXTURE_EVICTION_MIP_LEVELS 1
+#define TEXTURE_RESTORE_HEADROOM (64ULL * 1024 * 1024)
 #define MINIMUM_INTENSITY (5.0f / 256.0f)
 #define INVERSE_MININUM_INTENSITY (1.0f / MINIMUM_INTENSITY)
 
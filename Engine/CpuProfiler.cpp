@@ -0,0 +1,248 @@
+#include "CpuProfiler.h"
+#include "Constants.h"
+#include "Log.h"
+
+#include <vector>
+#include <mutex>
+#include <stdio.h>
+
+using namespace std;
+using namespace std::chrono;
+
+struct ZoneEvent
+{
+	const char* mName;
+	int64_t mStart;
+	int64_t mDuration;
+	uint32_t mThreadId;
+};
+
+// Only the owning thread appends. Readers see the first mCount events once mGeneration
+// matches the current capture.
+struct ThreadZoneBuffer
+{
+	vector<ZoneEvent> mEvents;
+	atomic<uint32_t> mCount;
+	atomic<uint32_t> mDropped;
+	atomic<uint32_t> mGeneration;
+	bool mInUse;
+};
+
+// Returns the buffer to the pool when its thread exits, so short lived threads reuse them.
+struct ThreadBufferHandle
+{
+	ThreadZoneBuffer* mBuffer = nullptr;
+	uint32_t mThreadId = 0;
+
+	~ThreadBufferHandle();
+};
+
+atomic<bool> CpuProfiler::sCapturing(false);
+
+static mutex sBuffersMutex;
+static vector<ThreadZoneBuffer*> sBuffers;
+static atomic<uint32_t> sGeneration(0);
+static uint32_t sNextThreadId = 0;
+static high_resolution_clock::time_point sCaptureStart;
+
+static uint32_t sFramesRemaining = 0;
+static string sCapturePath;
+
+static thread_local ThreadBufferHandle tBufferHandle;
+
+ThreadBufferHandle::~ThreadBufferHandle()
+{
+	if (mBuffer != nullptr)
+	{
+		lock_guard<mutex> lock(sBuffersMutex);
+		mBuffer->mInUse = false;
+	}
+}
+
+static ThreadBufferHandle& GetThreadBuffer()
+{
+	if (tBufferHandle.mBuffer == nullptr)
+	{
+		lock_guard<mutex> lock(sBuffersMutex);
+
+		for (ThreadZoneBuffer* buffer : sBuffers)
+		{
+			if (!buffer->mInUse)
+			{
+				tBufferHandle.mBuffer = buffer;
+				break;
+			}
+		}
+
+		if (tBufferHandle.mBuffer == nullptr)
+		{
+			ThreadZoneBuffer* buffer = new ThreadZoneBuffer();
+			buffer->mEvents.resize(CPU_PROFILER_MAX_ZONES_PER_THREAD);
+			buffer->mCount = 0;
+			buffer->mDropped = 0;
+			buffer->mGeneration = 0;
+			sBuffers.push_back(buffer);
+
+			tBufferHandle.mBuffer = buffer;
+		}
+
+		tBufferHandle.mBuffer->mInUse = true;
+		tBufferHandle.mThreadId = sNextThreadId++;
+	}
+
+	return tBufferHandle;
+}
+
+void CpuProfiler::BeginCapture()
+{
+	if (IsCapturing())
+	{
+		return;
+	}
+
+	sCaptureStart = high_resolution_clock::now();
+
+	// Buffers still holding an older generation are cleared by their own thread on the next zone.
+	sGeneration.fetch_add(1, memory_order_release);
+	sCapturing.store(true, memory_order_release);
+}
+
+void CpuProfiler::EndCapture()
+{
+	sCapturing.store(false, memory_order_release);
+	sFramesRemaining = 0;
+}
+
+void CpuProfiler::CaptureFrames(uint32_t numFrames, const std::string& path)
+{
+	EndCapture();
+	BeginCapture();
+
+	sFramesRemaining = numFrames;
+	sCapturePath = path;
+}
+
+void CpuProfiler::EndFrame()
+{
+	if (sFramesRemaining > 0 &&
+		--sFramesRemaining == 0)
+	{
+		EndCapture();
+		WriteChromeTrace(sCapturePath);
+	}
+}
+
+std::string CpuProfiler::GetChromeTraceJson()
+{
+	uint32_t generation = sGeneration.load(memory_order_acquire);
+
+	string json = "{\n\t\"displayTimeUnit\": \"ms\",\n\t\"traceEvents\": [";
+	char line[512];
+	bool first = true;
+
+	lock_guard<mutex> lock(sBuffersMutex);
+
+	for (ThreadZoneBuffer* buffer : sBuffers)
+	{
+		if (buffer->mGeneration.load(memory_order_acquire) != generation)
+		{
+			continue;
+		}
+
+		uint32_t count = buffer->mCount.load(memory_order_acquire);
+
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			const ZoneEvent& zone = buffer->mEvents[i];
+
+			// Chrome traces are in microseconds.
+			snprintf(line, sizeof(line), "%s\n\t\t{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 0, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f}",
+				first ? "" : ",",
+				zone.mName,
+				zone.mThreadId,
+				zone.mStart / 1000.0,
+				zone.mDuration / 1000.0);
+			json += line;
+
+			first = false;
+		}
+	}
+
+	json += "\n\t]\n}\n";
+
+	return json;
+}
+
+bool CpuProfiler::WriteChromeTrace(const std::string& path)
+{
+	FILE* file = fopen(path.c_str(), "w");
+
+	if (file == nullptr)
+	{
+		LogError("Failed to open %s for writing the CPU trace", path.c_str());
+		return false;
+	}
+
+	std::string json = GetChromeTraceJson();
+	fwrite(json.c_str(), 1, json.size(), file);
+	fclose(file);
+
+	uint32_t dropped = GetNumDroppedZones();
+
+	if (dropped > 0)
+	{
+		LogWarning("CPU trace %s is missing %u zones, raise CPU_PROFILER_MAX_ZONES_PER_THREAD", path.c_str(), dropped);
+	}
+
+	return true;
+}
+
+uint32_t CpuProfiler::GetNumDroppedZones()
+{
+	uint32_t generation = sGeneration.load(memory_order_acquire);
+	uint32_t dropped = 0;
+
+	lock_guard<mutex> lock(sBuffersMutex);
+
+	for (ThreadZoneBuffer* buffer : sBuffers)
+	{
+		if (buffer->mGeneration.load(memory_order_acquire) == generation)
+		{
+			dropped += buffer->mDropped.load(memory_order_relaxed);
+		}
+	}
+
+	return dropped;
+}
+
+void CpuProfiler::RecordZone(const char* name, high_resolution_clock::time_point start, high_resolution_clock::time_point end)
+{
+	ThreadBufferHandle& handle = GetThreadBuffer();
+	ThreadZoneBuffer* buffer = handle.mBuffer;
+
+	uint32_t generation = sGeneration.load(memory_order_acquire);
+
+	if (buffer->mGeneration.load(memory_order_relaxed) != generation)
+	{
+		buffer->mCount.store(0, memory_order_relaxed);
+		buffer->mDropped.store(0, memory_order_relaxed);
+		buffer->mGeneration.store(generation, memory_order_release);
+	}
+
+	uint32_t count = buffer->mCount.load(memory_order_relaxed);
+
+	if (count >= buffer->mEvents.size())
+	{
+		buffer->mDropped.fetch_add(1, memory_order_relaxed);
+		return;
+	}
+
+	ZoneEvent& zone = buffer->mEvents[count];
+	zone.mName = name;
+	zone.mStart = duration_cast<nanoseconds>(start - sCaptureStart).count();
+	zone.mDuration = duration_cast<nanoseconds>(end - start).count();
+	zone.mThreadId = handle.mThreadId;
+
+	// Publish the event to readers.
+	buffer->mCount.store(count + 1, memory_order_release);
+}
\ No newline at end of file
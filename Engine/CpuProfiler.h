@@ -0,0 +1,87 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <chrono>
+#include <atomic>
+
+// Set to 0 to compile out every profiling zone.
+#ifndef CPU_PROFILING
+#define CPU_PROFILING 1
+#endif
+
+#if CPU_PROFILING
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+// Times the rest of the enclosing scope. name must be a string literal.
+#define PROFILE_ZONE(name) CpuZone PROFILE_CONCAT(sCpuZone, __LINE__)(name)
+#define PROFILE_FUNCTION() PROFILE_ZONE(__FUNCTION__)
+#else
+#define PROFILE_ZONE(name)
+#define PROFILE_FUNCTION()
+#endif
+
+// Records CPU zones while a capture is running and writes them as a Chrome trace
+// (chrome://tracing or ui.perfetto.dev). Each thread appends to its own fixed size
+// buffer without locking, zones that don't fit are dropped and counted.
+class CpuProfiler
+{
+public:
+
+	static void BeginCapture();
+
+	static void EndCapture();
+
+	// Captures the next numFrames frames and writes them to path.
+	static void CaptureFrames(uint32_t numFrames, const std::string& path);
+
+	// Call once per frame, finishes a capture started with CaptureFrames().
+	static void EndFrame();
+
+	static bool IsCapturing()
+	{
+		return sCapturing.load(std::memory_order_relaxed);
+	}
+
+	static std::string GetChromeTraceJson();
+	static bool WriteChromeTrace(const std::string& path);
+
+	// Zones dropped in the last capture because a thread's buffer was full.
+	static uint32_t GetNumDroppedZones();
+
+	static void RecordZone(const char* name, std::chrono::high_resolution_clock::time_point start, std::chrono::high_resolution_clock::time_point end);
+
+private:
+
+	static std::atomic<bool> sCapturing;
+};
+
+class CpuZone
+{
+public:
+
+	CpuZone(const char* name) :
+		mName(name),
+		mActive(CpuProfiler::IsCapturing())
+	{
+		if (mActive)
+		{
+			mStart = std::chrono::high_resolution_clock::now();
+		}
+	}
+
+	~CpuZone()
+	{
+		if (mActive)
+		{
+			CpuProfiler::RecordZone(mName, mStart, std::chrono::high_resolution_clock::now());
+		}
+	}
+
+private:
+
+	const char* mName;
+	bool mActive;
+	std::chrono::high_resolution_clock::time_point mStart;
+};
\ No newline at end of file
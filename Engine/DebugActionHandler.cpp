@@ -2,7 +2,11 @@
 #include "Enums.h"
 #include "Renderer.h"
 #include "Input.h"
-#include <Windows.h>
+#include "Allocator.h"
+#include "CpuProfiler.h"
+#include "CameraPath.h"
+#include "Scene.h"
+#include "Constants.h"
 
 DebugActionHandler::DebugActionHandler() :
 	mGBufferViewMode(GB_COUNT),
@@ -116,6 +120,42 @@ void DebugActionHandler::Update()
 		Renderer::Get()->ToggleIrradianceDebug();
 	}
 
+	if (IsKeyJustDown(VKEY_J) &&
+		IsKeyDown(VKEY_CONTROL))
+	{
+		Allocator::WriteStatsJson("AllocatorStats.json");
+	}
+
+	// Starts a CPU capture, and writes it out when pressed again. Ctrl+P is taken by the scene's light movement.
+	if (IsKeyJustDown(VKEY_U) &&
+		IsKeyDown(VKEY_CONTROL))
+	{
+		if (CpuProfiler::IsCapturing())
+		{
+			CpuProfiler::EndCapture();
+			CpuProfiler::WriteChromeTrace(CPU_TRACE_FILE_NAME);
+		}
+		else
+		{
+			CpuProfiler::BeginCapture();
+		}
+	}
+
+	// Appends the current camera pose to a path for --camera-path, and saves it.
+	if (IsKeyJustDown(VKEY_B) &&
+		IsKeyDown(VKEY_CONTROL))
+	{
+		static CameraPath recordedPath;
+
+		Scene* scene = Renderer::Get()->GetScene();
+
+		if (scene != nullptr)
+		{
+			recordedPath.Record(scene->GetActiveCamera(), CAMERA_PATH_RECORD_INTERVAL);
+			recordedPath.Save(CAMERA_PATH_FILE_NAME);
+		}
+	}
+
     static bool eDown = false;
 
     if (IsKeyJustDown(VKEY_E) &&
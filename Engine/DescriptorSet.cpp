@@ -1,6 +1,8 @@
 #include "DescriptorSet.h"
 #include "Renderer.h"
 
+#include <stdexcept>
+
 using namespace std;
 
 DescriptorSet::DescriptorSet() :
@@ -31,7 +33,7 @@ void DescriptorSet::Create(VkDescriptorSetLayout layout, VkDescriptorPool pool)
 
 	if (vkAllocateDescriptorSets(device, &allocInfo, &mDescriptorSet) != VK_SUCCESS)
 	{
-		throw exception("Failed to create descriptor set");
+		throw runtime_error("Failed to create descriptor set");
 	}
 
 	mOwningPool = owningPool;
@@ -39,13 +41,10 @@ void DescriptorSet::Create(VkDescriptorSetLayout layout, VkDescriptorPool pool)
 
 void DescriptorSet::Destroy()
 {
-	Renderer* renderer = Renderer::Get();
-	VkDevice device = renderer->GetDevice();
-
 	if (mDescriptorSet != VK_NULL_HANDLE &&
 		mOwningPool != VK_NULL_HANDLE)
 	{
-		vkFreeDescriptorSets(device, mOwningPool, 1, &mDescriptorSet);
+		Renderer::Get()->GetDestructionQueue().FreeDescriptorSet(mDescriptorSet, mOwningPool);
 		mDescriptorSet = VK_NULL_HANDLE;
 		mOwningPool = VK_NULL_HANDLE;
 	}
@@ -75,7 +74,7 @@ void DescriptorSet::UpdateImageDescriptor(int32_t binding, VkImageView imageView
 	vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
 }
 
-void DescriptorSet::UpdateUniformDescriptor(int32_t binding, VkBuffer buffer, int32_t size)
+void DescriptorSet::UpdateUniformDescriptor(int32_t binding, VkBuffer buffer, int32_t size, VkDescriptorType type, VkDeviceSize offset)
 {
 	assert(mDescriptorSet != VK_NULL_HANDLE);
 
@@ -85,14 +84,14 @@ void DescriptorSet::UpdateUniformDescriptor(int32_t binding, VkBuffer buffer, in
 	VkDescriptorBufferInfo bufferInfo = {};
 	bufferInfo.buffer = buffer;
 	bufferInfo.range = size;
-	bufferInfo.offset = 0;
+	bufferInfo.offset = offset;
 
 	VkWriteDescriptorSet descriptorWrite = {};
 	descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
 	descriptorWrite.dstSet = mDescriptorSet;
 	descriptorWrite.dstBinding = binding;
 	descriptorWrite.dstArrayElement = 0;
-	descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	descriptorWrite.descriptorType = type;
 	descriptorWrite.descriptorCount = 1;
 	descriptorWrite.pBufferInfo = &bufferInfo;
 
@@ -17,7 +17,7 @@ public:
 
 	void UpdateImageDescriptor(int32_t binding, VkImageView imageView, VkSampler sampler, VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 
-	void UpdateUniformDescriptor(int32_t binding, VkBuffer buffer, int32_t size);
+	void UpdateUniformDescriptor(int32_t binding, VkBuffer buffer, int32_t size, VkDescriptorType type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VkDeviceSize offset = 0);
 
 	VkDescriptorSet GetDescriptorSet();
 
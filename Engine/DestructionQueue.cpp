@@ -0,0 +1,208 @@
+#include "DestructionQueue.h"
+#include "Renderer.h"
+
+#include <assert.h>
+
+DestructionQueue::DestructionQueue()
+{
+	for (uint32_t i = 0; i < VK_MAX_MEMORY_HEAPS; ++i)
+	{
+		mPendingFreeBytes[i] = 0;
+	}
+}
+
+void DestructionQueue::DestroyBuffer(VkBuffer buffer)
+{
+	if (buffer != VK_NULL_HANDLE)
+	{
+		Push(ResourceType::Buffer, (uint64_t)buffer);
+	}
+}
+
+void DestructionQueue::DestroyImage(VkImage image)
+{
+	if (image != VK_NULL_HANDLE)
+	{
+		Push(ResourceType::Image, (uint64_t)image);
+	}
+}
+
+void DestructionQueue::DestroyImageView(VkImageView imageView)
+{
+	if (imageView != VK_NULL_HANDLE)
+	{
+		Push(ResourceType::ImageView, (uint64_t)imageView);
+	}
+}
+
+void DestructionQueue::DestroySampler(VkSampler sampler)
+{
+	if (sampler != VK_NULL_HANDLE)
+	{
+		Push(ResourceType::Sampler, (uint64_t)sampler);
+	}
+}
+
+void DestructionQueue::DestroyPipeline(VkPipeline pipeline)
+{
+	if (pipeline != VK_NULL_HANDLE)
+	{
+		Push(ResourceType::Pipeline, (uint64_t)pipeline);
+	}
+}
+
+void DestructionQueue::DestroyFramebuffer(VkFramebuffer framebuffer)
+{
+	if (framebuffer != VK_NULL_HANDLE)
+	{
+		Push(ResourceType::Framebuffer, (uint64_t)framebuffer);
+	}
+}
+
+void DestructionQueue::FreeDescriptorSet(VkDescriptorSet descriptorSet, VkDescriptorPool pool)
+{
+	if (descriptorSet != VK_NULL_HANDLE)
+	{
+		assert(pool != VK_NULL_HANDLE);
+		Push(ResourceType::DescriptorSet, (uint64_t)descriptorSet, pool);
+	}
+}
+
+void DestructionQueue::FreeSingleSubmissionCommands(VkCommandBuffer commandBuffer)
+{
+	if (commandBuffer != VK_NULL_HANDLE)
+	{
+		Push(ResourceType::SingleSubmissionCommands, (uint64_t)(uintptr_t)commandBuffer);
+	}
+}
+
+void DestructionQueue::FreeAllocation(Allocation& allocation)
+{
+	if (!allocation.IsValid())
+	{
+		return;
+	}
+
+	// Defragment() must not move memory that is about to be freed, and the owner
+	// registered for it is about to be reset.
+	if (allocation.mMappedPtr == nullptr)
+	{
+		Allocator::SetRelocatable(allocation, nullptr);
+	}
+
+	Entry entry;
+	entry.mType = ResourceType::Allocation;
+	entry.mFrame = Renderer::Get()->GetFrameNumber();
+	entry.mAllocation = allocation;
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mEntries.push_back(entry);
+		mPendingFreeBytes[Allocator::GetHeapIndex(allocation.mType)] += allocation.mSize;
+	}
+
+	// The queue owns the memory now. Reset the caller's copy the way Allocator::Free() does.
+	allocation = Allocation();
+}
+
+void DestructionQueue::Flush(uint64_t completedFrame)
+{
+	// Release outside of the lock, freeing allocations takes the allocator locks.
+	std::deque<Entry> retired;
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+
+		while (!mEntries.empty() &&
+			mEntries.front().mFrame <= completedFrame)
+		{
+			retired.push_back(mEntries.front());
+			mEntries.pop_front();
+		}
+	}
+
+	for (Entry& entry : retired)
+	{
+		Release(entry);
+	}
+}
+
+void DestructionQueue::FlushAll()
+{
+	Flush(UINT64_MAX);
+}
+
+uint32_t DestructionQueue::GetNumPending()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return static_cast<uint32_t>(mEntries.size());
+}
+
+uint64_t DestructionQueue::GetPendingFreeBytes(uint32_t heapIndex)
+{
+	assert(heapIndex < VK_MAX_MEMORY_HEAPS);
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mPendingFreeBytes[heapIndex];
+}
+
+void DestructionQueue::Push(ResourceType type, uint64_t handle, VkDescriptorPool pool)
+{
+	Entry entry;
+	entry.mType = type;
+	entry.mFrame = Renderer::Get()->GetFrameNumber();
+	entry.mHandle = handle;
+	entry.mPool = pool;
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	mEntries.push_back(entry);
+}
+
+void DestructionQueue::Release(Entry& entry)
+{
+	VkDevice device = Renderer::Get()->GetDevice();
+
+	switch (entry.mType)
+	{
+	case ResourceType::Buffer:
+		vkDestroyBuffer(device, (VkBuffer)entry.mHandle, nullptr);
+		break;
+	case ResourceType::Image:
+		vkDestroyImage(device, (VkImage)entry.mHandle, nullptr);
+		break;
+	case ResourceType::ImageView:
+		vkDestroyImageView(device, (VkImageView)entry.mHandle, nullptr);
+		break;
+	case ResourceType::Sampler:
+		vkDestroySampler(device, (VkSampler)entry.mHandle, nullptr);
+		break;
+	case ResourceType::Pipeline:
+		vkDestroyPipeline(device, (VkPipeline)entry.mHandle, nullptr);
+		break;
+	case ResourceType::Framebuffer:
+		vkDestroyFramebuffer(device, (VkFramebuffer)entry.mHandle, nullptr);
+		break;
+	case ResourceType::DescriptorSet:
+	{
+		VkDescriptorSet descriptorSet = (VkDescriptorSet)entry.mHandle;
+		vkFreeDescriptorSets(device, entry.mPool, 1, &descriptorSet);
+		break;
+	}
+	case ResourceType::SingleSubmissionCommands:
+		Renderer::Get()->FreeSingleSubmissionCommands((VkCommandBuffer)(uintptr_t)entry.mHandle);
+		break;
+	case ResourceType::Allocation:
+	{
+		uint32_t heapIndex = Allocator::GetHeapIndex(entry.mAllocation.mType);
+		VkDeviceSize size = entry.mAllocation.mSize;
+
+		Allocator::Free(entry.mAllocation);
+
+		// Only now do the allocator's heap totals drop.
+		std::lock_guard<std::mutex> lock(mMutex);
+		assert(mPendingFreeBytes[heapIndex] >= size);
+		mPendingFreeBytes[heapIndex] -= size;
+		break;
+	}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <deque>
+#include <mutex>
+
+#include "Allocator.h"
+
+// Defers destroying GPU resources until no submitted frame can still use them.
+// Anything queued while Renderer::GetFrameNumber() is N is released by Flush(N) or later,
+// which the renderer calls once frame N has completed on the GPU. Handles are queued in
+// order and released in the same order, so queue views before their images and images
+// before their memory. May be called from any thread.
+class DestructionQueue
+{
+public:
+
+	DestructionQueue();
+
+	void DestroyBuffer(VkBuffer buffer);
+
+	void DestroyImage(VkImage image);
+
+	void DestroyImageView(VkImageView imageView);
+
+	void DestroySampler(VkSampler sampler);
+
+	void DestroyPipeline(VkPipeline pipeline);
+
+	void DestroyFramebuffer(VkFramebuffer framebuffer);
+
+	void FreeDescriptorSet(VkDescriptorSet descriptorSet, VkDescriptorPool pool);
+
+	// For command buffers from Renderer::BeginSingleSubmissionCommands() that weren't waited on.
+	void FreeSingleSubmissionCommands(VkCommandBuffer commandBuffer);
+
+	// Takes over the allocation and resets it, like Allocator::Free().
+	void FreeAllocation(Allocation& allocation);
+
+	// Releases everything queued up to and including completedFrame.
+	void Flush(uint64_t completedFrame);
+
+	// Releases everything. The device must be idle.
+	void FlushAll();
+
+	uint32_t GetNumPending();
+
+	// Bytes of queued allocations from the heap, which are still counted as allocated
+	// until they are released.
+	uint64_t GetPendingFreeBytes(uint32_t heapIndex);
+
+private:
+
+	enum class ResourceType
+	{
+		Buffer,
+		Image,
+		ImageView,
+		Sampler,
+		Pipeline,
+		Framebuffer,
+		DescriptorSet,
+		SingleSubmissionCommands,
+		Allocation
+	};
+
+	struct Entry
+	{
+		ResourceType mType;
+		uint64_t mFrame;
+
+		// Non-dispatchable handles are 64 bits on every platform.
+		uint64_t mHandle;
+		VkDescriptorPool mPool;
+		Allocation mAllocation;
+
+		Entry() :
+			mType(ResourceType::Buffer),
+			mFrame(0),
+			mHandle(0),
+			mPool(VK_NULL_HANDLE)
+		{
+
+		}
+	};
+
+	void Push(ResourceType type, uint64_t handle, VkDescriptorPool pool = VK_NULL_HANDLE);
+
+	void Release(Entry& entry);
+
+	std::mutex mMutex;
+
+	// Frame numbers only increase, so the oldest entries are at the front.
+	std::deque<Entry> mEntries;
+
+	uint64_t mPendingFreeBytes[VK_MAX_MEMORY_HEAPS];
+};
\ No newline at end of file
@@ -0,0 +1,100 @@
+#include "DynamicVertexBuffer.h"
+#include "Renderer.h"
+
+#include <algorithm>
+#include <string.h>
+
+DynamicVertexBuffer::DynamicVertexBuffer() :
+	mCapacity(0)
+{
+	for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
+	{
+		mStale[i] = false;
+	}
+}
+
+DynamicVertexBuffer::~DynamicVertexBuffer()
+{
+	Destroy();
+}
+
+void DynamicVertexBuffer::Destroy()
+{
+	DestructionQueue& destructionQueue = Renderer::Get()->GetDestructionQueue();
+
+	for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
+	{
+		// Frames in flight may still be drawing from the copies.
+		destructionQueue.FreeAllocation(mBuffers[i]);
+		mStale[i] = false;
+	}
+
+	mData.clear();
+	mCapacity = 0;
+}
+
+bool DynamicVertexBuffer::SetData(const void* data, VkDeviceSize size)
+{
+	Renderer* renderer = Renderer::Get();
+	uint32_t numFrames = renderer->GetNumFramesInFlight();
+	bool reallocated = false;
+
+	if (size > mCapacity)
+	{
+		// Grow geometrically so that text that keeps getting longer doesn't reallocate every time.
+		VkDeviceSize capacity = std::max(size, mCapacity * 2);
+		DestructionQueue& destructionQueue = renderer->GetDestructionQueue();
+
+		for (uint32_t i = 0; i < numFrames; ++i)
+		{
+			destructionQueue.FreeAllocation(mBuffers[i]);
+
+			Allocator::AllocBufferRange(capacity,
+				BufferArena::Geometry,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				mBuffers[i]);
+		}
+
+		mCapacity = capacity;
+		reallocated = true;
+	}
+
+	mData.assign(static_cast<const uint8_t*>(data), static_cast<const uint8_t*>(data) + size);
+
+	for (uint32_t i = 0; i < numFrames; ++i)
+	{
+		mStale[i] = true;
+	}
+
+	return reallocated;
+}
+
+void DynamicVertexBuffer::Update()
+{
+	uint32_t frameIndex = Renderer::Get()->GetFrameIndex();
+
+	if (!mStale[frameIndex])
+	{
+		return;
+	}
+
+	// The frame that last read this copy has completed.
+	if (!mData.empty())
+	{
+		memcpy(mBuffers[frameIndex].mMappedPtr, mData.data(), mData.size());
+		Allocator::FlushMappedRange(mBuffers[frameIndex], 0, mData.size());
+	}
+
+	mStale[frameIndex] = false;
+}
+
+void DynamicVertexBuffer::Bind(VkCommandBuffer commandBuffer)
+{
+	const Allocation& buffer = mBuffers[Renderer::Get()->GetFrameIndex()];
+	vkCmdBindVertexBuffers(commandBuffer, 0, 1, &buffer.mBuffer, &buffer.mOffset);
+}
+
+bool DynamicVertexBuffer::IsValid() const
+{
+	return mCapacity > 0;
+}
\ No newline at end of file
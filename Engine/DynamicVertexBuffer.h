@@ -0,0 +1,40 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+
+#include "Allocator.h"
+#include "Constants.h"
+
+// Host visible vertex data that changes now and then, e.g. a widget's. There is a copy per frame
+// in flight, so that the data can change without replacing the buffer that recorded command
+// buffers bind. Each frame's copy is brought up to date when that frame is prepared.
+class DynamicVertexBuffer
+{
+public:
+
+	DynamicVertexBuffer();
+
+	~DynamicVertexBuffer();
+
+	void Destroy();
+
+	// Replaces the vertex data. Returns true if the copies were reallocated to make room, in
+	// which case commands that bound them have to be recorded again.
+	bool SetData(const void* data, VkDeviceSize size);
+
+	// Writes the data into the current frame's copy if it changed since that copy was written.
+	void Update();
+
+	// Binds the current frame's copy to binding 0.
+	void Bind(VkCommandBuffer commandBuffer);
+
+	bool IsValid() const;
+
+private:
+
+	std::vector<uint8_t> mData;
+	Allocation mBuffers[MAX_FRAMES_IN_FLIGHT];
+	bool mStale[MAX_FRAMES_IN_FLIGHT];
+	VkDeviceSize mCapacity;
+};
\ No newline at end of file
@@ -1,6 +1,11 @@
 #include <vulkan/vulkan.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
 #include <Windows.h>
+#endif
 
 #include "ApplicationInfo.h"
 #include "ApplicationState.h"
@@ -9,6 +14,14 @@
 #include "CameraController.h"
 #include "DebugActionHandler.h"
 #include "Input.h"
+#include "CpuProfiler.h"
+#include "Constants.h"
+#include "CameraPath.h"
+#include "Benchmark.h"
+#include "Utilities.h"
+#include "Log.h"
+
+#include <chrono>
 
 static AppState sAppState;
 static bool sQuit = false;
@@ -16,7 +29,12 @@ static CameraController sCameraController;
 static DebugActionHandler sDebugHandler;
 static Scene* sScene = nullptr;
 static Clock sClock;
+static const CameraPath* sCameraPath = nullptr;
+static float sCameraPathTime = 0.0f;
+static Benchmark sBenchmark;
+static std::chrono::high_resolution_clock::time_point sStartTime;
 
+#if defined(_WIN32)
 // MS-Windows event handling function:
 LRESULT CALLBACK WndProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam) {
 	switch (uMsg) {
@@ -210,9 +228,11 @@ void CreateNativeWindow(int32_t width, int32_t height)
 	sAppState.mMinSize.x = GetSystemMetrics(SM_CXMINTRACK);
 	sAppState.mMinSize.y = GetSystemMetrics(SM_CYMINTRACK) + 1;
 }
+#endif
 
 void ProcessMessages()
 {
+#if defined(_WIN32)
 	MSG     msg;
 	BOOL    done = FALSE;
 
@@ -228,14 +248,106 @@ void ProcessMessages()
 			DispatchMessage(&msg);
 		}
 	}
+#endif
+}
+
+static void WriteScreenshot(const char* path)
+{
+	Renderer* renderer = Renderer::Get();
+	VkExtent2D extent = renderer->GetSwapchainExtent();
+	std::vector<uint8_t> pixels;
+
+	if (renderer->ReadbackLastFrame(pixels) &&
+		WritePng(path, extent.width, extent.height, pixels.data()))
+	{
+		printf("Wrote %s\n", path);
+	}
+	else
+	{
+		LogError("Failed to write the screenshot %s", path);
+	}
+}
+
+void ParseCommandLine(int32_t argc, char** argv)
+{
+	for (int32_t i = 1; i < argc; ++i)
+	{
+		if (!strcmp(argv[i], "--headless"))
+		{
+			sAppState.mHeadless = true;
+		}
+		else if (!strcmp(argv[i], "--frames") &&
+			i + 1 < argc)
+		{
+			sAppState.mHeadlessFrames = static_cast<uint32_t>(atoi(argv[++i]));
+		}
+		else if (!strcmp(argv[i], "--screenshot") &&
+			i + 1 < argc)
+		{
+			sAppState.mScreenshotPath = argv[++i];
+		}
+		else if (!strcmp(argv[i], "--benchmark") &&
+			i + 1 < argc)
+		{
+			sAppState.mBenchmarkFrames = static_cast<uint32_t>(atoi(argv[++i]));
+		}
+		else if (!strcmp(argv[i], "--warmup") &&
+			i + 1 < argc)
+		{
+			sAppState.mBenchmarkWarmupFrames = static_cast<uint32_t>(atoi(argv[++i]));
+		}
+		else if (!strcmp(argv[i], "--benchmark-output") &&
+			i + 1 < argc)
+		{
+			sAppState.mBenchmarkPath = argv[++i];
+		}
+		else if (!strcmp(argv[i], "--seed") &&
+			i + 1 < argc)
+		{
+			sAppState.mRandomSeed = static_cast<uint32_t>(atoi(argv[++i]));
+		}
+		else if (!strcmp(argv[i], "--scene") &&
+			i + 1 < argc)
+		{
+			sAppState.mSceneName = argv[++i];
+		}
+		else if (!strcmp(argv[i], "--camera-path") &&
+			i + 1 < argc)
+		{
+			sAppState.mCameraPathFile = argv[++i];
+		}
+		else if (!strcmp(argv[i], "--cpu-trace") &&
+			i + 1 < argc)
+		{
+			sAppState.mCpuTraceFrames = static_cast<uint32_t>(atoi(argv[++i]));
+		}
+		else if (!strcmp(argv[i], "--cold-pipeline-cache"))
+		{
+			sAppState.mLoadPipelineCache = false;
+		}
+		else
+		{
+			LogWarning("Ignoring unknown argument %s", argv[i]);
+		}
+	}
 }
 
 bool Initialize(int32_t width, int32_t height)
 {
+	sStartTime = std::chrono::high_resolution_clock::now();
+
 	Renderer::Create();
 	Renderer* renderer = Renderer::Get();
 
+#if defined(_WIN32)
 	sAppState.mConnection = GetModuleHandle(NULL); //hInstance;
+#else
+	if (!sAppState.mHeadless)
+	{
+		LogWarning("Only headless rendering is supported on this platform");
+		sAppState.mHeadless = true;
+	}
+#endif
 
 #ifdef NDEBUG
 	sAppState.mValidate = false;
@@ -245,10 +357,41 @@ bool Initialize(int32_t width, int32_t height)
 
 	renderer->SetAppState(&sAppState);
 
-	CreateNativeWindow(width, height);
+	// Started before the renderer so that initialization and scene loading are in the trace.
+	if (sAppState.mCpuTraceFrames > 0)
+	{
+		CpuProfiler::CaptureFrames(sAppState.mCpuTraceFrames, CPU_TRACE_FILE_NAME);
+	}
+
+	srand(sAppState.mRandomSeed);
+
+	// Fixed steps so that animation is the same in every run.
+	if (sAppState.mHeadless ||
+		sAppState.mBenchmarkFrames > 0)
+	{
+		sClock.SetFixedDeltaTime(APP_FIXED_DELTA_TIME);
+	}
+
+	if (sAppState.mHeadless)
+	{
+		// The offscreen images are the size the window would have been.
+		sAppState.mWindowWidth = width;
+		sAppState.mWindowHeight = height;
+	}
+	else
+	{
+#if defined(_WIN32)
+		CreateNativeWindow(width, height);
+#endif
+	}
 
 	renderer->Initialize();
 
+	if (sAppState.mBenchmarkFrames > 0)
+	{
+		sBenchmark.Start(sAppState.mBenchmarkWarmupFrames, sAppState.mBenchmarkFrames);
+	}
+
 	sClock.Start();
 
 	return true;
@@ -256,13 +399,80 @@ bool Initialize(int32_t width, int32_t height)
 
 bool Update()
 {
-	UpdateInput();
-	ProcessMessages();
-	sClock.Update();
-	sDebugHandler.Update();
-	sCameraController.Update(sClock.DeltaTime());
-	sScene->Update(sClock.DeltaTime());
-	Renderer::Get()->Render();
+	std::chrono::high_resolution_clock::time_point frameStart = std::chrono::high_resolution_clock::now();
+
+	{
+		PROFILE_ZONE("Update");
+
+		UpdateInput();
+		ProcessMessages();
+		sClock.Update();
+		sDebugHandler.Update();
+
+		if (sCameraPath != nullptr)
+		{
+			sCameraPathTime += sClock.DeltaTime();
+			sCameraPath->Apply(sCameraPathTime, sCameraController.GetCamera());
+		}
+		else
+		{
+			sCameraController.Update(sClock.DeltaTime());
+		}
+
+		sScene->Update(sClock.DeltaTime());
+		Renderer::Get()->Render();
+	}
+
+	if (Renderer::Get()->GetFrameNumber() == 1)
+	{
+		std::chrono::duration<float, std::milli> startupTime = std::chrono::high_resolution_clock::now() - sStartTime;
+		LogDebug("First frame submitted %.1f ms after Initialize()", startupTime.count());
+	}
+
+	CpuProfiler::EndFrame();
+
+	bool finished = false;
+
+	if (sBenchmark.IsRunning())
+	{
+		bool measuring = sBenchmark.IsMeasuring();
+
+		std::chrono::duration<float, std::milli> frameTime = std::chrono::high_resolution_clock::now() - frameStart;
+		sBenchmark.EndFrame(frameTime.count());
+
+		if (!measuring &&
+			sBenchmark.IsMeasuring())
+		{
+			// Measure the same stretch of the camera path in every run.
+			sCameraPathTime = 0.0f;
+		}
+
+		if (sBenchmark.IsFinished())
+		{
+			if (sBenchmark.WriteResults(sAppState.mBenchmarkPath, sAppState))
+			{
+				printf("Wrote %s\n", sAppState.mBenchmarkPath);
+			}
+
+			finished = true;
+		}
+	}
+	else if (sAppState.mHeadless &&
+		sAppState.mBenchmarkFrames == 0)
+	{
+		finished = Renderer::Get()->GetFrameNumber() >= sAppState.mHeadlessFrames;
+	}
+
+	if (finished)
+	{
+		if (sAppState.mHeadless &&
+			sAppState.mScreenshotPath != nullptr)
+		{
+			WriteScreenshot(sAppState.mScreenshotPath);
+		}
+
+		sQuit = true;
+	}
 
 	return !sQuit;
 }
@@ -279,6 +489,12 @@ void AssignDebugCamera(Camera* camera)
 	sCameraController.SetCamera(camera);
 }
 
+void SetCameraPath(const CameraPath* path)
+{
+	sCameraPath = path;
+	sCameraPathTime = 0.0f;
+}
+
 void SetScene(Scene* scene)
 {
 	Renderer* renderer = Renderer::Get();
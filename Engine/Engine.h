@@ -2,6 +2,12 @@
 
 #include <stdint.h>
 
+// Reads --headless, --frames <count>, --screenshot <file.png>, --benchmark <frames>, --warmup <frames>,
+// --benchmark-output <file.json>, --seed <n>, --scene <name>, --camera-path <file>, --cpu-trace <frames>
+// and --cold-pipeline-cache into the app state.
+// Call before Initialize().
+void ParseCommandLine(int32_t argc, char** argv);
+
 bool Initialize(int32_t width, int32_t height);
 
 bool Update();
@@ -10,6 +16,9 @@ void Shutdown();
 
 void AssignDebugCamera(class Camera* camera);
 
+// Moves the debug camera along path instead of the keyboard controls. nullptr hands control back.
+void SetCameraPath(const class CameraPath* path);
+
 void SetScene(class Scene* scene);
 
 const struct AppState* GetAppState();
@@ -3,6 +3,8 @@
 #include "Renderer.h"
 #include "Scene.h"
 
+#include <stdexcept>
+
 VkRenderPass EnvironmentCapture::sRenderPass = VK_NULL_HANDLE;
 
 //static float sQuadVertices = {0.0f, 0.0f,
@@ -17,8 +19,7 @@ EnvironmentCapture::EnvironmentCapture() :
 	mLitColorImage(VK_NULL_HANDLE),
 	mLitColorImageView(VK_NULL_HANDLE),
 	mLitColorSampler(VK_NULL_HANDLE),
-	mIrradianceRenderPass(VK_NULL_HANDLE),
-	mIrradianceBuffer(VK_NULL_HANDLE)
+	mIrradianceRenderPass(VK_NULL_HANDLE)
 {
 	for (int32_t i = 0; i < 6; ++i)
 	{
@@ -29,22 +30,19 @@ EnvironmentCapture::EnvironmentCapture() :
 
 EnvironmentCapture::~EnvironmentCapture()
 {
-	Renderer* renderer = Renderer::Get();
-	VkDevice device = renderer->GetDevice();
-
 	DestroyCubemap();
 
 	if (mLitColorImage != VK_NULL_HANDLE)
 	{
-		vkDestroyImage(device, mLitColorImage, nullptr);
-		vkDestroySampler(device, mLitColorSampler, nullptr);
-		vkDestroyImageView(device, mLitColorImageView, nullptr);
+		DestructionQueue& destructionQueue = Renderer::Get()->GetDestructionQueue();
+		destructionQueue.DestroyImageView(mLitColorImageView);
+		destructionQueue.DestroyImage(mLitColorImage);
+		destructionQueue.DestroySampler(mLitColorSampler);
+		destructionQueue.FreeAllocation(mLitColorImageMemory);
 
 		mLitColorImage = VK_NULL_HANDLE;
 		mLitColorSampler = VK_NULL_HANDLE;
 		mLitColorImageView = VK_NULL_HANDLE;
-
-		Allocator::Free(mLitColorImageMemory);
 	}
 }
 
@@ -89,28 +87,14 @@ void EnvironmentCapture::Capture()
 	mCubemap.TransitionToRT();
 	mIrradianceCubemap.TransitionToRT();
 
-    EarlyDepthPipeline earlyDepthPipeline;
-    ReflectionlessGeometryPipeline geometryPipeline;
-    LightPipeline lightPipeline;
-	DirectionalLightPipeline directionalLightPipeline;
-	PostProcessPipeline postProcessPipeline;
-
-    earlyDepthPipeline.mViewportWidth = mResolution;
-    earlyDepthPipeline.mViewportHeight = mResolution;
-    geometryPipeline.mViewportWidth = mResolution;
-    geometryPipeline.mViewportHeight = mResolution;
-    lightPipeline.mViewportWidth = mResolution;
-    lightPipeline.mViewportHeight = mResolution;
-	directionalLightPipeline.mViewportWidth = mResolution;
-	directionalLightPipeline.mViewportHeight = mResolution;
-	postProcessPipeline.mViewportWidth = mResolution;
-	postProcessPipeline.mViewportHeight = mResolution;
-
-    earlyDepthPipeline.Create();
-    geometryPipeline.Create();
-    lightPipeline.Create();
-	directionalLightPipeline.Create();
-	postProcessPipeline.Create();
+	// The renderer's pipelines have a dynamic viewport, so they render the faces as they are.
+	EarlyDepthPipeline& earlyDepthPipeline = renderer->GetEarlyDepthPipeline();
+	ReflectionlessGeometryPipeline& geometryPipeline = renderer->GetReflectionlessGeometryPipeline();
+	LightPipeline& lightPipeline = renderer->GetLightPipeline();
+	DirectionalLightPipeline& directionalLightPipeline = renderer->GetDirectionalLightPipeline();
+	PostProcessPipeline& postProcessPipeline = renderer->GetPostProcessPipeline();
+
+	geometryPipeline.Compile();
 
 	mPostProcessDescriptorSet.Destroy();
 	mPostProcessDescriptorSet.Create(postProcessPipeline.GetDescriptorSetLayout(1));
@@ -137,16 +121,24 @@ void EnvironmentCapture::Capture()
     renderer->UpdateGlobalDescriptorSet();
     UpdateDeferredDescriptor();
 
+	// Each face is submitted and waited on before the next one is recorded,
+	// so the per-face uniform data can reuse the same region of the ring.
+	UniformRingBuffer& uniformRing = renderer->GetUniformRingBuffer();
+	uint64_t uniformRingHead = uniformRing.GetHead();
+
 	uint32_t i = 0;
 
 	for (VkFramebuffer& framebuffer : mFramebuffers)
 	{
+		uniformRing.SetHead(uniformRingHead);
+
 		// Update scene using new camera
 		cameras[i].Update();
 		mScene->SetActiveCamera(&cameras[i]);
 		mScene->Update(0.0f, false);
 
 		VkCommandBuffer commandBuffer = renderer->BeginSingleSubmissionCommands();
+		renderer->GetGpuProfiler().BeginImmediateScope(commandBuffer, GpuScope::EnvironmentCapture);
 
 		renderer->SetViewportAndScissor(commandBuffer, 0, 0, mResolution, mResolution);
 
@@ -202,7 +194,10 @@ void EnvironmentCapture::Capture()
 
 		vkCmdEndRenderPass(commandBuffer);
 
+		// One sample per face, read back as soon as the face has been rendered.
+		renderer->GetGpuProfiler().EndImmediateScope(commandBuffer, GpuScope::EnvironmentCapture);
 		renderer->EndSingleSubmissionCommands(commandBuffer);
+		renderer->GetGpuProfiler().ResolveImmediateScope(GpuScope::EnvironmentCapture);
 
 		++i;
 	}
@@ -222,12 +217,12 @@ void EnvironmentCapture::Capture()
 
 	mScene->SetActiveCamera(savedCamera);
 
+	// Rewrite actor and light uniforms for the active camera.
+	uniformRing.SetHead(uniformRingHead);
+	mScene->Update(0.0f, false);
+
     DestroyFramebuffers();
     DestroyGBuffer();
-
-    earlyDepthPipeline.Destroy();
-    geometryPipeline.Destroy();
-    lightPipeline.Destroy();
 }
 
 void EnvironmentCapture::RenderIrradiance()
@@ -236,8 +231,6 @@ void EnvironmentCapture::RenderIrradiance()
 	VkDevice device = renderer->GetDevice();
 
 	IrradianceConvolutionPipeline irradiancePipeline;
-	irradiancePipeline.mViewportWidth = IRRADIANCE_RESOLUTION;
-	irradiancePipeline.mViewportHeight = IRRADIANCE_RESOLUTION;
 	irradiancePipeline.mRenderpass = mIrradianceRenderPass;
 	irradiancePipeline.mSubpass = 0;
 	irradiancePipeline.Create();
@@ -264,12 +257,10 @@ void EnvironmentCapture::RenderIrradiance()
 
 	for (int32_t i = 0; i < 6; ++i)
 	{
-		mIrradianceDescriptorSet.UpdateUniformDescriptor(1, mIrradianceBuffer, sizeof(glm::mat4));
+		mIrradianceDescriptorSet.UpdateUniformDescriptor(1, mIrradianceBuffer.mBuffer, sizeof(glm::mat4), VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, mIrradianceBuffer.mOffset);
 
-		void* data = nullptr;
-		vkMapMemory(device, mIrradianceBufferMemory.mDeviceMemory, mIrradianceBufferMemory.mOffset, sizeof(glm::mat4), 0, &data);
-		memcpy(data, &rotationMatrices[i], sizeof(glm::mat4));
-		vkUnmapMemory(device, mIrradianceBufferMemory.mDeviceMemory);
+		memcpy(mIrradianceBuffer.mMappedPtr, &rotationMatrices[i], sizeof(glm::mat4));
+		Allocator::FlushMappedRange(mIrradianceBuffer, 0, sizeof(glm::mat4));
 
 		VkCommandBuffer commandBuffer = renderer->BeginSingleSubmissionCommands();
 
@@ -301,6 +292,9 @@ void EnvironmentCapture::RenderIrradiance()
 		renderer->EndSingleSubmissionCommands(commandBuffer);
 
 	}
+
+	// Also releases its shader modules, which would otherwise be held until shutdown.
+	irradiancePipeline.Destroy();
 }
 
 void EnvironmentCapture::UpdateDeferredDescriptor()
@@ -363,7 +357,7 @@ void EnvironmentCapture::SetResolution(uint32_t size)
 	if (size == 0 ||
 		size > ENVIRONMENT_CAPTURE_MAX_RESOLUTION)
 	{
-		throw std::exception("Environment Capture invalid resolution");
+		throw std::runtime_error("Environment Capture invalid resolution");
 	}
 
 	mResolution = size;
@@ -372,8 +366,7 @@ void EnvironmentCapture::SetResolution(uint32_t size)
 
 void EnvironmentCapture::DestroyCubemap()
 {
-	Renderer* renderer = Renderer::Get();
-	VkDevice device = renderer->GetDevice();
+	DestructionQueue& destructionQueue = Renderer::Get()->GetDestructionQueue();
 
 	if (mCubemap.IsValid())
 	{
@@ -383,13 +376,13 @@ void EnvironmentCapture::DestroyCubemap()
 		assert(mDepthImageMemory.IsValid());
 		assert(mDepthImageView != VK_NULL_HANDLE);
 
-		vkDestroyImage(device, mDepthImage, nullptr);
-		mDepthImage = VK_NULL_HANDLE;
+		destructionQueue.DestroyImageView(mDepthImageView);
+		mDepthImageView = VK_NULL_HANDLE;
 
-		Allocator::Free(mDepthImageMemory);
+		destructionQueue.DestroyImage(mDepthImage);
+		mDepthImage = VK_NULL_HANDLE;
 
-		vkDestroyImageView(device, mDepthImageView, nullptr);
-		mDepthImageView = VK_NULL_HANDLE;
+		destructionQueue.FreeAllocation(mDepthImageMemory);
 	}
 }
 
@@ -423,8 +416,7 @@ glm::vec3 EnvironmentCapture::GetPosition()
 
 void EnvironmentCapture::CreateIrradianceUniformBuffer()
 {
-	Renderer* renderer = Renderer::Get();
-	renderer->CreateBuffer(sizeof(glm::mat4), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, mIrradianceBuffer, mIrradianceBufferMemory);
+	Allocator::AllocBufferRange(sizeof(glm::mat4), BufferArena::Uniform, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, mIrradianceBuffer);
 }
 
 void EnvironmentCapture::CreateIrradianceFramebuffers()
@@ -448,7 +440,7 @@ void EnvironmentCapture::CreateIrradianceFramebuffers()
 
 		if (vkCreateFramebuffer(device, &ciFramebuffer, nullptr, &mIrradianceFramebuffers[i]) != VK_SUCCESS)
 		{
-			throw std::exception("Failed to create framebuffer.");
+			throw std::runtime_error("Failed to create framebuffer.");
 		}
 	}
 }
@@ -490,14 +482,13 @@ void EnvironmentCapture::SetScene(Scene* scene)
 
 void EnvironmentCapture::DestroyFramebuffers()
 {
-	Renderer* renderer = Renderer::Get();
-	VkDevice device = renderer->GetDevice();
+	DestructionQueue& destructionQueue = Renderer::Get()->GetDestructionQueue();
 
 	for (VkFramebuffer& framebuffer : mFramebuffers)
 	{
 		if (framebuffer != VK_NULL_HANDLE)
 		{
-			vkDestroyFramebuffer(device, framebuffer, nullptr);
+			destructionQueue.DestroyFramebuffer(framebuffer);
 			framebuffer = VK_NULL_HANDLE;
 		}
 	}
@@ -538,7 +529,7 @@ void EnvironmentCapture::CreateFramebuffers()
 
 		if (vkCreateFramebuffer(device, &ciFramebuffer, nullptr, &mFramebuffers[i]) != VK_SUCCESS)
 		{
-			throw std::exception("Failed to create framebuffer.");
+			throw std::runtime_error("Failed to create framebuffer.");
 		}
 	}
 }
@@ -578,7 +569,7 @@ void EnvironmentCapture::CreateIrradianceRenderPass()
 
 		if (vkCreateRenderPass(device, &ciRenderPass, nullptr, &mIrradianceRenderPass) != VK_SUCCESS)
 		{
-			throw std::exception("Failed to create renderpass");
+			throw std::runtime_error("Failed to create renderpass");
 		}
 	}
 }
@@ -620,7 +611,7 @@ void EnvironmentCapture::CreateLitColorImage()
 
 	if (vkCreateSampler(device, &ciSampler, nullptr, &mLitColorSampler) != VK_SUCCESS)
 	{
-		throw std::exception("Failed to create texture sampler");
+		throw std::runtime_error("Failed to create texture sampler");
 	}
 
 	vkDeviceWaitIdle(device);
@@ -92,8 +92,7 @@ private:
 	DescriptorSet mPostProcessDescriptorSet;
 	DescriptorSet mIrradianceDescriptorSet;
 
-	VkBuffer mIrradianceBuffer;
-	Allocation mIrradianceBufferMemory;
+	Allocation mIrradianceBuffer;
 
 	VkRenderPass mIrradianceRenderPass;
 
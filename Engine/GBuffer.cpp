@@ -3,7 +3,7 @@
 #include "Allocator.h"
 
 #include <vulkan/vulkan.h>
-#include <exception>
+#include <stdexcept>
 
 using namespace std;
 
@@ -35,14 +35,13 @@ void GBuffer::Destroy()
         return;
     }
 
-	Renderer* renderer = Renderer::Get();
-	VkDevice device = renderer->GetDevice();
+	DestructionQueue& destructionQueue = Renderer::Get()->GetDestructionQueue();
 
 	for (size_t i = 0; i < mImages.size(); ++i)
 	{
-		vkDestroyImage(device, mImages[i], nullptr);
-		vkDestroyImageView(device, mImageViews[i], nullptr);
-		Allocator::Free(mImageMemory[i]);
+		destructionQueue.DestroyImageView(mImageViews[i]);
+		destructionQueue.DestroyImage(mImages[i]);
+		destructionQueue.FreeAllocation(mImageMemory[i]);
 	}
 
     mImages.clear();
@@ -52,7 +51,7 @@ void GBuffer::Destroy()
 
     if (mSampler != VK_NULL_HANDLE)
     {
-        vkDestroySampler(device, mSampler, nullptr);
+        destructionQueue.DestroySampler(mSampler);
         mSampler = VK_NULL_HANDLE;
     }
 }
@@ -113,7 +112,7 @@ void GBuffer::CreateSampler()
 
 	if (vkCreateSampler(Renderer::Get()->GetDevice(), &ciSampler, nullptr, &mSampler) != VK_SUCCESS)
 	{
-		throw exception("Failed to create GBuffer sampler");
+		throw runtime_error("Failed to create GBuffer sampler");
 	}
 }
 
@@ -0,0 +1,287 @@
+#include "GpuProfiler.h"
+#include "Renderer.h"
+#include "Constants.h"
+#include "Log.h"
+
+#include <assert.h>
+#include <stdexcept>
+
+using namespace std;
+
+static const uint32_t sQueriesPerScope = 2;
+static const uint32_t sQueriesPerSlot = static_cast<uint32_t>(GpuScope::Num) * sQueriesPerScope;
+
+GpuProfiler::GpuProfiler() :
+	mQueryPool(VK_NULL_HANDLE),
+	mNumFrames(0),
+	mHistorySize(GPU_PROFILER_HISTORY),
+	mRecordingFrame(0),
+	mTimestampPeriod(1.0f),
+	mTimestampMask(0)
+{
+
+}
+
+void GpuProfiler::Create(uint32_t numFrames)
+{
+	Destroy();
+
+	Renderer* renderer = Renderer::Get();
+	VkPhysicalDevice physicalDevice = renderer->GetPhysicalDevice();
+
+	uint32_t queueFamilyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+
+	vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+	uint32_t validBits = queueFamilies[renderer->GetGraphicsQueueFamily()].timestampValidBits;
+
+	if (validBits == 0)
+	{
+		LogWarning("GPU profiling disabled, the graphics queue doesn't support timestamps");
+		return;
+	}
+
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+
+	mTimestampPeriod = deviceProperties.limits.timestampPeriod;
+	mTimestampMask = (validBits >= 64) ? ~0ULL : ((1ULL << validBits) - 1);
+	mNumFrames = numFrames;
+	mRecordingFrame = 0;
+	mResolvedTimestamps.assign(mNumFrames, 0);
+
+	VkQueryPoolCreateInfo ciQueryPool = {};
+	ciQueryPool.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	ciQueryPool.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	ciQueryPool.queryCount = (mNumFrames + 1) * sQueriesPerSlot;
+
+	if (vkCreateQueryPool(renderer->GetDevice(), &ciQueryPool, nullptr, &mQueryPool) != VK_SUCCESS)
+	{
+		throw runtime_error("Failed to create timestamp query pool");
+	}
+
+	// Queries have to be reset before their results may be read, even if nothing was written.
+	VkCommandBuffer commandBuffer = renderer->BeginSingleSubmissionCommands();
+	vkCmdResetQueryPool(commandBuffer, mQueryPool, 0, ciQueryPool.queryCount);
+	renderer->EndSingleSubmissionCommands(commandBuffer);
+
+	SetHistorySize(mHistorySize);
+}
+
+void GpuProfiler::Destroy()
+{
+	if (mQueryPool != VK_NULL_HANDLE)
+	{
+		vkDestroyQueryPool(Renderer::Get()->GetDevice(), mQueryPool, nullptr);
+		mQueryPool = VK_NULL_HANDLE;
+	}
+}
+
+bool GpuProfiler::IsEnabled() const
+{
+	return mQueryPool != VK_NULL_HANDLE;
+}
+
+void GpuProfiler::BeginFrame(VkCommandBuffer commandBuffer, uint32_t frameIndex)
+{
+	assert(frameIndex < mNumFrames || !IsEnabled());
+	mRecordingFrame = frameIndex;
+
+	if (IsEnabled())
+	{
+		vkCmdResetQueryPool(commandBuffer, mQueryPool, GetQueryIndex(frameIndex, GpuScope::Frame), sQueriesPerSlot);
+	}
+}
+
+void GpuProfiler::BeginScope(VkCommandBuffer commandBuffer, GpuScope scope)
+{
+	if (IsEnabled())
+	{
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, mQueryPool, GetQueryIndex(mRecordingFrame, scope));
+	}
+}
+
+void GpuProfiler::EndScope(VkCommandBuffer commandBuffer, GpuScope scope)
+{
+	if (IsEnabled())
+	{
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, mQueryPool, GetQueryIndex(mRecordingFrame, scope) + 1);
+	}
+}
+
+void GpuProfiler::ResolveFrame(uint32_t frameIndex)
+{
+	if (IsEnabled())
+	{
+		ResolveSlot(frameIndex);
+	}
+}
+
+void GpuProfiler::BeginImmediateScope(VkCommandBuffer commandBuffer, GpuScope scope)
+{
+	if (IsEnabled())
+	{
+		uint32_t query = GetQueryIndex(mNumFrames, scope);
+		vkCmdResetQueryPool(commandBuffer, mQueryPool, query, sQueriesPerScope);
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, mQueryPool, query);
+	}
+}
+
+void GpuProfiler::EndImmediateScope(VkCommandBuffer commandBuffer, GpuScope scope)
+{
+	if (IsEnabled())
+	{
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, mQueryPool, GetQueryIndex(mNumFrames, scope) + 1);
+	}
+}
+
+void GpuProfiler::ResolveImmediateScope(GpuScope scope)
+{
+	if (!IsEnabled())
+	{
+		return;
+	}
+
+	uint64_t results[sQueriesPerScope * 2] = {};
+
+	VkResult result = vkGetQueryPoolResults(Renderer::Get()->GetDevice(),
+		mQueryPool,
+		GetQueryIndex(mNumFrames, scope),
+		sQueriesPerScope,
+		sizeof(results),
+		results,
+		sizeof(uint64_t) * 2,
+		VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+
+	if (result == VK_SUCCESS)
+	{
+		AddSample(scope, results[0], results[2]);
+	}
+}
+
+bool GpuProfiler::GetStats(GpuScope scope, SampleStats& outStats) const
+{
+	outStats = ComputeSampleStats(mHistory[static_cast<uint32_t>(scope)].mSamples);
+
+	return outStats.mNumSamples > 0;
+}
+
+void GpuProfiler::GetSamples(GpuScope scope, std::vector<float>& outSamples) const
+{
+	const ScopeHistory& history = mHistory[static_cast<uint32_t>(scope)];
+
+	// Once full, mNext is the oldest sample.
+	if (history.mSamples.size() < mHistorySize)
+	{
+		outSamples = history.mSamples;
+	}
+	else
+	{
+		outSamples.assign(history.mSamples.begin() + history.mNext, history.mSamples.end());
+		outSamples.insert(outSamples.end(), history.mSamples.begin(), history.mSamples.begin() + history.mNext);
+	}
+}
+
+void GpuProfiler::SetHistorySize(uint32_t historySize)
+{
+	assert(historySize > 0);
+	mHistorySize = historySize;
+
+	for (ScopeHistory& history : mHistory)
+	{
+		history.mSamples.reserve(mHistorySize);
+	}
+
+	ClearHistory();
+}
+
+void GpuProfiler::ClearHistory()
+{
+	for (ScopeHistory& history : mHistory)
+	{
+		history.mSamples.clear();
+		history.mNext = 0;
+	}
+}
+
+const char* GpuProfiler::GetScopeName(GpuScope scope)
+{
+	switch (scope)
+	{
+	case GpuScope::Frame: return "Frame";
+	case GpuScope::Shadows: return "Shadows";
+	case GpuScope::EarlyDepth: return "EarlyDepth";
+	case GpuScope::Geometry: return "Geometry";
+	case GpuScope::DirectionalLight: return "DirectionalLight";
+	case GpuScope::PointLights: return "PointLights";
+	case GpuScope::PostProcess: return "PostProcess";
+	case GpuScope::UI: return "UI";
+	case GpuScope::EnvironmentCapture: return "EnvironmentCapture";
+	default: return "Unknown";
+	}
+}
+
+uint32_t GpuProfiler::GetQueryIndex(uint32_t slot, GpuScope scope) const
+{
+	return slot * sQueriesPerSlot + static_cast<uint32_t>(scope) * sQueriesPerScope;
+}
+
+void GpuProfiler::ResolveSlot(uint32_t slot)
+{
+	// Pairs of timestamp and availability
+	uint64_t results[sQueriesPerSlot * 2] = {};
+
+	// Returns VK_NOT_READY when some scope wasn't written this frame, the others are still valid.
+	vkGetQueryPoolResults(Renderer::Get()->GetDevice(),
+		mQueryPool,
+		GetQueryIndex(slot, GpuScope::Frame),
+		sQueriesPerSlot,
+		sizeof(results),
+		results,
+		sizeof(uint64_t) * 2,
+		VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+
+	// The queries keep their results until the slot's next submission resets them.
+	if (results[1] != 0)
+	{
+		if (results[0] == mResolvedTimestamps[slot])
+		{
+			return;
+		}
+
+		mResolvedTimestamps[slot] = results[0];
+	}
+
+	for (uint32_t i = 0; i < static_cast<uint32_t>(GpuScope::Num); ++i)
+	{
+		const uint64_t* begin = &results[i * sQueriesPerScope * 2];
+		const uint64_t* end = begin + 2;
+
+		if (begin[1] != 0 && end[1] != 0)
+		{
+			AddSample(static_cast<GpuScope>(i), begin[0], end[0]);
+		}
+	}
+}
+
+void GpuProfiler::AddSample(GpuScope scope, uint64_t begin, uint64_t end)
+{
+	ScopeHistory& history = mHistory[static_cast<uint32_t>(scope)];
+
+	// Timestamps only have timestampValidBits, so they may wrap.
+	uint64_t ticks = ((end & mTimestampMask) - (begin & mTimestampMask)) & mTimestampMask;
+	float milliseconds = static_cast<float>(ticks * static_cast<double>(mTimestampPeriod) / 1000000.0);
+
+	if (history.mSamples.size() < mHistorySize)
+	{
+		history.mSamples.push_back(milliseconds);
+	}
+	else
+	{
+		history.mSamples[history.mNext] = milliseconds;
+	}
+
+	history.mNext = (history.mNext + 1) % mHistorySize;
+}
\ No newline at end of file
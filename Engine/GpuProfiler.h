@@ -0,0 +1,103 @@
+#pragma once
+
+#include "Utilities.h"
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <stdint.h>
+
+enum class GpuScope
+{
+	Frame,
+	Shadows,
+	EarlyDepth,
+	Geometry,
+	DirectionalLight,
+	PointLights,
+	PostProcess,
+	UI,
+	EnvironmentCapture,
+	Num
+};
+
+// Measures how long scopes of the frame take on the GPU with timestamp queries.
+// Each frame slot has its own queries. They are reset by the frame's command buffer, which may be
+// cached and submitted again, and read back once the slot's fence has signaled, so reading them
+// never stalls. Scopes that weren't written in a frame are skipped.
+class GpuProfiler
+{
+public:
+
+	GpuProfiler();
+
+	// Does nothing if the graphics queue doesn't support timestamps.
+	void Create(uint32_t numFrames);
+
+	void Destroy();
+
+	bool IsEnabled() const;
+
+	// Resets the queries of a frame slot. Record outside of a render pass, before any scope of the frame.
+	void BeginFrame(VkCommandBuffer commandBuffer, uint32_t frameIndex);
+
+	// Writes the timestamps of a scope into the frame last passed to BeginFrame(). In a subpass
+	// with secondary command buffer contents, write them into the first and last secondary.
+	void BeginScope(VkCommandBuffer commandBuffer, GpuScope scope);
+
+	void EndScope(VkCommandBuffer commandBuffer, GpuScope scope);
+
+	// Reads the timestamps of a frame slot whose last submission has completed. Each submission
+	// adds its samples once, so a slot may be resolved again before it is reused.
+	void ResolveFrame(uint32_t frameIndex);
+
+	// For work submitted outside of the frame loop, such as environment captures.
+	// Begin outside of a render pass and resolve once the submission has completed.
+	void BeginImmediateScope(VkCommandBuffer commandBuffer, GpuScope scope);
+
+	void EndImmediateScope(VkCommandBuffer commandBuffer, GpuScope scope);
+
+	void ResolveImmediateScope(GpuScope scope);
+
+	// In milliseconds, over the samples in the history. Returns false while the scope has no samples.
+	bool GetStats(GpuScope scope, SampleStats& outStats) const;
+
+	// The samples in the history, oldest first.
+	void GetSamples(GpuScope scope, std::vector<float>& outSamples) const;
+
+	// How many samples each scope keeps, GPU_PROFILER_HISTORY by default. Clears the history.
+	void SetHistorySize(uint32_t historySize);
+
+	// Drops all samples, e.g. after changing settings.
+	void ClearHistory();
+
+	static const char* GetScopeName(GpuScope scope);
+
+private:
+
+	struct ScopeHistory
+	{
+		std::vector<float> mSamples;
+		uint32_t mNext = 0;
+	};
+
+	// Queries of frame slot numFrames are used by immediate scopes.
+	uint32_t GetQueryIndex(uint32_t slot, GpuScope scope) const;
+
+	void ResolveSlot(uint32_t slot);
+
+	void AddSample(GpuScope scope, uint64_t begin, uint64_t end);
+
+	VkQueryPool mQueryPool;
+	uint32_t mNumFrames;
+	uint32_t mHistorySize;
+	uint32_t mRecordingFrame;
+
+	// Nanoseconds per tick
+	float mTimestampPeriod;
+	uint64_t mTimestampMask;
+
+	// Frame scope begin timestamp last read from each frame slot
+	std::vector<uint64_t> mResolvedTimestamps;
+
+	ScopeHistory mHistory[static_cast<uint32_t>(GpuScope::Num)];
+};
\ No newline at end of file
@@ -0,0 +1,59 @@
+#include "GpuProfilerOverlay.h"
+#include "Renderer.h"
+#include "DefaultFonts.h"
+
+#include <stdio.h>
+
+GpuProfilerOverlay::GpuProfilerOverlay()
+{
+	SetFont(&DefaultFonts::sRobotoMono24);
+	SetSize(16.0f);
+}
+
+GpuProfilerOverlay::~GpuProfilerOverlay()
+{
+
+}
+
+void GpuProfilerOverlay::Update()
+{
+	// The columns are fixed width, so new timings rewrite the vertices without re-recording.
+	RefreshText();
+
+	Text::Update();
+}
+
+void GpuProfilerOverlay::RefreshText()
+{
+	GpuProfiler& profiler = Renderer::Get()->GetGpuProfiler();
+
+	if (!profiler.IsEnabled())
+	{
+		SetText("GPU profiling unavailable");
+		return;
+	}
+
+	char line[256];
+	std::string text;
+
+	snprintf(line, sizeof(line), "%-18s %7s %7s %7s %7s\n", "GPU (ms)", "avg", "p50", "p95", "p99");
+	text += line;
+
+	for (uint32_t i = 0; i < static_cast<uint32_t>(GpuScope::Num); ++i)
+	{
+		SampleStats stats;
+
+		if (profiler.GetStats(static_cast<GpuScope>(i), stats))
+		{
+			snprintf(line, sizeof(line), "%-18s %7.3f %7.3f %7.3f %7.3f\n",
+				GpuProfiler::GetScopeName(static_cast<GpuScope>(i)),
+				stats.mMean,
+				stats.mP50,
+				stats.mP95,
+				stats.mP99);
+			text += line;
+		}
+	}
+
+	SetText(text);
+}
\ No newline at end of file
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "Text.h"
+
+// Text widget that displays GPU timings from the renderer's GpuProfiler, refreshed every frame.
+class GpuProfilerOverlay : public Text
+{
+public:
+
+	GpuProfilerOverlay();
+	virtual ~GpuProfilerOverlay();
+
+	virtual void Update() override;
+
+protected:
+
+	void RefreshText();
+};
\ No newline at end of file
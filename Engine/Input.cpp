@@ -781,7 +781,7 @@ int32_t CharToKey(char cTarget)
 	{
 		return VKEY_A + (cTarget - 'A');
 	}
-#elif defined (_WIN32)
+#else
 	return static_cast<int32_t>(cTarget);
 #endif
 
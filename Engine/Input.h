@@ -6,7 +6,105 @@
 #if defined(_WIN32)
 #include <windows.h>
 #include <Xinput.h>
+#endif
+
+#if defined(ANDROID)
+enum VakzKeyEnum
+{
+
+	VKEY_BACK = 4,
+
+	VKEY_0 = 7,
+	VKEY_1 = 8,
+	VKEY_2 = 9,
+	VKEY_3 = 10,
+	VKEY_4 = 11,
+	VKEY_5 = 12,
+	VKEY_6 = 13,
+	VKEY_7 = 14,
+	VKEY_8 = 15,
+	VKEY_9 = 16,
+
+	VKEY_A = 29,
+	VKEY_B = 30,
+	VKEY_C = 31,
+	VKEY_D = 32,
+	VKEY_E = 33,
+	VKEY_F = 34,
+	VKEY_G = 35,
+	VKEY_H = 36,
+	VKEY_I = 37,
+	VKEY_J = 38,
+	VKEY_K = 39,
+	VKEY_L = 40,
+	VKEY_M = 41,
+	VKEY_N = 42,
+	VKEY_O = 43,
+	VKEY_P = 44,
+	VKEY_Q = 45,
+	VKEY_R = 46,
+	VKEY_S = 47,
+	VKEY_T = 48,
+	VKEY_U = 49,
+	VKEY_V = 50,
+	VKEY_W = 51,
+	VKEY_X = 52,
+	VKEY_Y = 53,
+	VKEY_Z = 54,
+
+	VKEY_SPACE = 62,
+	VKEY_ENTER = 66,
+	VKEY_BACKSPACE = 67,
+	VKEY_TAB = 61,
+
+	VKEY_SHIFT = 60,
+	VKEY_CONTROL = 113,
+
+	VKEY_UP = 19,
+	VKEY_DOWN = 20,
+	VKEY_LEFT = 21,
+	VKEY_RIGHT = 22,
+
+	VKEY_NUMPAD0 = 144,
+	VKEY_NUMPAD1 = 145,
+	VKEY_NUMPAD2 = 146,
+	VKEY_NUMPAD3 = 147,
+	VKEY_NUMPAD4 = 148,
+	VKEY_NUMPAD5 = 149,
+	VKEY_NUMPAD6 = 150,
+	VKEY_NUMPAD7 = 151,
+	VKEY_NUMPAD8 = 152,
+	VKEY_NUMPAD9 = 153,
 
+	VKEY_F1 = 131,
+	VKEY_F2 = 132,
+	VKEY_F3 = 133,
+	VKEY_F4 = 134,
+	VKEY_F5 = 135,
+	VKEY_F6 = 136,
+	VKEY_F7 = 137,
+	VKEY_F8 = 138,
+	VKEY_F9 = 139,
+	VKEY_F10 = 140,
+	VKEY_F11 = 141,
+	VKEY_F12 = 142,
+
+	VKEY_PERIOD = 56,
+	VKEY_COMMA = 55,
+	VKEY_PLUS = 70,
+	VKEY_MINUS = 69,
+	VKEY_COLON = 74,
+	VKEY_QUESTION = 76,
+	VKEY_SQUIGGLE = 216, // Couldnt find keycode
+	VKEY_LEFT_BRACKET = 71,
+	VKEY_BACK_SLASH = 73,
+	VKEY_RIGHT_BRACKET = 72,
+	VKEY_QUOTE = 218, // Couldnt find keycode
+
+	VKEY_DELETE = 67
+};
+#else
+// Win32 virtual key codes. Other desktop platforms only render headless, where keys are never set.
 enum VakzKeyEnum
 {
 	VKEY_BACK = 10,
@@ -102,6 +200,7 @@ enum VakzKeyEnum
 	VKEY_DELETE = 0x2E
 
 };
+#endif
 
 enum VakzButtonEnum
 {
@@ -112,6 +211,7 @@ enum VakzButtonEnum
 	VBUTTON_X2 = 4
 };
 
+#if defined(_WIN32)
 enum VakzControllerEnum
 {
 	VCONT_A = XINPUT_GAMEPAD_A,
@@ -143,112 +243,7 @@ enum VakzControllerEnum
 	VCONT_AXIS_RTHUMB_X = 5,
 	VCONT_AXIS_RTHUMB_Y = 6
 };
-
-#elif defined(ANDROID)
-enum VakzKeyEnum
-{
-
-	VKEY_BACK = 4,
-
-	VKEY_0 = 7,
-	VKEY_1 = 8,
-	VKEY_2 = 9,
-	VKEY_3 = 10,
-	VKEY_4 = 11,
-	VKEY_5 = 12,
-	VKEY_6 = 13,
-	VKEY_7 = 14,
-	VKEY_8 = 15,
-	VKEY_9 = 16,
-
-	VKEY_A = 29,
-	VKEY_B = 30,
-	VKEY_C = 31,
-	VKEY_D = 32,
-	VKEY_E = 33,
-	VKEY_F = 34,
-	VKEY_G = 35,
-	VKEY_H = 36,
-	VKEY_I = 37,
-	VKEY_J = 38,
-	VKEY_K = 39,
-	VKEY_L = 40,
-	VKEY_M = 41,
-	VKEY_N = 42,
-	VKEY_O = 43,
-	VKEY_P = 44,
-	VKEY_Q = 45,
-	VKEY_R = 46,
-	VKEY_S = 47,
-	VKEY_T = 48,
-	VKEY_U = 49,
-	VKEY_V = 50,
-	VKEY_W = 51,
-	VKEY_X = 52,
-	VKEY_Y = 53,
-	VKEY_Z = 54,
-
-	VKEY_SPACE = 62,
-	VKEY_ENTER = 66,
-	VKEY_BACKSPACE = 67,
-	VKEY_TAB = 61,
-
-	VKEY_SHIFT = 60,
-	VKEY_CONTROL = 113,
-
-	VKEY_UP = 19,
-	VKEY_DOWN = 20,
-	VKEY_LEFT = 21,
-	VKEY_RIGHT = 22,
-
-	VKEY_NUMPAD0 = 144,
-	VKEY_NUMPAD1 = 145,
-	VKEY_NUMPAD2 = 146,
-	VKEY_NUMPAD3 = 147,
-	VKEY_NUMPAD4 = 148,
-	VKEY_NUMPAD5 = 149,
-	VKEY_NUMPAD6 = 150,
-	VKEY_NUMPAD7 = 151,
-	VKEY_NUMPAD8 = 152,
-	VKEY_NUMPAD9 = 153,
-
-	VKEY_F1 = 131,
-	VKEY_F2 = 132,
-	VKEY_F3 = 133,
-	VKEY_F4 = 134,
-	VKEY_F5 = 135,
-	VKEY_F6 = 136,
-	VKEY_F7 = 137,
-	VKEY_F8 = 138,
-	VKEY_F9 = 139,
-	VKEY_F10 = 140,
-	VKEY_F11 = 141,
-	VKEY_F12 = 142,
-
-	VKEY_PERIOD = 56,
-	VKEY_COMMA = 55,
-	VKEY_PLUS = 70,
-	VKEY_MINUS = 69,
-	VKEY_COLON = 74,
-	VKEY_QUESTION = 76,
-	VKEY_SQUIGGLE = 216, // Couldnt find keycode
-	VKEY_LEFT_BRACKET = 71,
-	VKEY_BACK_SLASH = 73,
-	VKEY_RIGHT_BRACKET = 72,
-	VKEY_QUOTE = 218, // Couldnt find keycode
-
-	VKEY_DELETE = 67
-};
-
-enum VakzButtonEnum
-{
-	VBUTTON_LEFT = 0,
-	VBUTTON_RIGHT = 1,
-	VBUTTON_MIDDLE = 2,
-	VBUTTON_X1 = 3,
-	VBUTTON_X2 = 4
-};
-
+#else
 enum VakzControllerEnum
 {
 	VCONT_A = 96,
@@ -275,7 +270,6 @@ enum VakzControllerEnum
 	VCONT_AXIS_LTRIGGER = 17,
 	VCONT_AXIS_RTRIGGER = 18
 };
-
 #endif
 
 enum VInputEnum
@@ -2,6 +2,7 @@
 #include "Texture2D.h"
 #include "Renderer.h"
 #include "Constants.h"
+#include "CpuProfiler.h"
 
 #include <assimp/scene.h>
 
@@ -41,6 +42,8 @@ void Material::Create(const Scene& scene,
 					  const aiMaterial& material,
 					  std::map<std::string, Texture2D>& textures)
 {
+	PROFILE_FUNCTION();
+
 	aiString name;
 	if (material.Get(AI_MATKEY_NAME, name) == aiReturn_SUCCESS)
 	{
@@ -171,16 +174,41 @@ void Material::UpdateDescriptorSets(VkDescriptorSet descriptorSet)
 	}
 }
 
+void Material::MarkSampled(uint64_t frameNumber)
+{
+	for (uint32_t i = 0; i < SLOT_COUNT; ++i)
+	{
+		if (mTextures[i] != nullptr)
+		{
+			mTextures[i]->MarkSampled(frameNumber);
+		}
+	}
+}
+
+bool Material::UsesTexture(const Texture2D* texture) const
+{
+	for (uint32_t i = 0; i < SLOT_COUNT; ++i)
+	{
+		if (mTextures[i] == texture)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
 void Material::SetTexture(const Scene& scene,
 	map<string, Texture2D>& textures,
 	Texture2D*& texture,
 	string name)
 {
+	// The texture is loaded later by Scene::LoadTextures(), together with all the others.
 	if (textures.find(name) == textures.end())
 	{
 		textures.insert(pair<string, Texture2D>(name, Texture2D()));
 		Texture2D& texEntry = textures[name];
-		texEntry.Load(scene.GetDirectory() + name);
+		texEntry.SetName(scene.GetDirectory() + name);
 		texture = &texEntry;
 	}
 	else
@@ -208,7 +236,7 @@ void Material::SetDefaultTexture(const Scene& scene,
 	{
 		textures.insert(pair<string, Texture2D>(name, Texture2D()));
 		Texture2D& texEntry = textures[name];
-		texEntry.Load(DEFAULT_TEXTURE_DIRECTORY_NAME + name);
+		texEntry.SetName(DEFAULT_TEXTURE_DIRECTORY_NAME + name);
 		texture = &texEntry;
 	}
 	else
@@ -28,6 +28,11 @@ public:
 
 	void UpdateDescriptorSets(VkDescriptorSet descriptorSet);
 
+	// Records that the textures were drawn with this frame, see Scene::UpdateTextureResidency().
+	void MarkSampled(uint64_t frameNumber);
+
+	bool UsesTexture(const Texture2D* texture) const;
+
 	float GetReflectivity();
 
     float GetMetallic();
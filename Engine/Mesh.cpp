@@ -2,6 +2,7 @@
 #include "Renderer.h"
 #include "Vertex.h"
 #include <assimp/scene.h>
+#include <stdexcept>
 
 using namespace std;
 
@@ -10,9 +11,7 @@ Mesh::Mesh() :
 	mMaterial(nullptr),
 	mNumVertices(0),
 	mNumFaces(0),
-	mOwnsMaterial(false),
-	mVertexBuffer(VK_NULL_HANDLE),
-	mIndexBuffer(VK_NULL_HANDLE)
+	mOwnsMaterial(false)
 {
 
 }
@@ -24,17 +23,11 @@ Mesh::~Mesh()
 
 void Mesh::Destroy()
 {
-	VkDevice device = Renderer::Get()->GetDevice();
-
-	if (mVertexBuffer != VK_NULL_HANDLE)
+	if (mVertexBuffer.IsValid())
 	{
-		vkDestroyBuffer(device, mIndexBuffer, nullptr);
-		Allocator::Free(mIndexBufferMemory);
-		vkDestroyBuffer(device, mVertexBuffer, nullptr);
-		Allocator::Free(mVertexBufferMemory);
-
-		mIndexBuffer = VK_NULL_HANDLE;
-		mVertexBuffer = VK_NULL_HANDLE;
+		DestructionQueue& destructionQueue = Renderer::Get()->GetDestructionQueue();
+		destructionQueue.FreeAllocation(mIndexBuffer);
+		destructionQueue.FreeAllocation(mVertexBuffer);
 	}
 
 	if (mOwnsMaterial)
@@ -76,11 +69,11 @@ void Mesh::Create(const aiMesh& meshData,
 
 void Mesh::BindBuffers(VkCommandBuffer commandBuffer)
 {
-	VkBuffer vertexBuffers[] = { mVertexBuffer };
-	VkDeviceSize offsets[] = { 0 };
+	VkBuffer vertexBuffers[] = { mVertexBuffer.mBuffer };
+	VkDeviceSize offsets[] = { mVertexBuffer.mOffset };
 	vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
 
-	vkCmdBindIndexBuffer(commandBuffer, mIndexBuffer, 0, VK_INDEX_TYPE_UINT32);
+	vkCmdBindIndexBuffer(commandBuffer, mIndexBuffer.mBuffer, mIndexBuffer.mOffset, VK_INDEX_TYPE_UINT32);
 }
 
 Material* Mesh::GetMaterial()
@@ -101,7 +94,7 @@ void Mesh::UpdateDescriptorSets(VkDescriptorSet descriptorSet)
 void Mesh::LoadMesh(const std::string& path)
 {
 	// Loads a .DAE file and loads the first mesh in the mesh library.
-	if (mVertexBuffer == VK_NULL_HANDLE)
+	if (!mVertexBuffer.IsValid())
 	{
 		Assimp::Importer importer;
 
@@ -113,18 +106,35 @@ void Mesh::LoadMesh(const std::string& path)
 
 		if (scene == nullptr)
 		{
-			throw exception("Failed to load dae file");
+			throw runtime_error("Failed to load dae file");
 		}
 
 		if (scene->mNumMeshes < 1)
 		{
-			throw exception("Failed to find any meshes in dae file");
+			throw runtime_error("Failed to find any meshes in dae file");
 		}
 
 		Create(*scene->mMeshes[0]);
 	}
 }
 
+void Mesh::RecordRelocation(VkCommandBuffer commandBuffer, const Allocation& oldAllocation, const Allocation& newAllocation)
+{
+	assert(&oldAllocation == &mVertexBuffer || &oldAllocation == &mIndexBuffer);
+
+	// Both ranges live in geometry arena buffers, so there is nothing to recreate.
+	VkBufferCopy copyRegion = {};
+	copyRegion.srcOffset = oldAllocation.mOffset;
+	copyRegion.dstOffset = newAllocation.mOffset;
+	copyRegion.size = oldAllocation.mSize;
+	vkCmdCopyBuffer(commandBuffer, oldAllocation.mBuffer, newAllocation.mBuffer, 1, &copyRegion);
+}
+
+void Mesh::FinishRelocation(const Allocation& allocation)
+{
+	// The allocation already refers to the new range, which BindBuffers() picks up.
+}
+
 uint32_t Mesh::GetNumIndices()
 {
 	return mNumFaces * 3;
@@ -164,7 +174,8 @@ void Mesh::CreateVertexBuffer(aiVector3D* positions,
 	}
 	
 	Renderer* renderer = Renderer::Get();
-	renderer->CreateVertexBuffer(vertices, sizeof(Vertex), mNumVertices, mVertexBuffer, mVertexBufferMemory);
+	renderer->CreateGeometryBuffer(vertices, sizeof(Vertex) * mNumVertices, mVertexBuffer);
+	Allocator::SetRelocatable(mVertexBuffer, this);
 	free(vertices);
 }
 
@@ -182,25 +193,8 @@ void Mesh::CreateIndexBuffer(aiFace* faces)
 	}
 
 	Renderer* renderer = Renderer::Get();
-	VkDevice device = renderer->GetDevice();
-
-	VkDeviceSize bufferSize = mNumFaces * 3 * sizeof(uint32_t);
-
-	VkBuffer stagingBuffer;
-	Allocation stagingBufferMemory;
-	renderer->CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
-
-	void* data;
-	vkMapMemory(device, stagingBufferMemory.mDeviceMemory, stagingBufferMemory.mOffset, bufferSize, 0, &data);
-	memcpy(data, indices, static_cast<size_t>(bufferSize));
-	vkUnmapMemory(device, stagingBufferMemory.mDeviceMemory);
-
-	renderer->CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, mIndexBuffer, mIndexBufferMemory);
-
-	renderer->CopyBuffer(stagingBuffer, mIndexBuffer, bufferSize);
-
-	vkDestroyBuffer(device, stagingBuffer, nullptr);
-	Allocator::Free(stagingBufferMemory);
+	renderer->CreateGeometryBuffer(indices, mNumFaces * 3 * sizeof(uint32_t), mIndexBuffer);
+	Allocator::SetRelocatable(mIndexBuffer, this);
 
 	free(indices);
 }
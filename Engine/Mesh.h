@@ -7,7 +7,7 @@
 #include "Material.h"
 #include "Allocator.h"
 
-class Mesh
+class Mesh : public RelocatableResource
 {
 public:
 
@@ -36,6 +36,10 @@ public:
 
 	uint32_t GetNumVertices();
 
+	virtual void RecordRelocation(VkCommandBuffer commandBuffer, const Allocation& oldAllocation, const Allocation& newAllocation) override;
+
+	virtual void FinishRelocation(const Allocation& allocation) override;
+
 private:
 
 	void CreateVertexBuffer(aiVector3D* positions,
@@ -52,9 +56,8 @@ private:
 	uint32_t mNumVertices;
 	uint32_t mNumFaces;
 
-	VkBuffer mVertexBuffer;
-	Allocation mVertexBufferMemory;
-	VkBuffer mIndexBuffer;
-	Allocation mIndexBufferMemory;
+	// Ranges of the geometry arena.
+	Allocation mVertexBuffer;
+	Allocation mIndexBuffer;
 
 };
\ No newline at end of file
@@ -0,0 +1,144 @@
+#include "ParallelRecorder.h"
+#include "Renderer.h"
+
+#include <assert.h>
+#include <stdexcept>
+
+using namespace std;
+
+ParallelRecorder::ParallelRecorder() :
+	mNumSlices(0),
+	mNumPrimaries(0),
+	mPrimaryIndex(0)
+{
+
+}
+
+void ParallelRecorder::Create(uint32_t queueFamilyIndex, uint32_t numSlices, uint32_t numPrimaries)
+{
+	Destroy();
+
+	VkDevice device = Renderer::Get()->GetDevice();
+
+	mNumSlices = numSlices;
+	mNumPrimaries = numPrimaries;
+	mPrimaryIndex = 0;
+	mPools.resize(mNumSlices * mNumPrimaries);
+
+	VkCommandPoolCreateInfo ciCommandPool = {};
+	ciCommandPool.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	ciCommandPool.queueFamilyIndex = queueFamilyIndex;
+	ciCommandPool.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+	for (SlicePool& slicePool : mPools)
+	{
+		slicePool.mNumUsed = 0;
+
+		if (vkCreateCommandPool(device, &ciCommandPool, nullptr, &slicePool.mPool) != VK_SUCCESS)
+		{
+			throw runtime_error("Failed to create command pool");
+		}
+	}
+}
+
+void ParallelRecorder::Destroy()
+{
+	if (mPools.size() == 0)
+	{
+		return;
+	}
+
+	VkDevice device = Renderer::Get()->GetDevice();
+
+	// Destroying a pool frees its command buffers.
+	for (SlicePool& slicePool : mPools)
+	{
+		vkDestroyCommandPool(device, slicePool.mPool, nullptr);
+	}
+
+	mPools.clear();
+	mNumSlices = 0;
+	mNumPrimaries = 0;
+}
+
+void ParallelRecorder::BeginPrimary(uint32_t primaryIndex)
+{
+	assert(primaryIndex < mNumPrimaries);
+
+	VkDevice device = Renderer::Get()->GetDevice();
+	mPrimaryIndex = primaryIndex;
+
+	for (uint32_t slice = 0; slice < mNumSlices; ++slice)
+	{
+		SlicePool& slicePool = GetPool(slice);
+
+		if (slicePool.mNumUsed > 0)
+		{
+			vkResetCommandPool(device, slicePool.mPool, 0);
+			slicePool.mNumUsed = 0;
+		}
+	}
+}
+
+VkCommandBuffer ParallelRecorder::BeginSecondary(uint32_t slice, VkRenderPass renderPass, uint32_t subpass, VkFramebuffer framebuffer)
+{
+	VkDevice device = Renderer::Get()->GetDevice();
+	SlicePool& slicePool = GetPool(slice);
+
+	// Command buffers are kept across frames and only allocated when a slice needs more than before.
+	if (slicePool.mNumUsed == slicePool.mCommandBuffers.size())
+	{
+		VkCommandBufferAllocateInfo allocInfo = {};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandPool = slicePool.mPool;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+		allocInfo.commandBufferCount = 1;
+
+		VkCommandBuffer newCommandBuffer = VK_NULL_HANDLE;
+
+		if (vkAllocateCommandBuffers(device, &allocInfo, &newCommandBuffer) != VK_SUCCESS)
+		{
+			throw runtime_error("Failed to create secondary command buffer");
+		}
+
+		slicePool.mCommandBuffers.push_back(newCommandBuffer);
+	}
+
+	VkCommandBuffer commandBuffer = slicePool.mCommandBuffers[slicePool.mNumUsed];
+	slicePool.mNumUsed++;
+
+	VkCommandBufferInheritanceInfo inheritanceInfo = {};
+	inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+	inheritanceInfo.renderPass = renderPass;
+	inheritanceInfo.subpass = subpass;
+	inheritanceInfo.framebuffer = framebuffer;
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	// Not one time submit, the primary may be submitted again without re-recording.
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+	beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+	vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+	return commandBuffer;
+}
+
+void ParallelRecorder::EndSecondary(VkCommandBuffer commandBuffer)
+{
+	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+	{
+		throw runtime_error("Failed to record secondary command buffer");
+	}
+}
+
+uint32_t ParallelRecorder::GetNumSlices() const
+{
+	return mNumSlices;
+}
+
+ParallelRecorder::SlicePool& ParallelRecorder::GetPool(uint32_t slice)
+{
+	assert(slice < mNumSlices);
+	return mPools[mPrimaryIndex * mNumSlices + slice];
+}
\ No newline at end of file
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+
+// Command pools for recording secondary command buffers on worker threads.
+// Work is split into slices, and each slice has its own pool per primary command buffer. A slice
+// is only recorded by one thread at a time, so the pools need no locking. All of a primary's pools
+// are reset together when it is recorded again.
+class ParallelRecorder
+{
+public:
+
+	ParallelRecorder();
+
+	void Create(uint32_t queueFamilyIndex, uint32_t numSlices, uint32_t numPrimaries);
+
+	void Destroy();
+
+	// Starts recording the secondaries of a primary command buffer, whose previous
+	// submission must have completed.
+	void BeginPrimary(uint32_t primaryIndex);
+
+	// Returns a secondary command buffer from the slice's pool, begun for use inside the given subpass.
+	VkCommandBuffer BeginSecondary(uint32_t slice, VkRenderPass renderPass, uint32_t subpass, VkFramebuffer framebuffer);
+
+	void EndSecondary(VkCommandBuffer commandBuffer);
+
+	uint32_t GetNumSlices() const;
+
+private:
+
+	struct SlicePool
+	{
+		VkCommandPool mPool;
+		std::vector<VkCommandBuffer> mCommandBuffers;
+		uint32_t mNumUsed;
+	};
+
+	SlicePool& GetPool(uint32_t slice);
+
+	// Indexed by primary * mNumSlices + slice
+	std::vector<SlicePool> mPools;
+
+	uint32_t mNumSlices;
+	uint32_t mNumPrimaries;
+	uint32_t mPrimaryIndex;
+};
\ No newline at end of file
@@ -2,15 +2,22 @@
 #include "Renderer.h"
 #include "Utilities.h"
 #include <vector>
+#include <mutex>
+#include <stdexcept>
 
 using namespace std;
 
+// Deferred pipelines may be bound for the first time from several recording threads at once.
+static mutex sCompileMutex;
+
 Pipeline::Pipeline() :
 	mPipeline(VK_NULL_HANDLE),
+	mCompiled(false),
 	mPipelineLayout(VK_NULL_HANDLE),
 	mRenderpass(VK_NULL_HANDLE),
 	mSubpass(0),
 	mComputePipeline(false),
+	mDeferCompilation(false),
 	mVertexShaderPath("Shaders/bin/geometryShader.vert"),
 	mFragmentShaderPath("Shaders/bin/geometryShader.frag"),
 	mRasterizerDiscard(VK_FALSE),
@@ -22,8 +29,6 @@ Pipeline::Pipeline() :
 	mDepthTestEnabled(VK_TRUE),
 	mDepthWriteEnabled(VK_TRUE),
 	mDepthCompareOp(VK_COMPARE_OP_LESS),
-    mViewportWidth(0),
-    mViewportHeight(0),
 	mUseVertexBinding(true),
 	mVertexType(VertexType::Vertex)
 {
@@ -49,7 +54,7 @@ VkDescriptorSetLayout Pipeline::GetDescriptorSetLayout(uint32_t index)
 {
 	if (index > mDescriptorSetLayouts.size())
 	{
-		throw exception("Accessing invalid descriptor set");
+		throw runtime_error("Accessing invalid descriptor set");
 	}
 	return mDescriptorSetLayouts[index];
 }
@@ -57,13 +62,8 @@ VkDescriptorSetLayout Pipeline::GetDescriptorSetLayout(uint32_t index)
 void Pipeline::CreateGraphicsPipeline()
 {
 	Renderer* renderer = Renderer::Get();
-	VkDevice device = renderer->GetDevice();
-
-	vector<char> vertShaderCode = ReadFile(mVertexShaderPath);
-
-	VkShaderModule vertShaderModule;
 
-	vertShaderModule = CreateShaderModule(vertShaderCode);
+	VkShaderModule vertShaderModule = AcquireShaderModule(mVertexShaderPath);
 
 	VkPipelineShaderStageCreateInfo vertShaderStageInfo = {};
 	vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -75,8 +75,7 @@ void Pipeline::CreateGraphicsPipeline()
 
 	if (mFragmentShaderPath != "")
 	{
-		vector<char> fragShaderCode = ReadFile(mFragmentShaderPath);
-		fragShaderModule = CreateShaderModule(fragShaderCode);
+		fragShaderModule = AcquireShaderModule(mFragmentShaderPath);
 	}
 
 	VkPipelineShaderStageCreateInfo fragShaderStageInfo = {};
@@ -124,27 +123,14 @@ void Pipeline::CreateGraphicsPipeline()
 	inputAssembly.topology = mPrimitiveTopology;
 	inputAssembly.primitiveRestartEnable = VK_FALSE;
 
-	VkExtent2D& swapchainExtent = renderer->GetSwapchainExtent();
-
-	VkViewport viewport = {};
-	viewport.x = 0.0f;
-	viewport.y = 0.0f;
-	viewport.width = (float)((mViewportWidth == 0) ? swapchainExtent.width : mViewportWidth);
-	viewport.height = (float)((mViewportHeight == 0) ? swapchainExtent.height : mViewportHeight);
-	viewport.minDepth = 0.0f;
-	viewport.maxDepth = 1.0f;
-
-	VkRect2D scissor = {};
-	scissor.offset = { 0, 0 };
-	scissor.extent.width = (mViewportWidth == 0) ? swapchainExtent.width : mViewportWidth;
-	scissor.extent.height = (mViewportHeight == 0) ? swapchainExtent.height : mViewportHeight;
-
+	// Viewport and scissor are dynamic, so one pipeline serves every render target size and
+	// survives swapchain resizes. Passes set them with Renderer::SetViewportAndScissor().
 	VkPipelineViewportStateCreateInfo viewportState = {};
 	viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
 	viewportState.viewportCount = 1;
-	viewportState.pViewports = &viewport;
+	viewportState.pViewports = nullptr;
 	viewportState.scissorCount = 1;
-	viewportState.pScissors = &scissor;
+	viewportState.pScissors = nullptr;
 
 	VkPipelineRasterizationStateCreateInfo rasterizer = {};
 	rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
@@ -197,8 +183,6 @@ void Pipeline::CreateGraphicsPipeline()
 	dynamicState.dynamicStateCount = 2;
 	dynamicState.pDynamicStates = dynamicStates;
 
-	CreatePipelineLayout();
-
 	VkGraphicsPipelineCreateInfo ciPipeline = {};
 	ciPipeline.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
 	ciPipeline.stageCount = (mFragmentShaderPath == "") ? 1 : 2;
@@ -218,33 +202,21 @@ void Pipeline::CreateGraphicsPipeline()
 	ciPipeline.basePipelineIndex = -1;
 
 	if (vkCreateGraphicsPipelines(renderer->GetDevice(),
-		VK_NULL_HANDLE,
+		renderer->GetPipelineCache().GetHandle(),
 		1,
 		&ciPipeline,
 		nullptr,
 		&mPipeline) != VK_SUCCESS)
 	{
-		throw exception("Failed to create graphics pipeline");
-	}
-
-	if (mFragmentShaderPath != "")
-	{
-		vkDestroyShaderModule(device, fragShaderModule, nullptr);
+		throw runtime_error("Failed to create graphics pipeline");
 	}
-
-	vkDestroyShaderModule(device, vertShaderModule, nullptr);
 }
 
 void Pipeline::CreateComputePipeline()
 {
 	Renderer* renderer = Renderer::Get();
-	VkDevice device = renderer->GetDevice();
-
-	vector<char> computeShaderCode = ReadFile(mComputeShaderPath);
-
-	VkShaderModule computeShaderModule;
 
-	computeShaderModule = CreateShaderModule(computeShaderCode);
+	VkShaderModule computeShaderModule = AcquireShaderModule(mComputeShaderPath);
 
 	VkPipelineShaderStageCreateInfo computeShaderStageInfo = {};
 	computeShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -252,8 +224,6 @@ void Pipeline::CreateComputePipeline()
 	computeShaderStageInfo.module = computeShaderModule;
 	computeShaderStageInfo.pName = "main";
 
-	CreatePipelineLayout();
-
 	VkComputePipelineCreateInfo ci = { };
 	ci.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
 	ci.stage = computeShaderStageInfo;
@@ -262,23 +232,48 @@ void Pipeline::CreateComputePipeline()
 	ci.basePipelineIndex = -1;
 
 	if (vkCreateComputePipelines(renderer->GetDevice(),
-		VK_NULL_HANDLE,
+		renderer->GetPipelineCache().GetHandle(),
 		1,
 		&ci,
 		nullptr,
 		&mPipeline) != VK_SUCCESS)
 	{
-		throw exception("Failed to create compute pipeline");
+		throw runtime_error("Failed to create compute pipeline");
 	}
-
-	vkDestroyShaderModule(device, computeShaderModule, nullptr);
 }
 
 void Pipeline::Create()
 {
 	PopulateLayoutBindings();
 	CreateDescriptorSetLayouts();
+	CreatePipelineLayout();
+
+	if (!mDeferCompilation)
+	{
+		CreatePipeline();
+		mCompiled.store(true, memory_order_release);
+	}
+}
 
+void Pipeline::Compile()
+{
+	// Compiled pipelines are bound from every recording thread, so only the first compile locks.
+	if (mCompiled.load(memory_order_acquire))
+	{
+		return;
+	}
+
+	lock_guard<mutex> lock(sCompileMutex);
+
+	if (!mCompiled.load(memory_order_relaxed))
+	{
+		CreatePipeline();
+		mCompiled.store(true, memory_order_release);
+	}
+}
+
+void Pipeline::CreatePipeline()
+{
 	if (mComputePipeline)
 	{
 		CreateComputePipeline();
@@ -294,8 +289,21 @@ void Pipeline::Destroy()
 {
 	VkDevice device = Renderer::Get()->GetDevice();
 
-	vkDestroyPipeline(device, mPipeline, nullptr);
+	// Layouts are only needed while recording, but the pipeline may still be executing.
+	Renderer::Get()->GetDestructionQueue().DestroyPipeline(mPipeline);
 	vkDestroyPipelineLayout(device, mPipelineLayout, nullptr);
+	mPipeline = VK_NULL_HANDLE;
+	mPipelineLayout = VK_NULL_HANDLE;
+	mCompiled.store(false, memory_order_relaxed);
+
+	ShaderModuleCache& shaderModuleCache = Renderer::Get()->GetShaderModuleCache();
+
+	for (VkShaderModule module : mShaderModules)
+	{
+		shaderModuleCache.Release(module);
+	}
+
+	mShaderModules.clear();
 
 	for (VkDescriptorSetLayout layout : mDescriptorSetLayouts)
 	{
@@ -308,6 +316,11 @@ void Pipeline::Destroy()
 
 void Pipeline::BindPipeline(VkCommandBuffer commandBuffer)
 {
+	if (mDeferCompilation)
+	{
+		Compile();
+	}
+
 	VkPipelineBindPoint bindPoint = mComputePipeline ? VK_PIPELINE_BIND_POINT_COMPUTE : VK_PIPELINE_BIND_POINT_GRAPHICS;
 	vkCmdBindPipeline(commandBuffer, bindPoint, mPipeline);
 }
@@ -317,23 +330,10 @@ VkPipelineLayout Pipeline::GetPipelineLayout()
 	return mPipelineLayout;
 }
 
-VkShaderModule Pipeline::CreateShaderModule(const std::vector<char>& code)
+VkShaderModule Pipeline::AcquireShaderModule(const std::string& path)
 {
-	VkDevice device = Renderer::Get()->GetDevice();
-	VkShaderModuleCreateInfo ciModule = {};
-	ciModule.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-	ciModule.codeSize = code.size();
-
-	vector<uint32_t> codeLong(code.size() / sizeof(uint32_t) + 1);
-	memcpy(codeLong.data(), code.data(), code.size());
-	ciModule.pCode = codeLong.data();
-
-	VkShaderModule module;
-
-	if (vkCreateShaderModule(device, &ciModule, nullptr, &module) != VK_SUCCESS)
-	{
-		throw exception("Failed to create shader module");
-	}
+	VkShaderModule module = Renderer::Get()->GetShaderModuleCache().Acquire(path);
+	mShaderModules.push_back(module);
 
 	return module;
 }
@@ -405,7 +405,7 @@ void Pipeline::CreateDescriptorSetLayouts()
 			nullptr,
 			&mDescriptorSetLayouts[i]) != VK_SUCCESS)
 		{
-			throw exception("Failed to create descriptor set layout");
+			throw runtime_error("Failed to create descriptor set layout");
 		}
 	}
 }
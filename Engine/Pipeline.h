@@ -3,6 +3,7 @@
 #include <vulkan/vulkan.h>
 #include <string>
 #include <vector>
+#include <atomic>
 
 #include "Vertex.h"
 
@@ -15,10 +16,16 @@ public:
 
 	virtual ~Pipeline();
 
+	// Creates the layouts, and the pipeline itself unless mDeferCompilation is set.
+	// Pipelines only share the pipeline cache, so different ones may be created on different threads.
 	void Create();
 
 	void Destroy();
 
+	// Compiles a deferred pipeline if that hasn't happened yet. Call before recording to avoid
+	// compiling on the recording thread. May be called from any thread.
+	void Compile();
+
 	void SetVertexShader(const std::string& path);
 
 	void SetFragmentShader(const std::string& path);
@@ -31,13 +38,15 @@ public:
 
 protected:
 
+	void CreatePipeline();
 	void CreateGraphicsPipeline();
 	void CreateComputePipeline();
 
 	void PushSet();
 	void AddLayoutBinding(VkDescriptorType type, VkShaderStageFlags stageFlags);
 
-	VkShaderModule CreateShaderModule(const std::vector<char>& code);
+	// Held until Destroy(), so pipelines using the same shaders share one module.
+	VkShaderModule AcquireShaderModule(const std::string& path);
 
 	virtual void PopulateLayoutBindings();
 	void CreateDescriptorSetLayouts();
@@ -46,8 +55,12 @@ protected:
 	void AddBlendAttachmentState();
 
 	VkPipeline mPipeline;
+
+	// Set once mPipeline has been created, checked before taking the compile lock.
+	std::atomic<bool> mCompiled;
 	VkPipelineLayout mPipelineLayout;
 	std::vector<VkDescriptorSetLayout> mDescriptorSetLayouts;
+	std::vector<VkShaderModule> mShaderModules;
 	
 public:
 
@@ -55,15 +68,14 @@ public:
     uint32_t mSubpass;
 	bool mComputePipeline;
 
+	// Leaves compiling to Compile() or the first BindPipeline(), for pipelines most sessions never use.
+	bool mDeferCompilation;
+
 	// Shader stages
 	std::string mVertexShaderPath;
 	std::string mFragmentShaderPath;
 	std::string mComputeShaderPath;
 
-    // Viewport
-    uint32_t mViewportWidth;
-    uint32_t mViewportHeight;
-
 	// Vertex Input
 	bool mUseVertexBinding; // (Generally only false for post process / full screen quad pipelines.)
 	VertexType mVertexType;
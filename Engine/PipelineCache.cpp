@@ -0,0 +1,188 @@
+#include "PipelineCache.h"
+#include "Renderer.h"
+#include "Log.h"
+
+#include <stdexcept>
+#include <string.h>
+#include <stdio.h>
+
+using namespace std;
+
+// "VKPC"
+static const uint32_t sFileMagic = 0x43504b56;
+static const uint32_t sFileVersion = 1;
+
+struct PipelineCacheFileHeader
+{
+	uint32_t mMagic;
+	uint32_t mVersion;
+	uint32_t mVendorId;
+	uint32_t mDeviceId;
+	uint32_t mDriverVersion;
+	uint8_t mPipelineCacheUuid[VK_UUID_SIZE];
+	uint64_t mDataSize;
+};
+
+static PipelineCacheFileHeader GetDeviceHeader()
+{
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(Renderer::Get()->GetPhysicalDevice(), &deviceProperties);
+
+	PipelineCacheFileHeader header;
+	memset(&header, 0, sizeof(header));
+	header.mMagic = sFileMagic;
+	header.mVersion = sFileVersion;
+	header.mVendorId = deviceProperties.vendorID;
+	header.mDeviceId = deviceProperties.deviceID;
+	header.mDriverVersion = deviceProperties.driverVersion;
+	memcpy(header.mPipelineCacheUuid, deviceProperties.pipelineCacheUUID, VK_UUID_SIZE);
+
+	return header;
+}
+
+PipelineCache::PipelineCache() :
+	mPipelineCache(VK_NULL_HANDLE),
+	mWarm(false)
+{
+
+}
+
+void PipelineCache::Create(const std::string& path, bool loadFromFile)
+{
+	Destroy();
+
+	mPath = path;
+	mWarm = false;
+
+	VkDevice device = Renderer::Get()->GetDevice();
+	string data;
+
+	VkPipelineCacheCreateInfo ciPipelineCache = {};
+	ciPipelineCache.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+
+	if (loadFromFile &&
+		ReadFile(data))
+	{
+		ciPipelineCache.initialDataSize = data.size();
+		ciPipelineCache.pInitialData = data.data();
+
+		mWarm = vkCreatePipelineCache(device, &ciPipelineCache, nullptr, &mPipelineCache) == VK_SUCCESS;
+
+		if (!mWarm)
+		{
+			LogWarning("Discarding pipeline cache %s, the driver rejected it", mPath.c_str());
+		}
+	}
+
+	if (!mWarm)
+	{
+		ciPipelineCache.initialDataSize = 0;
+		ciPipelineCache.pInitialData = nullptr;
+
+		if (vkCreatePipelineCache(device, &ciPipelineCache, nullptr, &mPipelineCache) != VK_SUCCESS)
+		{
+			throw runtime_error("Failed to create pipeline cache");
+		}
+	}
+}
+
+void PipelineCache::Destroy()
+{
+	if (mPipelineCache != VK_NULL_HANDLE)
+	{
+		vkDestroyPipelineCache(Renderer::Get()->GetDevice(), mPipelineCache, nullptr);
+		mPipelineCache = VK_NULL_HANDLE;
+	}
+}
+
+bool PipelineCache::Save()
+{
+	if (mPipelineCache == VK_NULL_HANDLE)
+	{
+		return false;
+	}
+
+	VkDevice device = Renderer::Get()->GetDevice();
+
+	size_t dataSize = 0;
+	vkGetPipelineCacheData(device, mPipelineCache, &dataSize, nullptr);
+
+	string data(dataSize, '\0');
+
+	if (dataSize == 0 ||
+		vkGetPipelineCacheData(device, mPipelineCache, &dataSize, &data[0]) != VK_SUCCESS)
+	{
+		return false;
+	}
+
+	FILE* file = fopen(mPath.c_str(), "wb");
+
+	if (file == nullptr)
+	{
+		LogError("Failed to open %s for writing the pipeline cache", mPath.c_str());
+		return false;
+	}
+
+	PipelineCacheFileHeader header = GetDeviceHeader();
+	header.mDataSize = dataSize;
+
+	bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+		fwrite(data.data(), 1, dataSize, file) == dataSize;
+
+	fclose(file);
+
+	if (!written)
+	{
+		// A partial file would only be thrown away on the next launch.
+		remove(mPath.c_str());
+	}
+
+	return written;
+}
+
+VkPipelineCache PipelineCache::GetHandle() const
+{
+	return mPipelineCache;
+}
+
+bool PipelineCache::IsWarm() const
+{
+	return mWarm;
+}
+
+bool PipelineCache::ReadFile(std::string& outData)
+{
+	FILE* file = fopen(mPath.c_str(), "rb");
+
+	if (file == nullptr)
+	{
+		return false;
+	}
+
+	PipelineCacheFileHeader header;
+	PipelineCacheFileHeader expected = GetDeviceHeader();
+	bool valid = fread(&header, sizeof(header), 1, file) == 1;
+
+	valid = valid &&
+		header.mMagic == expected.mMagic &&
+		header.mVersion == expected.mVersion &&
+		header.mVendorId == expected.mVendorId &&
+		header.mDeviceId == expected.mDeviceId &&
+		header.mDriverVersion == expected.mDriverVersion &&
+		memcmp(header.mPipelineCacheUuid, expected.mPipelineCacheUuid, VK_UUID_SIZE) == 0 &&
+		header.mDataSize > 0;
+
+	if (valid)
+	{
+		outData.resize(static_cast<size_t>(header.mDataSize));
+		valid = fread(&outData[0], 1, outData.size(), file) == outData.size();
+	}
+	else
+	{
+		LogWarning("Ignoring pipeline cache %s, it is truncated or from a different device or driver", mPath.c_str());
+	}
+
+	fclose(file);
+
+	return valid;
+}
\ No newline at end of file
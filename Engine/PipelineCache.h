@@ -0,0 +1,40 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <string>
+
+// Driver compiled pipeline state shared by every Pipeline and kept on disk between runs, so
+// later launches, swapchain resizes and environment captures skip most shader compilation.
+// The file is prefixed with the vendor, device, driver version and pipeline cache UUID it was
+// written with, and is ignored when any of them no longer match, since a driver may reject or
+// misbehave on data saved by another driver.
+// vkCreate*Pipelines may use the cache from any thread.
+class PipelineCache
+{
+public:
+
+	PipelineCache();
+
+	// Starts from the contents of path if it was saved on this device and driver, or empty
+	// if loadFromFile is false or the file is missing or stale.
+	void Create(const std::string& path, bool loadFromFile);
+
+	void Destroy();
+
+	// Writes the cache to the path passed to Create().
+	bool Save();
+
+	VkPipelineCache GetHandle() const;
+
+	// Whether Create() started from a saved cache.
+	bool IsWarm() const;
+
+private:
+
+	// Returns false if the file is missing or was saved by a different device or driver.
+	bool ReadFile(std::string& outData);
+
+	VkPipelineCache mPipelineCache;
+	std::string mPath;
+	bool mWarm;
+};
\ No newline at end of file
@@ -26,7 +26,7 @@ public:
 		Pipeline::PopulateLayoutBindings();
 
 		PushSet();
-		AddLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
+		AddLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
 
 		// Add texture sampler descriptors for each texture slot
 		for (int32_t i = 0; i < SLOT_COUNT; ++i)
@@ -72,7 +72,7 @@ public:
 		Pipeline::PopulateLayoutBindings();
 
 		PushSet();
-		AddLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
+		AddLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
 
 		// Add texture sampler descriptors for each texture slot
 		for (int32_t i = 0; i < SLOT_COUNT; ++i)
@@ -89,6 +89,9 @@ public:
 	ReflectionlessGeometryPipeline()
 	{
 		mFragmentShaderPath = ENGINE_SHADER_DIR "nonreflectiveGeometryShader.frag";
+
+		// Only environment captures use it.
+		mDeferCompilation = true;
 	}
 };
 
@@ -146,7 +149,7 @@ public:
 		DeferredPipeline::PopulateLayoutBindings();
 
 		PushSet();
-		AddLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
+		AddLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
 	}
 };
 
@@ -186,6 +189,7 @@ public:
 	{
 		mVertexShaderPath = ENGINE_SHADER_DIR "debugDeferredShader.vert";
 		mFragmentShaderPath = ENGINE_SHADER_DIR "debugDeferredShader.frag";
+		mDeferCompilation = true;
 	}
 
 	virtual void PopulateLayoutBindings() override
@@ -201,6 +205,7 @@ public:
 	BaseDebugPipeline()
 	{
 		mFragmentShaderPath = ENGINE_SHADER_DIR "environmentCaptureDebug.frag";
+		mDeferCompilation = true;
 	}
 
 	virtual void PopulateLayoutBindings() override
@@ -235,6 +240,7 @@ public:
 	ShadowMapDebugPipeline()
 	{
         mFragmentShaderPath = ENGINE_SHADER_DIR "shadowMapDebug.frag";
+		mDeferCompilation = true;
 	}
 
 	virtual void PopulateLayoutBindings() override
@@ -277,6 +283,7 @@ public:
 	NullPostProcessPipeline()
 	{
 		mFragmentShaderPath = ENGINE_SHADER_DIR "nullPostProcessShader.frag";
+		mDeferCompilation = true;
 	}
 
 };
@@ -331,7 +338,7 @@ public:
 		Pipeline::PopulateLayoutBindings();
 
 		PushSet();
-		AddLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
+		AddLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
 		AddLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT);
 	}
 };
@@ -362,7 +369,7 @@ public:
 		Pipeline::PopulateLayoutBindings();
 
 		PushSet();
-		AddLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
+		AddLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
 		AddLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT);
 	}
 };
\ No newline at end of file
@@ -4,6 +4,9 @@
 #include "Mesh.h"
 #include "Constants.h"
 #include "Renderer.h"
+#include "CpuProfiler.h"
+
+#include <stdexcept>
 
 #undef min
 #undef max
@@ -14,7 +17,7 @@ Mesh* PointLight::sSphereMesh = nullptr;
 
 PointLight::PointLight() : 
 	mDescriptorSet(VK_NULL_HANDLE),
-	mUniformBuffer(VK_NULL_HANDLE)
+	mUniformOffset(0)
 {
 
 }
@@ -61,7 +64,6 @@ void PointLight::Create(const aiLight& light,
 
 void PointLight::Destroy()
 {
-	DestroyUniformBuffer();
 	DestroyDescriptorSet();
 }
 
@@ -94,6 +96,7 @@ void PointLight::BindSphereMeshBuffers(VkCommandBuffer& commandBuffer)
 void PointLight::Update(Scene* scene,
 	float deltaTime)
 {
+	PROFILE_FUNCTION();
 	UpdateUniformBuffer(scene->GetActiveCamera(), deltaTime);
 }
 
@@ -101,7 +104,7 @@ void PointLight::Draw(VkCommandBuffer commandBuffer)
 {
 	if (mDescriptorSet == VK_NULL_HANDLE)
 	{
-		throw exception("Attempting to render point light without a valid descriptor set");
+		throw runtime_error("Attempting to render point light without a valid descriptor set");
 	}
 	
 	assert(sSphereMesh != nullptr);
@@ -121,8 +124,8 @@ void PointLight::Draw(VkCommandBuffer commandBuffer)
 		2,
 		1,
 		&mDescriptorSet,
-		0,
-		nullptr);
+		1,
+		&mUniformOffset);
 
 	vkCmdDrawIndexed(commandBuffer,
 		sSphereMesh->GetNumIndices(),
@@ -181,11 +184,9 @@ void PointLight::CreateDescriptorSet()
 {
 	if (mDescriptorSet != VK_NULL_HANDLE)
 	{
-		throw exception("Attempting to recreate descriptor set");
+		throw runtime_error("Attempting to recreate descriptor set");
 	}
 
-	CreateUniformBuffer();
-
 	Renderer* renderer = Renderer::Get();
 	VkDevice device = renderer->GetDevice();
 
@@ -199,11 +200,11 @@ void PointLight::CreateDescriptorSet()
 
 	if (vkAllocateDescriptorSets(device, &allocInfo, &mDescriptorSet) != VK_SUCCESS)
 	{
-		throw exception("Failed to create descriptor set");
+		throw runtime_error("Failed to create descriptor set");
 	}
 
 	VkDescriptorBufferInfo bufferInfo = {};
-	bufferInfo.buffer = mUniformBuffer;
+	bufferInfo.buffer = renderer->GetUniformRingBuffer().GetBuffer();
 	bufferInfo.offset = 0;
 	bufferInfo.range = sizeof(LightData);
 
@@ -215,7 +216,7 @@ void PointLight::CreateDescriptorSet()
 	descriptorWrites[0].dstSet = mDescriptorSet;
 	descriptorWrites[0].dstBinding = LD_UNIFORM_BUFFER;
 	descriptorWrites[0].dstArrayElement = 0;
-	descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	descriptorWrites[0].descriptorCount = 1;
 	descriptorWrites[0].pBufferInfo = &bufferInfo;
 	descriptorWrites[0].pImageInfo = nullptr;
@@ -224,48 +225,19 @@ void PointLight::CreateDescriptorSet()
 	vkUpdateDescriptorSets(device, 1, descriptorWrites, 0, nullptr);
 }
 
-void PointLight::CreateUniformBuffer()
-{
-	Renderer* renderer = Renderer::Get();
-
-	VkDeviceSize bufferSize = sizeof(LightData);
-	renderer->CreateBuffer(bufferSize,
-		VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, 
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		mUniformBuffer,
-		mUniformBufferMemory);
-}
-
 void PointLight::DestroyDescriptorSet()
 {
 	if (mDescriptorSet != VK_NULL_HANDLE)
 	{
 		Renderer* renderer = Renderer::Get();
-		vkFreeDescriptorSets(renderer->GetDevice(),
-			renderer->GetDescriptorPool(),
-			1,
-			&mDescriptorSet);
+		renderer->GetDestructionQueue().FreeDescriptorSet(mDescriptorSet, renderer->GetDescriptorPool());
 
 		mDescriptorSet = VK_NULL_HANDLE;
 	}
 }
 
-void PointLight::DestroyUniformBuffer()
-{
-	if (mUniformBuffer != VK_NULL_HANDLE)
-	{
-		Renderer* renderer = Renderer::Get();
-
-		vkDestroyBuffer(renderer->GetDevice(), mUniformBuffer, nullptr);
-		mUniformBuffer = VK_NULL_HANDLE;
-
-		Allocator::Free(mUniformBufferMemory);
-	}
-}
-
 void PointLight::UpdateUniformBuffer(Camera* camera, float deltaTime)
 {
-	VkDevice device = Renderer::Get()->GetDevice();
 
 	mLightData.mWVP = glm::translate(glm::mat4(),
 		glm::vec3(mLightData.mPosition.x,
@@ -275,8 +247,5 @@ void PointLight::UpdateUniformBuffer(Camera* camera, float deltaTime)
 
 	mLightData.mWVP = camera->GetViewProjectionMatrix() * mLightData.mWVP;
 
-	void* data;
-	vkMapMemory(device, mUniformBufferMemory.mDeviceMemory, mUniformBufferMemory.mOffset, sizeof(LightData), 0, &data);
-	memcpy(data, &mLightData, sizeof(LightData));
-	vkUnmapMemory(device, mUniformBufferMemory.mDeviceMemory);
+	mUniformOffset = Renderer::Get()->GetUniformRingBuffer().Write(&mLightData, sizeof(LightData));
 }
@@ -74,10 +74,8 @@ private:
 	static class Mesh* sSphereMesh;
 
 	void CreateDescriptorSet();
-	void CreateUniformBuffer();
 
 	void DestroyDescriptorSet();
-	void DestroyUniformBuffer();
 
 	void UpdateUniformBuffer(class Camera* camera, float deltaTime);
 
@@ -86,6 +84,7 @@ private:
 	LightData mLightData;
 
 	VkDescriptorSet mDescriptorSet;
-	VkBuffer mUniformBuffer;
-	Allocation mUniformBufferMemory;
+
+	// Dynamic offset of this frame's LightData in the renderer's uniform ring.
+	uint32_t mUniformOffset;
 };
\ No newline at end of file
@@ -3,20 +3,17 @@
 
 Quad::Quad() :
 	mTexture(nullptr),
-	mVertexBuffer(VK_NULL_HANDLE),
-	mUniformBuffer(VK_NULL_HANDLE),
+	mDescriptorSetDirty(true),
+	mUniformOffset(0),
 	mTint(glm::vec4(1, 1, 1, 1))
 {
 	InitVertexData();
-	CreateVertexBuffer();
-	CreateUniformBuffer();
 	CreateDescriptorSet();
 }
 
 Quad::~Quad()
 {
-	DestroyVertexBuffer();
-	DestroyUniformBuffer();
+	mVertexBuffer.Destroy();
 	DestroyDescriptorSet();
 }
 
@@ -29,8 +26,7 @@ void Quad::Render(VkCommandBuffer commandBuffer)
 	QuadPipeline& quadPipeline = renderer->GetQuadPipeline();
 	quadPipeline.BindPipeline(commandBuffer);
 
-	VkDeviceSize offset = 0;
-	vkCmdBindVertexBuffers(commandBuffer, 0, 1, &mVertexBuffer, &offset);
+	mVertexBuffer.Bind(commandBuffer);
 
 	VkDescriptorSet quadDescriptorSet = mDescriptorSet.GetDescriptorSet();
 	vkCmdBindDescriptorSets(commandBuffer,
@@ -39,8 +35,8 @@ void Quad::Render(VkCommandBuffer commandBuffer)
 		1,
 		1,
 		&quadDescriptorSet,
-		0,
-		nullptr);
+		1,
+		&mUniformOffset);
 
 	vkCmdDraw(commandBuffer, 4, 1, 0, 0);
 }
@@ -52,15 +48,27 @@ void Quad::Update()
 	if (mDirty)
 	{
 		UpdateVertexBuffer();
-		UpdateUniformBuffer();
+	}
+
+	if (mDescriptorSetDirty)
+	{
 		UpdateDescriptorSet();
+		mDescriptorSetDirty = false;
 	}
+
+	mVertexBuffer.Update();
+
+	// Uniform data lives in the per-frame ring, so it is written every frame.
+	UpdateUniformBuffer();
 }
 
 void Quad::SetTexture(class Texture* texture)
 {
-	mTexture = texture;
-	MarkDirty();
+	if (mTexture != texture)
+	{
+		mTexture = texture;
+		mDescriptorSetDirty = true;
+	}
 }
 
 void Quad::SetColor(glm::vec4 color)
@@ -94,35 +102,16 @@ void Quad::SetColor(glm::vec4 topLeft,
 
 void Quad::SetTint(glm::vec4 tint)
 {
+	// The tint lives in the per-frame uniform, so nothing recorded has to change.
 	mTint = tint;
-	MarkDirty();
-}
-
-void Quad::CreateVertexBuffer()
-{
-	DestroyVertexBuffer();
-
-	Renderer* renderer = Renderer::Get();
-
-	renderer->CreateBuffer(4 * sizeof(VertexUI),
-		VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		mVertexBuffer,
-		mVertexBufferMemory);
 }
 
-void Quad::CreateUniformBuffer()
+void Quad::ReplaceTexture(const Texture* texture)
 {
-	Renderer* renderer = Renderer::Get();
-
-	VkDeviceSize bufferSize = sizeof(QuadUniformBuffer);
-	renderer->CreateBuffer(bufferSize,
-		VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		mUniformBuffer,
-		mUniformBufferMemory);
-
-	UpdateUniformBuffer();
+	if (mTexture == texture)
+	{
+		mDescriptorSetDirty = true;
+	}
 }
 
 void Quad::CreateDescriptorSet()
@@ -131,33 +120,6 @@ void Quad::CreateDescriptorSet()
 	mDescriptorSet.Create(renderer->GetQuadPipeline().GetDescriptorSetLayout(1));
 }
 
-void Quad::DestroyVertexBuffer()
-{
-	if (mVertexBuffer != VK_NULL_HANDLE)
-	{
-		Renderer* renderer = Renderer::Get();
-		VkDevice device = renderer->GetDevice();
-
-		vkDestroyBuffer(device, mVertexBuffer, nullptr);
-		mVertexBuffer = VK_NULL_HANDLE;
-
-		Allocator::Free(mVertexBufferMemory);
-	}
-}
-
-void Quad::DestroyUniformBuffer()
-{
-	if (mUniformBuffer != VK_NULL_HANDLE)
-	{
-		Renderer* renderer = Renderer::Get();
-
-		vkDestroyBuffer(renderer->GetDevice(), mUniformBuffer, nullptr);
-		mUniformBuffer = VK_NULL_HANDLE;
-
-		Allocator::Free(mUniformBufferMemory);
-	}
-}
-
 void Quad::DestroyDescriptorSet()
 {
 	mDescriptorSet.Destroy();
@@ -192,9 +154,6 @@ void Quad::InitVertexData()
 
 void Quad::UpdateVertexBuffer()
 {
-	Renderer* renderer = Renderer::Get();
-	VkDevice device = Renderer::Get()->GetDevice();
-
 	mVertices[0].mPosition.x = mAbsoluteRect.mX;
 	mVertices[0].mPosition.y = mAbsoluteRect.mY;
 							   
@@ -207,24 +166,18 @@ void Quad::UpdateVertexBuffer()
 	mVertices[3].mPosition.x = mAbsoluteRect.mX + mAbsoluteRect.mWidth;
 	mVertices[3].mPosition.y = mAbsoluteRect.mY + mAbsoluteRect.mHeight;
 
-	void* data = nullptr;
-	vkMapMemory(device, mVertexBufferMemory.mDeviceMemory, mVertexBufferMemory.mOffset, mVertexBufferMemory.mSize, 0, &data);
-	memcpy(data, mVertices, sizeof(VertexUI) * 4);
-	vkUnmapMemory(device, mVertexBufferMemory.mDeviceMemory);
+	if (mVertexBuffer.SetData(mVertices, sizeof(VertexUI) * 4))
+	{
+		Renderer::Get()->InvalidateCommandBuffers();
+	}
 }
 
 void Quad::UpdateUniformBuffer()
 {
-	Renderer* renderer = Renderer::Get();
-	VkDevice device = renderer->GetDevice();
-
 	QuadUniformBuffer ubo = {};
 	ubo.mTint = mTint;
 
-	void* data;
-	vkMapMemory(device, mUniformBufferMemory.mDeviceMemory, mUniformBufferMemory.mOffset, sizeof(ubo), 0, &data);
-	memcpy(data, &ubo, sizeof(ubo));
-	vkUnmapMemory(device, mUniformBufferMemory.mDeviceMemory);
+	mUniformOffset = Renderer::Get()->GetUniformRingBuffer().Write(&ubo, sizeof(ubo));
 }
 
 void Quad::UpdateDescriptorSet()
@@ -232,6 +185,12 @@ void Quad::UpdateDescriptorSet()
 	Renderer* renderer = Renderer::Get();
 	Texture* texture = (mTexture != nullptr) ? mTexture : &renderer->mWhiteTexture;
 
-	mDescriptorSet.UpdateUniformDescriptor(0, mUniformBuffer, sizeof(QuadUniformBuffer));
+	// Frames in flight may still have the current set bound, so write to a new one.
+	DestroyDescriptorSet();
+	CreateDescriptorSet();
+
+	mDescriptorSet.UpdateUniformDescriptor(0, renderer->GetUniformRingBuffer().GetBuffer(), sizeof(QuadUniformBuffer), VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC);
 	mDescriptorSet.UpdateImageDescriptor(1, texture->GetImageView(), texture->GetSampler());
+
+	renderer->InvalidateCommandBuffers();
 }
\ No newline at end of file
@@ -4,6 +4,7 @@
 #include "Texture.h"
 #include "Vertex.h"
 #include "DescriptorSet.h"
+#include "DynamicVertexBuffer.h"
 #include "glm/glm.hpp"
 
 struct QuadUniformBuffer
@@ -34,14 +35,12 @@ public:
 
 	void SetTint(glm::vec4 tint);
 
+	virtual void ReplaceTexture(const Texture* texture) override;
+
 protected:
 
-	void CreateVertexBuffer();
-	void CreateUniformBuffer();
 	void CreateDescriptorSet();
 
-	void DestroyVertexBuffer();
-	void DestroyUniformBuffer();
 	void DestroyDescriptorSet();
 
 	void UpdateVertexBuffer();
@@ -53,12 +52,11 @@ protected:
 	Texture* mTexture;
 	VertexUI mVertices[4];
 
-	VkBuffer mVertexBuffer;
-	Allocation mVertexBufferMemory;
+	DynamicVertexBuffer mVertexBuffer;
 
 	DescriptorSet mDescriptorSet;
-	VkBuffer mUniformBuffer;
-	Allocation mUniformBufferMemory;
+	bool mDescriptorSetDirty;
+	uint32_t mUniformOffset;
 
 	glm::vec4 mTint;
 };
\ No newline at end of file
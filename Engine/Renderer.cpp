@@ -5,10 +5,12 @@
 #include "Allocator.h"
 #include "Widget.h"
 #include "DefaultFonts.h"
+#include "Log.h"
+#include "CpuProfiler.h"
 
 #include <assert.h>
 #include <stdlib.h>
-#include <exception>
+#include <stdexcept>
 #include <stdio.h>
 #include <vector>
 #include <set>
@@ -20,6 +22,7 @@
 #include <stb_image.h>
 
 #include <chrono>
+#include <thread>
 
 #undef min
 #undef max
@@ -33,6 +36,14 @@ static uint32_t sNumValidationLayers = 1;
 static const char* sDeviceExtensions[] = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
 static uint32_t sNumDeviceExtensions = 1;
 
+// Optional, enabled when the device supports them.
+static const char* sDedicatedAllocationExtensions[] = { VK_KHR_GET_MEMORY_REQUIREMENTS_2_EXTENSION_NAME, VK_KHR_DEDICATED_ALLOCATION_EXTENSION_NAME };
+static uint32_t sNumDedicatedAllocationExtensions = 2;
+static const char* sMemoryBudgetExtensions[] = { VK_EXT_MEMORY_BUDGET_EXTENSION_NAME };
+static uint32_t sNumMemoryBudgetExtensions = 1;
+static const char* sTimelineSemaphoreExtensions[] = { VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME };
+static uint32_t sNumTimelineSemaphoreExtensions = 1;
+
 static bool sDebugIrradiance = false;
 static int sDebugEnvironmentCaptureIndex = 0;
 
@@ -45,15 +56,23 @@ Renderer::Renderer() :
 	mDevice(0),
 	mGraphicsQueue(0),
 	mPresentQueue(0),
+	mTransferQueue(VK_NULL_HANDLE),
+	mGraphicsQueueFamily(0),
+	mTransferQueueFamily(0),
 	mSurface(0),
 	mSwapchain(0),
 	mRenderPass(0),
-	mImageAvailableSemaphore(0),
-	mRenderFinishedSemaphore(0),
+	mNumFramesInFlight(1),
+	mDeferredShadowMapImageView(VK_NULL_HANDLE),
 	mScene(nullptr),
 	mRootWidget(nullptr),
 	mDebugMode(DEBUG_NONE),
 	mInitialized(false),
+	mPhysicalDeviceProperties2Enabled(false),
+	mFrameIndex(0),
+	mFrameNumber(0),
+	mLastImageIndex(0),
+	mPipelineCreationTime(0.0f),
     mEnvironmentDebugFace(0),
 	mLitColorImageFormat(VK_FORMAT_R16G16B16A16_SFLOAT)
 {
@@ -62,6 +81,11 @@ Renderer::Renderer() :
 	mGlobalUniformData.mScreenDimensions = glm::vec2(800.0f, 600.0f);
 	mGlobalUniformData.mVisualizationMode = 0;
 
+	mImageAvailableSemaphores.fill(VK_NULL_HANDLE);
+	mRenderFinishedSemaphores.fill(VK_NULL_HANDLE);
+	mInFlightFences.fill(VK_NULL_HANDLE);
+	mGlobalDescriptorSets.fill(VK_NULL_HANDLE);
+
 	SetInterfaceResolution(glm::vec2(1280, 720));
 }
 
@@ -132,6 +156,7 @@ void Renderer::SetAppState(AppState* appState)
 void Renderer::WaitOnExecutionFinished()
 {
 	vkDeviceWaitIdle(mDevice);
+	mDestructionQueue.FlushAll();
 }
 
 void Renderer::DestroySwapchain()
@@ -143,6 +168,8 @@ void Renderer::DestroySwapchain()
 
 	vkFreeCommandBuffers(mDevice, mCommandPool, static_cast<uint32_t>(mCommandBuffers.size()), mCommandBuffers.data());
 	mCommandBuffers.clear();
+	mRecordedCommandBuffers.clear();
+	mParallelRecorder.Destroy();
 
 	mGBuffer.Destroy();
 
@@ -157,20 +184,38 @@ void Renderer::DestroySwapchain()
 	vkDestroySampler(mDevice, mLitColorSampler, nullptr);
 	Allocator::Free(mLitColorImageMemory);
 
-	vkDestroyBuffer(mDevice, mGlobalUniformBuffer, nullptr);
-	Allocator::Free(mGlobalUniformBufferMemory);
-	vkFreeDescriptorSets(mDevice, mDescriptorPool, 1, &mGlobalDescriptorSet);
+	for (uint32_t i = 0; i < mNumFramesInFlight; ++i)
+	{
+		Allocator::Free(mGlobalUniformBuffers[i]);
+	}
+
+	vkFreeDescriptorSets(mDevice, mDescriptorPool, mNumFramesInFlight, mGlobalDescriptorSets.data());
 
 	for (size_t i = 0; i < mSwapchainImageViews.size(); ++i)
 	{
 		vkDestroyImageView(mDevice, mSwapchainImageViews[i], nullptr);
 	}
 
-	vkDestroySwapchainKHR(mDevice, mSwapchain, nullptr);
+	if (mAppState->mHeadless)
+	{
+		for (size_t i = 0; i < mSwapchainImages.size(); ++i)
+		{
+			vkDestroyImage(mDevice, mSwapchainImages[i], nullptr);
+			Allocator::Free(mOffscreenImageMemory[i]);
+		}
+
+		mOffscreenImageMemory.clear();
+	}
+	else
+	{
+		vkDestroySwapchainKHR(mDevice, mSwapchain, nullptr);
+	}
 }
 
 Renderer::~Renderer()
 {
+	mWorkerPool.Destroy();
+
 	DestroyDefaultTextures();
 
 	DefaultFonts::Destroy();
@@ -178,20 +223,43 @@ Renderer::~Renderer()
 
     mShadowCaster.Destroy();
 
+	mUniformRingBuffer.Destroy();
+	mUploadBatcher.Destroy();
+
 	DestroySwapchain();
 
 	DestroyPipelines();
 
+	// Everything queued above is unused once the device is idle.
+	vkDeviceWaitIdle(mDevice);
+	mDestructionQueue.FlushAll();
+
+	mGpuProfiler.Destroy();
+
+	mPipelineCache.Save();
+	mPipelineCache.Destroy();
+
+	// Only modules of pipelines that were never destroyed are left.
+	mShaderModuleCache.Destroy();
+
 	vkDestroyDescriptorPool(mDevice, mDescriptorPool, nullptr);
 
-	vkDestroySemaphore(mDevice, mRenderFinishedSemaphore, nullptr);
-	vkDestroySemaphore(mDevice, mImageAvailableSemaphore, nullptr);
+	for (uint32_t i = 0; i < mNumFramesInFlight; ++i)
+	{
+		vkDestroySemaphore(mDevice, mRenderFinishedSemaphores[i], nullptr);
+		vkDestroySemaphore(mDevice, mImageAvailableSemaphores[i], nullptr);
+		vkDestroyFence(mDevice, mInFlightFences[i], nullptr);
+	}
 
 	vkDestroyCommandPool(mDevice, mCommandPool, nullptr);
 
 	DestroyDebugCallback();
 
-	vkDestroySurfaceKHR(mInstance, mSurface, nullptr);
+	if (mSurface != VK_NULL_HANDLE)
+	{
+		vkDestroySurfaceKHR(mInstance, mSurface, nullptr);
+	}
+
 	vkDestroyDevice(mDevice, nullptr);
 	vkDestroyInstance(mInstance, nullptr);
 }
@@ -203,23 +271,54 @@ void Renderer::Initialize()
 	CreateSurface();
 	PickPhysicalDevice();
 	CreateLogicalDevice();
+
+	mNumFramesInFlight = mAppState->mFramesInFlight;
+	if (mNumFramesInFlight < 1)
+		mNumFramesInFlight = 1;
+	if (mNumFramesInFlight > MAX_FRAMES_IN_FLIGHT)
+		mNumFramesInFlight = MAX_FRAMES_IN_FLIGHT;
+
 	CreateSwapchain();
 	CreateImageViews();
 	CreateCommandPool();
+	CreateSyncObjects();
+	mUploadBatcher.Create(UPLOAD_STAGING_SIZE, UPLOAD_MAX_BATCHES);
+
+	// Records the secondary command buffers together with the render thread, which is why
+	// one thread less than the most recording slices is enough.
+	uint32_t numWorkerThreads = std::thread::hardware_concurrency();
+	if (numWorkerThreads > RENDERER_MAX_RECORDING_THREADS)
+		numWorkerThreads = RENDERER_MAX_RECORDING_THREADS;
+	mWorkerPool.Create(numWorkerThreads > 1 ? numWorkerThreads - 1 : 0);
+
+	if (mAppState->mGpuProfiling)
+	{
+		mGpuProfiler.Create(mNumFramesInFlight);
+	}
+
 	CreateDefaultTextures();
     CreateLitColorImage();
 	CreateDepthImage();
 	CreateDescriptorPool();
+	mUniformRingBuffer.Create(UNIFORM_RING_FRAME_SIZE, mNumFramesInFlight);
 	CreateGBuffer();
 	CreateRenderPass();
+
+	mPipelineCache.Create(PIPELINE_CACHE_FILE_NAME, mAppState->mLoadPipelineCache);
+
+	high_resolution_clock::time_point pipelineStart = high_resolution_clock::now();
 	CreatePipelines();
+	duration<float, std::milli> pipelineTime = high_resolution_clock::now() - pipelineStart;
+	mPipelineCreationTime = pipelineTime.count();
+
+	LogDebug("Created pipelines in %.1f ms from a %s pipeline cache", mPipelineCreationTime, mPipelineCache.IsWarm() ? "warm" : "cold");
+
 	mGBuffer.CreateSampler();
 	CreateGlobalDescriptorSet();
 	CreatePostProcessDescriptorSet();
 	CreateDebugDescriptorSet();
 	CreateFramebuffers();
 	CreateCommandBuffers();
-	CreateSemaphores();
 
 	mDefaultMaterial.Create();
 
@@ -236,6 +335,12 @@ VkDevice Renderer::GetDevice()
 
 void Renderer::CreateSwapchain()
 {
+	if (mAppState->mHeadless)
+	{
+		CreateOffscreenImages();
+		return;
+	}
+
 	SwapChainSupportDetails swapChainSupport = QuerySwapChainSupport(mPhysicalDevice);
 
 	VkSurfaceFormatKHR surfaceFormat = ChooseSwapSurfaceFormat(swapChainSupport.formats);
@@ -285,12 +390,13 @@ void Renderer::CreateSwapchain()
 
 	if (vkCreateSwapchainKHR(mDevice, &ciSwapchain, nullptr, &mSwapchain) != VK_SUCCESS)
 	{
-		throw exception("Failed to create swapchain");
+		throw runtime_error("Failed to create swapchain");
 	}
 
 	vkGetSwapchainImagesKHR(mDevice, mSwapchain, &imageCount, nullptr);
 	mSwapchainImages.resize(imageCount);
 	vkGetSwapchainImagesKHR(mDevice, mSwapchain, &imageCount, mSwapchainImages.data());
+	mImagesInFlight.assign(imageCount, VK_NULL_HANDLE);
 
 	mSwapchainImageFormat = surfaceFormat.format;
 	mSwapchainExtent = extent;
@@ -298,13 +404,118 @@ void Renderer::CreateSwapchain()
 	mGlobalUniformData.mScreenDimensions = glm::vec2(extent.width, extent.height);
 }
 
+void Renderer::CreateOffscreenImages()
+{
+	// These stand in for the swapchain images, so the rest of the frame is the same as when presenting.
+	// B8G8R8A8 is also what ChooseSwapSurfaceFormat() prefers.
+	VkExtent2D extent = { mAppState->mWindowWidth, mAppState->mWindowHeight };
+	VkFormat format = VK_FORMAT_B8G8R8A8_UNORM;
+	uint32_t imageCount = 2;
+
+	mSwapchainImages.resize(imageCount);
+	mOffscreenImageMemory.resize(imageCount);
+
+	for (uint32_t i = 0; i < imageCount; ++i)
+	{
+		Texture::CreateImage(extent.width,
+			extent.height,
+			format,
+			VK_IMAGE_TILING_OPTIMAL,
+			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			mSwapchainImages[i],
+			mOffscreenImageMemory[i]);
+	}
+
+	mImagesInFlight.assign(imageCount, VK_NULL_HANDLE);
+
+	mSwapchainImageFormat = format;
+	mSwapchainExtent = extent;
+
+	mGlobalUniformData.mScreenDimensions = glm::vec2(extent.width, extent.height);
+}
+
 void Renderer::PreparePresentation()
 {
 
 }
 
+bool Renderer::ReadbackLastFrame(std::vector<uint8_t>& outPixels)
+{
+	if (!mAppState->mHeadless)
+	{
+		throw runtime_error("Frames can only be read back in headless mode");
+	}
+
+	if (mFrameNumber == 0)
+	{
+		return false;
+	}
+
+	WaitForFramesInFlight();
+
+	uint32_t width = mSwapchainExtent.width;
+	uint32_t height = mSwapchainExtent.height;
+	VkDeviceSize size = static_cast<VkDeviceSize>(width) * height * 4;
+
+	Allocation readback;
+	Allocator::AllocBufferRange(size, BufferArena::Staging, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, readback);
+
+	VkCommandBuffer commandBuffer = BeginSingleSubmissionCommands();
+
+	// The render pass already left the image in TRANSFER_SRC_OPTIMAL, this only makes its writes visible to the copy.
+	VkImageMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = mSwapchainImages[mLastImageIndex];
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.levelCount = 1;
+	barrier.subresourceRange.layerCount = 1;
+
+	vkCmdPipelineBarrier(commandBuffer,
+		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		0,
+		0, nullptr,
+		0, nullptr,
+		1, &barrier);
+
+	VkBufferImageCopy region = {};
+	region.bufferOffset = readback.mOffset;
+	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	region.imageSubresource.layerCount = 1;
+	region.imageExtent = { width, height, 1 };
+
+	vkCmdCopyImageToBuffer(commandBuffer, mSwapchainImages[mLastImageIndex], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readback.mBuffer, 1, &region);
+
+	EndSingleSubmissionCommands(commandBuffer);
+
+	// Swizzle from B8G8R8A8. Alpha isn't meaningful in the back buffer.
+	const uint8_t* src = static_cast<const uint8_t*>(readback.mMappedPtr);
+	outPixels.resize(static_cast<size_t>(size));
+
+	for (size_t i = 0; i < outPixels.size(); i += 4)
+	{
+		outPixels[i + 0] = src[i + 2];
+		outPixels[i + 1] = src[i + 1];
+		outPixels[i + 2] = src[i + 0];
+		outPixels[i + 3] = 255;
+	}
+
+	Allocator::Free(readback);
+
+	return true;
+}
+
 void Renderer::Render()
 {
+	PROFILE_FUNCTION();
+
 	if (mScene == nullptr)
 	{
 		// Cannot create command buffers yet.
@@ -316,50 +527,226 @@ void Renderer::Render()
 		CreateCommandBuffers();
 	}
 
+	// The fence of this frame slot was waited on when the previous frame ended.
+	VkFence inFlightFence = mInFlightFences[mFrameIndex];
+
+	bool present = !mAppState->mHeadless;
 	uint32_t imageIndex;
-	VkResult result = vkAcquireNextImageKHR(mDevice, mSwapchain, std::numeric_limits<uint64_t>::max(), mImageAvailableSemaphore, VK_NULL_HANDLE, &imageIndex);
 
-	if (result == VK_ERROR_OUT_OF_DATE_KHR)
+	if (present)
 	{
-		RecreateSwapchain();
-		return;
+		VkResult result = vkAcquireNextImageKHR(mDevice, mSwapchain, std::numeric_limits<uint64_t>::max(), mImageAvailableSemaphores[mFrameIndex], VK_NULL_HANDLE, &imageIndex);
+
+		if (result == VK_ERROR_OUT_OF_DATE_KHR)
+		{
+			RecreateSwapchain();
+
+			// Nothing was submitted, so discard this frame's uniform data.
+			mUniformRingBuffer.BeginFrame(mFrameIndex);
+			return;
+		}
+		else if (result != VK_SUCCESS &&
+			result != VK_SUBOPTIMAL_KHR)
+		{
+			throw runtime_error("Failed to acquire swapchain image");
+		}
+	}
+	else
+	{
+		// Offscreen images are used in turn and there is nothing to wait on or present.
+		imageIndex = static_cast<uint32_t>(mFrameNumber % mSwapchainImages.size());
 	}
-	else if (result != VK_SUCCESS &&
-		result != VK_SUBOPTIMAL_KHR)
+
+	// The image can be handed out again while an earlier frame is still rendering to it.
+	if (mImagesInFlight[imageIndex] != VK_NULL_HANDLE)
 	{
-		throw exception("Failed to acquire swapchain image");
+		vkWaitForFences(mDevice, 1, &mImagesInFlight[imageIndex], VK_TRUE, std::numeric_limits<uint64_t>::max());
 	}
 
+	mImagesInFlight[imageIndex] = inFlightFence;
+	mLastImageIndex = imageIndex;
+
 	if (mRootWidget != nullptr)
 	{
+		PROFILE_ZONE("Widget::RecursiveUpdate");
 		mRootWidget->RecursiveUpdate();
 	}
 
-	// Reset our command buffer to record a fresh set of commands for this frame.
-	vkResetCommandBuffer(mCommandBuffers[imageIndex], 0);
+	// Static scenes produce the same commands every frame, so a recorded command buffer is
+	// kept for each frame slot and swapchain image and only re-recorded after something it
+	// references has changed.
+	uint32_t commandBufferIndex = mFrameIndex * static_cast<uint32_t>(mSwapchainImages.size()) + imageIndex;
+	VkCommandBuffer commandBuffer = mCommandBuffers[commandBufferIndex];
+	RecordedCommandBuffer& recorded = mRecordedCommandBuffers[commandBufferIndex];
+
+	bool castShadows = mScene->GetDirectionalLight().ShouldCastShadows();
+
+	if (castShadows)
+	{
+		mShadowCaster.Prepare();
+
+		// The shadow map is created on first use. Earlier frames bound the deferred set
+		// with the placeholder, so they have to finish before it can be rewritten. This
+		// also has to happen before any command buffer of this frame binds the set.
+		if (mDeferredShadowMapImageView != GetShadowMapImageView())
+		{
+			WaitForFramesInFlight();
+			UpdateDeferredDescriptorSet();
+		}
+	}
+
+	// Dynamic uniform offsets are baked into the commands, so they are only reused if this frame
+	// was handed exactly the same offsets. Everything else they reference invalidates them.
+	const std::vector<uint32_t>& uniformOffsets = mUniformRingBuffer.GetFrameOffsets();
+
+	if (!mAppState->mCacheCommandBuffers ||
+		!recorded.mValid ||
+		recorded.mUniformOffsets != uniformOffsets ||
+		recorded.mCastShadows != castShadows)
+	{
+		RecordCommandBuffer(commandBuffer, commandBufferIndex, imageIndex, castShadows);
+
+		recorded.mValid = true;
+		recorded.mUniformOffsets = uniformOffsets;
+		recorded.mCastShadows = castShadows;
+	}
+
+	UpdateGlobalUniformData();
+	UpdateGlobalDescriptorSet();
+
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+
+	VkSemaphore waitSemaphores[] = { mImageAvailableSemaphores[mFrameIndex] };
+	VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+	submitInfo.waitSemaphoreCount = present ? 1 : 0;
+	submitInfo.pWaitSemaphores = waitSemaphores;
+	submitInfo.pWaitDstStageMask = waitStages;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &commandBuffer;
+
+	VkSemaphore signalSemaphores[] = { mRenderFinishedSemaphores[mFrameIndex] };
+	submitInfo.signalSemaphoreCount = present ? 1 : 0;
+	submitInfo.pSignalSemaphores = signalSemaphores;
+
+	vkResetFences(mDevice, 1, &inFlightFence);
+
+	VkPresentInfoKHR presentInfo = {};
+	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+	presentInfo.waitSemaphoreCount = 1;
+	presentInfo.pWaitSemaphores = signalSemaphores;
+	VkSwapchainKHR swapchains[] = { mSwapchain };
+	presentInfo.swapchainCount = 1;
+	presentInfo.pSwapchains = swapchains;
+	presentInfo.pImageIndices = &imageIndex;
+	presentInfo.pResults = nullptr;
+
+	{
+		// Uploads may be submitted from loading threads at the same time.
+		std::lock_guard<std::recursive_mutex> lock(mSingleSubmissionMutex);
+
+		if (vkQueueSubmit(mGraphicsQueue, 1, &submitInfo, inFlightFence) != VK_SUCCESS)
+		{
+			throw runtime_error("Failed to submit draw command buffer");
+		}
+
+		if (present)
+		{
+			vkQueuePresentKHR(mPresentQueue, &presentInfo);
+		}
+	}
+
+	// Move on to the next frame slot. Once the frame that last used it has finished, its command
+	// buffer, global uniform buffer and region of the uniform ring can be rewritten, and anything
+	// queued for destruction up to that frame is no longer referenced.
+	mFrameNumber++;
+	mFrameIndex = (mFrameIndex + 1) % mNumFramesInFlight;
+
+	vkWaitForFences(mDevice, 1, &mInFlightFences[mFrameIndex], VK_TRUE, std::numeric_limits<uint64_t>::max());
+	mUniformRingBuffer.BeginFrame(mFrameIndex);
+	mGpuProfiler.ResolveFrame(mFrameIndex);
+
+	if (mFrameNumber >= mNumFramesInFlight)
+	{
+		mDestructionQueue.Flush(mFrameNumber - mNumFramesInFlight);
+	}
+
+	// Compact a little of device local memory and drop or restore texture mips to stay within
+	// the memory budget. Defragmenting doesn't wait for the frames in flight.
+	std::vector<RelocatableResource*> movedResources;
+	Allocator::Defragment(DEFRAG_MAX_BYTES_PER_FRAME, movedResources);
+
+	for (RelocatableResource* resource : movedResources)
+	{
+		// Moved textures have new image views. Submitted frames may still use the descriptor
+		// sets that sample them, so only those sets are replaced rather than rewritten.
+		Texture2D* texture = dynamic_cast<Texture2D*>(resource);
+
+		if (texture != nullptr)
+		{
+			mScene->ReplaceMaterialDescriptors(texture);
+
+			if (mRootWidget != nullptr)
+			{
+				mRootWidget->RecursiveReplaceTexture(texture);
+			}
+		}
+	}
+
+	if (!movedResources.empty())
+	{
+		// Moved buffers are bound at their new offsets.
+		InvalidateCommandBuffers();
+	}
+
+	mScene->UpdateTextureResidency();
+}
+
+void Renderer::RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t commandBufferIndex, uint32_t imageIndex, bool castShadows)
+{
+	PROFILE_FUNCTION();
+
+	// Reset the command buffer to record a fresh set of commands.
+	vkResetCommandBuffer(commandBuffer, 0);
 
 	VkCommandBufferBeginInfo beginInfo = {};
 	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
 	beginInfo.pInheritanceInfo = nullptr;
 
-	vkBeginCommandBuffer(mCommandBuffers[imageIndex], &beginInfo);
+	vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+	// The secondary command buffers last executed from this one are no longer pending.
+	mParallelRecorder.BeginPrimary(commandBufferIndex);
+
+	mGpuProfiler.BeginFrame(commandBuffer, mFrameIndex);
+	mGpuProfiler.BeginScope(commandBuffer, GpuScope::Frame);
+
+	VkFramebuffer framebuffer = mSwapchainFramebuffers[imageIndex];
+	uint32_t numSlices = GetNumRecordingSlices();
+	bool parallel = numSlices > 1;
+
+	if (parallel)
+	{
+		RecordSecondaryCommandBuffers(numSlices, framebuffer, castShadows);
+	}
+
+	VkSubpassContents sceneContents = parallel ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE;
 
 	// ***************
 	//  Shadow Depths
 	// ***************
-	if (mScene->GetDirectionalLight().ShouldCastShadows())
+	if (castShadows)
 	{
-		mShadowCaster.RenderShadows(mScene, mCommandBuffers[imageIndex]);
-		UpdateDeferredDescriptorSet();
+		mShadowCaster.RenderShadows(mScene, commandBuffer, parallel ? &mSecondaryCommandBuffers.mShadow : nullptr);
 	}
 
-	SetViewportAndScissor(mCommandBuffers[imageIndex], 0, 0, mSwapchainExtent.width, mSwapchainExtent.height);
+	SetViewportAndScissor(commandBuffer, 0, 0, mSwapchainExtent.width, mSwapchainExtent.height);
 
 	VkRenderPassBeginInfo renderPassInfo = {};
 	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
 	renderPassInfo.renderPass = mRenderPass;
-	renderPassInfo.framebuffer = mSwapchainFramebuffers[imageIndex];
+	renderPassInfo.framebuffer = framebuffer;
 	renderPassInfo.renderArea.offset = { 0, 0 };
 	renderPassInfo.renderArea.extent = mSwapchainExtent;
 
@@ -369,77 +756,102 @@ void Renderer::Render()
 	renderPassInfo.clearValueCount = ATTACHMENT_COUNT;
 	renderPassInfo.pClearValues = clearValues;
 
-	vkCmdBeginRenderPass(mCommandBuffers[imageIndex], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+	vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, sceneContents);
 
 	// ******************
 	//  Early Depth Pass
 	// ******************
-	mEarlyDepthPipeline.BindPipeline(mCommandBuffers[imageIndex]);
-	mScene->RenderGeometry(mCommandBuffers[imageIndex]);
-	vkCmdNextSubpass(mCommandBuffers[imageIndex], VK_SUBPASS_CONTENTS_INLINE);
+	if (parallel)
+	{
+		vkCmdExecuteCommands(commandBuffer, numSlices, mSecondaryCommandBuffers.mEarlyDepth.data());
+	}
+	else
+	{
+		mGpuProfiler.BeginScope(commandBuffer, GpuScope::EarlyDepth);
+		RecordEarlyDepth(commandBuffer, 0, mScene->GetNumActors());
+		mGpuProfiler.EndScope(commandBuffer, GpuScope::EarlyDepth);
+	}
 
-	// ******************
-	//  Geometry Pass
-	// ******************
-	mGeometryPipeline.BindPipeline(mCommandBuffers[imageIndex]);
-	vkCmdBindDescriptorSets(mCommandBuffers[imageIndex], VK_PIPELINE_BIND_POINT_GRAPHICS, mGeometryPipeline.GetPipelineLayout(), 0, 1, &mGlobalDescriptorSet, 0, 0);
-	mScene->RenderGeometry(mCommandBuffers[imageIndex]);
-	vkCmdNextSubpass(mCommandBuffers[imageIndex], VK_SUBPASS_CONTENTS_INLINE);
+	vkCmdNextSubpass(commandBuffer, sceneContents);
 
 	// ******************
-	//  Deferred Pass
+	//  Geometry Pass
 	// ******************
-	if (mDebugMode == DEBUG_GBUFFER)
+	if (parallel)
 	{
-		mDebugDeferredPipeline.BindPipeline(mCommandBuffers[imageIndex]);
-		vkCmdBindDescriptorSets(mCommandBuffers[imageIndex], VK_PIPELINE_BIND_POINT_GRAPHICS, mLightPipeline.GetPipelineLayout(), 0, 1, &mGlobalDescriptorSet, 0, 0);
-		vkCmdBindDescriptorSets(mCommandBuffers[imageIndex], VK_PIPELINE_BIND_POINT_GRAPHICS, mLightPipeline.GetPipelineLayout(), 1, 1, &mDeferredDescriptorSet, 0, 0);
-		vkCmdDraw(mCommandBuffers[imageIndex], 4, 1, 0, 0);
+		vkCmdExecuteCommands(commandBuffer, numSlices, mSecondaryCommandBuffers.mGeometry.data());
 	}
-	else if (mDebugMode == DEBUG_ENVIRONMENT_CAPTURE)
+	else
 	{
-		mEnvironmentCaptureDebugPipeline.BindPipeline(mCommandBuffers[imageIndex]);
-		vkCmdBindDescriptorSets(mCommandBuffers[imageIndex], VK_PIPELINE_BIND_POINT_GRAPHICS, mEnvironmentCaptureDebugPipeline.GetPipelineLayout(), 0, 1, &mGlobalDescriptorSet, 0, 0);
-		vkCmdBindDescriptorSets(mCommandBuffers[imageIndex], VK_PIPELINE_BIND_POINT_GRAPHICS, mEnvironmentCaptureDebugPipeline.GetPipelineLayout(), 1, 1, &mDeferredDescriptorSet, 0, 0);
-		vkCmdBindDescriptorSets(mCommandBuffers[imageIndex], VK_PIPELINE_BIND_POINT_GRAPHICS, mEnvironmentCaptureDebugPipeline.GetPipelineLayout(), 2, 1, &mDebugDescriptorSet, 0, 0);
-		vkCmdDraw(mCommandBuffers[imageIndex], 4, 1, 0, 0);
+		mGpuProfiler.BeginScope(commandBuffer, GpuScope::Geometry);
+		RecordGeometry(commandBuffer, 0, mScene->GetNumActors());
+		mGpuProfiler.EndScope(commandBuffer, GpuScope::Geometry);
 	}
-	else if (mDebugMode == DEBUG_SHADOW_MAP)
+
+	vkCmdNextSubpass(commandBuffer, sceneContents);
+
+	// ******************
+	//  Deferred Pass
+	// ******************
+	if (parallel)
 	{
-		mShadowMapDebugPipeline.BindPipeline(mCommandBuffers[imageIndex]);
-		vkCmdBindDescriptorSets(mCommandBuffers[imageIndex], VK_PIPELINE_BIND_POINT_GRAPHICS, mShadowMapDebugPipeline.GetPipelineLayout(), 0, 1, &mGlobalDescriptorSet, 0, 0);
-		vkCmdBindDescriptorSets(mCommandBuffers[imageIndex], VK_PIPELINE_BIND_POINT_GRAPHICS, mShadowMapDebugPipeline.GetPipelineLayout(), 1, 1, &mDeferredDescriptorSet, 0, 0);
-		vkCmdBindDescriptorSets(mCommandBuffers[imageIndex], VK_PIPELINE_BIND_POINT_GRAPHICS, mShadowMapDebugPipeline.GetPipelineLayout(), 2, 1, &mDebugDescriptorSet, 0, 0);
-		vkCmdDraw(mCommandBuffers[imageIndex], 4, 1, 0, 0);
+		// The subpass only takes secondary command buffers, so the fullscreen draw gets one of its own.
+		VkCommandBuffer lightingCommandBuffer = mParallelRecorder.BeginSecondary(0, mRenderPass, PASS_DEFERRED, framebuffer);
+		SetViewportAndScissor(lightingCommandBuffer, 0, 0, mSwapchainExtent.width, mSwapchainExtent.height);
+		mGpuProfiler.BeginScope(lightingCommandBuffer, GpuScope::DirectionalLight);
+		RecordFullscreenLighting(lightingCommandBuffer);
+		mGpuProfiler.EndScope(lightingCommandBuffer, GpuScope::DirectionalLight);
+		mParallelRecorder.EndSecondary(lightingCommandBuffer);
+
+		vkCmdExecuteCommands(commandBuffer, 1, &lightingCommandBuffer);
+
+		if (ShouldRenderLightVolumes())
+		{
+			vkCmdExecuteCommands(commandBuffer, numSlices, mSecondaryCommandBuffers.mLightVolumes.data());
+		}
 	}
 	else
 	{
-		mDirectionalLightPipeline.BindPipeline(mCommandBuffers[imageIndex]);
-		vkCmdBindDescriptorSets(mCommandBuffers[imageIndex], VK_PIPELINE_BIND_POINT_GRAPHICS, mLightPipeline.GetPipelineLayout(), 0, 1, &mGlobalDescriptorSet, 0, 0);
-		vkCmdBindDescriptorSets(mCommandBuffers[imageIndex], VK_PIPELINE_BIND_POINT_GRAPHICS, mLightPipeline.GetPipelineLayout(), 1, 1, &mDeferredDescriptorSet, 0, 0);
-		vkCmdDraw(mCommandBuffers[imageIndex], 4, 1, 0, 0);
+		mGpuProfiler.BeginScope(commandBuffer, GpuScope::DirectionalLight);
+		RecordFullscreenLighting(commandBuffer);
+		mGpuProfiler.EndScope(commandBuffer, GpuScope::DirectionalLight);
 
-		mLightPipeline.BindPipeline(mCommandBuffers[imageIndex]);
-		mScene->RenderLightVolumes(mCommandBuffers[imageIndex]);
+		if (ShouldRenderLightVolumes())
+		{
+			mGpuProfiler.BeginScope(commandBuffer, GpuScope::PointLights);
+			RecordLightVolumes(commandBuffer, 0, mScene->GetNumPointLights());
+			mGpuProfiler.EndScope(commandBuffer, GpuScope::PointLights);
+		}
 	}
 
 	// ******************
 	//  Post Process
 	// ******************
-	vkCmdNextSubpass(mCommandBuffers[imageIndex], VK_SUBPASS_CONTENTS_INLINE);
+	vkCmdNextSubpass(commandBuffer, VK_SUBPASS_CONTENTS_INLINE);
+	mGpuProfiler.BeginScope(commandBuffer, GpuScope::PostProcess);
+
+	if (parallel)
+	{
+		// Executing secondary command buffers leaves the primary's dynamic state and bindings undefined.
+		SetViewportAndScissor(commandBuffer, 0, 0, mSwapchainExtent.width, mSwapchainExtent.height);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mPostProcessPipeline.GetPipelineLayout(), 0, 1, &mGlobalDescriptorSets[mFrameIndex], 0, 0);
+	}
+
 	if (mDebugMode == DEBUG_NONE)
 	{
-		mPostProcessPipeline.BindPipeline(mCommandBuffers[imageIndex]);
-		vkCmdBindDescriptorSets(mCommandBuffers[imageIndex], VK_PIPELINE_BIND_POINT_GRAPHICS, mPostProcessPipeline.GetPipelineLayout(), 1, 1, &mPostProcessDescriptorSet, 0, 0);
-		vkCmdDraw(mCommandBuffers[imageIndex], 4, 1, 0, 0);
+		mPostProcessPipeline.BindPipeline(commandBuffer);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mPostProcessPipeline.GetPipelineLayout(), 1, 1, &mPostProcessDescriptorSet, 0, 0);
+		vkCmdDraw(commandBuffer, 4, 1, 0, 0);
 	}
 	else
 	{
-		mNullPostProcessPipeline.BindPipeline(mCommandBuffers[imageIndex]);
-		vkCmdBindDescriptorSets(mCommandBuffers[imageIndex], VK_PIPELINE_BIND_POINT_GRAPHICS, mPostProcessPipeline.GetPipelineLayout(), 1, 1, &mPostProcessDescriptorSet, 0, 0);
-		vkCmdDraw(mCommandBuffers[imageIndex], 4, 1, 0, 0);
+		mNullPostProcessPipeline.BindPipeline(commandBuffer);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mPostProcessPipeline.GetPipelineLayout(), 1, 1, &mPostProcessDescriptorSet, 0, 0);
+		vkCmdDraw(commandBuffer, 4, 1, 0, 0);
 	}
-	vkCmdNextSubpass(mCommandBuffers[imageIndex], VK_SUBPASS_CONTENTS_INLINE);
+
+	mGpuProfiler.EndScope(commandBuffer, GpuScope::PostProcess);
+	vkCmdNextSubpass(commandBuffer, VK_SUBPASS_CONTENTS_INLINE);
 
 	// ******************
 	//  UI
@@ -449,51 +861,173 @@ void Renderer::Render()
 	screenRect.mY = 0.0f;
 	screenRect.mWidth = mInterfaceResolution.x;
 	screenRect.mHeight = mInterfaceResolution.y;
-	if (mRootWidget != nullptr) { mRootWidget->RecursiveRender(mCommandBuffers[imageIndex]); }
-	vkCmdEndRenderPass(mCommandBuffers[imageIndex]);
+	mGpuProfiler.BeginScope(commandBuffer, GpuScope::UI);
 
-	if (vkEndCommandBuffer(mCommandBuffers[imageIndex]) != VK_SUCCESS)
+	if (mRootWidget != nullptr)
 	{
-		throw exception("Failed to record command buffer");
+		PROFILE_ZONE("Widget::RecursiveRender");
+		mRootWidget->RecursiveRender(commandBuffer);
 	}
 
-	UpdateGlobalUniformData();
-	UpdateGlobalDescriptorSet();
+	mGpuProfiler.EndScope(commandBuffer, GpuScope::UI);
+	vkCmdEndRenderPass(commandBuffer);
 
-	VkSubmitInfo submitInfo = {};
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	mGpuProfiler.EndScope(commandBuffer, GpuScope::Frame);
 
-	VkSemaphore waitSemaphores[] = { mImageAvailableSemaphore };
-	VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-	submitInfo.waitSemaphoreCount = 1;
-	submitInfo.pWaitSemaphores = waitSemaphores;
-	submitInfo.pWaitDstStageMask = waitStages;
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &mCommandBuffers[imageIndex];
+	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+	{
+		throw runtime_error("Failed to record command buffer");
+	}
+}
 
-	VkSemaphore signalSemaphores[] = { mRenderFinishedSemaphore };
-	submitInfo.signalSemaphoreCount = 1;
-	submitInfo.pSignalSemaphores = signalSemaphores;
+uint32_t Renderer::GetNumRecordingSlices()
+{
+	if (!mAppState->mParallelRecording)
+	{
+		return 1;
+	}
+
+	// Small scenes are cheaper to record inline than to hand out to other threads.
+	uint32_t numSlices = (mScene->GetNumActors() + RENDERER_MIN_DRAWS_PER_SLICE - 1) / RENDERER_MIN_DRAWS_PER_SLICE;
 
-	if (vkQueueSubmit(mGraphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+	if (numSlices > mParallelRecorder.GetNumSlices())
 	{
-		throw exception("Failed to submit draw command buffer");
+		numSlices = mParallelRecorder.GetNumSlices();
 	}
 
-	VkPresentInfoKHR presentInfo = {};
-	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-	presentInfo.waitSemaphoreCount = 1;
-	presentInfo.pWaitSemaphores = signalSemaphores;
-	VkSwapchainKHR swapchains[] = { mSwapchain };
-	presentInfo.swapchainCount = 1;
-	presentInfo.pSwapchains = swapchains;
-	presentInfo.pImageIndices = &imageIndex;
-	presentInfo.pResults = nullptr;
+	if (numSlices < 1)
+	{
+		numSlices = 1;
+	}
+
+	return numSlices;
+}
+
+void Renderer::RecordSecondaryCommandBuffers(uint32_t numSlices, VkFramebuffer framebuffer, bool castShadows)
+{
+	mSecondaryCommandBuffers.mShadow.resize(castShadows ? numSlices : 0);
+	mSecondaryCommandBuffers.mEarlyDepth.resize(numSlices);
+	mSecondaryCommandBuffers.mGeometry.resize(numSlices);
+	mSecondaryCommandBuffers.mLightVolumes.resize(ShouldRenderLightVolumes() ? numSlices : 0);
+
+	uint32_t numActors = mScene->GetNumActors();
+	uint32_t numLights = mScene->GetNumPointLights();
+
+	// Each slice records a contiguous range of actors and lights into every pass, using only
+	// its own command pool. Nothing shared is written while recording.
+	mWorkerPool.ParallelFor(numSlices, [&](uint32_t slice)
+	{
+		PROFILE_ZONE("Renderer::RecordSlice");
+
+		// Timestamps can't go into the primary inside these subpasses, so a pass is timed
+		// from the start of its first slice to the end of its last.
+		bool firstSlice = (slice == 0);
+		bool lastSlice = (slice + 1 == numSlices);
+
+		uint32_t firstActor = slice * numActors / numSlices;
+		uint32_t sliceActors = (slice + 1) * numActors / numSlices - firstActor;
+
+		if (castShadows)
+		{
+			VkCommandBuffer shadowCommandBuffer = mParallelRecorder.BeginSecondary(slice, mShadowCaster.GetRenderPass(), 0, mShadowCaster.GetFramebuffer());
+			mShadowCaster.RecordShadowCasters(mScene, shadowCommandBuffer, firstActor, sliceActors);
+			mParallelRecorder.EndSecondary(shadowCommandBuffer);
+			mSecondaryCommandBuffers.mShadow[slice] = shadowCommandBuffer;
+		}
+
+		VkCommandBuffer earlyDepthCommandBuffer = mParallelRecorder.BeginSecondary(slice, mRenderPass, PASS_DEPTH, framebuffer);
+		SetViewportAndScissor(earlyDepthCommandBuffer, 0, 0, mSwapchainExtent.width, mSwapchainExtent.height);
+		if (firstSlice) { mGpuProfiler.BeginScope(earlyDepthCommandBuffer, GpuScope::EarlyDepth); }
+		RecordEarlyDepth(earlyDepthCommandBuffer, firstActor, sliceActors);
+		if (lastSlice) { mGpuProfiler.EndScope(earlyDepthCommandBuffer, GpuScope::EarlyDepth); }
+		mParallelRecorder.EndSecondary(earlyDepthCommandBuffer);
+		mSecondaryCommandBuffers.mEarlyDepth[slice] = earlyDepthCommandBuffer;
+
+		VkCommandBuffer geometryCommandBuffer = mParallelRecorder.BeginSecondary(slice, mRenderPass, PASS_GEOMETRY, framebuffer);
+		SetViewportAndScissor(geometryCommandBuffer, 0, 0, mSwapchainExtent.width, mSwapchainExtent.height);
+		if (firstSlice) { mGpuProfiler.BeginScope(geometryCommandBuffer, GpuScope::Geometry); }
+		RecordGeometry(geometryCommandBuffer, firstActor, sliceActors);
+		if (lastSlice) { mGpuProfiler.EndScope(geometryCommandBuffer, GpuScope::Geometry); }
+		mParallelRecorder.EndSecondary(geometryCommandBuffer);
+		mSecondaryCommandBuffers.mGeometry[slice] = geometryCommandBuffer;
+
+		if (ShouldRenderLightVolumes())
+		{
+			uint32_t firstLight = slice * numLights / numSlices;
+			uint32_t sliceLights = (slice + 1) * numLights / numSlices - firstLight;
+
+			VkCommandBuffer lightCommandBuffer = mParallelRecorder.BeginSecondary(slice, mRenderPass, PASS_DEFERRED, framebuffer);
+			SetViewportAndScissor(lightCommandBuffer, 0, 0, mSwapchainExtent.width, mSwapchainExtent.height);
+			if (firstSlice) { mGpuProfiler.BeginScope(lightCommandBuffer, GpuScope::PointLights); }
+			RecordLightVolumes(lightCommandBuffer, firstLight, sliceLights);
+			if (lastSlice) { mGpuProfiler.EndScope(lightCommandBuffer, GpuScope::PointLights); }
+			mParallelRecorder.EndSecondary(lightCommandBuffer);
+			mSecondaryCommandBuffers.mLightVolumes[slice] = lightCommandBuffer;
+		}
+	});
+}
+
+void Renderer::RecordEarlyDepth(VkCommandBuffer commandBuffer, uint32_t firstActor, uint32_t numActors)
+{
+	mEarlyDepthPipeline.BindPipeline(commandBuffer);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mEarlyDepthPipeline.GetPipelineLayout(), 0, 1, &mGlobalDescriptorSets[mFrameIndex], 0, 0);
+	mScene->RenderGeometry(commandBuffer, firstActor, numActors);
+}
+
+void Renderer::RecordGeometry(VkCommandBuffer commandBuffer, uint32_t firstActor, uint32_t numActors)
+{
+	mGeometryPipeline.BindPipeline(commandBuffer);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mGeometryPipeline.GetPipelineLayout(), 0, 1, &mGlobalDescriptorSets[mFrameIndex], 0, 0);
+	mScene->RenderGeometry(commandBuffer, firstActor, numActors);
+}
+
+void Renderer::RecordFullscreenLighting(VkCommandBuffer commandBuffer)
+{
+	if (mDebugMode == DEBUG_GBUFFER)
+	{
+		mDebugDeferredPipeline.BindPipeline(commandBuffer);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mLightPipeline.GetPipelineLayout(), 0, 1, &mGlobalDescriptorSets[mFrameIndex], 0, 0);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mLightPipeline.GetPipelineLayout(), 1, 1, &mDeferredDescriptorSet, 0, 0);
+		vkCmdDraw(commandBuffer, 4, 1, 0, 0);
+	}
+	else if (mDebugMode == DEBUG_ENVIRONMENT_CAPTURE)
+	{
+		mEnvironmentCaptureDebugPipeline.BindPipeline(commandBuffer);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mEnvironmentCaptureDebugPipeline.GetPipelineLayout(), 0, 1, &mGlobalDescriptorSets[mFrameIndex], 0, 0);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mEnvironmentCaptureDebugPipeline.GetPipelineLayout(), 1, 1, &mDeferredDescriptorSet, 0, 0);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mEnvironmentCaptureDebugPipeline.GetPipelineLayout(), 2, 1, &mDebugDescriptorSet, 0, 0);
+		vkCmdDraw(commandBuffer, 4, 1, 0, 0);
+	}
+	else if (mDebugMode == DEBUG_SHADOW_MAP)
+	{
+		mShadowMapDebugPipeline.BindPipeline(commandBuffer);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mShadowMapDebugPipeline.GetPipelineLayout(), 0, 1, &mGlobalDescriptorSets[mFrameIndex], 0, 0);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mShadowMapDebugPipeline.GetPipelineLayout(), 1, 1, &mDeferredDescriptorSet, 0, 0);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mShadowMapDebugPipeline.GetPipelineLayout(), 2, 1, &mDebugDescriptorSet, 0, 0);
+		vkCmdDraw(commandBuffer, 4, 1, 0, 0);
+	}
+	else
+	{
+		mDirectionalLightPipeline.BindPipeline(commandBuffer);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mLightPipeline.GetPipelineLayout(), 0, 1, &mGlobalDescriptorSets[mFrameIndex], 0, 0);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mLightPipeline.GetPipelineLayout(), 1, 1, &mDeferredDescriptorSet, 0, 0);
+		vkCmdDraw(commandBuffer, 4, 1, 0, 0);
+	}
+}
 
-	vkQueuePresentKHR(mPresentQueue, &presentInfo);
+void Renderer::RecordLightVolumes(VkCommandBuffer commandBuffer, uint32_t firstLight, uint32_t numLights)
+{
+	mLightPipeline.BindPipeline(commandBuffer);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mLightPipeline.GetPipelineLayout(), 0, 1, &mGlobalDescriptorSets[mFrameIndex], 0, 0);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mLightPipeline.GetPipelineLayout(), 1, 1, &mDeferredDescriptorSet, 0, 0);
+	mScene->RenderLightVolumes(commandBuffer, firstLight, numLights);
+}
 
-	// TODO: Perhaps only wait if validation layers are enabled.
-	vkQueueWaitIdle(mPresentQueue);
+bool Renderer::ShouldRenderLightVolumes()
+{
+	return mDebugMode != DEBUG_GBUFFER &&
+		mDebugMode != DEBUG_ENVIRONMENT_CAPTURE &&
+		mDebugMode != DEBUG_SHADOW_MAP;
 }
 
 void Renderer::SetScene(Scene* scene)
@@ -506,6 +1040,11 @@ void Renderer::SetScene(Scene* scene)
 	if (mScene != scene)
 	{
 		mScene = scene;
+
+		// Pick up the new scene's irradiance map.
+		WaitForFramesInFlight();
+		UpdateDeferredDescriptorSet();
+		InvalidateCommandBuffers();
 	}
 }
 
@@ -517,6 +1056,7 @@ Scene* Renderer::GetScene()
 void Renderer::SetRootWidget(class Widget* widget)
 {
 	mRootWidget = widget;
+	InvalidateCommandBuffers();
 }
 
 class Widget* Renderer::GetRootWidget()
@@ -536,9 +1076,11 @@ VKAPI_ATTR VkBool32 VKAPI_CALL Renderer::DebugCallback(VkDebugReportFlagsEXT fla
 	printf("Validation Layer ");
 	printf(msg);
 
+#if defined(_WIN32)
 	OutputDebugString("Validation Layer: ");
 	OutputDebugString(msg);
 	OutputDebugString("\n");
+#endif
 
 	return VK_FALSE;
 }
@@ -551,10 +1093,13 @@ void Renderer::CreateInstance()
 	uint32_t extensionCount = 0;
 	uint32_t enabledExtensions = 0;
 
+	// Headless rendering doesn't need a surface, so it also runs without a window system.
+	bool needSurface = !mAppState->mHeadless;
+
 	if (mAppState->mValidate &&
 		CheckValidationLayerSupport(sValidationLayers, sNumValidationLayers) == false)
 	{
-		throw std::exception("Validation layers enabled but the configured layers are not supported.");
+		throw std::runtime_error("Validation layers enabled but the configured layers are not supported.");
 	}
 
 	result = vkEnumerateInstanceExtensionProperties(NULL, &extensionCount, NULL);
@@ -569,17 +1114,28 @@ void Renderer::CreateInstance()
 
 		for (uint32_t i = 0; i < extensionCount; i++)
 		{
-			if (!strcmp(VK_KHR_SURFACE_EXTENSION_NAME, extensions[i].extensionName))
+			if (needSurface &&
+				!strcmp(VK_KHR_SURFACE_EXTENSION_NAME, extensions[i].extensionName))
 			{
 				surfaceExtFound = true;
 				mAppState->mEnabledExtensions[mAppState->mEnabledExtensionCount++] = VK_KHR_SURFACE_EXTENSION_NAME;
 			}
 
-			if (!strcmp(VK_KHR_WIN32_SURFACE_EXTENSION_NAME, extensions[i].extensionName))
+#if defined(VK_USE_PLATFORM_WIN32_KHR)
+			if (needSurface &&
+				!strcmp(VK_KHR_WIN32_SURFACE_EXTENSION_NAME, extensions[i].extensionName))
 			{
 				platformSurfaceExtFound = 1;
 				mAppState->mEnabledExtensions[mAppState->mEnabledExtensionCount++] = VK_KHR_WIN32_SURFACE_EXTENSION_NAME;
 			}
+#endif
+
+			// Needed to query VK_EXT_memory_budget on a Vulkan 1.0 instance.
+			if (!strcmp(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME, extensions[i].extensionName))
+			{
+				mPhysicalDeviceProperties2Enabled = true;
+				mAppState->mEnabledExtensions[mAppState->mEnabledExtensionCount++] = VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME;
+			}
 
 			if (!strcmp(VK_EXT_DEBUG_REPORT_EXTENSION_NAME, extensions[i].extensionName))
 			{
@@ -595,7 +1151,8 @@ void Renderer::CreateInstance()
 		extensions = nullptr;
 	}
 
-	if (!surfaceExtFound)
+	if (needSurface &&
+		!surfaceExtFound)
 	{
 		ERR_EXIT("vkEnumerateInstanceExtensionProperties failed to find "
 			"the " VK_KHR_SURFACE_EXTENSION_NAME
@@ -605,7 +1162,9 @@ void Renderer::CreateInstance()
 			"information.\n",
 			"vkCreateInstance Failure");
 	}
-	if (!platformSurfaceExtFound)
+#if defined(VK_USE_PLATFORM_WIN32_KHR)
+	if (needSurface &&
+		!platformSurfaceExtFound)
 	{
 		ERR_EXIT("vkEnumerateInstanceExtensionProperties failed to find "
 			"the " VK_KHR_WIN32_SURFACE_EXTENSION_NAME
@@ -615,6 +1174,7 @@ void Renderer::CreateInstance()
 			"information.\n",
 			"vkCreateInstance Failure");
 	}
+#endif
 
 	VkApplicationInfo appInfo = {};
 	appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
@@ -637,7 +1197,7 @@ void Renderer::CreateInstance()
 
 	if (result != VK_SUCCESS)
 	{
-		throw std::exception("Failed to create instance.");
+		throw std::runtime_error("Failed to create instance.");
 	}
 }
 
@@ -662,12 +1222,18 @@ void Renderer::CreateDebugCallback()
 	}
 	else
 	{
-		throw exception("Failed to setup debug callback!");
+		throw runtime_error("Failed to setup debug callback!");
 	}
 }
 
 void Renderer::CreateSurface()
 {
+	if (mAppState->mHeadless)
+	{
+		return;
+	}
+
+#if defined(VK_USE_PLATFORM_WIN32_KHR)
 	PFN_vkCreateWin32SurfaceKHR pfnCreateWin32Surface = (PFN_vkCreateWin32SurfaceKHR)vkGetInstanceProcAddr(mInstance, "vkCreateWin32SurfaceKHR");
 
 	assert(pfnCreateWin32Surface != nullptr);
@@ -679,8 +1245,11 @@ void Renderer::CreateSurface()
 
 	if (pfnCreateWin32Surface(mInstance, &ciSurface, nullptr, &mSurface) != VK_SUCCESS)
 	{
-		throw exception("Failed to create window surface.");
+		throw runtime_error("Failed to create window surface.");
 	}
+#else
+	throw runtime_error("Presenting to a window isn't supported on this platform, run headless.");
+#endif
 }
 
 void Renderer::PickPhysicalDevice()
@@ -690,7 +1259,7 @@ void Renderer::PickPhysicalDevice()
 
 	if (deviceCount == 0)
 	{
-		throw exception("No physical device found.");
+		throw runtime_error("No physical device found.");
 	}
 
 	vector<VkPhysicalDevice> devices(deviceCount);
@@ -707,7 +1276,7 @@ void Renderer::PickPhysicalDevice()
 
 	if (mPhysicalDevice == VK_NULL_HANDLE)
 	{
-		throw exception("Failed to find a suitable GPU.");
+		throw runtime_error("Failed to find a suitable GPU.");
 	}
 }
 
@@ -721,8 +1290,8 @@ void Renderer::CreateLogicalDevice()
 	const int QUEUE_PRESENT = 1;
 	int queueCount = (indices.mGraphicsFamily != indices.mPresentFamily) ? 2 : 1;
 
-	VkDeviceQueueCreateInfo ciDeviceQueues[2];
-	memset(ciDeviceQueues, 0, sizeof(VkDeviceQueueCreateInfo)*2);
+	VkDeviceQueueCreateInfo ciDeviceQueues[3];
+	memset(ciDeviceQueues, 0, sizeof(VkDeviceQueueCreateInfo)*3);
 	ciDeviceQueues[QUEUE_GRAPHICS].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
 	ciDeviceQueues[QUEUE_GRAPHICS].queueFamilyIndex = indices.mGraphicsFamily;
 	ciDeviceQueues[QUEUE_GRAPHICS].queueCount = 1;
@@ -735,13 +1304,70 @@ void Renderer::CreateLogicalDevice()
 
 	VkPhysicalDeviceFeatures deviceFeatures = {};
 
+	vector<const char*> enabledExtensions;
+
+	if (!mAppState->mHeadless)
+	{
+		enabledExtensions.insert(enabledExtensions.end(), sDeviceExtensions, sDeviceExtensions + sNumDeviceExtensions);
+	}
+
+	bool dedicatedAllocation = CheckDeviceExtensionSupport(mPhysicalDevice, sDedicatedAllocationExtensions, sNumDedicatedAllocationExtensions);
+
+	if (dedicatedAllocation)
+	{
+		enabledExtensions.insert(enabledExtensions.end(), sDedicatedAllocationExtensions, sDedicatedAllocationExtensions + sNumDedicatedAllocationExtensions);
+	}
+
+	bool memoryBudget = mPhysicalDeviceProperties2Enabled && CheckDeviceExtensionSupport(mPhysicalDevice, sMemoryBudgetExtensions, sNumMemoryBudgetExtensions);
+
+	if (memoryBudget)
+	{
+		enabledExtensions.insert(enabledExtensions.end(), sMemoryBudgetExtensions, sMemoryBudgetExtensions + sNumMemoryBudgetExtensions);
+	}
+
+	// Uploads only move to the transfer queue when the graphics queue can wait on it with a timeline semaphore.
+	VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timelineSemaphoreFeatures = {};
+	timelineSemaphoreFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+
+	bool transferQueue = indices.mTransferFamily >= 0 &&
+		mPhysicalDeviceProperties2Enabled &&
+		CheckDeviceExtensionSupport(mPhysicalDevice, sTimelineSemaphoreExtensions, sNumTimelineSemaphoreExtensions);
+
+	if (transferQueue)
+	{
+		auto getFeatures2 = (PFN_vkGetPhysicalDeviceFeatures2KHR)vkGetInstanceProcAddr(mInstance, "vkGetPhysicalDeviceFeatures2KHR");
+
+		VkPhysicalDeviceFeatures2KHR features2 = {};
+		features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR;
+		features2.pNext = &timelineSemaphoreFeatures;
+
+		if (getFeatures2 != nullptr)
+		{
+			getFeatures2(mPhysicalDevice, &features2);
+		}
+
+		transferQueue = timelineSemaphoreFeatures.timelineSemaphore == VK_TRUE;
+	}
+
+	if (transferQueue)
+	{
+		enabledExtensions.insert(enabledExtensions.end(), sTimelineSemaphoreExtensions, sTimelineSemaphoreExtensions + sNumTimelineSemaphoreExtensions);
+
+		ciDeviceQueues[queueCount].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+		ciDeviceQueues[queueCount].queueFamilyIndex = indices.mTransferFamily;
+		ciDeviceQueues[queueCount].queueCount = 1;
+		ciDeviceQueues[queueCount].pQueuePriorities = &priorities;
+		queueCount++;
+	}
+
 	VkDeviceCreateInfo ciDevice = {};
 	ciDevice.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+	ciDevice.pNext = transferQueue ? &timelineSemaphoreFeatures : nullptr;
 	ciDevice.pQueueCreateInfos = ciDeviceQueues;
 	ciDevice.queueCreateInfoCount = queueCount;
 	ciDevice.pEnabledFeatures = &deviceFeatures;
-	ciDevice.enabledExtensionCount = sNumDeviceExtensions;
-	ciDevice.ppEnabledExtensionNames = sDeviceExtensions;
+	ciDevice.enabledExtensionCount = static_cast<uint32_t>(enabledExtensions.size());
+	ciDevice.ppEnabledExtensionNames = enabledExtensions.data();
 
 	if (mAppState->mValidate)
 	{
@@ -757,11 +1383,26 @@ void Renderer::CreateLogicalDevice()
 
 	if (result != VK_SUCCESS)
 	{
-		throw exception("Failed to create logical device.");
+		throw runtime_error("Failed to create logical device.");
 	}
 
 	vkGetDeviceQueue(mDevice, indices.mGraphicsFamily, 0, &mGraphicsQueue);
 	vkGetDeviceQueue(mDevice, indices.mPresentFamily, 0, &mPresentQueue);
+
+	mGraphicsQueueFamily = indices.mGraphicsFamily;
+	mTransferQueue = VK_NULL_HANDLE;
+	mTransferQueueFamily = indices.mGraphicsFamily;
+
+	if (transferQueue)
+	{
+		vkGetDeviceQueue(mDevice, indices.mTransferFamily, 0, &mTransferQueue);
+		mTransferQueueFamily = indices.mTransferFamily;
+	}
+
+	LogDebug("Uploading on the %s queue", transferQueue ? "transfer" : "graphics");
+
+	Allocator::Initialize(dedicatedAllocation, memoryBudget);
+	Allocator::SetBudgetLimit(mAppState->mMemoryBudget);
 }
 
 void Renderer::CreateImageViews()
@@ -838,7 +1479,7 @@ void Renderer::CreateLitColorImage()
 
 	if (vkCreateSampler(device, &ciSampler, nullptr, &mLitColorSampler) != VK_SUCCESS)
 	{
-		throw std::exception("Failed to create texture sampler");
+		throw std::runtime_error("Failed to create texture sampler");
 	}
 
 	vkDeviceWaitIdle(device);
@@ -853,6 +1494,9 @@ void Renderer::CreateRenderPass()
 {
 	std::vector<VkAttachmentDescription> attachments;
 
+	// Offscreen images are left ready to be read back instead of presented.
+	VkImageLayout backBufferLayout = mAppState->mHeadless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
 	attachments.push_back(
 		// Back buffer
 	{
@@ -864,7 +1508,7 @@ void Renderer::CreateRenderPass()
 		VK_ATTACHMENT_LOAD_OP_DONT_CARE,
 		VK_ATTACHMENT_STORE_OP_DONT_CARE,
 		VK_IMAGE_LAYOUT_UNDEFINED,
-		VK_IMAGE_LAYOUT_PRESENT_SRC_KHR
+		backBufferLayout
 	}
 	);
 
@@ -1115,7 +1759,7 @@ void Renderer::CreateRenderPass()
 
 	if (vkCreateRenderPass(mDevice, &ciRenderPass, nullptr, &mRenderPass) != VK_SUCCESS)
 	{
-		throw std::exception("Failed to create renderpass");
+		throw std::runtime_error("Failed to create renderpass");
 	}
 }
 
@@ -1162,7 +1806,7 @@ void Renderer::CreateFramebuffers()
 
 		if (vkCreateFramebuffer(mDevice, &ciFramebuffer, nullptr, &mSwapchainFramebuffers[i]) != VK_SUCCESS)
 		{
-			throw exception("Failed to create framebuffer.");
+			throw runtime_error("Failed to create framebuffer.");
 		}
 	}
 }
@@ -1203,7 +1847,12 @@ void Renderer::CreateGBuffer()
 void Renderer::CreateGlobalUniformBuffer()
 {
 	VkDeviceSize bufferSize = sizeof(GlobalUniformData);
-	CreateBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, mGlobalUniformBuffer, mGlobalUniformBufferMemory);
+
+	for (uint32_t i = 0; i < mNumFramesInFlight; ++i)
+	{
+		Allocator::AllocBufferRange(bufferSize, BufferArena::Uniform, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, mGlobalUniformBuffers[i]);
+	}
+
 	UpdateGlobalDescriptorSet();
 }
 
@@ -1226,6 +1875,51 @@ VkPhysicalDevice Renderer::GetPhysicalDevice()
 	return mPhysicalDevice;
 }
 
+VkInstance Renderer::GetInstance()
+{
+	return mInstance;
+}
+
+uint64_t Renderer::GetFrameNumber()
+{
+	return mFrameNumber;
+}
+
+uint32_t Renderer::GetNumFramesInFlight()
+{
+	return mNumFramesInFlight;
+}
+
+uint32_t Renderer::GetFrameIndex() const
+{
+	return mFrameIndex;
+}
+
+void Renderer::InvalidateCommandBuffers()
+{
+	for (RecordedCommandBuffer& recorded : mRecordedCommandBuffers)
+	{
+		recorded.mValid = false;
+	}
+}
+
+void Renderer::WaitForFramesInFlight()
+{
+	// The current slot's fence is already signaled, so this waits on every other submitted frame.
+	vkWaitForFences(mDevice, mNumFramesInFlight, mInFlightFences.data(), VK_TRUE, std::numeric_limits<uint64_t>::max());
+}
+
+void Renderer::ResolveFramesInFlight()
+{
+	WaitForFramesInFlight();
+
+	// Oldest first. The current slot was resolved when the renderer moved on to it.
+	for (uint32_t i = 1; i < mNumFramesInFlight; ++i)
+	{
+		mGpuProfiler.ResolveFrame((mFrameIndex + i) % mNumFramesInFlight);
+	}
+}
+
 GlobalUniformData& Renderer::GetGlobalUniformData()
 {
     return mGlobalUniformData;
@@ -1233,56 +1927,63 @@ GlobalUniformData& Renderer::GetGlobalUniformData()
 
 void Renderer::UpdateGlobalDescriptorSet()
 {
-	void* data;
-	vkMapMemory(mDevice, mGlobalUniformBufferMemory.mDeviceMemory, mGlobalUniformBufferMemory.mOffset, sizeof(GlobalUniformData), 0, &data);
-	memcpy(data, &mGlobalUniformData, sizeof(GlobalUniformData));
-	vkUnmapMemory(mDevice, mGlobalUniformBufferMemory.mDeviceMemory);
+	// Earlier frames may still be reading their own copy, so only the current frame's is written.
+	Allocation& uniformBuffer = mGlobalUniformBuffers[mFrameIndex];
+	memcpy(uniformBuffer.mMappedPtr, &mGlobalUniformData, sizeof(GlobalUniformData));
+	Allocator::FlushMappedRange(uniformBuffer, 0, sizeof(GlobalUniformData));
 }
 
 void Renderer::CreateGlobalDescriptorSet()
 {
 	CreateGlobalUniformBuffer();
 
-	VkDescriptorSetLayout layouts[] = { mGeometryPipeline.GetDescriptorSetLayout(0)};
+	// One set per frame in flight, each pointing at that frame's uniform buffer.
+	std::array<VkDescriptorSetLayout, MAX_FRAMES_IN_FLIGHT> layouts;
+	layouts.fill(mGeometryPipeline.GetDescriptorSetLayout(0));
+
 	VkDescriptorSetAllocateInfo allocInfo = {};
 	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
 	allocInfo.descriptorPool = mDescriptorPool;
-	allocInfo.descriptorSetCount = 1;
-	allocInfo.pSetLayouts = layouts;
+	allocInfo.descriptorSetCount = mNumFramesInFlight;
+	allocInfo.pSetLayouts = layouts.data();
 
-	if (vkAllocateDescriptorSets(mDevice, &allocInfo, &mGlobalDescriptorSet) != VK_SUCCESS)
+	if (vkAllocateDescriptorSets(mDevice, &allocInfo, mGlobalDescriptorSets.data()) != VK_SUCCESS)
 	{
-		throw exception("Failed to create descriptor set");
+		throw runtime_error("Failed to create descriptor set");
 	}
 
 	VkDescriptorSetLayout deferredLayouts[] = { mLightPipeline.GetDescriptorSetLayout(1) };
+	allocInfo.descriptorSetCount = 1;
 	allocInfo.pSetLayouts = deferredLayouts;
 
 	if (vkAllocateDescriptorSets(mDevice, &allocInfo, &mDeferredDescriptorSet) != VK_SUCCESS)
 	{
-		throw exception("Failed to create descriptor set");
+		throw runtime_error("Failed to create descriptor set");
 	}
 
     UpdateDeferredDescriptorSet();
 
-	// Update the uniform buffer descriptor
-	VkDescriptorBufferInfo bufferInfo = {};
-	bufferInfo.buffer = mGlobalUniformBuffer;
-	bufferInfo.range = sizeof(GlobalUniformData);
-	bufferInfo.offset = 0;
+	// Update the uniform buffer descriptors
+	for (uint32_t i = 0; i < mNumFramesInFlight; ++i)
+	{
+		VkDescriptorBufferInfo bufferInfo = {};
+		bufferInfo.buffer = mGlobalUniformBuffers[i].mBuffer;
+		bufferInfo.range = sizeof(GlobalUniformData);
+		bufferInfo.offset = mGlobalUniformBuffers[i].mOffset;
 
-	VkWriteDescriptorSet bufferWrite = {};
-	bufferWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-	bufferWrite.dstSet = mGlobalDescriptorSet;
-	bufferWrite.dstBinding = 0;
-	bufferWrite.dstArrayElement = 0;
-	bufferWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	bufferWrite.descriptorCount = 1;
-	bufferWrite.pBufferInfo = &bufferInfo;
-	bufferWrite.pImageInfo = nullptr;
-	bufferWrite.pTexelBufferView = nullptr;
+		VkWriteDescriptorSet bufferWrite = {};
+		bufferWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		bufferWrite.dstSet = mGlobalDescriptorSets[i];
+		bufferWrite.dstBinding = 0;
+		bufferWrite.dstArrayElement = 0;
+		bufferWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		bufferWrite.descriptorCount = 1;
+		bufferWrite.pBufferInfo = &bufferInfo;
+		bufferWrite.pImageInfo = nullptr;
+		bufferWrite.pTexelBufferView = nullptr;
 
-	vkUpdateDescriptorSets(mDevice, 1, &bufferWrite, 0, nullptr);
+		vkUpdateDescriptorSets(mDevice, 1, &bufferWrite, 0, nullptr);
+	}
 }
 
 void Renderer::CreatePostProcessDescriptorSet()
@@ -1296,7 +1997,7 @@ void Renderer::CreatePostProcessDescriptorSet()
 
 	if (vkAllocateDescriptorSets(mDevice, &allocInfo, &mPostProcessDescriptorSet) != VK_SUCCESS)
 	{
-		throw exception("Failed to create descriptor set");
+		throw runtime_error("Failed to create descriptor set");
 	}
 
 
@@ -1348,6 +2049,7 @@ void Renderer::UpdateDeferredDescriptorSet()
 
     VkImageView shadowMapImageView = renderer->GetShadowMapImageView();
     VkSampler shadowMapSampler = renderer->GetShadowMapSampler();
+	mDeferredShadowMapImageView = shadowMapImageView;
 
 	// No shadowmap texture created yet? Use the default black texture.
 	if (shadowMapImageView == VK_NULL_HANDLE)
@@ -1409,6 +2111,8 @@ void Renderer::UpdateDeferredDescriptorSet()
 
 		vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
 	}
+
+	InvalidateCommandBuffers();
 }
 
 void Renderer::CreateDebugDescriptorSet()
@@ -1422,7 +2126,7 @@ void Renderer::CreateDebugDescriptorSet()
 
 	if (vkAllocateDescriptorSets(mDevice, &allocInfo, &mDebugDescriptorSet) != VK_SUCCESS)
 	{
-		throw exception("Failed to create descriptor set");
+		throw runtime_error("Failed to create descriptor set");
 	}
 
 	//// Update image descriptors
@@ -1462,6 +2166,9 @@ void Renderer::UpdateDebugDescriptorSet()
         return;
     }
 
+	// The debug set may still be bound by a frame in flight.
+	WaitForFramesInFlight();
+
 	if (mDebugMode == DEBUG_ENVIRONMENT_CAPTURE)
 	{
 		std::vector<EnvironmentCapture>& captures = mScene->GetEnvironmentCaptures();
@@ -1508,6 +2215,9 @@ void Renderer::UpdateDebugDescriptorSet()
 	descriptorWrite.pImageInfo = &imageInfo;
 
 	vkUpdateDescriptorSets(mDevice, 1, &descriptorWrite, 0, nullptr);
+
+	// Recorded command buffers that bound the set are invalidated by the update.
+	InvalidateCommandBuffers();
 }
 
 void Renderer::CreateCommandPool()
@@ -1521,7 +2231,7 @@ void Renderer::CreateCommandPool()
 
 	if (vkCreateCommandPool(mDevice, &ciCommandPool, nullptr, &mCommandPool))
 	{
-		throw exception("Failed to create command pool");
+		throw runtime_error("Failed to create command pool");
 	}
 }
 
@@ -1529,7 +2239,10 @@ void Renderer::CreateCommandBuffers()
 {
 	if (mCommandBuffers.size() == 0)
 	{
-		mCommandBuffers.resize(mSwapchainFramebuffers.size());
+		// One per frame slot and swapchain image, so that each combination can be reused.
+		mCommandBuffers.resize(mNumFramesInFlight * mSwapchainImages.size());
+		mRecordedCommandBuffers.clear();
+		mRecordedCommandBuffers.resize(mCommandBuffers.size());
 
 		VkCommandBufferAllocateInfo allocInfo = {};
 		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -1539,8 +2252,17 @@ void Renderer::CreateCommandBuffers()
 
 		if (vkAllocateCommandBuffers(mDevice, &allocInfo, mCommandBuffers.data()) != VK_SUCCESS)
 		{
-			throw exception("Failed to create command buffers");
+			throw runtime_error("Failed to create command buffers");
 		}
+
+		uint32_t numRecordingSlices = std::thread::hardware_concurrency();
+		if (numRecordingSlices < 1)
+			numRecordingSlices = 1;
+		if (numRecordingSlices > RENDERER_MAX_RECORDING_THREADS)
+			numRecordingSlices = RENDERER_MAX_RECORDING_THREADS;
+
+		// Secondary command buffers live as long as the primary that executes them.
+		mParallelRecorder.Create(FindQueueFamilies(mPhysicalDevice).mGraphicsFamily, numRecordingSlices, static_cast<uint32_t>(mCommandBuffers.size()));
 	}
 }
 
@@ -1559,21 +2281,34 @@ VkSampler Renderer::GetShadowMapSampler()
     return mShadowCaster.GetShadowMapSampler();
 }
 
-void Renderer::CreateSemaphores()
+void Renderer::CreateSyncObjects()
 {
 	VkSemaphoreCreateInfo ciSemaphore = {};
 	ciSemaphore.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-	if (vkCreateSemaphore(mDevice, &ciSemaphore, nullptr, &mImageAvailableSemaphore) != VK_SUCCESS ||
-		vkCreateSemaphore(mDevice, &ciSemaphore, nullptr, &mRenderFinishedSemaphore) != VK_SUCCESS)
+	// Fences start signaled so the first wait on each frame slot returns immediately.
+	VkFenceCreateInfo ciFence = {};
+	ciFence.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	ciFence.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+	for (uint32_t i = 0; i < mNumFramesInFlight; ++i)
 	{
-		throw exception("Failed to create semaphores");
+		if (vkCreateSemaphore(mDevice, &ciSemaphore, nullptr, &mImageAvailableSemaphores[i]) != VK_SUCCESS ||
+			vkCreateSemaphore(mDevice, &ciSemaphore, nullptr, &mRenderFinishedSemaphores[i]) != VK_SUCCESS)
+		{
+			throw runtime_error("Failed to create semaphores");
+		}
+
+		if (vkCreateFence(mDevice, &ciFence, nullptr, &mInFlightFences[i]) != VK_SUCCESS)
+		{
+			throw runtime_error("Failed to create fence");
+		}
 	}
 }
 
 void Renderer::CreateDescriptorPool()
 {
-	VkDescriptorPoolSize poolSizes[4] = {};
+	VkDescriptorPoolSize poolSizes[5] = {};
 	poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
 	poolSizes[0].descriptorCount = RENDERER_MAX_UNIFORM_BUFFER_DESCRIPTORS;
 	poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
@@ -1582,22 +2317,26 @@ void Renderer::CreateDescriptorPool()
 	poolSizes[2].descriptorCount = RENDERER_MAX_STORAGE_BUFFER_DESCRIPTORS;
 	poolSizes[3].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
 	poolSizes[3].descriptorCount = RENDERER_MAX_STORAGE_IMAGE_DESCRIPTORS;
+	poolSizes[4].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	poolSizes[4].descriptorCount = RENDERER_MAX_DYNAMIC_UNIFORM_BUFFER_DESCRIPTORS;
 
 	VkDescriptorPoolCreateInfo ciPool = {};
 	ciPool.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-	ciPool.poolSizeCount = 4;
+	ciPool.poolSizeCount = 5;
 	ciPool.pPoolSizes = poolSizes;
 	ciPool.maxSets = RENDERER_MAX_DESCRIPTOR_SETS;
 	ciPool.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
 
 	if (vkCreateDescriptorPool(mDevice, &ciPool, nullptr, &mDescriptorPool) != VK_SUCCESS)
 	{
-		throw exception("Failed to create descriptor pool");
+		throw runtime_error("Failed to create descriptor pool");
 	}
 }
 
 VkCommandBuffer Renderer::BeginSingleSubmissionCommands()
 {
+	mSingleSubmissionMutex.lock();
+
 	VkCommandBufferAllocateInfo allocInfo = {};
 	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
 	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
@@ -1616,7 +2355,7 @@ VkCommandBuffer Renderer::BeginSingleSubmissionCommands()
 	return commandBuffer;
 }
 
-void Renderer::EndSingleSubmissionCommands(VkCommandBuffer commandBuffer, bool waitForIdle)
+void Renderer::EndSingleSubmissionCommands(VkCommandBuffer commandBuffer, bool waitForIdle, VkFence fence)
 {
 	vkEndCommandBuffer(commandBuffer);
 
@@ -1625,71 +2364,75 @@ void Renderer::EndSingleSubmissionCommands(VkCommandBuffer commandBuffer, bool w
 	submitInfo.commandBufferCount = 1;
 	submitInfo.pCommandBuffers = &commandBuffer;
 
-	vkQueueSubmit(mGraphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-	
+	vkQueueSubmit(mGraphicsQueue, 1, &submitInfo, fence);
+
 	if (waitForIdle)
 	{
 		vkQueueWaitIdle(mGraphicsQueue);
+		vkFreeCommandBuffers(mDevice, mCommandPool, 1, &commandBuffer);
+	}
+	else
+	{
+		// Still pending, it was submitted ahead of the frame being prepared.
+		mDestructionQueue.FreeSingleSubmissionCommands(commandBuffer);
 	}
 
+	mSingleSubmissionMutex.unlock();
+}
+
+void Renderer::FreeSingleSubmissionCommands(VkCommandBuffer commandBuffer)
+{
+	// The pool is shared with threads recording their own single submissions.
+	std::lock_guard<std::recursive_mutex> lock(mSingleSubmissionMutex);
 	vkFreeCommandBuffers(mDevice, mCommandPool, 1, &commandBuffer);
 }
 
-void Renderer::CreateBuffer(VkDeviceSize size,
-	VkBufferUsageFlags usage,
-	VkMemoryPropertyFlags properties,
-	VkBuffer& buffer,
-	Allocation& bufferMemory)
+void Renderer::SubmitToQueue(VkQueue queue, const VkSubmitInfo& submitInfo, VkFence fence)
 {
-	VkBufferCreateInfo ciBuffer = {};
-	ciBuffer.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-	ciBuffer.size = size;
-	ciBuffer.usage = usage;
-	ciBuffer.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-	ciBuffer.flags = 0;
+	std::lock_guard<std::recursive_mutex> lock(mSingleSubmissionMutex);
 
-	if (vkCreateBuffer(mDevice, &ciBuffer, nullptr, &buffer) != VK_SUCCESS)
+	if (vkQueueSubmit(queue, 1, &submitInfo, fence) != VK_SUCCESS)
 	{
-		throw exception("Failed to create vertex buffer");
+		throw runtime_error("Failed to submit commands");
 	}
-
-	VkMemoryRequirements memRequirements;
-	vkGetBufferMemoryRequirements(mDevice, buffer, &memRequirements);
-	uint32_t memoryType = FindMemoryType(memRequirements.memoryTypeBits, properties);
-	
-	Allocator::Alloc(memRequirements.size, memRequirements.alignment, memoryType, bufferMemory);
-
-	vkBindBufferMemory(mDevice, buffer, bufferMemory.mDeviceMemory, bufferMemory.mOffset);
 }
 
-void Renderer::CreateVertexBuffer(void* vertexData, uint32_t vertexSize, uint32_t numVertices, VkBuffer& outVertexBuffer, Allocation& outVertexBufferMemory)
+VkQueue Renderer::GetGraphicsQueue()
 {
-	VkDeviceSize bufferSize = vertexSize * numVertices;
+	return mGraphicsQueue;
+}
 
-	VkBuffer stagingBuffer;
-	Allocation stagingBufferMemory;
-	CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+uint32_t Renderer::GetGraphicsQueueFamily()
+{
+	return mGraphicsQueueFamily;
+}
 
-	void* data;
-	vkMapMemory(mDevice, stagingBufferMemory.mDeviceMemory, stagingBufferMemory.mOffset, bufferSize, 0, &data);
-	memcpy(data, vertexData, (size_t)bufferSize);
-	vkUnmapMemory(mDevice, stagingBufferMemory.mDeviceMemory);
+VkQueue Renderer::GetTransferQueue()
+{
+	return mTransferQueue;
+}
 
-	CreateBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, outVertexBuffer, outVertexBufferMemory);
+uint32_t Renderer::GetTransferQueueFamily()
+{
+	return mTransferQueueFamily;
+}
 
-	CopyBuffer(stagingBuffer, outVertexBuffer, bufferSize);
+void Renderer::CreateGeometryBuffer(const void* data, VkDeviceSize size, Allocation& outBuffer)
+{
+	Allocator::AllocBufferRange(size, BufferArena::Geometry, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, outBuffer);
 
-	vkDestroyBuffer(mDevice, stagingBuffer, nullptr);
-	Allocator::Free(stagingBufferMemory);
+	mUploadBatcher.UploadBuffer(data, size, outBuffer);
 }
 
-void Renderer::CopyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size)
+void Renderer::CopyBuffer(const Allocation& srcBuffer, const Allocation& dstBuffer, VkDeviceSize size)
 {
 	VkCommandBuffer commandBuffer = BeginSingleSubmissionCommands();
 
 	VkBufferCopy copyRegion = {};
+	copyRegion.srcOffset = srcBuffer.mOffset;
+	copyRegion.dstOffset = dstBuffer.mOffset;
 	copyRegion.size = size;
-	vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
+	vkCmdCopyBuffer(commandBuffer, srcBuffer.mBuffer, dstBuffer.mBuffer, 1, &copyRegion);
 
 	EndSingleSubmissionCommands(commandBuffer);
 }
@@ -1702,6 +2445,7 @@ void Renderer::RecreateSwapchain()
 	}
 
 	vkDeviceWaitIdle(mDevice);
+	mDestructionQueue.FlushAll();
 
 	DestroySwapchain();
 
@@ -1710,6 +2454,9 @@ void Renderer::RecreateSwapchain()
 	CreateDepthImage();
 	CreateLitColorImage();
 	mGBuffer.Create(mSwapchainExtent.width, mSwapchainExtent.height);
+
+	// Pipelines are kept. Their viewport is dynamic and the new render pass is compatible with
+	// the one they were created with.
 	CreateRenderPass();
 	CreateFramebuffers();
 	CreateGlobalDescriptorSet();
@@ -1737,6 +2484,21 @@ LightPipeline& Renderer::GetLightPipeline()
 	return mLightPipeline;
 }
 
+DirectionalLightPipeline& Renderer::GetDirectionalLightPipeline()
+{
+	return mDirectionalLightPipeline;
+}
+
+ReflectionlessGeometryPipeline& Renderer::GetReflectionlessGeometryPipeline()
+{
+	return mReflectionlessGeometryPipeline;
+}
+
+PostProcessPipeline& Renderer::GetPostProcessPipeline()
+{
+	return mPostProcessPipeline;
+}
+
 Pipeline& Renderer::GetDeferredPipeline()
 {
 	return mLightPipeline;
@@ -1753,9 +2515,49 @@ TextPipeline& Renderer::GetTextPipeline()
 	return mTextPipeline;
 }
 
+UniformRingBuffer& Renderer::GetUniformRingBuffer()
+{
+	return mUniformRingBuffer;
+}
+
+DestructionQueue& Renderer::GetDestructionQueue()
+{
+	return mDestructionQueue;
+}
+
+UploadBatcher& Renderer::GetUploadBatcher()
+{
+	return mUploadBatcher;
+}
+
+GpuProfiler& Renderer::GetGpuProfiler()
+{
+	return mGpuProfiler;
+}
+
+PipelineCache& Renderer::GetPipelineCache()
+{
+	return mPipelineCache;
+}
+
+float Renderer::GetPipelineCreationTime() const
+{
+	return mPipelineCreationTime;
+}
+
+ShaderModuleCache& Renderer::GetShaderModuleCache()
+{
+	return mShaderModuleCache;
+}
+
+WorkerPool& Renderer::GetWorkerPool()
+{
+	return mWorkerPool;
+}
+
 VkDescriptorSet& Renderer::GetGlobalDescriptorSet()
 {
-	return mGlobalDescriptorSet;
+	return mGlobalDescriptorSets[mFrameIndex];
 }
 
 VkDescriptorSet& Renderer::GetDeferredDescriptorSet()
@@ -1777,7 +2579,7 @@ uint32_t Renderer::FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags pro
 		}
 	}
 
-	throw exception("Failed to find suitable memory type");
+	throw runtime_error("Failed to find suitable memory type");
 }
 
 bool Renderer::IsDeviceSuitable(VkPhysicalDevice device)
@@ -1792,6 +2594,12 @@ bool Renderer::IsDeviceSuitable(VkPhysicalDevice device)
 
 	QueueFamilyIndices indices = FindQueueFamilies(device);
 
+	if (mAppState->mHeadless)
+	{
+		// Nothing is presented, so neither the swapchain extension nor surface support is needed.
+		return indices.IsComplete();
+	}
+
 	bool swapChainAdequate = false;
 
 	if (extensionsSupported)
@@ -1807,7 +2615,7 @@ VkSurfaceFormatKHR Renderer::ChooseSwapSurfaceFormat(const std::vector<VkSurface
 {
 	if (availableFormats.size() == 0)
 	{
-		throw exception("No available formats for swap surface.");
+		throw runtime_error("No available formats for swap surface.");
 	}
 
 	if (availableFormats.size() == 1 &&
@@ -1843,7 +2651,7 @@ VkPresentModeKHR Renderer::ChooseSwapPresentMode(const std::vector<VkPresentMode
 		}
 	}
 
-	throw exception("Could not find a valid present mode for swapchain.");
+	throw runtime_error("Could not find a valid present mode for swapchain.");
 }
 
 VkExtent2D Renderer::ChooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities)
@@ -1891,7 +2699,16 @@ QueueFamilyIndices Renderer::FindQueueFamilies(VkPhysicalDevice device)
 		}
 
 		VkBool32 presentSupport = false;
-		vkGetPhysicalDeviceSurfaceSupportKHR(device, i, mSurface, &presentSupport);
+
+		if (mAppState->mHeadless)
+		{
+			// The graphics queue takes the place of the present queue.
+			presentSupport = (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0;
+		}
+		else
+		{
+			vkGetPhysicalDeviceSurfaceSupportKHR(device, i, mSurface, &presentSupport);
+		}
 
 		if (queueFamily.queueCount > 0 &&
 			presentSupport)
@@ -1907,6 +2724,30 @@ QueueFamilyIndices Renderer::FindQueueFamilies(VkPhysicalDevice device)
 		i++;
 	}
 
+	// Prefer a pure copy family, otherwise settle for an async compute family.
+	for (i = 0; i < static_cast<int32_t>(queueFamilies.size()); i++)
+	{
+		VkQueueFlags flags = queueFamilies[i].queueFlags;
+
+		if (queueFamilies[i].queueCount == 0 ||
+			!(flags & VK_QUEUE_TRANSFER_BIT) ||
+			(flags & VK_QUEUE_GRAPHICS_BIT))
+		{
+			continue;
+		}
+
+		if (!(flags & VK_QUEUE_COMPUTE_BIT))
+		{
+			indices.mTransferFamily = i;
+			break;
+		}
+
+		if (indices.mTransferFamily < 0)
+		{
+			indices.mTransferFamily = i;
+		}
+	}
+
 	return indices;
 }
 
@@ -2050,23 +2891,37 @@ void Renderer::SetDirectionalLightDirection(glm::vec3 direction)
 
 void Renderer::CreatePipelines()
 {
-	mEarlyDepthPipeline.Create();
-	mGeometryPipeline.Create();
-	mLightPipeline.Create();
-    mDirectionalLightPipeline.Create();
-	mDebugDeferredPipeline.Create();
-	mEnvironmentCaptureDebugPipeline.Create();
-	mShadowMapDebugPipeline.Create();
-	mPostProcessPipeline.Create();
-	mNullPostProcessPipeline.Create();
-	mQuadPipeline.Create();
-	mTextPipeline.Create();
+	PROFILE_FUNCTION();
+
+	// The debug pipelines only compile once a debug mode is selected, and the reflectionless
+	// geometry pipeline on the first environment capture.
+	Pipeline* pipelines[] =
+	{
+		&mEarlyDepthPipeline,
+		&mGeometryPipeline,
+		&mReflectionlessGeometryPipeline,
+		&mLightPipeline,
+		&mDirectionalLightPipeline,
+		&mDebugDeferredPipeline,
+		&mEnvironmentCaptureDebugPipeline,
+		&mShadowMapDebugPipeline,
+		&mPostProcessPipeline,
+		&mNullPostProcessPipeline,
+		&mQuadPipeline,
+		&mTextPipeline
+	};
+
+	ParallelFor(ARRAYSIZE(pipelines), RENDERER_MAX_PIPELINE_THREADS, [&](uint32_t i)
+	{
+		pipelines[i]->Create();
+	});
 }
 
 void Renderer::DestroyPipelines()
 {
 	mEarlyDepthPipeline.Destroy();
 	mGeometryPipeline.Destroy();
+	mReflectionlessGeometryPipeline.Destroy();
 	mLightPipeline.Destroy();
 	mDirectionalLightPipeline.Destroy();
 	mDebugDeferredPipeline.Destroy();
@@ -2080,9 +2935,31 @@ void Renderer::DestroyPipelines()
 
 void Renderer::SetDebugMode(DebugMode mode)
 {
+	// Compile here rather than when the next frame is recorded.
+	switch (mode)
+	{
+	case DEBUG_GBUFFER:
+		mDebugDeferredPipeline.Compile();
+		break;
+	case DEBUG_ENVIRONMENT_CAPTURE:
+		mEnvironmentCaptureDebugPipeline.Compile();
+		break;
+	case DEBUG_SHADOW_MAP:
+		mShadowMapDebugPipeline.Compile();
+		break;
+	default:
+		break;
+	}
+
+	if (mode != DEBUG_NONE)
+	{
+		mNullPostProcessPipeline.Compile();
+	}
+
 	mDebugMode = mode;
 	UpdateGlobalDescriptorSet();
     UpdateDebugDescriptorSet();
+	InvalidateCommandBuffers();
 }
 
 void Renderer::SetViewportAndScissor(VkCommandBuffer cb, int32_t x, int32_t y, int32_t width, int32_t height)
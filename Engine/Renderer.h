@@ -3,6 +3,7 @@
 #include <vulkan/vulkan.h>
 
 #include <vector>
+#include <mutex>
 #include "glm/glm.hpp"
 #include <array>
 
@@ -18,6 +19,14 @@
 #include "GBuffer.h"
 
 #include "ShadowCaster.h"
+#include "UniformRingBuffer.h"
+#include "DestructionQueue.h"
+#include "ParallelRecorder.h"
+#include "UploadBatcher.h"
+#include "GpuProfiler.h"
+#include "PipelineCache.h"
+#include "ShaderModuleCache.h"
+#include "WorkerPool.h"
 
 struct GlobalUniformData
 {
@@ -31,11 +40,33 @@ struct GlobalUniformData
 	int32_t mVisualizationMode;
 };
 
+// Secondary command buffers recorded by worker threads, one per slice for each pass.
+struct SecondaryCommandBuffers
+{
+	std::vector<VkCommandBuffer> mShadow;
+	std::vector<VkCommandBuffer> mEarlyDepth;
+	std::vector<VkCommandBuffer> mGeometry;
+	std::vector<VkCommandBuffer> mLightVolumes;
+};
+
+// What a primary command buffer was last recorded with, to tell whether it can be submitted again.
+struct RecordedCommandBuffer
+{
+	bool mValid = false;
+	bool mCastShadows = false;
+
+	// Dynamic uniform offsets the commands were recorded with, see UniformRingBuffer::GetFrameOffsets().
+	std::vector<uint32_t> mUniformOffsets;
+};
+
 struct QueueFamilyIndices
 {
 	int32_t mGraphicsFamily = -1;
 	int32_t mPresentFamily = -1;
 
+	// Optional, a family with transfer but no graphics support. Usually backed by copy engines.
+	int32_t mTransferFamily = -1;
+
 	bool IsComplete()
 	{
 		return mGraphicsFamily >= 0 &&
@@ -68,6 +99,10 @@ public:
 
 	void PreparePresentation();
 
+	// Copies the image of the last submitted frame into outPixels as tightly packed RGBA8.
+	// Only available in headless mode, returns false if nothing has been rendered yet.
+	bool ReadbackLastFrame(std::vector<uint8_t>& outPixels);
+
 	void Render();
 
 	void SetScene(Scene* scene);
@@ -84,6 +119,28 @@ public:
 
 	VkPhysicalDevice GetPhysicalDevice();
 
+	VkInstance GetInstance();
+
+	// Number of frames submitted so far.
+	uint64_t GetFrameNumber();
+
+	uint32_t GetNumFramesInFlight();
+
+	// Slot of the frame being prepared, below GetNumFramesInFlight().
+	uint32_t GetFrameIndex() const;
+
+	// Forces the next frames to re-record their command buffers. Needed after anything the
+	// recorded commands reference changes, e.g. descriptor set updates or replaced buffers.
+	void InvalidateCommandBuffers();
+
+	// Blocks until every submitted frame has finished on the GPU. Needed before changing
+	// images or descriptor sets that those frames may still be using.
+	void WaitForFramesInFlight();
+
+	// Waits for the submitted frames and reads their GPU timestamps, which otherwise arrive once
+	// their slots are reused, so that the GpuProfiler has samples up to the last submitted frame.
+	void ResolveFramesInFlight();
+
 	void RecreateSwapchain();
 
 	VkDescriptorPool GetDescriptorPool();
@@ -91,25 +148,67 @@ public:
 	EarlyDepthPipeline& GetEarlyDepthPipeline();
 	GeometryPipeline& GetGeometryPipeline();
 	LightPipeline& GetLightPipeline();
+	DirectionalLightPipeline& GetDirectionalLightPipeline();
+	ReflectionlessGeometryPipeline& GetReflectionlessGeometryPipeline();
+	PostProcessPipeline& GetPostProcessPipeline();
 	Pipeline& GetDeferredPipeline();
 	QuadPipeline& GetQuadPipeline();
 	TextPipeline& GetTextPipeline();
 
-	uint32_t FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
+	UniformRingBuffer& GetUniformRingBuffer();
+
+	// Resources that frames in flight may still use are destroyed through this queue.
+	DestructionQueue& GetDestructionQueue();
+
+	// Buffer and image uploads go through this, batch them with BeginBatch()/EndBatch().
+	UploadBatcher& GetUploadBatcher();
+
+	// GPU time per pass, read back a few frames after it was rendered.
+	GpuProfiler& GetGpuProfiler();
 
-	void CreateBuffer(VkDeviceSize size,
-					  VkBufferUsageFlags usage,
-					  VkMemoryPropertyFlags properties,
-					  VkBuffer& buffer,
-					  Allocation& bufferMemory);
+	// Shared by every pipeline, loaded at startup and saved at shutdown.
+	PipelineCache& GetPipelineCache();
 
-	void CreateVertexBuffer(void* vertexData, uint32_t vertexSize, uint32_t numVertices, VkBuffer& outVertexBuffer, Allocation& outVertexBufferMemory);
+	// Milliseconds Initialize() spent creating the renderer's pipelines.
+	float GetPipelineCreationTime() const;
 
-	void CopyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
+	ShaderModuleCache& GetShaderModuleCache();
 
+	// Threads that live as long as the renderer, for work that is split up every frame.
+	WorkerPool& GetWorkerPool();
+
+	uint32_t FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
+
+	// Uploads vertex or index data to a device local range of the geometry arena.
+	// The data is only in place once the upload batcher has submitted it.
+	void CreateGeometryBuffer(const void* data, VkDeviceSize size, Allocation& outBuffer);
+
+	void CopyBuffer(const Allocation& srcBuffer, const Allocation& dstBuffer, VkDeviceSize size);
+
+	// The command pool and queue are shared, so a thread holds mSingleSubmissionMutex from Begin until End.
+	// It is recursive because some helpers begin their own commands while others are being recorded.
 	VkCommandBuffer BeginSingleSubmissionCommands();
 
-	void EndSingleSubmissionCommands(VkCommandBuffer commandBuffer, bool waitForIdle = true);
+	// Without waitForIdle the command buffer is freed once the frame being prepared has completed,
+	// so later frames are ordered after it but the commands must not be waited on otherwise.
+	// fence, if given, is signaled once the commands have completed.
+	void EndSingleSubmissionCommands(VkCommandBuffer commandBuffer, bool waitForIdle = true, VkFence fence = VK_NULL_HANDLE);
+
+	// Called by the destruction queue for command buffers that weren't waited on.
+	void FreeSingleSubmissionCommands(VkCommandBuffer commandBuffer);
+
+	// Submits to queue without waiting. Submissions to any queue go through here or hold
+	// mSingleSubmissionMutex, since uploads may be submitted from other threads.
+	void SubmitToQueue(VkQueue queue, const VkSubmitInfo& submitInfo, VkFence fence);
+
+	VkQueue GetGraphicsQueue();
+
+	uint32_t GetGraphicsQueueFamily();
+
+	// VK_NULL_HANDLE unless the device has a dedicated transfer queue family and timeline semaphores.
+	VkQueue GetTransferQueue();
+
+	uint32_t GetTransferQueueFamily();
 
 	VkExtent2D& GetSwapchainExtent();
 
@@ -182,6 +281,9 @@ private:
 
 	void CreateSurface();
 
+	// Headless replacement for the swapchain images.
+	void CreateOffscreenImages();
+
 	void PickPhysicalDevice();
 
 	void CreateLogicalDevice();
@@ -210,7 +312,7 @@ private:
 
 	void CreateCommandPool();
 
-	void CreateSemaphores();
+	void CreateSyncObjects();
 
 	void UpdateInputEnabled();
 
@@ -224,6 +326,26 @@ private:
 
 	void DestroySwapchain();
 
+	void RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t commandBufferIndex, uint32_t imageIndex, bool castShadows);
+
+	// Returns how many slices to split this frame's draws into, 1 records everything inline.
+	uint32_t GetNumRecordingSlices();
+
+	// Records each slice's share of the scene passes on worker threads.
+	void RecordSecondaryCommandBuffers(uint32_t numSlices, VkFramebuffer framebuffer, bool castShadows);
+
+	// Each of these binds everything it uses, so it can be recorded into either a primary
+	// command buffer or a secondary one that inherits the render pass.
+	void RecordEarlyDepth(VkCommandBuffer commandBuffer, uint32_t firstActor, uint32_t numActors);
+
+	void RecordGeometry(VkCommandBuffer commandBuffer, uint32_t firstActor, uint32_t numActors);
+
+	void RecordFullscreenLighting(VkCommandBuffer commandBuffer);
+
+	void RecordLightVolumes(VkCommandBuffer commandBuffer, uint32_t firstLight, uint32_t numLights);
+
+	bool ShouldRenderLightVolumes();
+
 	bool IsDeviceSuitable(VkPhysicalDevice device);
 
 	VkSurfaceFormatKHR ChooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& availableFormats);
@@ -257,12 +379,16 @@ private:
 	VkDevice mDevice;
 	VkQueue mGraphicsQueue;
 	VkQueue mPresentQueue;
+	VkQueue mTransferQueue;
+	uint32_t mGraphicsQueueFamily;
+	uint32_t mTransferQueueFamily;
 	VkSurfaceKHR mSurface;
 
 	VkDescriptorPool mDescriptorPool;
 
 	VkRenderPass mRenderPass;
 	VkCommandPool mCommandPool;
+	std::recursive_mutex mSingleSubmissionMutex;
 
 	// Swapchain images
 	VkSwapchainKHR mSwapchain;
@@ -272,7 +398,13 @@ private:
 	VkExtent2D mSwapchainExtent;
 
 	std::vector<VkFramebuffer> mSwapchainFramebuffers;
-	std::vector<VkCommandBuffer> mCommandBuffers;
+
+	// Memory of the images that stand in for the swapchain when headless.
+	std::vector<Allocation> mOffscreenImageMemory;
+	uint32_t mLastImageIndex;
+
+	// Fence of the frame that last rendered to each swapchain image.
+	std::vector<VkFence> mImagesInFlight;
 
 	// Depth image
 	VkImage mDepthImage;
@@ -286,11 +418,23 @@ private:
 	VkSampler mLitColorSampler;
 	VkFormat mLitColorImageFormat;
 
-	VkSemaphore mImageAvailableSemaphore;
-	VkSemaphore mRenderFinishedSemaphore;
+	// Indexed by mFrameIndex * swapchain image count + image index
+	std::vector<VkCommandBuffer> mCommandBuffers;
+	std::vector<RecordedCommandBuffer> mRecordedCommandBuffers;
+
+	// Per frame in flight, indexed by mFrameIndex
+	std::array<VkSemaphore, MAX_FRAMES_IN_FLIGHT> mImageAvailableSemaphores;
+	std::array<VkSemaphore, MAX_FRAMES_IN_FLIGHT> mRenderFinishedSemaphores;
+	std::array<VkFence, MAX_FRAMES_IN_FLIGHT> mInFlightFences;
+	uint32_t mNumFramesInFlight;
+
+	ParallelRecorder mParallelRecorder;
+	WorkerPool mWorkerPool;
+	SecondaryCommandBuffers mSecondaryCommandBuffers;
 
 	EarlyDepthPipeline mEarlyDepthPipeline;
 	GeometryPipeline mGeometryPipeline;
+	ReflectionlessGeometryPipeline mReflectionlessGeometryPipeline;
 	LightPipeline mLightPipeline;
     DirectionalLightPipeline mDirectionalLightPipeline;
 	DebugDeferredPipeline mDebugDeferredPipeline;
@@ -301,16 +445,29 @@ private:
 	QuadPipeline mQuadPipeline;
 	TextPipeline mTextPipeline;
 
-	VkDescriptorSet mGlobalDescriptorSet;
-	VkBuffer mGlobalUniformBuffer;
-	Allocation mGlobalUniformBufferMemory;
+	std::array<VkDescriptorSet, MAX_FRAMES_IN_FLIGHT> mGlobalDescriptorSets;
+	std::array<Allocation, MAX_FRAMES_IN_FLIGHT> mGlobalUniformBuffers;
 
 	VkDescriptorSet mDeferredDescriptorSet;
+	VkImageView mDeferredShadowMapImageView;
 	VkDescriptorSet mDebugDescriptorSet;
 	VkDescriptorSet mPostProcessDescriptorSet;
 
 	GlobalUniformData mGlobalUniformData;
 
+	UniformRingBuffer mUniformRingBuffer;
+	uint32_t mFrameIndex;
+	uint64_t mFrameNumber;
+
+	DestructionQueue mDestructionQueue;
+
+	UploadBatcher mUploadBatcher;
+	GpuProfiler mGpuProfiler;
+
+	PipelineCache mPipelineCache;
+	float mPipelineCreationTime;
+	ShaderModuleCache mShaderModuleCache;
+
 	GBuffer mGBuffer;
 
 	Scene* mScene;
@@ -322,6 +479,8 @@ private:
 
 	bool mInitialized;
 
+	bool mPhysicalDeviceProperties2Enabled;
+
     uint32_t mEnvironmentDebugFace;
 
 	ShadowCaster mShadowCaster;
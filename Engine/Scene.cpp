@@ -2,7 +2,15 @@
 #include "Camera.h"
 #include "Constants.h"
 #include "Renderer.h"
+#include "Utilities.h"
+#include "Log.h"
+#include "CpuProfiler.h"
+#include "Input.h"
 #include <map>
+#include <algorithm>
+#include <assert.h>
+#include <chrono>
+#include <stdexcept>
 
 using namespace std;
 
@@ -19,6 +27,8 @@ static const float radiusGrowSpeed = 2.0f;
 static bool spawnedTestLights = false;
 
 Scene::Scene() :
+	mRestoringTexture(nullptr),
+	mEvictionFence(VK_NULL_HANDLE),
 	mLoaded(false),
 	mDebugMoveLights(true)
 {
@@ -30,6 +40,32 @@ Scene::Scene() :
 
 void Scene::Destroy()
 {
+	if (mRestoringTexture != nullptr)
+	{
+		mRestoringTexture->CancelRestore();
+		mRestoringTexture = nullptr;
+	}
+
+	if (mEvictionFence != VK_NULL_HANDLE)
+	{
+		VkDevice device = Renderer::Get()->GetDevice();
+
+		if (!mEvictingTextures.empty())
+		{
+			vkWaitForFences(device, 1, &mEvictionFence, VK_TRUE, UINT64_MAX);
+		}
+
+		vkDestroyFence(device, mEvictionFence, nullptr);
+		mEvictionFence = VK_NULL_HANDLE;
+	}
+
+	for (Texture2D* texture : mEvictingTextures)
+	{
+		texture->CancelEvictMips();
+	}
+
+	mEvictingTextures.clear();
+
 	for (Actor& actor : mActors)
 	{
 		actor.Destroy();
@@ -42,6 +78,8 @@ void Scene::Destroy()
 void Scene::Load(const std::string& directory,
 	const std::string& file)
 {
+	PROFILE_FUNCTION();
+
 	if (!mLoaded)
 	{
 		std::string path = directory + file;
@@ -55,11 +93,25 @@ void Scene::Load(const std::string& directory,
 
 		if (scene == nullptr)
 		{
-			throw exception("Failed to open Collada file");
+			throw runtime_error("Failed to open Collada file");
 		}
 
+		std::chrono::steady_clock::time_point loadStart = std::chrono::steady_clock::now();
+
+		// Collect the texture and mesh uploads into a few submissions rather than waiting on each.
+		UploadBatcher& uploadBatcher = Renderer::Get()->GetUploadBatcher();
+		uint32_t numSubmits = uploadBatcher.GetNumSubmits();
+
 		LoadMaterials(*scene);
+
+		uploadBatcher.BeginBatch();
+		LoadTextures();
 		LoadMeshes(*scene);
+		uploadBatcher.EndBatch();
+
+		std::chrono::duration<double> loadTime = std::chrono::steady_clock::now() - loadStart;
+		LogDebug("Loaded %s textures and meshes in %.3f s with %u upload submissions", path.c_str(), loadTime.count(), uploadBatcher.GetNumSubmits() - numSubmits);
+
 		LoadActors(*scene);
 		AssignEnvironmentCaptures();
 
@@ -68,6 +120,8 @@ void Scene::Load(const std::string& directory,
 		SetTestDirectionalLight();
 
 		mLoaded = true;
+
+		Renderer::Get()->InvalidateCommandBuffers();
 	}
 }
 
@@ -92,7 +146,7 @@ TextureCube* Scene::GetIrradianceMap()
 void Scene::UpdateDebug(float deltaTime)
 {
 	// Change Radii
-	if (GetAsyncKeyState('T'))
+	if (IsKeyDown(VKEY_T))
 	{
 		for (PointLight& light : mPointLights)
 		{
@@ -102,7 +156,7 @@ void Scene::UpdateDebug(float deltaTime)
 		}
 	}
 
-	if (GetAsyncKeyState('R'))
+	if (IsKeyDown(VKEY_R))
 	{
 		for (PointLight& light : mPointLights)
 		{
@@ -112,29 +166,19 @@ void Scene::UpdateDebug(float deltaTime)
 		}
 	}
 
-	static bool cDown = false;
-	if (GetAsyncKeyState('C') &&
-		GetAsyncKeyState(VK_CONTROL))
-	{
-		if (!cDown)
-		{
-			CaptureEnvironment();
-		}
-
-		cDown = true;
-	}
-	else
+	if (IsKeyJustDown(VKEY_C) &&
+		IsKeyDown(VKEY_CONTROL))
 	{
-		cDown = false;
+		CaptureEnvironment();
 	}
 
-	if ((GetAsyncKeyState('A') || GetAsyncKeyState('D')) &&
-		GetAsyncKeyState(VK_CONTROL))
+	if ((IsKeyDown(VKEY_A) || IsKeyDown(VKEY_D)) &&
+		IsKeyDown(VKEY_CONTROL))
 	{
 		glm::vec3 dir = mDirectionalLight.GetDirection();
 		float deltaDir = 0.3f * deltaTime;
 		
-		if (GetAsyncKeyState('D'))
+		if (IsKeyDown(VKEY_D))
 		{
 			deltaDir *= -1.0f;
 		}
@@ -144,56 +188,26 @@ void Scene::UpdateDebug(float deltaTime)
 		mDirectionalLight.SetDirection(dir);
 	}
 
-	static bool sDown = false;
-	if (GetAsyncKeyState('S') &&
-		GetAsyncKeyState(VK_CONTROL))
+	if (IsKeyJustDown(VKEY_S) &&
+		IsKeyDown(VKEY_CONTROL))
 	{
-		if (!sDown)
-		{
-			bool castShadows = !mDirectionalLight.ShouldCastShadows();
-			mDirectionalLight.SetCastShadows(castShadows);
-		}
-
-		sDown = true;
-	}
-	else
-	{
-		sDown = false;
+		bool castShadows = !mDirectionalLight.ShouldCastShadows();
+		mDirectionalLight.SetCastShadows(castShadows);
 	}
 
-	static bool oDown = false;
-	if (GetAsyncKeyState('O') &&
-		GetAsyncKeyState(VK_CONTROL))
+	if (IsKeyJustDown(VKEY_O) &&
+		IsKeyDown(VKEY_CONTROL) &&
+		!spawnedTestLights)
 	{
-		if (!oDown &&
-			!spawnedTestLights)
-		{
-			spawnedTestLights = true;
-			mPointLights.clear();
-			SpawnTestLights();
-		}
-
-		oDown = true;
-	}
-	else
-	{
-		oDown = false;
+		spawnedTestLights = true;
+		mPointLights.clear();
+		SpawnTestLights();
 	}
 
-	static bool pDown = false;
-	if (GetAsyncKeyState('P') &&
-		GetAsyncKeyState(VK_CONTROL))
+	if (IsKeyJustDown(VKEY_P) &&
+		IsKeyDown(VKEY_CONTROL))
 	{
-		if (!pDown)
-		{
-			mDebugMoveLights = !mDebugMoveLights;
-		}
-
-		pDown = true;
-	}
-	else
-	{
-		pDown = false;
+		mDebugMoveLights = !mDebugMoveLights;
 	}
 }
 
@@ -230,10 +244,14 @@ void Scene::SpawnTestLights()
 
 		pointLight.SetVelocity(velocity);
 	}
+
+	Renderer::Get()->InvalidateCommandBuffers();
 }
 
 void Scene::LoadMaterials(const aiScene& scene)
 {
+	PROFILE_FUNCTION();
+
 	int numMaterials = scene.mNumMaterials;
 
 	mMaterials.resize(numMaterials);
@@ -244,20 +262,45 @@ void Scene::LoadMaterials(const aiScene& scene)
 	}
 }
 
+void Scene::LoadTextures()
+{
+	PROFILE_FUNCTION();
+
+	// Materials only register their textures, decoding and uploading them is the slow part of loading.
+	std::vector<Texture2D*> textures;
+
+	for (std::pair<const std::string, Texture2D>& entry : mTextures)
+	{
+		if (!entry.second.IsValid())
+		{
+			textures.push_back(&entry.second);
+		}
+	}
+
+	ParallelFor(static_cast<uint32_t>(textures.size()), SCENE_LOAD_MAX_THREADS, [&](uint32_t i)
+	{
+		textures[i]->Load(textures[i]->GetName());
+	});
+}
+
 void Scene::LoadMeshes(const aiScene& scene)
 {
-	int numMeshes = scene.mNumMeshes;
+	PROFILE_FUNCTION();
+
+	uint32_t numMeshes = scene.mNumMeshes;
 
 	mMeshes.resize(numMeshes);
 
-	for (int i = 0; i < numMeshes; ++i)
+	ParallelFor(numMeshes, SCENE_LOAD_MAX_THREADS, [&](uint32_t i)
 	{
 		mMeshes[i].Create(*scene.mMeshes[i], &mMaterials);
-	}
+	});
 }
 
 void Scene::LoadActors(const aiScene& scene)
 {
+	PROFILE_FUNCTION();
+
 	int numNodes = scene.mRootNode->mNumChildren;
 	mActors.reserve(numNodes);
 
@@ -322,9 +365,16 @@ DirectionalLight& Scene::GetDirectionalLight()
 
 void Scene::RenderGeometry(VkCommandBuffer commandBuffer)
 {	
-	for (Actor& actor : mActors)
+	RenderGeometry(commandBuffer, 0, GetNumActors());
+}
+
+void Scene::RenderGeometry(VkCommandBuffer commandBuffer, uint32_t firstActor, uint32_t numActors)
+{
+	assert(firstActor + numActors <= mActors.size());
+
+	for (uint32_t i = firstActor; i < firstActor + numActors; ++i)
 	{
-		actor.Draw(commandBuffer);
+		mActors[i].Draw(commandBuffer);
 	}
 }
 
@@ -338,19 +388,37 @@ void Scene::RenderShadowCasters(VkCommandBuffer commandBuffer)
 
 void Scene::RenderLightVolumes(VkCommandBuffer commandBuffer)
 {
-	if (mPointLights.size() > 0)
+	RenderLightVolumes(commandBuffer, 0, GetNumPointLights());
+}
+
+void Scene::RenderLightVolumes(VkCommandBuffer commandBuffer, uint32_t firstLight, uint32_t numLights)
+{
+	assert(firstLight + numLights <= mPointLights.size());
+
+	if (numLights > 0)
 	{
 		PointLight::BindSphereMeshBuffers(commandBuffer);
 
-		for (PointLight& pointLight : mPointLights)
+		for (uint32_t i = firstLight; i < firstLight + numLights; ++i)
 		{
-			pointLight.Draw(commandBuffer);
+			mPointLights[i].Draw(commandBuffer);
 		}
 	}
 }
 
+uint32_t Scene::GetNumActors() const
+{
+	return static_cast<uint32_t>(mActors.size());
+}
+
+uint32_t Scene::GetNumPointLights() const
+{
+	return static_cast<uint32_t>(mPointLights.size());
+}
+
 void Scene::Update(float deltaTime, bool updateDebug)
 {
+	PROFILE_FUNCTION();
 
 	if (mActiveCamera != nullptr)
 	{
@@ -434,6 +502,159 @@ void Scene::CaptureEnvironment()
     {
         actor.UpdateEnvironmentSampler();
     }
+
+	Renderer::Get()->InvalidateCommandBuffers();
+}
+
+void Scene::ReplaceMaterialDescriptors(const Texture2D* texture)
+{
+	for (Actor& actor : mActors)
+	{
+		if (actor.UsesTexture(texture))
+		{
+			actor.ReplaceDescriptorSet();
+		}
+	}
+
+	Renderer::Get()->InvalidateCommandBuffers();
+}
+
+bool Scene::UpdateTextureResidency()
+{
+	if (mRestoringTexture != nullptr)
+	{
+		bool restored = mRestoringTexture->UpdateRestore();
+
+		if (restored)
+		{
+			ReplaceMaterialDescriptors(mRestoringTexture);
+		}
+
+		if (!mRestoringTexture->IsRestoring())
+		{
+			mRestoringTexture = nullptr;
+		}
+
+		return restored;
+	}
+
+	Renderer* renderer = Renderer::Get();
+	VkDevice device = renderer->GetDevice();
+
+	if (!mEvictingTextures.empty())
+	{
+		if (vkGetFenceStatus(device, mEvictionFence) != VK_SUCCESS)
+		{
+			return false;
+		}
+
+		for (Texture2D* texture : mEvictingTextures)
+		{
+			texture->FinishEvictMips();
+			ReplaceMaterialDescriptors(texture);
+		}
+
+		mEvictingTextures.clear();
+		return true;
+	}
+
+	HeapBudget budget;
+	Allocator::GetHeapBudget(Allocator::GetDeviceLocalHeap(), budget);
+
+	uint64_t usage = budget.GetEffectiveUsage();
+
+	if (usage > budget.mBudget)
+	{
+		std::vector<Texture2D*> candidates;
+
+		for (std::pair<const std::string, Texture2D>& entry : mTextures)
+		{
+			if (entry.second.IsValid())
+			{
+				candidates.push_back(&entry.second);
+			}
+		}
+
+		// Least recently drawn first. Of textures drawn in the same frame, evict the largest first.
+		std::sort(candidates.begin(), candidates.end(), [](const Texture2D* a, const Texture2D* b)
+		{
+			if (a->GetLastSampledFrame() != b->GetLastSampledFrame())
+			{
+				return a->GetLastSampledFrame() < b->GetLastSampledFrame();
+			}
+
+			return a->GetMemorySize() > b->GetMemorySize();
+		});
+
+		if (mEvictionFence == VK_NULL_HANDLE)
+		{
+			VkFenceCreateInfo ciFence = {};
+			ciFence.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+			if (vkCreateFence(device, &ciFence, nullptr, &mEvictionFence) != VK_SUCCESS)
+			{
+				throw runtime_error("Failed to create eviction fence");
+			}
+		}
+
+		// All copies of the pass go into one submission that nothing waits on. The textures keep
+		// their current images until the fence signals.
+		VkCommandBuffer commandBuffer = renderer->BeginSingleSubmissionCommands();
+
+		for (Texture2D* texture : candidates)
+		{
+			if (usage <= budget.mBudget)
+			{
+				break;
+			}
+
+			uint64_t releasedBytes = texture->RecordEvictMips(commandBuffer, TEXTURE_EVICTION_MIP_LEVELS);
+			usage = (usage > releasedBytes) ? usage - releasedBytes : 0;
+
+			if (releasedBytes > 0)
+			{
+				mEvictingTextures.push_back(texture);
+			}
+		}
+
+		vkResetFences(device, 1, &mEvictionFence);
+		renderer->EndSingleSubmissionCommands(commandBuffer, false, mEvictionFence);
+
+		return false;
+	}
+
+	// Bring back one texture at a time, the most recently drawn first, but only when its full
+	// mip chain fits with room to spare so that it isn't evicted again straight away.
+	Texture2D* restore = nullptr;
+
+	for (std::pair<const std::string, Texture2D>& entry : mTextures)
+	{
+		Texture2D& texture = entry.second;
+
+		if (texture.GetNumEvictedMips() > 0 &&
+			(restore == nullptr || texture.GetLastSampledFrame() > restore->GetLastSampledFrame()))
+		{
+			restore = &texture;
+		}
+	}
+
+	if (restore == nullptr)
+	{
+		return false;
+	}
+
+	// Each evicted level was about four times the size of everything below it.
+	uint64_t restoredSize = restore->GetMemorySize() << (2 * restore->GetNumEvictedMips());
+
+	if (usage + restoredSize + TEXTURE_RESTORE_HEADROOM > budget.mBudget)
+	{
+		return false;
+	}
+
+	restore->BeginRestoreMips();
+	mRestoringTexture = restore;
+
+	return false;
 }
 
 void Scene::LoadEnvironmentCapture(const aiNode& node)
@@ -33,10 +33,19 @@ public:
 
 	void RenderGeometry(VkCommandBuffer commandBuffer);
 
+	// Draws a contiguous range of actors, so that slices of the scene can be recorded on separate threads.
+	void RenderGeometry(VkCommandBuffer commandBuffer, uint32_t firstActor, uint32_t numActors);
+
 	void RenderShadowCasters(VkCommandBuffer commandBuffer);
 
 	void RenderLightVolumes(VkCommandBuffer commandBuffer);
 
+	void RenderLightVolumes(VkCommandBuffer commandBuffer, uint32_t firstLight, uint32_t numLights);
+
+	uint32_t GetNumActors() const;
+
+	uint32_t GetNumPointLights() const;
+
 	void Update(float deltaTime, bool updateDebug = true);
 
 	Camera* GetActiveCamera();
@@ -51,6 +60,16 @@ public:
 
 	void CaptureEnvironment();
 
+	// Drops the largest mips of the least recently drawn textures while device local memory is
+	// over budget, and restores them once there is room again. The copies of an eviction pass
+	// are submitted together and swapped in once their fence signals, restores are decoded and
+	// uploaded in the background. Neither waits for the GPU. Actors drawn with a changed texture
+	// get new descriptor sets. Returns true if any texture changed.
+	bool UpdateTextureResidency();
+
+	// Replaces the descriptor sets of the actors drawn with texture, after its image view changed.
+	void ReplaceMaterialDescriptors(const Texture2D* texture);
+
     void UpdateShadowMapDescriptors();
 
 	std::vector<EnvironmentCapture>& GetEnvironmentCaptures();
@@ -65,6 +84,9 @@ private:
 
 	void LoadMaterials(const aiScene& scene);
 
+	// Loads the textures referenced by the materials on worker threads.
+	void LoadTextures();
+
 	void LoadMeshes(const aiScene& scene);
 
 	void LoadActors(const aiScene& scene);
@@ -90,6 +112,13 @@ private:
 
 	std::map<std::string, Texture2D> mTextures;
 
+	// Texture whose evicted mips are being brought back, see UpdateTextureResidency().
+	Texture2D* mRestoringTexture;
+
+	// Textures whose eviction copies were submitted together, signaling mEvictionFence.
+	std::vector<Texture2D*> mEvictingTextures;
+	VkFence mEvictionFence;
+
 	std::vector<Actor> mActors;
 
 	std::vector<PointLight> mPointLights;
@@ -0,0 +1,118 @@
+#include "ShaderModuleCache.h"
+#include "Renderer.h"
+#include "Utilities.h"
+#include "Log.h"
+
+#include <assert.h>
+#include <stdexcept>
+
+using namespace std;
+
+VkShaderModule ShaderModuleCache::Acquire(const std::string& path)
+{
+	{
+		lock_guard<mutex> lock(mMutex);
+
+		map<string, Entry>::iterator it = mEntries.find(path);
+
+		if (it != mEntries.end())
+		{
+			it->second.mRefCount++;
+			return it->second.mModule;
+		}
+	}
+
+	// Loaded without holding the lock, so pipelines compiling on other threads aren't held up.
+	VkDevice device = Renderer::Get()->GetDevice();
+	size_t codeSize = 0;
+	const void* code = MapFile(path, codeSize);
+
+	if (code == nullptr)
+	{
+		LogError("Failed to map shader %s", path.c_str());
+		throw runtime_error("Failed to open file.");
+	}
+
+	// Mapped views are page aligned, which satisfies the uint32_t alignment of pCode.
+	VkShaderModuleCreateInfo ciModule = {};
+	ciModule.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	ciModule.codeSize = codeSize;
+	ciModule.pCode = static_cast<const uint32_t*>(code);
+
+	VkShaderModule module = VK_NULL_HANDLE;
+	VkResult result = vkCreateShaderModule(device, &ciModule, nullptr, &module);
+
+	UnmapFile(code, codeSize);
+
+	if (result != VK_SUCCESS)
+	{
+		throw runtime_error("Failed to create shader module");
+	}
+
+	lock_guard<mutex> lock(mMutex);
+
+	map<string, Entry>::iterator it = mEntries.find(path);
+
+	if (it != mEntries.end())
+	{
+		// Another thread loaded the same file in the meantime, keep its module.
+		vkDestroyShaderModule(device, module, nullptr);
+
+		it->second.mRefCount++;
+		return it->second.mModule;
+	}
+
+	Entry& entry = mEntries[path];
+	entry.mModule = module;
+	entry.mRefCount = 1;
+
+	return module;
+}
+
+void ShaderModuleCache::Release(VkShaderModule module)
+{
+	if (module == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	lock_guard<mutex> lock(mMutex);
+
+	for (map<string, Entry>::iterator it = mEntries.begin(); it != mEntries.end(); ++it)
+	{
+		if (it->second.mModule == module)
+		{
+			assert(it->second.mRefCount > 0);
+
+			if (--it->second.mRefCount == 0)
+			{
+				vkDestroyShaderModule(Renderer::Get()->GetDevice(), module, nullptr);
+				mEntries.erase(it);
+			}
+
+			return;
+		}
+	}
+
+	assert(!"Releasing a shader module that wasn't acquired");
+}
+
+void ShaderModuleCache::Destroy()
+{
+	lock_guard<mutex> lock(mMutex);
+
+	VkDevice device = Renderer::Get()->GetDevice();
+
+	for (map<string, Entry>::iterator it = mEntries.begin(); it != mEntries.end(); ++it)
+	{
+		vkDestroyShaderModule(device, it->second.mModule, nullptr);
+	}
+
+	mEntries.clear();
+}
+
+uint32_t ShaderModuleCache::GetNumModules()
+{
+	lock_guard<mutex> lock(mMutex);
+	return static_cast<uint32_t>(mEntries.size());
+}
\ No newline at end of file
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <map>
+#include <mutex>
+#include <string>
+
+// Shader modules shared by every pipeline, keyed by the path of their SPIR-V file.
+// Each file is mapped and turned into a module the first time it is acquired, and the module is
+// destroyed once the last pipeline holding it has released it. Modules are only read while
+// pipelines compile, so a release never has to wait for the GPU.
+// May be called from any thread.
+class ShaderModuleCache
+{
+public:
+
+	// Returns the module for the SPIR-V file at path, loading it if no pipeline holds it yet.
+	// Every Acquire() has to be matched by a Release().
+	VkShaderModule Acquire(const std::string& path);
+
+	void Release(VkShaderModule module);
+
+	// Destroys the modules that are still held.
+	void Destroy();
+
+	uint32_t GetNumModules();
+
+private:
+
+	struct Entry
+	{
+		VkShaderModule mModule;
+		uint32_t mRefCount;
+	};
+
+	std::map<std::string, Entry> mEntries;
+	std::mutex mMutex;
+};
\ No newline at end of file
@@ -1,6 +1,8 @@
 #include "ShadowCaster.h"
 #include "Renderer.h"
 
+#include <stdexcept>
+
 ShadowCaster::ShadowCaster() :
 	mShadowRenderPass(VK_NULL_HANDLE),
 	mShadowFramebuffer(VK_NULL_HANDLE),
@@ -23,37 +25,41 @@ void ShadowCaster::Destroy()
 		vkDestroyRenderPass(device, mShadowRenderPass, nullptr);
 		mShadowRenderPass = VK_NULL_HANDLE;
 
-		vkDestroyFramebuffer(device, mShadowFramebuffer, nullptr);
-		mShadowFramebuffer = VK_NULL_HANDLE;
+		DestructionQueue& destructionQueue = renderer->GetDestructionQueue();
 
-		vkDestroyImage(device, mShadowMapImage, nullptr);
-		mShadowMapImage = VK_NULL_HANDLE;
+		destructionQueue.DestroyFramebuffer(mShadowFramebuffer);
+		mShadowFramebuffer = VK_NULL_HANDLE;
 
-		vkDestroyImageView(device, mShadowMapImageView, nullptr);
+		destructionQueue.DestroyImageView(mShadowMapImageView);
 		mShadowMapImageView = VK_NULL_HANDLE;
 
-		vkDestroySampler(device, mShadowMapSampler, nullptr);
+		destructionQueue.DestroyImage(mShadowMapImage);
+		mShadowMapImage = VK_NULL_HANDLE;
+
+		destructionQueue.DestroySampler(mShadowMapSampler);
 		mShadowMapSampler = VK_NULL_HANDLE;
 
-		Allocator::Free(mShadowMapImageMemory);
+		destructionQueue.FreeAllocation(mShadowMapImageMemory);
 	}
 }
 
-void ShadowCaster::RenderShadows(Scene* scene, VkCommandBuffer commandBuffer)
+void ShadowCaster::Prepare()
 {
-	Renderer* renderer = Renderer::Get();
-	VkDevice device = renderer->GetDevice();
-
-	if (scene == nullptr)
+	if (mShadowRenderPass == VK_NULL_HANDLE)
 	{
-		throw std::exception("Attempting to render shadow map for null scene");
+		Initialize();
 	}
+}
 
-	if (mShadowRenderPass == VK_NULL_HANDLE)
+void ShadowCaster::RenderShadows(Scene* scene, VkCommandBuffer commandBuffer, const std::vector<VkCommandBuffer>* secondaryCommandBuffers)
+{
+	if (scene == nullptr)
 	{
-		Initialize();
+		throw std::runtime_error("Attempting to render shadow map for null scene");
 	}
 
+	Prepare();
+
 	VkExtent2D renderAreaExtent = {};
 	renderAreaExtent.width = SHADOW_MAP_RESOLUTION;
 	renderAreaExtent.height = SHADOW_MAP_RESOLUTION;
@@ -71,18 +77,48 @@ void ShadowCaster::RenderShadows(Scene* scene, VkCommandBuffer commandBuffer)
 	renderPassInfo.clearValueCount = 1;
 	renderPassInfo.pClearValues = &clearValue;
 
+	GpuProfiler& profiler = Renderer::Get()->GetGpuProfiler();
+	profiler.BeginScope(commandBuffer, GpuScope::Shadows);
+
 	Texture::TransitionImageLayout(mShadowMapImage, VK_FORMAT_D16_UNORM, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, 1, 1, commandBuffer);
 
-	vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+	if (secondaryCommandBuffers != nullptr)
+	{
+		vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+		vkCmdExecuteCommands(commandBuffer, static_cast<uint32_t>(secondaryCommandBuffers->size()), secondaryCommandBuffers->data());
+	}
+	else
+	{
+		vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+		RecordShadowCasters(scene, commandBuffer, 0, scene->GetNumActors());
+	}
+
+	vkCmdEndRenderPass(commandBuffer);
+
+	Texture::TransitionImageLayout(mShadowMapImage, VK_FORMAT_D16_UNORM, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 1, 1, commandBuffer);
+
+	profiler.EndScope(commandBuffer, GpuScope::Shadows);
+}
+
+void ShadowCaster::RecordShadowCasters(Scene* scene, VkCommandBuffer commandBuffer, uint32_t firstActor, uint32_t numActors)
+{
+	Renderer* renderer = Renderer::Get();
 
 	renderer->SetViewportAndScissor(commandBuffer, 0, 0, SHADOW_MAP_RESOLUTION, SHADOW_MAP_RESOLUTION);
 
 	mShadowPipeline.BindPipeline(commandBuffer);
-	scene->RenderGeometry(commandBuffer);
-	
-	vkCmdEndRenderPass(commandBuffer);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mShadowPipeline.GetPipelineLayout(), 0, 1, &renderer->GetGlobalDescriptorSet(), 0, 0);
+	scene->RenderGeometry(commandBuffer, firstActor, numActors);
+}
 
-	Texture::TransitionImageLayout(mShadowMapImage, VK_FORMAT_D16_UNORM, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 1, 1, commandBuffer);
+VkRenderPass ShadowCaster::GetRenderPass()
+{
+	return mShadowRenderPass;
+}
+
+VkFramebuffer ShadowCaster::GetFramebuffer()
+{
+	return mShadowFramebuffer;
 }
 
 VkImageView ShadowCaster::GetShadowMapImageView()
@@ -136,7 +172,7 @@ void ShadowCaster::CreateShadowRenderPass()
 
 	if (vkCreateRenderPass(device, &ciRenderPass, nullptr, &mShadowRenderPass) != VK_SUCCESS)
 	{
-		throw std::exception("Failed to create renderpass");
+		throw std::runtime_error("Failed to create renderpass");
 	}
 }
 
@@ -159,7 +195,7 @@ void ShadowCaster::CreateShadowFramebuffer()
 
 	if (vkCreateFramebuffer(device, &ciFramebuffer, nullptr, &mShadowFramebuffer) != VK_SUCCESS)
 	{
-		throw std::exception("Failed to create framebuffer.");
+		throw std::runtime_error("Failed to create framebuffer.");
 	}
 }
 
@@ -200,7 +236,7 @@ void ShadowCaster::CreateShadowMapImage()
 
 	if (vkCreateSampler(device, &ciSampler, nullptr, &mShadowMapSampler) != VK_SUCCESS)
 	{
-		throw std::exception("Failed to create texture sampler");
+		throw std::runtime_error("Failed to create texture sampler");
 	}
 
 	vkDeviceWaitIdle(device);
@@ -208,8 +244,6 @@ void ShadowCaster::CreateShadowMapImage()
 
 void ShadowCaster::CreateShadowPipeline()
 {
-	mShadowPipeline.mViewportWidth = SHADOW_MAP_RESOLUTION;
-	mShadowPipeline.mViewportHeight = SHADOW_MAP_RESOLUTION;
 	mShadowPipeline.mRenderpass = mShadowRenderPass;
 	mShadowPipeline.Create();
 }
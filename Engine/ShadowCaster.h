@@ -13,7 +13,19 @@ public:
 
     void Destroy();
 
-	void RenderShadows(Scene* scene, VkCommandBuffer commandBuffer);
+	// Creates the shadow map and render pass on first use.
+	void Prepare();
+
+	// Records the shadow pass. If secondary command buffers are given they are executed
+	// inside the render pass instead of drawing the scene inline.
+	void RenderShadows(Scene* scene, VkCommandBuffer commandBuffer, const std::vector<VkCommandBuffer>* secondaryCommandBuffers = nullptr);
+
+	// Draws a range of actors into the shadow map, inside the shadow render pass.
+	void RecordShadowCasters(Scene* scene, VkCommandBuffer commandBuffer, uint32_t firstActor, uint32_t numActors);
+
+	VkRenderPass GetRenderPass();
+
+	VkFramebuffer GetFramebuffer();
 
 	VkImageView GetShadowMapImageView();
 
@@ -13,22 +13,18 @@ Text::Text() :
 	mSoftness(0.125f),
 	mOutlineColor(0.0f, 0.0f, 0.0, 1.0f),
 	mVisibleCharacters(0),
-	mVertexBuffer(VK_NULL_HANDLE),
-	mUniformBuffer(VK_NULL_HANDLE),
-	mNumCharactersAllocated(0),
-	mVertexBufferDirty(true)
+	mUniformOffset(0),
+	mVertexBufferDirty(true),
+	mDescriptorSetDirty(true)
 {
 	mFont = &DefaultFonts::sRoboto32;
 
-	CreateVertexBuffer();
-	CreateUniformBuffer();
 	CreateDescriptorSet();
 }
 
 Text::~Text()
 {
-	DestroyVertexBuffer();
-	DestroyUniformBuffer();
+	mVertexBuffer.Destroy();
 	DestroyDescriptorSet();
 }
 
@@ -36,14 +32,13 @@ void Text::Render(VkCommandBuffer commandBuffer)
 {
 	Widget::Render(commandBuffer);
 
-	if (mText.size() > 0 && mVertexBuffer != VK_NULL_HANDLE)
+	if (mVisibleCharacters > 0 && mVertexBuffer.IsValid())
 	{
 		Renderer* renderer = Renderer::Get();
 		TextPipeline& textPipeline = renderer->GetTextPipeline();
 		textPipeline.BindPipeline(commandBuffer);
 
-		VkDeviceSize offset = 0;
-		vkCmdBindVertexBuffers(commandBuffer, 0, 1, &mVertexBuffer, &offset);
+		mVertexBuffer.Bind(commandBuffer);
 
 		VkDescriptorSet quadDescriptorSet = mDescriptorSet.GetDescriptorSet();
 		vkCmdBindDescriptorSets(commandBuffer,
@@ -52,8 +47,8 @@ void Text::Render(VkCommandBuffer commandBuffer)
 			1,
 			1,
 			&quadDescriptorSet,
-			0,
-			nullptr);
+			1,
+			&mUniformOffset);
 
 		vkCmdDraw(commandBuffer, 6 * mVisibleCharacters, 1, 0, 0);
 	}
@@ -68,12 +63,17 @@ void Text::Update()
 		UpdateVertexBuffer();
 		mVertexBufferDirty = false;
 	}
-	
-	if (mDirty)
+
+	if (mDescriptorSetDirty)
 	{
-		UpdateUniformBuffer();
 		UpdateDescriptorSet();
+		mDescriptorSetDirty = false;
 	}
+
+	mVertexBuffer.Update();
+
+	// Uniform data lives in the per-frame ring, so it is written every frame.
+	UpdateUniformBuffer();
 }
 
 void Text::SetFont(struct Font* font)
@@ -82,25 +82,28 @@ void Text::SetFont(struct Font* font)
 	{
 		mFont = font;
 		mVertexBufferDirty = true;
-		MarkDirty();
+		mDescriptorSetDirty = true;
 	}
 }
 
 void Text::SetOutlineColor(glm::vec4 color)
 {
-	if (mColor != color)
-	{
-		mOutlineColor = color;
-		MarkDirty();
-	}
+	mOutlineColor = color;
 }
 
 void Text::SetSize(float size)
 {
-	if (mSize != size)
+	// The size lives in the per-frame uniform, so nothing recorded has to change.
+	mSize = size;
+}
+
+void Text::SetColor(glm::vec4 color)
+{
+	if (mColor != color)
 	{
-		mSize = size;
-		MarkDirty();
+		// The color is baked into the vertices.
+		Widget::SetColor(color);
+		mVertexBufferDirty = true;
 	}
 }
 
@@ -110,7 +113,6 @@ void Text::SetText(const std::string& text)
 	{
 		mText = text;
 		mVertexBufferDirty = true;
-		MarkDirty();
 	}
 }
 
@@ -119,76 +121,20 @@ const std::string& Text::GetText() const
 	return mText;
 }
 
-void Text::CreateVertexBuffer()
+void Text::ReplaceTexture(const Texture* texture)
 {
-	DestroyVertexBuffer();
-
-	if (mText.size() > 0)
+	if (mFont != nullptr && mFont->mTexture == texture)
 	{
-		const uint32_t allocGranularity = 32;
-		uint32_t numCharsToAllocate = allocGranularity * ((uint32_t(mText.size()) + allocGranularity - 1) / allocGranularity);
-
-		Renderer* renderer = Renderer::Get();
-
-		renderer->CreateBuffer(numCharsToAllocate * 6 * sizeof(VertexUI),
-			VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			mVertexBuffer,
-			mVertexBufferMemory);
-
-		mNumCharactersAllocated = numCharsToAllocate;
+		mDescriptorSetDirty = true;
 	}
 }
 
-void Text::CreateUniformBuffer()
-{
-	Renderer* renderer = Renderer::Get();
-
-	VkDeviceSize bufferSize = sizeof(TextUniformBuffer);
-	renderer->CreateBuffer(bufferSize,
-		VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		mUniformBuffer,
-		mUniformBufferMemory);
-
-	UpdateUniformBuffer();
-}
-
 void Text::CreateDescriptorSet()
 {
 	Renderer* renderer = Renderer::Get();
 	mDescriptorSet.Create(renderer->GetTextPipeline().GetDescriptorSetLayout(1));
 }
 
-void Text::DestroyVertexBuffer()
-{
-	if (mVertexBuffer != VK_NULL_HANDLE)
-	{
-		Renderer* renderer = Renderer::Get();
-		VkDevice device = renderer->GetDevice();
-
-		vkDestroyBuffer(device, mVertexBuffer, nullptr);
-		mVertexBuffer = VK_NULL_HANDLE;
-
-		Allocator::Free(mVertexBufferMemory);
-
-		mNumCharactersAllocated = 0;
-	}
-}
-
-void Text::DestroyUniformBuffer()
-{
-	if (mUniformBuffer != VK_NULL_HANDLE)
-	{
-		Renderer* renderer = Renderer::Get();
-
-		vkDestroyBuffer(renderer->GetDevice(), mUniformBuffer, nullptr);
-		mUniformBuffer = VK_NULL_HANDLE;
-
-		Allocator::Free(mUniformBufferMemory);
-	}
-}
-
 void Text::DestroyDescriptorSet()
 {
 	mDescriptorSet.Destroy();
@@ -199,28 +145,12 @@ void Text::UpdateVertexBuffer()
 	if (mFont == nullptr)
 		return;
 
-	Renderer* renderer = Renderer::Get();
-	VkDevice device = renderer->GetDevice();
-
-	const glm::vec2 interfaceResolution = renderer->GetInterfaceResolution();
-
-	// Check if we need to reallocate a bigger buffer.
-	if (mText.size() > mNumCharactersAllocated)
-	{
-		DestroyVertexBuffer();
-		CreateVertexBuffer();
-	}
-
 	assert(mFont);
 	assert(mFont->mCharacters);
 
+	int32_t prevVisibleCharacters = mVisibleCharacters;
 	mVisibleCharacters = 0;
-
-	if (mText.size() == 0)
-		return;
-
-	void* data = nullptr;
-	vkMapMemory(device, mVertexBufferMemory.mDeviceMemory, mVertexBufferMemory.mOffset, mVertexBufferMemory.mSize, 0, &data);
+	mVertices.resize(mText.size() * 6);
 
 	// Run through each of the characters and construct vertices for it.
 	// Not using an index buffer currently, so each character is 6 vertices.
@@ -248,7 +178,7 @@ void Text::UpdateVertexBuffer()
 		}
 
 		Character& fontChar = mFont->mCharacters[textChar - ' '];
-		VertexUI* vertices = reinterpret_cast<VertexUI*>(data) + (mVisibleCharacters * 6);
+		VertexUI* vertices = mVertices.data() + (mVisibleCharacters * 6);
 
 		//   0---2  3
 		//   |  / / |
@@ -294,13 +224,19 @@ void Text::UpdateVertexBuffer()
 		cursorX += fontChar.mAdvance;
 	}
 
-	vkUnmapMemory(device, mVertexBufferMemory.mDeviceMemory);
+	bool reallocated = mVertexBuffer.SetData(mVertices.data(), mVisibleCharacters * 6 * sizeof(VertexUI));
+
+	// The draw recorded for the old text has the old vertex count.
+	if (reallocated ||
+		mVisibleCharacters != prevVisibleCharacters)
+	{
+		Renderer::Get()->InvalidateCommandBuffers();
+	}
 }
 
 void Text::UpdateUniformBuffer()
 {
 	Renderer* renderer = Renderer::Get();
-	VkDevice device = renderer->GetDevice();
 	glm::vec2 resolution = renderer->GetInterfaceResolution();
 
 	TextUniformBuffer ubo = {};
@@ -315,10 +251,7 @@ void Text::UpdateUniformBuffer()
 	ubo.mDistanceField = (mFont != nullptr) ? mFont->mDistanceField : false;
 	ubo.mEffect = 0;
 
-	void* data;
-	vkMapMemory(device, mUniformBufferMemory.mDeviceMemory, mUniformBufferMemory.mOffset, sizeof(ubo), 0, &data);
-	memcpy(data, &ubo, sizeof(ubo));
-	vkUnmapMemory(device, mUniformBufferMemory.mDeviceMemory);
+	mUniformOffset = renderer->GetUniformRingBuffer().Write(&ubo, sizeof(ubo));
 }
 
 void Text::UpdateDescriptorSet()
@@ -331,6 +264,12 @@ void Text::UpdateDescriptorSet()
 		texture = mFont->mTexture;
 	}
 
-	mDescriptorSet.UpdateUniformDescriptor(0, mUniformBuffer, sizeof(TextUniformBuffer));
+	// Frames in flight may still have the current set bound, so write to a new one.
+	DestroyDescriptorSet();
+	CreateDescriptorSet();
+
+	mDescriptorSet.UpdateUniformDescriptor(0, renderer->GetUniformRingBuffer().GetBuffer(), sizeof(TextUniformBuffer), VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC);
 	mDescriptorSet.UpdateImageDescriptor(1, texture->GetImageView(), texture->GetSampler());
+
+	renderer->InvalidateCommandBuffers();
 }
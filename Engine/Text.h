@@ -1,8 +1,11 @@
 #pragma once
 
 #include "Widget.h"
-#include "Allocator.h"
+#include "Vertex.h"
 #include "DescriptorSet.h"
+#include "DynamicVertexBuffer.h"
+
+#include <vector>
 
 struct TextUniformBuffer
 {
@@ -34,17 +37,17 @@ public:
 	void SetOutlineColor(glm::vec4 color);
 	void SetSize(float size);
 
+	virtual void SetColor(glm::vec4 color) override;
+
 	void SetText(const std::string& text);
 	const std::string& GetText() const;
 
+	virtual void ReplaceTexture(const class Texture* texture) override;
+
 protected:
 
-	void CreateVertexBuffer();
-	void CreateUniformBuffer();
 	void CreateDescriptorSet();
 
-	void DestroyVertexBuffer();
-	void DestroyUniformBuffer();
 	void DestroyDescriptorSet();
 
 	void UpdateVertexBuffer();
@@ -61,14 +64,13 @@ protected:
 
 	int32_t mVisibleCharacters; // ( \n excluded )
 
-	VkBuffer mVertexBuffer;
-	Allocation mVertexBufferMemory;
+	std::vector<VertexUI> mVertices;
+	DynamicVertexBuffer mVertexBuffer;
 
-	VkBuffer mUniformBuffer;
-	Allocation mUniformBufferMemory;
+	uint32_t mUniformOffset;
 
 	DescriptorSet mDescriptorSet;
 
-	uint32_t mNumCharactersAllocated;
 	bool mVertexBufferDirty;
+	bool mDescriptorSetDirty;
 };
\ No newline at end of file
@@ -3,7 +3,7 @@
 #include "Allocator.h"
 
 #include <stb_image.h>
-#include <exception>
+#include <stdexcept>
 
 using namespace std;
 
@@ -27,15 +27,14 @@ Texture::~Texture()
 
 void Texture::Destroy()
 {
-	Renderer* renderer = Renderer::Get();
-	VkDevice device = renderer ? Renderer::Get()->GetDevice() : nullptr;
-
 	if (mImage != VK_NULL_HANDLE)
 	{
-		vkDestroySampler(device, mSampler, nullptr);
-		vkDestroyImageView(device, mImageView, nullptr);
-		vkDestroyImage(device, mImage, nullptr);
-		Allocator::Free(mImageMemory);
+		// Frames in flight may still sample the image.
+		DestructionQueue& destructionQueue = Renderer::Get()->GetDestructionQueue();
+		destructionQueue.DestroySampler(mSampler);
+		destructionQueue.DestroyImageView(mImageView);
+		destructionQueue.DestroyImage(mImage);
+		destructionQueue.FreeAllocation(mImageMemory);
 
 		mImage = VK_NULL_HANDLE;
 		mImageView = VK_NULL_HANDLE;
@@ -50,14 +49,24 @@ void Texture::Load(const std::string& path)
 	
 }
 
-void Texture::GenerateMips()
+void Texture::GenerateMips(VkCommandBuffer commandBuffer)
 {
 	Renderer* renderer = Renderer::Get();
-	VkCommandBuffer blitCmd = renderer->BeginSingleSubmissionCommands();
+	VkCommandBuffer blitCmd = (commandBuffer != VK_NULL_HANDLE) ? commandBuffer : renderer->BeginSingleSubmissionCommands();
+
+	RecordGenerateMips(blitCmd, mImage, mWidth, mHeight, mMipLevels, mLayers);
+
+	if (commandBuffer == VK_NULL_HANDLE)
+	{
+		renderer->EndSingleSubmissionCommands(blitCmd);
+	}
+}
 
+void Texture::RecordGenerateMips(VkCommandBuffer commandBuffer, VkImage image, uint32_t width, uint32_t height, uint32_t mipLevels, uint32_t layers)
+{
 	VkImageMemoryBarrier barrier = {};
 	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-	barrier.image = mImage;
+	barrier.image = image;
 	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
 	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -66,9 +75,9 @@ void Texture::GenerateMips()
 	barrier.subresourceRange.levelCount = 1;
 
 	// Copy down mips from n-1 to n
-	for (uint32_t f = 0; f < mLayers; ++f)
+	for (uint32_t f = 0; f < layers; ++f)
 	{
-		for (uint32_t i = 1; i < mMipLevels; i++)
+		for (uint32_t i = 1; i < mipLevels; i++)
 		{
 			barrier.subresourceRange.baseMipLevel = i - 1;
 			barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
@@ -76,7 +85,7 @@ void Texture::GenerateMips()
 			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
 			barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
 
-			vkCmdPipelineBarrier(blitCmd,
+			vkCmdPipelineBarrier(commandBuffer,
 				VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
 				0, nullptr,
 				0, nullptr,
@@ -84,10 +93,10 @@ void Texture::GenerateMips()
 
 			VkImageBlit imageBlit{};
 
-			int32_t srcWidth = int32_t(mWidth >> (i - 1));
-			int32_t srcHeight = int32_t(mHeight >> (i - 1));
-			int32_t dstWidth = int32_t(mWidth >> i);
-			int32_t dstHeight = int32_t(mHeight >> i);
+			int32_t srcWidth = int32_t(width >> (i - 1));
+			int32_t srcHeight = int32_t(height >> (i - 1));
+			int32_t dstWidth = int32_t(width >> i);
+			int32_t dstHeight = int32_t(height >> i);
 
 			// Source
 			imageBlit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -109,10 +118,10 @@ void Texture::GenerateMips()
 
 			// Blit from previous level
 			vkCmdBlitImage(
-				blitCmd,
-				mImage,
+				commandBuffer,
+				image,
 				VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-				mImage,
+				image,
 				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
 				1,
 				&imageBlit,
@@ -124,7 +133,7 @@ void Texture::GenerateMips()
 			barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
 			barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
 
-			vkCmdPipelineBarrier(blitCmd,
+			vkCmdPipelineBarrier(commandBuffer,
 				VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
 				0, nullptr,
 				0, nullptr,
@@ -132,20 +141,18 @@ void Texture::GenerateMips()
 		}
 
 		// Transition the last mips layout to Shader Read Only
-		barrier.subresourceRange.baseMipLevel = mMipLevels - 1;
+		barrier.subresourceRange.baseMipLevel = mipLevels - 1;
 		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
 		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
 		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
 
-		vkCmdPipelineBarrier(blitCmd,
+		vkCmdPipelineBarrier(commandBuffer,
 			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
 			0, nullptr,
 			0, nullptr,
 			1, &barrier);
 	}
-
-	renderer->EndSingleSubmissionCommands(blitCmd);
 }
 
 bool Texture::IsValid() const
@@ -158,6 +165,11 @@ const std::string& Texture::GetName() const
 	return mName;
 }
 
+void Texture::SetName(const std::string& name)
+{
+	mName = name;
+}
+
 VkImageView Texture::GetImageView()
 {
 	return mImageView;
@@ -203,14 +215,10 @@ void Texture::CreateImage(uint32_t width,
 
 	if (vkCreateImage(device, &ciImage, nullptr, &image) != VK_SUCCESS)
 	{
-		throw exception("Failed to create image");
+		throw runtime_error("Failed to create image");
 	}
 
-	VkMemoryRequirements memRequirements;
-	vkGetImageMemoryRequirements(device, image, &memRequirements);
-	uint32_t memoryType = renderer->FindMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-	Allocator::Alloc(memRequirements.size, memRequirements.alignment, memoryType, imageMemory);
+	Allocator::AllocImage(image, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, imageMemory);
 
 	vkBindImageMemory(device, image, imageMemory.mDeviceMemory, imageMemory.mOffset);
 }
@@ -234,7 +242,7 @@ VkImageView Texture::CreateImageView(VkImage image, VkFormat format, VkImageAspe
 	VkImageView imageView;
 	if (vkCreateImageView(device, &view, nullptr, &imageView) != VK_SUCCESS)
 	{
-		throw exception("Failed to create texture image view");
+		throw runtime_error("Failed to create texture image view");
 	}
 
 	return imageView;
@@ -267,7 +275,7 @@ void Texture::CreateTextureSampler()
 
 	if (vkCreateSampler(device, &sampler, nullptr, &mSampler) != VK_SUCCESS)
 	{
-		throw exception("Failed to create texture sampler");
+		throw runtime_error("Failed to create texture sampler");
 	}
 }
 
@@ -419,13 +427,10 @@ void Texture::TransitionImageLayout(VkImage image, VkFormat format, VkImageLayou
 	}
 }
 
-void Texture::CopyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height)
+void Texture::CopyBufferToImage(VkBuffer buffer, VkDeviceSize offset, VkImage image, uint32_t width, uint32_t height, VkCommandBuffer commandBuffer)
 {
-	Renderer* renderer = Renderer::Get();
-	VkCommandBuffer commandBuffer = renderer->BeginSingleSubmissionCommands();
-
 	VkBufferImageCopy region = {};
-	region.bufferOffset = 0;
+	region.bufferOffset = offset;
 	region.bufferRowLength = 0;
 	region.bufferImageHeight = 0;
 
@@ -443,9 +448,6 @@ void Texture::CopyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width,
 		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
 		1,
 		&region);
-
-
-	renderer->EndSingleSubmissionCommands(commandBuffer);
 }
 
 void Texture::Clear(glm::vec4 color)
@@ -31,12 +31,16 @@ public:
 
 	void SetLayout(VkImageLayout newLayout);
 
-	void GenerateMips();
+	// Expects every mip in TRANSFER_DST layout and leaves them in SHADER_READ_ONLY.
+	// Records into commandBuffer if given, otherwise submits and waits.
+	void GenerateMips(VkCommandBuffer commandBuffer = VK_NULL_HANDLE);
 
 	bool IsValid() const;
 
 	const std::string& GetName() const;
 
+	void SetName(const std::string& name);
+
 	void CreateTextureSampler();
 
 	void TransitionLayout(VkImageLayout newLayout);
@@ -53,11 +57,14 @@ public:
 
 	static VkImageView CreateImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels = 1, uint32_t layers = 1, TextureType type = TextureType::Texture2D);
 
+	// Blits each mip from the one above it. Expects every mip in TRANSFER_DST layout and leaves them in SHADER_READ_ONLY.
+	static void RecordGenerateMips(VkCommandBuffer commandBuffer, VkImage image, uint32_t width, uint32_t height, uint32_t mipLevels, uint32_t layers = 1);
+
 	static void TransitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, int32_t mipLevels = 1, int32_t layerCount = 1, VkCommandBuffer commandBuffer = VK_NULL_HANDLE);
 
-protected:
+	static void CopyBufferToImage(VkBuffer buffer, VkDeviceSize offset, VkImage image, uint32_t width, uint32_t height, VkCommandBuffer commandBuffer);
 
-	static void CopyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height);
+protected:
 
 	std::string mName;
 
@@ -1,10 +1,71 @@
 #include "Renderer.h"
 #include "Texture2D.h"
+#include "Constants.h"
+#include "Log.h"
+#include "CpuProfiler.h"
 
 #include <stb_image.h>
-#include <exception>
+#include <stdexcept>
+#include <future>
+#include <vector>
 
-Texture2D::Texture2D()
+struct DecodedImage
+{
+	stbi_uc* mPixels;
+	int32_t mWidth;
+	int32_t mHeight;
+};
+
+struct Texture2D::RestoreJob
+{
+	std::future<DecodedImage> mDecode;
+
+	// Valid once the decoded pixels have been uploaded.
+	VkImage mImage;
+	Allocation mImageMemory;
+	uint32_t mWidth;
+	uint32_t mHeight;
+	uint32_t mMipLevels;
+	uint32_t mUploadSubmit;
+};
+
+// Box filters RGBA8 pixels down to the next mip level.
+static void DownsamplePixels(const stbi_uc* src, uint32_t width, uint32_t height, std::vector<stbi_uc>& dst)
+{
+	uint32_t dstWidth = std::max(width / 2, 1u);
+	uint32_t dstHeight = std::max(height / 2, 1u);
+
+	dst.resize(dstWidth * dstHeight * 4);
+
+	for (uint32_t y = 0; y < dstHeight; ++y)
+	{
+		uint32_t y0 = std::min(y * 2, height - 1);
+		uint32_t y1 = std::min(y * 2 + 1, height - 1);
+
+		for (uint32_t x = 0; x < dstWidth; ++x)
+		{
+			uint32_t x0 = std::min(x * 2, width - 1);
+			uint32_t x1 = std::min(x * 2 + 1, width - 1);
+
+			for (uint32_t c = 0; c < 4; ++c)
+			{
+				uint32_t sum = src[(y0 * width + x0) * 4 + c] +
+					src[(y0 * width + x1) * 4 + c] +
+					src[(y1 * width + x0) * 4 + c] +
+					src[(y1 * width + x1) * 4 + c];
+
+				dst[(y * dstWidth + x) * 4 + c] = static_cast<stbi_uc>((sum + 2) / 4);
+			}
+		}
+	}
+}
+
+Texture2D::Texture2D() :
+	mRelocatedImage(VK_NULL_HANDLE),
+	mEvictionImage(VK_NULL_HANDLE),
+	mNumEvictingMips(0),
+	mNumEvictedMips(0),
+	mLastSampledFrame(0)
 {
 	mTextureType = TextureType::Texture2D;
 	mLayers = 1;
@@ -16,6 +77,7 @@ void Texture2D::Create(uint32_t width, uint32_t height, VkFormat format)
 	mWidth = width;
 	mHeight = height;
 	mFormat = format;
+	mNumEvictedMips = 0;
 
 	CreateImage(mWidth,
 		mHeight,
@@ -35,8 +97,17 @@ void Texture2D::Create(uint32_t width, uint32_t height, VkFormat format)
 	Clear(glm::vec4(0.0f, 0.0f, 0.0f, 0.0f));
 }
 
+void Texture2D::Destroy()
+{
+	CancelRestore();
+	CancelEvictMips();
+	Texture::Destroy();
+}
+
 void Texture2D::Load(const std::string& path)
 {
+	PROFILE_FUNCTION();
+
 	Renderer* renderer = Renderer::Get();
 	VkDevice device = renderer->GetDevice();
 	VkPhysicalDevice physicalDevice = renderer->GetPhysicalDevice();
@@ -53,40 +124,361 @@ void Texture2D::Load(const std::string& path)
 
 	stbi_uc* pixels = stbi_load(path.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
 
-	VkDeviceSize imageSize = texWidth * texHeight * 4;
-	int32_t imageSizeInt = static_cast<int32_t>(imageSize);
-
 	if (pixels == nullptr)
 	{
-		throw std::exception("Failed to load texture image");
+		throw std::runtime_error("Failed to load texture image");
 	}
 
 	mWidth = texWidth;
 	mHeight = texHeight;
 	mMipLevels = static_cast<int32_t>(floor(log2(std::max(mWidth, mHeight))) + 1);
 
-	VkBuffer stagingBuffer;
-	Allocation stagingBufferMemory;
+	// When device local memory is already over budget, leave out the largest mips straight away
+	// rather than failing to allocate. Scene::UpdateTextureResidency() restores them later.
+	HeapBudget budget;
+	Allocator::GetHeapBudget(Allocator::GetDeviceLocalHeap(), budget);
 
-	renderer->CreateBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+	mNumEvictedMips = budget.IsOverBudget() ? std::min<uint32_t>(TEXTURE_EVICTION_MIP_LEVELS, mMipLevels - 1) : 0;
 
-	void* data;
-	vkMapMemory(device, stagingBufferMemory.mDeviceMemory, stagingBufferMemory.mOffset, imageSize, 0, &data);
-	memcpy(data, pixels, static_cast<size_t>(imageSize));
-	vkUnmapMemory(device, stagingBufferMemory.mDeviceMemory);
+	const stbi_uc* data = pixels;
+	std::vector<stbi_uc> reduced;
+	std::vector<stbi_uc> scratch;
 
-	stbi_image_free(pixels);
+	for (uint32_t i = 0; i < mNumEvictedMips; ++i)
+	{
+		DownsamplePixels(data, mWidth, mHeight, scratch);
+		reduced.swap(scratch);
+		data = reduced.data();
+
+		mWidth = std::max(mWidth / 2, 1u);
+		mHeight = std::max(mHeight / 2, 1u);
+		mMipLevels--;
+	}
+
+	texWidth = static_cast<int32_t>(mWidth);
+	texHeight = static_cast<int32_t>(mHeight);
+
+	VkDeviceSize imageSize = texWidth * texHeight * 4;
 
 	mFormat = VK_FORMAT_R8G8B8A8_UNORM;
 	CreateImage(texWidth, texHeight, mFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, mImage, mImageMemory, mMipLevels, mLayers);
 
-	TransitionImageLayout(mImage, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_PREINITIALIZED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mMipLevels);
-	CopyBufferToImage(stagingBuffer, mImage, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight));
+	// The copy, layout transitions and mip blits are recorded into the current upload batch.
+	renderer->GetUploadBatcher().UploadImage(data, imageSize, mImage, mFormat, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight), mMipLevels);
 
-	vkDestroyBuffer(device, stagingBuffer, nullptr);
-	Allocator::Free(stagingBufferMemory);
+	stbi_image_free(pixels);
 
-	GenerateMips();
 	CreateTextureSampler();
 	mImageView = CreateImageView(mImage, mFormat, VK_IMAGE_ASPECT_COLOR_BIT, mMipLevels, mLayers);
+
+	// Loaded textures are immutable sampled images, so they can be moved by the defragmenter.
+	Allocator::SetRelocatable(mImageMemory, this);
+}
+
+void Texture2D::RecordRelocation(VkCommandBuffer commandBuffer, const Allocation& oldAllocation, const Allocation& newAllocation)
+{
+	VkDevice device = Renderer::Get()->GetDevice();
+
+	assert(&oldAllocation == &mImageMemory);
+
+	VkImageCreateInfo ciImage = {};
+	ciImage.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	ciImage.imageType = VK_IMAGE_TYPE_2D;
+	ciImage.extent.width = mWidth;
+	ciImage.extent.height = mHeight;
+	ciImage.extent.depth = 1;
+	ciImage.mipLevels = mMipLevels;
+	ciImage.arrayLayers = mLayers;
+	ciImage.format = mFormat;
+	ciImage.tiling = VK_IMAGE_TILING_OPTIMAL;
+	ciImage.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	ciImage.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	ciImage.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	ciImage.samples = VK_SAMPLE_COUNT_1_BIT;
+
+	if (vkCreateImage(device, &ciImage, nullptr, &mRelocatedImage) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create relocated image");
+	}
+
+	vkBindImageMemory(device, mRelocatedImage, newAllocation.mDeviceMemory, newAllocation.mOffset);
+
+	TransitionImageLayout(mRelocatedImage, mFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mMipLevels, mLayers, commandBuffer);
+	RecordMipCopy(commandBuffer, mRelocatedImage, 0);
+}
+
+void Texture2D::FinishRelocation(const Allocation& allocation)
+{
+	assert(&allocation == &mImageMemory);
+
+	// The copy and frames in flight still read the old image. Its memory is freed through the
+	// destruction queue by Allocator::Defragment().
+	DestructionQueue& destructionQueue = Renderer::Get()->GetDestructionQueue();
+	destructionQueue.DestroyImageView(mImageView);
+	destructionQueue.DestroyImage(mImage);
+
+	mImage = mRelocatedImage;
+	mRelocatedImage = VK_NULL_HANDLE;
+
+	// Descriptor sets that sampled the old view need to be rewritten by their owners.
+	mImageView = CreateImageView(mImage, mFormat, VK_IMAGE_ASPECT_COLOR_BIT, mMipLevels, mLayers);
+}
+
+uint64_t Texture2D::RecordEvictMips(VkCommandBuffer commandBuffer, uint32_t numLevels)
+{
+	numLevels = std::min(numLevels, mMipLevels - 1);
+
+	if (numLevels == 0 ||
+		mEvictionImage != VK_NULL_HANDLE)
+	{
+		return 0;
+	}
+
+	uint32_t newWidth = std::max(mWidth >> numLevels, 1u);
+	uint32_t newHeight = std::max(mHeight >> numLevels, 1u);
+	uint32_t newMipLevels = mMipLevels - numLevels;
+
+	CreateImage(newWidth, newHeight, mFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, mEvictionImage, mEvictionImageMemory, newMipLevels, mLayers);
+
+	// Defragment() must not move the image the copy reads from.
+	Allocator::SetRelocatable(mImageMemory, nullptr);
+
+	// The layout barriers wait for earlier frames still sampling the image. Frames recorded
+	// before FinishEvictMips() go on sampling it, so it is handed back for reading afterwards.
+	TransitionImageLayout(mEvictionImage, mFormat, VK_IMAGE_LAYOUT_PREINITIALIZED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, newMipLevels, mLayers, commandBuffer);
+	RecordMipCopy(commandBuffer, mEvictionImage, numLevels);
+	TransitionImageLayout(mImage, mFormat, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, mMipLevels, mLayers, commandBuffer);
+
+	mNumEvictingMips = numLevels;
+
+	return mImageMemory.mSize - mEvictionImageMemory.mSize;
+}
+
+void Texture2D::FinishEvictMips()
+{
+	if (mEvictionImage == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	uint64_t releasedBytes = mImageMemory.mSize - mEvictionImageMemory.mSize;
+
+	// Frames in flight may still sample the current image.
+	DestructionQueue& destructionQueue = Renderer::Get()->GetDestructionQueue();
+	destructionQueue.DestroyImageView(mImageView);
+	destructionQueue.DestroyImage(mImage);
+	destructionQueue.FreeAllocation(mImageMemory);
+
+	mImage = mEvictionImage;
+	mImageMemory = mEvictionImageMemory;
+	mWidth = std::max(mWidth >> mNumEvictingMips, 1u);
+	mHeight = std::max(mHeight >> mNumEvictingMips, 1u);
+	mMipLevels -= mNumEvictingMips;
+	mNumEvictedMips += mNumEvictingMips;
+
+	// Descriptor sets that sampled the old view need to be rewritten by their owners.
+	mImageView = CreateImageView(mImage, mFormat, VK_IMAGE_ASPECT_COLOR_BIT, mMipLevels, mLayers);
+	Allocator::SetRelocatable(mImageMemory, this);
+
+	LogDebug("Evicted %u mips of %s, %llu bytes released", mNumEvictingMips, mName.c_str(), static_cast<unsigned long long>(releasedBytes));
+
+	mEvictionImage = VK_NULL_HANDLE;
+	mEvictionImageMemory = Allocation();
+	mNumEvictingMips = 0;
+}
+
+bool Texture2D::IsEvicting() const
+{
+	return mEvictionImage != VK_NULL_HANDLE;
+}
+
+void Texture2D::CancelEvictMips()
+{
+	if (mEvictionImage == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	// The copy may still be writing the image.
+	DestructionQueue& destructionQueue = Renderer::Get()->GetDestructionQueue();
+	destructionQueue.DestroyImage(mEvictionImage);
+	destructionQueue.FreeAllocation(mEvictionImageMemory);
+
+	if (mImageMemory.IsValid())
+	{
+		Allocator::SetRelocatable(mImageMemory, this);
+	}
+
+	mEvictionImage = VK_NULL_HANDLE;
+	mNumEvictingMips = 0;
+}
+
+void Texture2D::BeginRestoreMips()
+{
+	if (mNumEvictedMips == 0 ||
+		mRestore != nullptr)
+	{
+		return;
+	}
+
+	std::string path = mName;
+
+	mRestore = std::make_shared<RestoreJob>();
+	mRestore->mImage = VK_NULL_HANDLE;
+	mRestore->mDecode = std::async(std::launch::async, [path]()
+	{
+		PROFILE_ZONE("Texture2D::DecodeRestore");
+
+		DecodedImage image;
+		image.mPixels = stbi_load(path.c_str(), &image.mWidth, &image.mHeight, nullptr, STBI_rgb_alpha);
+		return image;
+	});
+}
+
+bool Texture2D::UpdateRestore()
+{
+	if (mRestore == nullptr)
+	{
+		return false;
+	}
+
+	RestoreJob& job = *mRestore;
+	Renderer* renderer = Renderer::Get();
+
+	if (job.mImage == VK_NULL_HANDLE)
+	{
+		if (job.mDecode.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+		{
+			return false;
+		}
+
+		DecodedImage decoded = job.mDecode.get();
+
+		if (decoded.mPixels == nullptr)
+		{
+			LogError("Failed to decode %s, its evicted mips stay evicted", mName.c_str());
+			mRestore.reset();
+			return false;
+		}
+
+		job.mWidth = static_cast<uint32_t>(decoded.mWidth);
+		job.mHeight = static_cast<uint32_t>(decoded.mHeight);
+		job.mMipLevels = static_cast<uint32_t>(floor(log2(std::max(job.mWidth, job.mHeight))) + 1);
+
+		VkDeviceSize imageSize = static_cast<VkDeviceSize>(job.mWidth) * job.mHeight * 4;
+
+		CreateImage(job.mWidth, job.mHeight, mFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, job.mImage, job.mImageMemory, job.mMipLevels, mLayers);
+
+		// The pixels are copied into staging memory before this returns.
+		job.mUploadSubmit = renderer->GetUploadBatcher().UploadImage(decoded.mPixels, imageSize, job.mImage, mFormat, job.mWidth, job.mHeight, job.mMipLevels);
+
+		stbi_image_free(decoded.mPixels);
+	}
+
+	if (!renderer->GetUploadBatcher().IsSubmitComplete(job.mUploadSubmit))
+	{
+		return false;
+	}
+
+	// Frames in flight may still sample the current image.
+	DestructionQueue& destructionQueue = renderer->GetDestructionQueue();
+	destructionQueue.DestroyImageView(mImageView);
+	destructionQueue.DestroyImage(mImage);
+	destructionQueue.FreeAllocation(mImageMemory);
+
+	mImage = job.mImage;
+	mImageMemory = job.mImageMemory;
+	mWidth = job.mWidth;
+	mHeight = job.mHeight;
+	mMipLevels = job.mMipLevels;
+	mNumEvictedMips = 0;
+	mRestore.reset();
+
+	mImageView = CreateImageView(mImage, mFormat, VK_IMAGE_ASPECT_COLOR_BIT, mMipLevels, mLayers);
+	Allocator::SetRelocatable(mImageMemory, this);
+
+	return true;
+}
+
+bool Texture2D::IsRestoring() const
+{
+	return mRestore != nullptr;
+}
+
+void Texture2D::CancelRestore()
+{
+	if (mRestore == nullptr)
+	{
+		return;
+	}
+
+	RestoreJob& job = *mRestore;
+
+	if (job.mDecode.valid())
+	{
+		stbi_image_free(job.mDecode.get().mPixels);
+	}
+
+	if (job.mImage != VK_NULL_HANDLE)
+	{
+		// The upload may still be writing the image.
+		DestructionQueue& destructionQueue = Renderer::Get()->GetDestructionQueue();
+		destructionQueue.DestroyImage(job.mImage);
+		destructionQueue.FreeAllocation(job.mImageMemory);
+	}
+
+	mRestore.reset();
+}
+
+uint32_t Texture2D::GetNumEvictedMips() const
+{
+	return mNumEvictedMips;
+}
+
+uint64_t Texture2D::GetMemorySize() const
+{
+	return mImageMemory.mSize;
+}
+
+void Texture2D::MarkSampled(uint64_t frameNumber)
+{
+	mLastSampledFrame = frameNumber;
+}
+
+uint64_t Texture2D::GetLastSampledFrame() const
+{
+	return mLastSampledFrame;
+}
+
+void Texture2D::RecordMipCopy(VkCommandBuffer commandBuffer, VkImage dstImage, uint32_t srcBaseMip)
+{
+	uint32_t numLevels = mMipLevels - srcBaseMip;
+
+	TransitionImageLayout(mImage, mFormat, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, mMipLevels, mLayers, commandBuffer);
+
+	std::vector<VkImageCopy> regions(numLevels);
+	for (uint32_t i = 0; i < numLevels; ++i)
+	{
+		VkImageCopy& region = regions[i];
+		region = {};
+		region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.srcSubresource.mipLevel = srcBaseMip + i;
+		region.srcSubresource.baseArrayLayer = 0;
+		region.srcSubresource.layerCount = mLayers;
+		region.dstSubresource = region.srcSubresource;
+		region.dstSubresource.mipLevel = i;
+		region.extent.width = std::max(mWidth >> (srcBaseMip + i), 1u);
+		region.extent.height = std::max(mHeight >> (srcBaseMip + i), 1u);
+		region.extent.depth = 1;
+	}
+
+	vkCmdCopyImage(commandBuffer,
+		mImage,
+		VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+		dstImage,
+		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		static_cast<uint32_t>(regions.size()),
+		regions.data());
+
+	TransitionImageLayout(dstImage, mFormat, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, numLevels, mLayers, commandBuffer);
 }
\ No newline at end of file
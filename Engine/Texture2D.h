@@ -2,7 +2,9 @@
 
 #include "Texture.h"
 
-class Texture2D : public Texture
+#include <memory>
+
+class Texture2D : public Texture, public RelocatableResource
 {
 public:
 
@@ -10,6 +12,69 @@ public:
 
 	virtual void Create(uint32_t width, uint32_t height, VkFormat format = VK_FORMAT_R8G8B8A8_UNORM) override;
 
+	virtual void Destroy() override;
+
 	virtual void Load(const std::string& path) override;
 
+	virtual void RecordRelocation(VkCommandBuffer commandBuffer, const Allocation& oldAllocation, const Allocation& newAllocation) override;
+
+	virtual void FinishRelocation(const Allocation& allocation) override;
+
+	// Records a copy of the image into a new one that lacks the numLevels largest mips, always
+	// keeping the smallest level. The current image stays in use until FinishEvictMips().
+	// Returns the number of bytes that will be released.
+	uint64_t RecordEvictMips(VkCommandBuffer commandBuffer, uint32_t numLevels);
+
+	// Swaps in the smaller image once the commands from RecordEvictMips() have completed, after
+	// which descriptor sets sampling the texture need to be replaced.
+	void FinishEvictMips();
+
+	bool IsEvicting() const;
+
+	// Drops an eviction that hasn't been swapped in yet.
+	void CancelEvictMips();
+
+	// Starts bringing back the evicted mips. The source file is decoded on another thread and the
+	// full image is uploaded without waiting, while the current image stays in use.
+	void BeginRestoreMips();
+
+	// Swaps in the restored image once its upload has completed. Returns true if it did, after
+	// which descriptor sets sampling the texture need to be replaced.
+	bool UpdateRestore();
+
+	bool IsRestoring() const;
+
+	// Drops a restore that hasn't been swapped in yet, waiting for its decode to finish.
+	void CancelRestore();
+
+	uint32_t GetNumEvictedMips() const;
+
+	uint64_t GetMemorySize() const;
+
+	// Frame the texture was last drawn with, see Renderer::GetFrameNumber().
+	void MarkSampled(uint64_t frameNumber);
+	uint64_t GetLastSampledFrame() const;
+
+private:
+
+	// Records a copy of the mips starting at srcBaseMip into the base levels of dstImage,
+	// which is left ready to be sampled.
+	void RecordMipCopy(VkCommandBuffer commandBuffer, VkImage dstImage, uint32_t srcBaseMip);
+
+	// Replacement image while a defragmentation copy is in flight.
+	VkImage mRelocatedImage;
+
+	// Smaller image while an eviction copy is in flight.
+	VkImage mEvictionImage;
+	Allocation mEvictionImageMemory;
+	uint32_t mNumEvictingMips;
+
+	// Full mip chain being decoded or uploaded by BeginRestoreMips(). Shared so that the
+	// texture stays copyable.
+	struct RestoreJob;
+	std::shared_ptr<RestoreJob> mRestore;
+
+	uint32_t mNumEvictedMips;
+	uint64_t mLastSampledFrame;
+
 };
\ No newline at end of file
@@ -1,6 +1,8 @@
 #include "TextureCube.h"
 #include "Renderer.h"
 
+#include <stdexcept>
+
 TextureCube::TextureCube()
 {
 	mTextureType = TextureType::TextureCube;
@@ -16,7 +18,7 @@ TextureCube::TextureCube()
 void TextureCube::Load(const std::string& path)
 {
 	// TODO! Load an HDR cubemap
-	throw std::exception("Cubemap load not implemented yet");
+	throw std::runtime_error("Cubemap load not implemented yet");
 }
 
 void TextureCube::Create(uint32_t width, uint32_t height, VkFormat format)
@@ -55,15 +57,12 @@ VkImageView TextureCube::GetFaceImageView(uint32_t index)
 
 void TextureCube::Destroy()
 {
-	Renderer* renderer = Renderer::Get();
-	VkDevice device = renderer->GetDevice();
-
 	if (mImage != VK_NULL_HANDLE)
 	{
 		for (VkImageView& view : mFaceImageViews)
 		{
 			assert(view != VK_NULL_HANDLE);
-			vkDestroyImageView(device, view, nullptr);
+			Renderer::Get()->GetDestructionQueue().DestroyImageView(view);
 			view = VK_NULL_HANDLE;
 		}
 	}
@@ -93,7 +92,7 @@ void TextureCube::CreateFaceImageViews()
 
 		if (vkCreateImageView(device, &ciImageView, nullptr, &mFaceImageViews[i]) != VK_SUCCESS)
 		{
-			throw std::exception("Failed to create texture image view");
+			throw std::runtime_error("Failed to create texture image view");
 		}
 	}
 }
@@ -0,0 +1,124 @@
+#include "UniformRingBuffer.h"
+#include "Renderer.h"
+#include "Log.h"
+
+#include <assert.h>
+#include <string.h>
+#include <stdexcept>
+
+UniformRingBuffer::UniformRingBuffer() :
+	mFrameSize(0),
+	mNumFrames(0),
+	mFrameIndex(0),
+	mAlignment(1),
+	mHead(0)
+{
+
+}
+
+void UniformRingBuffer::Create(uint64_t frameSize, uint32_t numFrames)
+{
+	Destroy();
+
+	Renderer* renderer = Renderer::Get();
+
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(renderer->GetPhysicalDevice(), &deviceProperties);
+	mAlignment = deviceProperties.limits.minUniformBufferOffsetAlignment;
+
+	if (mAlignment == 0)
+	{
+		mAlignment = 1;
+	}
+
+	// Keep every frame region aligned so that offsets stay valid across frames.
+	mFrameSize = ((frameSize + mAlignment - 1) / mAlignment) * mAlignment;
+	mNumFrames = numFrames;
+
+	Allocator::AllocBufferRange(mFrameSize * mNumFrames,
+		BufferArena::Uniform,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		mBuffer);
+
+	BeginFrame(0);
+}
+
+void UniformRingBuffer::Destroy()
+{
+	if (mBuffer.IsValid())
+	{
+		Allocator::Free(mBuffer);
+	}
+}
+
+void UniformRingBuffer::BeginFrame(uint32_t frameIndex)
+{
+	assert(frameIndex < mNumFrames);
+
+	mFrameIndex = frameIndex;
+	mHead = mFrameIndex * mFrameSize;
+	mFrameOffsets.clear();
+}
+
+uint32_t UniformRingBuffer::Allocate(uint64_t size, void*& outData)
+{
+	assert(mBuffer.IsValid());
+
+	uint64_t offset = mHead;
+	uint64_t alignedSize = ((size + mAlignment - 1) / mAlignment) * mAlignment;
+
+	if (offset + alignedSize > (mFrameIndex + 1) * mFrameSize)
+	{
+		LogError("Uniform ring buffer exhausted (%llu bytes per frame)", mFrameSize);
+		throw std::runtime_error("Uniform ring buffer out of memory");
+	}
+
+	mHead += alignedSize;
+	outData = reinterpret_cast<uint8_t*>(mBuffer.mMappedPtr) + offset;
+
+	// The arena range starts at an offset that is itself uniform aligned.
+	uint32_t dynamicOffset = static_cast<uint32_t>(mBuffer.mOffset + offset);
+	mFrameOffsets.push_back(dynamicOffset);
+
+	return dynamicOffset;
+}
+
+uint32_t UniformRingBuffer::Write(const void* data, uint64_t size)
+{
+	void* dst = nullptr;
+	uint32_t offset = Allocate(size, dst);
+
+	memcpy(dst, data, static_cast<size_t>(size));
+	Allocator::FlushMappedRange(mBuffer, offset - mBuffer.mOffset, size);
+
+	return offset;
+}
+
+uint64_t UniformRingBuffer::GetHead() const
+{
+	return mHead;
+}
+
+void UniformRingBuffer::SetHead(uint64_t head)
+{
+	assert(head >= mFrameIndex * mFrameSize);
+	assert(head <= (mFrameIndex + 1) * mFrameSize);
+	mHead = head;
+
+	// Rewound allocations are no longer part of the frame.
+	while (!mFrameOffsets.empty() &&
+		mFrameOffsets.back() >= mBuffer.mOffset + mHead)
+	{
+		mFrameOffsets.pop_back();
+	}
+}
+
+const std::vector<uint32_t>& UniformRingBuffer::GetFrameOffsets() const
+{
+	return mFrameOffsets;
+}
+
+VkBuffer UniformRingBuffer::GetBuffer()
+{
+	return mBuffer.mBuffer;
+}
\ No newline at end of file
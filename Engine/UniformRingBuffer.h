@@ -0,0 +1,51 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+
+#include "Allocator.h"
+
+// Linear allocator for uniform data that is rewritten every frame.
+// One host visible range of the uniform arena is split into a region per frame,
+// and each region is reset when its frame begins. Allocations are bound through
+// VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC offsets into GetBuffer(), so
+// descriptors should use offset 0.
+class UniformRingBuffer
+{
+public:
+
+	UniformRingBuffer();
+
+	void Create(uint64_t frameSize, uint32_t numFrames);
+
+	void Destroy();
+
+	void BeginFrame(uint32_t frameIndex);
+
+	// Returns the dynamic offset of the new allocation, relative to the start of GetBuffer().
+	uint32_t Allocate(uint64_t size, void*& outData);
+
+	uint32_t Write(const void* data, uint64_t size);
+
+	// Marker for rewinding transient allocations (e.g. environment capture faces).
+	uint64_t GetHead() const;
+	void SetHead(uint64_t head);
+
+	// Dynamic offsets handed out since BeginFrame(), in order. Commands recorded with them
+	// can be submitted again in a later use of the same region if they match.
+	const std::vector<uint32_t>& GetFrameOffsets() const;
+
+	VkBuffer GetBuffer();
+
+private:
+
+	Allocation mBuffer;
+
+	uint64_t mFrameSize;
+	uint32_t mNumFrames;
+	uint32_t mFrameIndex;
+	uint64_t mAlignment;
+	uint64_t mHead;
+
+	std::vector<uint32_t> mFrameOffsets;
+};
\ No newline at end of file
@@ -0,0 +1,587 @@
+#include "UploadBatcher.h"
+#include "Renderer.h"
+#include "Texture.h"
+
+#include <assert.h>
+#include <limits>
+#include <string.h>
+#include <stdexcept>
+
+using namespace std;
+
+static VkCommandBuffer AllocateCommandBuffer(VkDevice device, VkCommandPool commandPool)
+{
+	VkCommandBufferAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.commandPool = commandPool;
+	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocInfo.commandBufferCount = 1;
+
+	VkCommandBuffer commandBuffer;
+
+	if (vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer) != VK_SUCCESS)
+	{
+		throw runtime_error("Failed to create upload command buffer");
+	}
+
+	return commandBuffer;
+}
+
+static VkCommandPool CreateCommandPool(VkDevice device, uint32_t queueFamilyIndex)
+{
+	VkCommandPoolCreateInfo ciCommandPool = {};
+	ciCommandPool.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	ciCommandPool.queueFamilyIndex = queueFamilyIndex;
+	ciCommandPool.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+
+	VkCommandPool commandPool;
+
+	if (vkCreateCommandPool(device, &ciCommandPool, nullptr, &commandPool) != VK_SUCCESS)
+	{
+		throw runtime_error("Failed to create upload command pool");
+	}
+
+	return commandPool;
+}
+
+UploadBatcher::UploadBatcher() :
+	mCommandPool(VK_NULL_HANDLE),
+	mAcquireCommandPool(VK_NULL_HANDLE),
+	mQueue(VK_NULL_HANDLE),
+	mGraphicsQueue(VK_NULL_HANDLE),
+	mQueueFamily(0),
+	mGraphicsQueueFamily(0),
+	mUseTransferQueue(false),
+	mTimelineSemaphore(VK_NULL_HANDLE),
+	mTimelineValue(0),
+	mSegmentSize(0),
+	mSegmentHead(0),
+	mAlignment(1),
+	mBatchIndex(0),
+	mBatchDepth(0),
+	mNumSubmits(0)
+{
+
+}
+
+void UploadBatcher::Create(VkDeviceSize stagingSize, uint32_t numBatches)
+{
+	Destroy();
+
+	Renderer* renderer = Renderer::Get();
+	VkDevice device = renderer->GetDevice();
+
+	mGraphicsQueue = renderer->GetGraphicsQueue();
+	mGraphicsQueueFamily = renderer->GetGraphicsQueueFamily();
+	mUseTransferQueue = renderer->GetTransferQueue() != VK_NULL_HANDLE;
+	mQueue = mUseTransferQueue ? renderer->GetTransferQueue() : mGraphicsQueue;
+	mQueueFamily = mUseTransferQueue ? renderer->GetTransferQueueFamily() : mGraphicsQueueFamily;
+
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(renderer->GetPhysicalDevice(), &deviceProperties);
+
+	// Texel copies need offsets that are a multiple of the texel size, 16 covers every format we upload.
+	mAlignment = deviceProperties.limits.optimalBufferCopyOffsetAlignment;
+
+	if (mAlignment < 16)
+	{
+		mAlignment = 16;
+	}
+
+	mSegmentSize = ((stagingSize / numBatches) / mAlignment) * mAlignment;
+	mSegmentHead = 0;
+	mBatchIndex = 0;
+
+	Allocator::AllocBufferRange(mSegmentSize * numBatches,
+		BufferArena::Staging,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		mStaging);
+
+	mCommandPool = CreateCommandPool(device, mQueueFamily);
+
+	if (mUseTransferQueue)
+	{
+		mAcquireCommandPool = CreateCommandPool(device, mGraphicsQueueFamily);
+
+		VkSemaphoreTypeCreateInfoKHR ciSemaphoreType = {};
+		ciSemaphoreType.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR;
+		ciSemaphoreType.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR;
+		ciSemaphoreType.initialValue = 0;
+
+		VkSemaphoreCreateInfo ciSemaphore = {};
+		ciSemaphore.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		ciSemaphore.pNext = &ciSemaphoreType;
+
+		if (vkCreateSemaphore(device, &ciSemaphore, nullptr, &mTimelineSemaphore) != VK_SUCCESS)
+		{
+			throw runtime_error("Failed to create upload semaphore");
+		}
+
+		mTimelineValue = 0;
+	}
+
+	mBatches.resize(numBatches);
+
+	for (Batch& batch : mBatches)
+	{
+		batch.mCommandBuffer = AllocateCommandBuffer(device, mCommandPool);
+		batch.mAcquireCommandBuffer = mUseTransferQueue ? AllocateCommandBuffer(device, mAcquireCommandPool) : VK_NULL_HANDLE;
+
+		VkFenceCreateInfo ciFence = {};
+		ciFence.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+		if (vkCreateFence(device, &ciFence, nullptr, &batch.mFence) != VK_SUCCESS)
+		{
+			throw runtime_error("Failed to create upload fence");
+		}
+
+		batch.mRecording = false;
+		batch.mPending = false;
+		batch.mSubmit = 0;
+	}
+}
+
+void UploadBatcher::Destroy()
+{
+	if (mCommandPool == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	VkDevice device = Renderer::Get()->GetDevice();
+
+	for (Batch& batch : mBatches)
+	{
+		if (batch.mRecording)
+		{
+			vkEndCommandBuffer(batch.mCommandBuffer);
+
+			if (mUseTransferQueue)
+			{
+				vkEndCommandBuffer(batch.mAcquireCommandBuffer);
+			}
+		}
+
+		Wait(batch);
+
+		for (Allocation& allocation : batch.mOversized)
+		{
+			Allocator::Free(allocation);
+		}
+
+		vkDestroyFence(device, batch.mFence, nullptr);
+	}
+
+	// Destroying the pools frees the command buffers.
+	vkDestroyCommandPool(device, mCommandPool, nullptr);
+
+	if (mAcquireCommandPool != VK_NULL_HANDLE)
+	{
+		vkDestroyCommandPool(device, mAcquireCommandPool, nullptr);
+	}
+
+	if (mTimelineSemaphore != VK_NULL_HANDLE)
+	{
+		vkDestroySemaphore(device, mTimelineSemaphore, nullptr);
+	}
+
+	Allocator::Free(mStaging);
+
+	mBatches.clear();
+	mCommandPool = VK_NULL_HANDLE;
+	mAcquireCommandPool = VK_NULL_HANDLE;
+	mTimelineSemaphore = VK_NULL_HANDLE;
+}
+
+void UploadBatcher::BeginBatch()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mBatchDepth++;
+}
+
+void UploadBatcher::EndBatch()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	assert(mBatchDepth > 0);
+	mBatchDepth--;
+
+	if (mBatchDepth == 0)
+	{
+		Submit();
+
+		if (!mUseTransferQueue)
+		{
+			for (Batch& batch : mBatches)
+			{
+				Wait(batch);
+			}
+		}
+	}
+}
+
+void UploadBatcher::UploadBuffer(const void* data, VkDeviceSize size, const Allocation& dstBuffer)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	StagingRange staging;
+	Batch& batch = Reserve(data, size, staging);
+
+	VkBufferCopy copyRegion = {};
+	copyRegion.srcOffset = staging.mOffset;
+	copyRegion.dstOffset = dstBuffer.mOffset;
+	copyRegion.size = size;
+	vkCmdCopyBuffer(batch.mCommandBuffer, staging.mBuffer, dstBuffer.mBuffer, 1, &copyRegion);
+
+	if (mUseTransferQueue)
+	{
+		// Release the range to the graphics queue family. The acquire must use an identical barrier.
+		VkBufferMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = 0;
+		barrier.srcQueueFamilyIndex = mQueueFamily;
+		barrier.dstQueueFamilyIndex = mGraphicsQueueFamily;
+		barrier.buffer = dstBuffer.mBuffer;
+		barrier.offset = dstBuffer.mOffset;
+		barrier.size = size;
+
+		vkCmdPipelineBarrier(batch.mCommandBuffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+			0, nullptr,
+			1, &barrier,
+			0, nullptr);
+
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+
+		vkCmdPipelineBarrier(batch.mAcquireCommandBuffer,
+			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+			0, nullptr,
+			1, &barrier,
+			0, nullptr);
+	}
+
+	FinishUpload();
+}
+
+uint32_t UploadBatcher::UploadImage(const void* data, VkDeviceSize size, VkImage image, VkFormat format, uint32_t width, uint32_t height, uint32_t mipLevels)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	StagingRange staging;
+	Batch& batch = Reserve(data, size, staging);
+
+	// Batches are submitted in order, so the one being recorded goes out with the next submit.
+	uint32_t submit = mNumSubmits + 1;
+
+	if (!mUseTransferQueue)
+	{
+		Texture::TransitionImageLayout(image, format, VK_IMAGE_LAYOUT_PREINITIALIZED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mipLevels, 1, batch.mCommandBuffer);
+		Texture::CopyBufferToImage(staging.mBuffer, staging.mOffset, image, width, height, batch.mCommandBuffer);
+		Texture::RecordGenerateMips(batch.mCommandBuffer, image, width, height, mipLevels);
+
+		FinishUpload();
+		return submit;
+	}
+
+	VkImageMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_PREINITIALIZED;
+	barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.srcAccessMask = 0;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = image;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.baseMipLevel = 0;
+	barrier.subresourceRange.levelCount = mipLevels;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount = 1;
+
+	vkCmdPipelineBarrier(batch.mCommandBuffer,
+		VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+		0, nullptr,
+		0, nullptr,
+		1, &barrier);
+
+	Texture::CopyBufferToImage(staging.mBuffer, staging.mOffset, image, width, height, batch.mCommandBuffer);
+
+	// Release every mip to the graphics queue family, still in TRANSFER_DST for the blits.
+	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = 0;
+	barrier.srcQueueFamilyIndex = mQueueFamily;
+	barrier.dstQueueFamilyIndex = mGraphicsQueueFamily;
+
+	vkCmdPipelineBarrier(batch.mCommandBuffer,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+		0, nullptr,
+		0, nullptr,
+		1, &barrier);
+
+	barrier.srcAccessMask = 0;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+
+	vkCmdPipelineBarrier(batch.mAcquireCommandBuffer,
+		VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+		0, nullptr,
+		0, nullptr,
+		1, &barrier);
+
+	// Transfer queues can't blit, so the mips are generated after the acquire.
+	Texture::RecordGenerateMips(batch.mAcquireCommandBuffer, image, width, height, mipLevels);
+
+	FinishUpload();
+	return submit;
+}
+
+void UploadBatcher::WaitIdle()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	for (Batch& batch : mBatches)
+	{
+		Wait(batch);
+	}
+}
+
+bool UploadBatcher::IsSubmitComplete(uint32_t submit)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	if (submit > mNumSubmits)
+	{
+		return false;
+	}
+
+	// A batch is only recorded again once its previous submit has completed.
+	Batch& batch = mBatches[(submit - 1) % mBatches.size()];
+
+	if (batch.mSubmit != submit ||
+		!batch.mPending)
+	{
+		return true;
+	}
+
+	return vkGetFenceStatus(Renderer::Get()->GetDevice(), batch.mFence) == VK_SUCCESS;
+}
+
+bool UploadBatcher::IsUsingTransferQueue() const
+{
+	return mUseTransferQueue;
+}
+
+uint32_t UploadBatcher::GetNumSubmits() const
+{
+	return mNumSubmits;
+}
+
+UploadBatcher::Batch& UploadBatcher::Reserve(const void* data, VkDeviceSize size, StagingRange& outStaging)
+{
+	VkDeviceSize offset = ((mSegmentHead + mAlignment - 1) / mAlignment) * mAlignment;
+
+	if (size > mSegmentSize)
+	{
+		// Too large for the ring, give the upload staging memory of its own.
+		Batch& batch = mBatches[mBatchIndex];
+		BeginRecording(batch);
+
+		Allocation allocation;
+		Allocator::AllocBufferRange(size, BufferArena::Staging, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, allocation);
+		batch.mOversized.push_back(allocation);
+
+		outStaging.mData = allocation.mMappedPtr;
+		outStaging.mBuffer = allocation.mBuffer;
+		outStaging.mOffset = allocation.mOffset;
+
+		memcpy(outStaging.mData, data, static_cast<size_t>(size));
+
+		return batch;
+	}
+
+	if (offset + size > mSegmentSize)
+	{
+		Submit();
+		offset = 0;
+	}
+
+	Batch& batch = mBatches[mBatchIndex];
+	BeginRecording(batch);
+
+	VkDeviceSize stagingOffset = mBatchIndex * mSegmentSize + offset;
+	mSegmentHead = offset + size;
+
+	outStaging.mData = reinterpret_cast<uint8_t*>(mStaging.mMappedPtr) + stagingOffset;
+	outStaging.mBuffer = mStaging.mBuffer;
+	outStaging.mOffset = mStaging.mOffset + stagingOffset;
+
+	memcpy(outStaging.mData, data, static_cast<size_t>(size));
+
+	return batch;
+}
+
+void UploadBatcher::FinishUpload()
+{
+	if (mBatchDepth > 0)
+	{
+		return;
+	}
+
+	Batch& batch = mBatches[mBatchIndex];
+	Submit();
+
+	// With a transfer queue the acquire on the graphics queue already orders later submissions
+	// after the copies. The batch's segment is reclaimed once it comes around again.
+	if (!mUseTransferQueue)
+	{
+		Wait(batch);
+	}
+}
+
+void UploadBatcher::BeginRecording(Batch& batch)
+{
+	if (batch.mRecording)
+	{
+		return;
+	}
+
+	// The batch's segment of the ring is still being read until its last submission completes.
+	Wait(batch);
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	vkResetCommandBuffer(batch.mCommandBuffer, 0);
+	vkBeginCommandBuffer(batch.mCommandBuffer, &beginInfo);
+
+	if (mUseTransferQueue)
+	{
+		vkResetCommandBuffer(batch.mAcquireCommandBuffer, 0);
+		vkBeginCommandBuffer(batch.mAcquireCommandBuffer, &beginInfo);
+	}
+
+	batch.mRecording = true;
+}
+
+void UploadBatcher::Submit()
+{
+	Batch& batch = mBatches[mBatchIndex];
+
+	if (!batch.mRecording)
+	{
+		return;
+	}
+
+	if (mSegmentHead > 0)
+	{
+		Allocator::FlushMappedRange(mStaging, mBatchIndex * mSegmentSize, mSegmentHead);
+	}
+
+	for (Allocation& allocation : batch.mOversized)
+	{
+		Allocator::FlushMappedRange(allocation);
+	}
+
+	// Make the copied data visible to whatever reads it next, e.g. vertex input or sampling.
+	// With a transfer queue this goes after the acquires, on the graphics queue.
+	VkCommandBuffer lastCommandBuffer = mUseTransferQueue ? batch.mAcquireCommandBuffer : batch.mCommandBuffer;
+
+	VkMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+
+	vkCmdPipelineBarrier(lastCommandBuffer,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+		0,
+		1,
+		&barrier,
+		0,
+		nullptr,
+		0,
+		nullptr);
+
+	if (vkEndCommandBuffer(batch.mCommandBuffer) != VK_SUCCESS ||
+		(mUseTransferQueue && vkEndCommandBuffer(batch.mAcquireCommandBuffer) != VK_SUCCESS))
+	{
+		throw runtime_error("Failed to record upload command buffer");
+	}
+
+	Renderer* renderer = Renderer::Get();
+	vkResetFences(renderer->GetDevice(), 1, &batch.mFence);
+
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &batch.mCommandBuffer;
+
+	if (!mUseTransferQueue)
+	{
+		renderer->SubmitToQueue(mQueue, submitInfo, batch.mFence);
+	}
+	else
+	{
+		// The transfer queue signals the next timeline value and the graphics queue waits for it
+		// before acquiring, so neither the CPU nor a frame has to wait on the copies.
+		mTimelineValue++;
+
+		VkTimelineSemaphoreSubmitInfoKHR timelineInfo = {};
+		timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+		timelineInfo.signalSemaphoreValueCount = 1;
+		timelineInfo.pSignalSemaphoreValues = &mTimelineValue;
+
+		submitInfo.pNext = &timelineInfo;
+		submitInfo.signalSemaphoreCount = 1;
+		submitInfo.pSignalSemaphores = &mTimelineSemaphore;
+
+		renderer->SubmitToQueue(mQueue, submitInfo, VK_NULL_HANDLE);
+
+		VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+
+		timelineInfo.signalSemaphoreValueCount = 0;
+		timelineInfo.pSignalSemaphoreValues = nullptr;
+		timelineInfo.waitSemaphoreValueCount = 1;
+		timelineInfo.pWaitSemaphoreValues = &mTimelineValue;
+
+		VkSubmitInfo acquireSubmitInfo = {};
+		acquireSubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		acquireSubmitInfo.pNext = &timelineInfo;
+		acquireSubmitInfo.waitSemaphoreCount = 1;
+		acquireSubmitInfo.pWaitSemaphores = &mTimelineSemaphore;
+		acquireSubmitInfo.pWaitDstStageMask = &waitStage;
+		acquireSubmitInfo.commandBufferCount = 1;
+		acquireSubmitInfo.pCommandBuffers = &batch.mAcquireCommandBuffer;
+
+		renderer->SubmitToQueue(mGraphicsQueue, acquireSubmitInfo, batch.mFence);
+	}
+
+	batch.mRecording = false;
+	batch.mPending = true;
+	mNumSubmits++;
+	batch.mSubmit = mNumSubmits;
+
+	mBatchIndex = (mBatchIndex + 1) % mBatches.size();
+	mSegmentHead = 0;
+}
+
+void UploadBatcher::Wait(Batch& batch)
+{
+	if (!batch.mPending)
+	{
+		return;
+	}
+
+	vkWaitForFences(Renderer::Get()->GetDevice(), 1, &batch.mFence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+	batch.mPending = false;
+
+	for (Allocation& allocation : batch.mOversized)
+	{
+		Allocator::Free(allocation);
+	}
+
+	batch.mOversized.clear();
+}
\ No newline at end of file
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <mutex>
+
+#include "Allocator.h"
+
+// Staging memory reserved for one upload.
+struct StagingRange
+{
+	void* mData;
+	VkBuffer mBuffer;
+	VkDeviceSize mOffset;
+};
+
+// Records buffer and image uploads out of a persistently mapped staging ring into a few
+// command buffers, rather than submitting and waiting for each copy on its own.
+// The ring is split into one segment per batch. When a segment fills up its batch is submitted,
+// and the segment is reused once that submission has completed. Outside of
+// BeginBatch()/EndBatch() every upload is submitted straight away, and only waited on when it
+// went to the graphics queue.
+//
+// When the device has a dedicated transfer queue family and timeline semaphores, the copies run
+// on the transfer queue. Ownership of the uploaded ranges is released there and acquired by a
+// second command buffer on the graphics queue, which waits on the timeline semaphore and also
+// generates the mips, since blits need a graphics queue. Graphics submissions made after a batch
+// was submitted are ordered after its uploads, so nothing waits on them on the CPU.
+// Otherwise everything is recorded into one command buffer on the graphics queue.
+// May be called from any thread.
+class UploadBatcher
+{
+public:
+
+	UploadBatcher();
+
+	void Create(VkDeviceSize stagingSize, uint32_t numBatches);
+
+	void Destroy();
+
+	// Starts collecting uploads. Calls may be nested. Uploaded resources must not be used by
+	// other submissions until the outermost EndBatch() has returned.
+	void BeginBatch();
+
+	// Submits the remaining uploads. Later graphics submissions are ordered after them, so only the
+	// fallback on the graphics queue still waits for them on the CPU.
+	void EndBatch();
+
+	// Copies data into a device local buffer range that is about to be used for the first time.
+	void UploadBuffer(const void* data, VkDeviceSize size, const Allocation& dstBuffer);
+
+	// Copies tightly packed pixels into mip 0 of a newly created image, generates the other mips
+	// and leaves every mip in SHADER_READ_ONLY layout. Returns the submit the upload goes out
+	// with, see IsSubmitComplete().
+	uint32_t UploadImage(const void* data, VkDeviceSize size, VkImage image, VkFormat format, uint32_t width, uint32_t height, uint32_t mipLevels);
+
+	// Blocks until every submitted upload has completed.
+	void WaitIdle();
+
+	// Whether a submit returned by UploadImage() has been submitted and completed on the GPU.
+	bool IsSubmitComplete(uint32_t submit);
+
+	bool IsUsingTransferQueue() const;
+
+	// Number of batches submitted so far.
+	uint32_t GetNumSubmits() const;
+
+private:
+
+	struct Batch
+	{
+		// Records the copies, on the transfer queue if there is one.
+		VkCommandBuffer mCommandBuffer;
+
+		// Acquires ownership on the graphics queue and generates mips. Only used with a transfer queue.
+		VkCommandBuffer mAcquireCommandBuffer;
+
+		// Signaled once the last submission of the batch has completed.
+		VkFence mFence;
+
+		bool mRecording;
+		bool mPending;
+
+		// Number of the submit the batch last went out with, counting from 1.
+		uint32_t mSubmit;
+
+		// Staging for uploads too large for a segment, freed once the batch completes.
+		std::vector<Allocation> mOversized;
+	};
+
+	// Reserves staging memory in the current batch and copies data into it. Call with mMutex held.
+	Batch& Reserve(const void* data, VkDeviceSize size, StagingRange& outStaging);
+
+	// Submits right away unless a batch is open, waiting only on the graphics queue fallback.
+	// Call with mMutex held.
+	void FinishUpload();
+
+	void BeginRecording(Batch& batch);
+
+	// Submits the current batch, if anything was recorded, and moves on to the next one.
+	void Submit();
+
+	void Wait(Batch& batch);
+
+	Allocation mStaging;
+	VkCommandPool mCommandPool;
+	VkCommandPool mAcquireCommandPool;
+	std::vector<Batch> mBatches;
+
+	VkQueue mQueue;
+	VkQueue mGraphicsQueue;
+	uint32_t mQueueFamily;
+	uint32_t mGraphicsQueueFamily;
+	bool mUseTransferQueue;
+
+	// The graphics queue waits on this to acquire what the transfer queue released.
+	VkSemaphore mTimelineSemaphore;
+	uint64_t mTimelineValue;
+
+	VkDeviceSize mSegmentSize;
+	VkDeviceSize mSegmentHead;
+	VkDeviceSize mAlignment;
+
+	uint32_t mBatchIndex;
+	uint32_t mBatchDepth;
+	uint32_t mNumSubmits;
+
+	std::mutex mMutex;
+};
\ No newline at end of file
@@ -1,7 +1,22 @@
 #include "Utilities.h"
 
+#include <algorithm>
 #include <iostream>
 #include <fstream>
+#include <atomic>
+#include <future>
+#include <thread>
+#include <stdexcept>
+#include <stdarg.h>
+
+#if defined(_WIN32)
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 using namespace std;
 
@@ -11,7 +26,7 @@ std::vector<char> ReadFile(const std::string& filename)
 
 	if (!file.is_open())
 	{
-		throw exception("Failed to open file.");
+		throw runtime_error("Failed to open file.");
 	}
 
 	size_t fileSize = static_cast<size_t>(file.tellg());
@@ -21,4 +36,283 @@ std::vector<char> ReadFile(const std::string& filename)
 	file.read(buffer.data(), fileSize);
 
 	return buffer;
+}
+
+const void* MapFile(const std::string& filename, size_t& outSize)
+{
+	outSize = 0;
+
+#if defined(_WIN32)
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return nullptr;
+	}
+
+	LARGE_INTEGER fileSize;
+	void* data = nullptr;
+
+	if (GetFileSizeEx(file, &fileSize) &&
+		fileSize.QuadPart > 0)
+	{
+		HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+		if (mapping != nullptr)
+		{
+			// The view keeps the mapping alive after its handle is closed.
+			data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+			CloseHandle(mapping);
+		}
+	}
+
+	CloseHandle(file);
+
+	if (data != nullptr)
+	{
+		outSize = static_cast<size_t>(fileSize.QuadPart);
+	}
+
+	return data;
+#else
+	int file = open(filename.c_str(), O_RDONLY);
+
+	if (file < 0)
+	{
+		return nullptr;
+	}
+
+	struct stat fileStat;
+	void* data = nullptr;
+
+	if (fstat(file, &fileStat) == 0 &&
+		fileStat.st_size > 0)
+	{
+		data = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+
+		if (data == MAP_FAILED)
+		{
+			data = nullptr;
+		}
+	}
+
+	close(file);
+
+	if (data != nullptr)
+	{
+		outSize = static_cast<size_t>(fileStat.st_size);
+	}
+
+	return data;
+#endif
+}
+
+void UnmapFile(const void* data, size_t size)
+{
+	if (data == nullptr)
+	{
+		return;
+	}
+
+#if defined(_WIN32)
+	UnmapViewOfFile(data);
+#else
+	munmap(const_cast<void*>(data), size);
+#endif
+}
+
+void ParallelFor(uint32_t count, uint32_t maxThreads, const std::function<void(uint32_t)>& func)
+{
+	uint32_t numThreads = std::thread::hardware_concurrency();
+	numThreads = (numThreads > maxThreads) ? maxThreads : numThreads;
+	numThreads = (numThreads > count) ? count : numThreads;
+
+	if (numThreads <= 1)
+	{
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			func(i);
+		}
+
+		return;
+	}
+
+	// Workers pull indices until there are none left, so uneven items still balance out.
+	std::atomic<uint32_t> nextIndex(0);
+	std::vector<std::future<void>> workers;
+	workers.reserve(numThreads);
+
+	for (uint32_t t = 0; t < numThreads; ++t)
+	{
+		workers.push_back(std::async(std::launch::async, [&]()
+		{
+			for (uint32_t i = nextIndex++; i < count; i = nextIndex++)
+			{
+				func(i);
+			}
+		}));
+	}
+
+	for (std::future<void>& worker : workers)
+	{
+		worker.wait();
+	}
+
+	for (std::future<void>& worker : workers)
+	{
+		worker.get();
+	}
+}
+
+static void AppendBigEndian(std::vector<uint8_t>& out, uint32_t value)
+{
+	out.push_back(static_cast<uint8_t>(value >> 24));
+	out.push_back(static_cast<uint8_t>(value >> 16));
+	out.push_back(static_cast<uint8_t>(value >> 8));
+	out.push_back(static_cast<uint8_t>(value));
+}
+
+static uint32_t Crc32(const uint8_t* data, size_t size)
+{
+	uint32_t crc = 0xffffffff;
+
+	for (size_t i = 0; i < size; ++i)
+	{
+		crc ^= data[i];
+
+		for (uint32_t bit = 0; bit < 8; ++bit)
+		{
+			crc = (crc >> 1) ^ (0xedb88320 & (0 - (crc & 1)));
+		}
+	}
+
+	return ~crc;
+}
+
+static void AppendPngChunk(std::vector<uint8_t>& out, const char* type, const std::vector<uint8_t>& data)
+{
+	AppendBigEndian(out, static_cast<uint32_t>(data.size()));
+
+	size_t start = out.size();
+	out.insert(out.end(), type, type + 4);
+	out.insert(out.end(), data.begin(), data.end());
+
+	AppendBigEndian(out, Crc32(out.data() + start, out.size() - start));
+}
+
+bool WritePng(const std::string& filename, uint32_t width, uint32_t height, const uint8_t* pixels)
+{
+	// Each row starts with its filter type, 0 leaves it unfiltered.
+	size_t rowSize = static_cast<size_t>(width) * 4;
+	std::vector<uint8_t> raw;
+	raw.reserve((rowSize + 1) * height);
+
+	for (uint32_t y = 0; y < height; ++y)
+	{
+		raw.push_back(0);
+		raw.insert(raw.end(), pixels + y * rowSize, pixels + (y + 1) * rowSize);
+	}
+
+	// A zlib stream of stored deflate blocks. Larger than compressing, but it needs no dependencies.
+	std::vector<uint8_t> idat;
+	idat.push_back(0x78);
+	idat.push_back(0x01);
+
+	const size_t maxBlockSize = 0xffff;
+	size_t offset = 0;
+
+	do
+	{
+		size_t blockSize = (raw.size() - offset > maxBlockSize) ? maxBlockSize : raw.size() - offset;
+		bool last = offset + blockSize == raw.size();
+
+		idat.push_back(last ? 1 : 0);
+		idat.push_back(static_cast<uint8_t>(blockSize));
+		idat.push_back(static_cast<uint8_t>(blockSize >> 8));
+		idat.push_back(static_cast<uint8_t>(~blockSize));
+		idat.push_back(static_cast<uint8_t>(~blockSize >> 8));
+		idat.insert(idat.end(), raw.begin() + offset, raw.begin() + offset + blockSize);
+
+		offset += blockSize;
+	} while (offset < raw.size());
+
+	uint32_t a = 1;
+	uint32_t b = 0;
+
+	for (uint8_t byte : raw)
+	{
+		a = (a + byte) % 65521;
+		b = (b + a) % 65521;
+	}
+
+	AppendBigEndian(idat, (b << 16) | a);
+
+	std::vector<uint8_t> header;
+	AppendBigEndian(header, width);
+	AppendBigEndian(header, height);
+	header.push_back(8);	// Bit depth
+	header.push_back(6);	// RGBA
+	header.push_back(0);	// Compression
+	header.push_back(0);	// Filter
+	header.push_back(0);	// Interlace
+
+	static const uint8_t signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	std::vector<uint8_t> png(signature, signature + sizeof(signature));
+
+	AppendPngChunk(png, "IHDR", header);
+	AppendPngChunk(png, "IDAT", idat);
+	AppendPngChunk(png, "IEND", std::vector<uint8_t>());
+
+	ofstream file(filename, std::ios::binary);
+
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	file.write(reinterpret_cast<const char*>(png.data()), png.size());
+
+	return file.good();
+}
+
+void AppendFormat(std::string& str, const char* format, ...)
+{
+	char buffer[512];
+
+	va_list args;
+	va_start(args, format);
+	vsnprintf(buffer, sizeof(buffer), format, args);
+	va_end(args);
+
+	str += buffer;
+}
+
+SampleStats ComputeSampleStats(std::vector<float> samples)
+{
+	SampleStats stats;
+
+	if (samples.empty())
+	{
+		return stats;
+	}
+
+	sort(samples.begin(), samples.end());
+
+	uint32_t numSamples = static_cast<uint32_t>(samples.size());
+	double total = 0.0;
+
+	for (float sample : samples)
+	{
+		total += sample;
+	}
+
+	stats.mMean = static_cast<float>(total / numSamples);
+	stats.mMin = samples.front();
+	stats.mMax = samples.back();
+	stats.mP50 = samples[(numSamples - 1) * 50 / 100];
+	stats.mP95 = samples[(numSamples - 1) * 95 / 100];
+	stats.mP99 = samples[(numSamples - 1) * 99 / 100];
+	stats.mNumSamples = numSamples;
+
+	return stats;
 }
\ No newline at end of file
@@ -1,11 +1,57 @@
 #pragma once
 
+#include <stdint.h>
 #include <vector>
+#include <string>
+#include <functional>
+#include <stdio.h>
+#include <stdlib.h>
 
+#if defined(_WIN32)
 #define ERR_EXIT(err_msg, err_class)                                           \
     do {                                                                       \
         MessageBox(NULL, err_msg, err_class, MB_OK);                       \
         exit(1);                                                               \
     } while (0)
+#else
+#define ERR_EXIT(err_msg, err_class)                                           \
+    do {                                                                       \
+        fprintf(stderr, "%s: %s\n", err_class, err_msg);                       \
+        exit(1);                                                               \
+    } while (0)
+
+#define ARRAYSIZE(a) (sizeof(a) / sizeof((a)[0]))
+#endif
+
+std::vector<char> ReadFile(const std::string& filename);
+
+// Maps a whole file read only, page aligned. Returns nullptr if it can't be opened or is empty.
+const void* MapFile(const std::string& filename, size_t& outSize);
+
+void UnmapFile(const void* data, size_t size);
+
+// Runs func(0) .. func(count - 1) spread over up to maxThreads worker threads and waits for all of them.
+// The first exception thrown by a worker is rethrown on the calling thread.
+// Threads are started for every call, work that repeats every frame belongs on the renderer's WorkerPool.
+void ParallelFor(uint32_t count, uint32_t maxThreads, const std::function<void(uint32_t)>& func);
+
+// Writes tightly packed RGBA8 pixels, top row first, as an uncompressed PNG.
+bool WritePng(const std::string& filename, uint32_t width, uint32_t height, const uint8_t* pixels);
+
+// Appends printf style formatted text, up to 511 characters per call.
+void AppendFormat(std::string& str, const char* format, ...);
+
+// Mean, extremes and nearest-rank percentiles of a set of samples, e.g. frame times in milliseconds.
+struct SampleStats
+{
+	float mMean = 0.0f;
+	float mMin = 0.0f;
+	float mMax = 0.0f;
+	float mP50 = 0.0f;
+	float mP95 = 0.0f;
+	float mP99 = 0.0f;
+	uint32_t mNumSamples = 0;
+};
 
-std::vector<char> ReadFile(const std::string& filename);
\ No newline at end of file
+// All zero without samples.
+SampleStats ComputeSampleStats(std::vector<float> samples);
\ No newline at end of file
@@ -74,6 +74,8 @@ void Widget::Update()
 {
 	if (mDirty)
 	{
+		Rect prevRect = mAbsoluteRect;
+
 		if (mParent != nullptr)
 		{
 			Rect parentRect = mParent->GetAbsoluteRect();
@@ -86,6 +88,16 @@ void Widget::Update()
 		{
 			mAbsoluteRect = mRect;
 		}
+
+		// Scissor rects are baked into the recorded command buffers.
+		if (IsScissorRecorded() &&
+			(prevRect.mX != mAbsoluteRect.mX ||
+			prevRect.mY != mAbsoluteRect.mY ||
+			prevRect.mWidth != mAbsoluteRect.mWidth ||
+			prevRect.mHeight != mAbsoluteRect.mHeight))
+		{
+			Renderer::Get()->InvalidateCommandBuffers();
+		}
 	}
 }
 
@@ -143,7 +155,11 @@ void Widget::SetRect(Rect rect)
 
 void Widget::SetVisible(bool visible)
 {
-	mVisible = visible;
+	if (mVisible != visible)
+	{
+		mVisible = visible;
+		Renderer::Get()->InvalidateCommandBuffers();
+	}
 }
 
 bool Widget::IsVisible() const
@@ -162,6 +178,7 @@ void Widget::AddChild(Widget* widget)
 	mChildren.push_back(widget);
 	mChildren.back()->mParent = this;
 	mChildren.back()->MarkDirty();
+	Renderer::Get()->InvalidateCommandBuffers();
 }
 
 Widget* Widget::RemoveChild(Widget* widget)
@@ -175,6 +192,7 @@ Widget* Widget::RemoveChild(Widget* widget)
 			removedWidget = mChildren[i];
 			removedWidget->mParent = nullptr;
 			mChildren.erase(mChildren.begin() + i);
+			Renderer::Get()->InvalidateCommandBuffers();
 			break;
 		}
 	}
@@ -191,6 +209,7 @@ Widget* Widget::RemoveChild(int32_t index)
 	{
 		removedWidget = mChildren[index];
 		mChildren.erase(mChildren.begin() + index);
+		Renderer::Get()->InvalidateCommandBuffers();
 	}
 
 	return removedWidget;
@@ -211,6 +230,21 @@ void Widget::MarkDirty()
 	}
 }
 
+void Widget::RecursiveReplaceTexture(const Texture* texture)
+{
+	ReplaceTexture(texture);
+
+	for (int32_t i = 0; i < mChildren.size(); ++i)
+	{
+		mChildren[i]->RecursiveReplaceTexture(texture);
+	}
+}
+
+void Widget::ReplaceTexture(const Texture* texture)
+{
+
+}
+
 float Widget::InterfaceToNormalized(float interfaceCoord, float interfaceSize)
 {
 	return (interfaceCoord / interfaceSize) * 2.0f - 1.0f;
@@ -266,6 +300,24 @@ void Widget::PushScissor(VkCommandBuffer commandBuffer)
 	SetScissor(commandBuffer, scissorRect);
 }
 
+bool Widget::IsScissorRecorded() const
+{
+	if (mUseScissor)
+	{
+		return true;
+	}
+
+	for (int32_t i = 0; i < mChildren.size(); ++i)
+	{
+		if (mChildren[i]->mUseScissor)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
 void Widget::PopScissor(VkCommandBuffer commandBuffer)
 {
 	if (mParent != nullptr)
@@ -42,8 +42,17 @@ public:
 	Widget* RemoveChild(int32_t index);
 	Widget* GetChild(int32_t index);
 
+	// Flags this widget and its children to refresh their vertex data on the next update.
+	// Recorded command buffers are only invalidated if a buffer, descriptor set or scissor
+	// rect they hold actually has to change.
 	void MarkDirty();
 
+	// Replaces the descriptor sets of the widgets that sample texture, after the texture was
+	// moved to a new image view.
+	void RecursiveReplaceTexture(const class Texture* texture);
+
+	virtual void ReplaceTexture(const class Texture* texture);
+
 	static float InterfaceToNormalized(float interfaceCoord, float interfaceSize);
 	static bool IsMouseInsideInterfaceRect(Rect interfaceRect);
 
@@ -54,6 +63,9 @@ protected:
 	void PushScissor(VkCommandBuffer commandBuffer);
 	void PopScissor(VkCommandBuffer commandBuffer);
 
+	// Whether this widget's rect is recorded as a scissor, by itself or by a child restoring it.
+	bool IsScissorRecorded() const;
+
 	Widget* mParent;
 	std::vector<Widget*> mChildren;
 
@@ -0,0 +1,160 @@
+#include "WorkerPool.h"
+
+#include <assert.h>
+
+using namespace std;
+
+WorkerPool::WorkerPool() :
+	mFunc(nullptr),
+	mCount(0),
+	mNextIndex(0),
+	mJobId(0),
+	mNumBusy(0),
+	mQuit(false)
+{
+
+}
+
+WorkerPool::~WorkerPool()
+{
+	Destroy();
+}
+
+void WorkerPool::Create(uint32_t numThreads)
+{
+	Destroy();
+
+	mQuit = false;
+	mThreads.reserve(numThreads);
+
+	for (uint32_t i = 0; i < numThreads; ++i)
+	{
+		mThreads.push_back(thread(&WorkerPool::WorkerMain, this));
+	}
+}
+
+void WorkerPool::Destroy()
+{
+	if (mThreads.empty())
+	{
+		return;
+	}
+
+	{
+		lock_guard<mutex> lock(mMutex);
+		mQuit = true;
+	}
+
+	mWorkCondition.notify_all();
+
+	for (thread& worker : mThreads)
+	{
+		worker.join();
+	}
+
+	mThreads.clear();
+}
+
+void WorkerPool::ParallelFor(uint32_t count, const std::function<void(uint32_t)>& func)
+{
+	if (mThreads.empty() || count <= 1)
+	{
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			func(i);
+		}
+
+		return;
+	}
+
+	{
+		lock_guard<mutex> lock(mMutex);
+		assert(mNumBusy == 0);
+
+		mFunc = &func;
+		mCount = count;
+		mNextIndex = 0;
+		mException = nullptr;
+		mNumBusy = static_cast<uint32_t>(mThreads.size());
+		mJobId++;
+	}
+
+	mWorkCondition.notify_all();
+
+	RunIndices();
+
+	exception_ptr error;
+
+	{
+		// func lives on the caller's stack, so every thread has to be done with it.
+		unique_lock<mutex> lock(mMutex);
+		mDoneCondition.wait(lock, [this]() { return mNumBusy == 0; });
+
+		error = mException;
+		mException = nullptr;
+		mFunc = nullptr;
+	}
+
+	if (error)
+	{
+		rethrow_exception(error);
+	}
+}
+
+uint32_t WorkerPool::GetNumThreads() const
+{
+	return static_cast<uint32_t>(mThreads.size());
+}
+
+void WorkerPool::WorkerMain()
+{
+	uint64_t lastJobId = 0;
+
+	for (;;)
+	{
+		{
+			unique_lock<mutex> lock(mMutex);
+			mWorkCondition.wait(lock, [&]() { return mQuit || mJobId != lastJobId; });
+
+			if (mQuit)
+			{
+				return;
+			}
+
+			lastJobId = mJobId;
+		}
+
+		RunIndices();
+
+		lock_guard<mutex> lock(mMutex);
+
+		if (--mNumBusy == 0)
+		{
+			mDoneCondition.notify_one();
+		}
+	}
+}
+
+void WorkerPool::RunIndices()
+{
+	// Threads pull indices until there are none left, so uneven items still balance out.
+	for (uint32_t i = mNextIndex++; i < mCount; i = mNextIndex++)
+	{
+		try
+		{
+			(*mFunc)(i);
+		}
+		catch (...)
+		{
+			lock_guard<mutex> lock(mMutex);
+
+			if (!mException)
+			{
+				mException = current_exception();
+			}
+
+			// Leave the remaining items, the job has failed anyway.
+			mNextIndex = mCount;
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Threads that stay alive for the lifetime of their owner, for work that is split up again every
+// frame, so no thread is started or joined per frame. The calling thread takes part in the work.
+// Only one thread may submit work at a time.
+class WorkerPool
+{
+public:
+
+	WorkerPool();
+
+	~WorkerPool();
+
+	// Starts numThreads threads in addition to the calling thread, which may be zero.
+	void Create(uint32_t numThreads);
+
+	// Waits for the threads to finish and joins them. Must not be called during ParallelFor().
+	void Destroy();
+
+	// Runs func(0) .. func(count - 1) on the pool and the calling thread and waits for all of them.
+	// The first exception thrown is rethrown on the calling thread.
+	void ParallelFor(uint32_t count, const std::function<void(uint32_t)>& func);
+
+	uint32_t GetNumThreads() const;
+
+private:
+
+	void WorkerMain();
+
+	// Takes indices of the current job until there are none left.
+	void RunIndices();
+
+	std::vector<std::thread> mThreads;
+	std::mutex mMutex;
+	std::condition_variable mWorkCondition;
+	std::condition_variable mDoneCondition;
+
+	// The current job, written under mMutex before mJobId changes.
+	const std::function<void(uint32_t)>* mFunc;
+	uint32_t mCount;
+	std::atomic<uint32_t> mNextIndex;
+	std::exception_ptr mException;
+
+	// Increases with every job, so a woken thread knows whether it has already run it.
+	uint64_t mJobId;
+	uint32_t mNumBusy;
+	bool mQuit;
+};
\ No newline at end of file